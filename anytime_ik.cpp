@@ -0,0 +1,173 @@
+#include "anytime_ik.h"
+#include <algorithm>
+
+static const double CGOLD = 0.3819660;  // Golden ratio constant
+static const double TINY = 1e-20;       // Small number to avoid division by zero
+
+AnytimeIKSolver::AnytimeIKSolver(const WeightedIKSolver& solver)
+    : solver_(solver), param_(RedundancyParam::Q7), tolerance_(1e-6), max_iterations_(0),
+      a_(0.0), b_(0.0), d_(0.0), e_(0.0), v_(0.0), w_(0.0), x_(0.0), fv_(0.0), fw_(0.0), fx_(0.0),
+      initial_width_(0.0), iterations_(0), evaluations_(0), started_(false), converged_(false),
+      elapsed_nanoseconds_(0), step_estimate_nanoseconds_(0) {
+    best_.success = false;
+    best_.score = -std::numeric_limits<double>::infinity();
+}
+
+void AnytimeIKSolver::reset(
+    RedundancyParam param,
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose,
+    double value_min,
+    double value_max,
+    double tolerance,
+    int max_iterations
+) {
+    param_ = param;
+    prepare_target(target_position, target_orientation, target_);
+    current_pose_ = current_pose;
+    tolerance_ = tolerance;
+    max_iterations_ = max_iterations;
+
+    a_ = std::min(value_min, value_max);
+    b_ = std::max(value_min, value_max);
+    d_ = e_ = 0.0;
+    x_ = w_ = v_ = 0.5 * (value_min + value_max);  // Start in the middle, as solve_optimized does
+    fx_ = fw_ = fv_ = 0.0;
+    initial_width_ = b_ - a_;
+    iterations_ = 0;
+    evaluations_ = 0;
+    started_ = false;
+    converged_ = false;
+    elapsed_nanoseconds_ = 0;
+
+    // Nothing of the previous target survives, not even the solution or the clearance
+    best_ = WeightedIKResult();
+    best_.score = -std::numeric_limits<double>::infinity();
+    best_.parameterization = param;
+    best_.solution_index = -1;
+}
+
+double AnytimeIKSolver::evaluate(double value) {
+    evaluations_++;
+    return -solver_.evaluate_cost(param_, value, target_, current_pose_, &best_);  // Minimize negative of cost
+}
+
+bool AnytimeIKSolver::check_converged() const {
+    double xm = 0.5 * (a_ + b_);
+    double tol2 = 2.0 * (tolerance_ * fabs(x_) + TINY);
+    return fabs(x_ - xm) <= (tol2 - 0.5 * (b_ - a_));
+}
+
+bool AnytimeIKSolver::step() {
+    if (done()) return false;
+    auto start = std::chrono::steady_clock::now();
+
+    if (!started_) {
+        fx_ = fw_ = fv_ = evaluate(x_);
+        started_ = true;
+    } else {
+        // One iteration of WeightedIKSolver::brent_optimize
+        iterations_++;
+        double xm = 0.5 * (a_ + b_);
+        double tol1 = tolerance_ * fabs(x_) + TINY;
+        double tol2 = 2.0 * tol1;
+        double u;
+
+        if (fabs(e_) > tol1) {
+            // Construct parabolic fit
+            double r = (x_ - w_) * (fx_ - fv_);
+            double q = (x_ - v_) * (fx_ - fw_);
+            double p = (x_ - v_) * q - (x_ - w_) * r;
+            q = 2.0 * (q - r);
+            if (q > 0.0) p = -p;
+            q = fabs(q);
+            double etemp = e_;
+            e_ = d_;
+
+            // Check if parabolic fit is acceptable
+            if (fabs(p) >= fabs(0.5 * q * etemp) || p <= q * (a_ - x_) || p >= q * (b_ - x_)) {
+                d_ = CGOLD * (e_ = (x_ >= xm ? a_ - x_ : b_ - x_));
+            } else {
+                d_ = p / q;
+                u = x_ + d_;
+                if (u - a_ < tol2 || b_ - u < tol2) {
+                    d_ = (xm - x_ >= 0 ? fabs(tol1) : -fabs(tol1));
+                }
+            }
+        } else {
+            // Golden section step
+            d_ = CGOLD * (e_ = (x_ >= xm ? a_ - x_ : b_ - x_));
+        }
+
+        u = (fabs(d_) >= tol1 ? x_ + d_ : x_ + (d_ >= 0 ? fabs(tol1) : -fabs(tol1)));
+        double fu = evaluate(u);
+
+        // Update points
+        if (fu <= fx_) {
+            if (u >= x_) a_ = x_; else b_ = x_;
+            v_ = w_; w_ = x_; x_ = u;
+            fv_ = fw_; fw_ = fx_; fx_ = fu;
+        } else {
+            if (u < x_) a_ = u; else b_ = u;
+            if (fu <= fw_ || w_ == x_) {
+                v_ = w_; w_ = u;
+                fv_ = fw_; fw_ = fu;
+            } else if (fu <= fv_ || v_ == x_ || v_ == w_) {
+                v_ = u;
+                fv_ = fu;
+            }
+        }
+    }
+    converged_ = check_converged();
+
+    long step_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    elapsed_nanoseconds_ += step_nanoseconds;
+    // Worst recent step, forgetting a slow outlier (page fault, preemption) over ~16 steps
+    step_estimate_nanoseconds_ = std::max(step_nanoseconds, step_estimate_nanoseconds_ - step_estimate_nanoseconds_ / 16);
+    return true;
+}
+
+AnytimeIKResult AnytimeIKSolver::solve_until(std::chrono::steady_clock::time_point deadline) {
+    bool deadline_reached = false;
+    while (!done()) {
+        if (std::chrono::steady_clock::now() + std::chrono::nanoseconds(step_estimate_nanoseconds_) > deadline) {
+            // Also decay while declining, so one outlier cannot starve all later ticks
+            step_estimate_nanoseconds_ -= step_estimate_nanoseconds_ / 16;
+            deadline_reached = true;
+            break;
+        }
+        step();
+    }
+    AnytimeIKResult result = status();
+    result.deadline_reached = deadline_reached;
+    return result;
+}
+
+AnytimeIKResult AnytimeIKSolver::status() const {
+    AnytimeIKResult result;
+    result.best = best_;
+    result.best.optimization_iterations = iterations_;
+    result.best.q7_values_tested = evaluations_;
+    result.best.duration_microseconds = elapsed_nanoseconds_ / 1000;
+    result.converged = converged_;
+    result.exhausted = !converged_ && iterations_ >= max_iterations_;
+    result.deadline_reached = false;
+    result.bracket_lower = a_;
+    result.bracket_upper = b_;
+    result.evaluations = evaluations_;
+    result.step_estimate_nanoseconds = step_estimate_nanoseconds_;
+
+    // Bracket reduction on a log scale, against the width at which Brent stops
+    double target_width = 4.0 * (tolerance_ * fabs(x_) + TINY);
+    double width = b_ - a_;
+    if (converged_ || width <= target_width) {
+        result.convergence = 1.0;
+    } else if (!started_ || initial_width_ <= target_width) {
+        result.convergence = 0.0;
+    } else {
+        result.convergence = std::max(0.0, log(initial_width_ / width) / log(initial_width_ / target_width));
+    }
+    return result;
+}
@@ -0,0 +1,79 @@
+#ifndef ANYTIME_IK_H
+#define ANYTIME_IK_H
+
+#include <array>
+#include <chrono>
+#include "weighted_ik.h"
+
+// Snapshot of an anytime solve
+struct AnytimeIKResult {
+    WeightedIKResult best;     // Best candidate evaluated so far, success is false until one was feasible
+    bool converged;            // The tolerance was met, more steps would not change best
+    bool exhausted;            // max_iterations was reached before converging
+    bool deadline_reached;     // solve_until() stopped because the next step would have overrun
+    double bracket_lower;      // Interval still known to hold the optimum (if the score is unimodal in it)
+    double bracket_upper;
+    double convergence;        // 0 at the start, 1 once the bracket has shrunk to the tolerance (log scale)
+    int evaluations;           // IK evaluations so far
+    long step_estimate_nanoseconds;  // Predicted cost of the next step
+};
+
+// Brent optimization of WeightedIKSolver split into single IK evaluations, for control loops
+// that must not overrun their cycle. Give it a target with reset(), then either call step()
+// from successive ticks or solve_until() with the time left in the current tick; the state
+// carries over, so a solve can span several ticks and stops refining once converged.
+// Follows the same iterates as WeightedIKSolver::solve_optimized for the same range.
+class AnytimeIKSolver {
+private:
+    const WeightedIKSolver& solver_;
+
+    // Target of the current solve (copied so callers' buffers may change between ticks)
+    RedundancyParam param_;
+    PreparedTarget target_;
+    std::array<double, 7> current_pose_;
+    double tolerance_;
+    int max_iterations_;
+
+    // Brent state, named as in WeightedIKSolver::brent_optimize (costs are negated scores)
+    double a_, b_, d_, e_;
+    double v_, w_, x_;
+    double fv_, fw_, fx_;
+    double initial_width_;
+    int iterations_;
+    int evaluations_;
+    bool started_;
+    bool converged_;
+
+    WeightedIKResult best_;
+    long elapsed_nanoseconds_;
+    long step_estimate_nanoseconds_;  // Recent worst step, kept across reset(), decays after slow outliers
+
+    double evaluate(double value);
+    bool check_converged() const;
+
+public:
+    explicit AnytimeIKSolver(const WeightedIKSolver& solver);
+
+    // Starts a new solve over [value_min, value_max] of the free variable
+    void reset(
+        RedundancyParam param,
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose,
+        double value_min,
+        double value_max,
+        double tolerance = 1e-6,
+        int max_iterations = 100
+    );
+
+    // Performs one IK evaluation. Returns false without evaluating once done().
+    bool step();
+
+    // Steps until done() or until the next step is predicted to end after the deadline
+    AnytimeIKResult solve_until(std::chrono::steady_clock::time_point deadline);
+
+    bool done() const { return converged_ || iterations_ >= max_iterations_; }
+    AnytimeIKResult status() const;
+};
+
+#endif // ANYTIME_IK_H
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include "weighted_ik.h"
+#include "collision.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_collision.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o benchmark_collision.exe
+
+// Capsule collision model: time per evaluation of the frames, the self-collision pairs and a
+// small scene (table, box, sphere) over the configurations of the benchmark corpus, against one
+// IK call; then solve_q7_optimized on the corpus poses with and without the collision screen.
+
+static volatile double sink;
+
+// Fastest of n_passes passes of call over the corpus, in ns per call
+static double time_calls(int n, int n_passes, const std::function<double(int)>& call) {
+    double best = 1e300;
+    for (int pass = 0; pass < n_passes; pass++) {
+        double total = 0;
+        auto start = high_resolution_clock::now();
+        for (int k = 0; k < n; k++) total += call(k);
+        best = std::min(best, duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)n);
+        sink = total;
+    }
+    return best;
+}
+
+int main() {
+    const int n_poses = 2000;
+    const int n_passes = 7;
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+
+    CollisionModel self_model;
+    CollisionModel scene = self_model;
+    scene.add_plane({ 0.0, 0.0, 1.0 }, 0.0);                                                  // Table top
+    scene.add_box({ 0.55, 0.0, 0.15 }, { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0.1, 0.25, 0.15 });   // Part on the table
+    scene.add_sphere({ 0.2, -0.45, 0.6 }, 0.1);                                               // Fixture
+    CollisionModel obstacles_only = scene;
+    obstacles_only.set_self_collision(false);
+
+    cout << "=== CAPSULE COLLISION BENCHMARK ===" << endl;
+    cout << self_model.capsule_count() << " capsules, " << self_model.pair_count() << " self-collision pairs" << endl;
+
+    // Batched and single evaluations agree
+    std::vector<std::array<double, 7>> configurations(n_poses);
+    for (int k = 0; k < n_poses; k++) configurations[k] = corpus[k].q;
+    std::vector<double> batched(n_poses);
+    scene.clearances(configurations[0].data(), n_poses, 7, batched.data());
+    int self_colliding = 0, scene_colliding = 0, batch_mismatches = 0;
+    for (int k = 0; k < n_poses; k++) {
+        if (batched[k] != scene.clearance(corpus[k].q)) batch_mismatches++;
+        self_colliding += self_model.clearance(corpus[k].q) < 0;
+        scene_colliding += batched[k] < 0;
+    }
+    cout << "Corpus configurations in collision: " << self_colliding << " with themselves, " << scene_colliding
+         << " with themselves or the scene, of " << n_poses << " (" << batch_mismatches << " batch mismatches)" << endl << endl;
+
+    // Time per evaluation
+    std::vector<FrankaFrames> frames(n_poses);
+    for (int k = 0; k < n_poses; k++) franka_fk_all_frames(corpus[k].q, frames[k]);
+    std::vector<PreparedTarget> targets(n_poses);
+    for (int k = 0; k < n_poses; k++) prepare_target(corpus[k].position, corpus[k].orientation, targets[k]);
+    IKSolutionSet sols;
+    FrankaFrames f;
+    double t_ik = time_calls(n_poses, n_passes, [&](int k) { return (double)franka_ik_q7_manipulability(targets[k], corpus[k].q[6], sols); });
+    double t_fk = time_calls(n_poses, n_passes, [&](int k) { franka_fk_all_frames(corpus[k].q, f); return f.p[9][0]; });
+    double t_eigen_fk = time_calls(n_poses, n_passes, [&](int k) { return franka_fk(corpus[k].q)(0, 3); });
+    double t_self = time_calls(n_poses, n_passes, [&](int k) { return self_model.clearance(frames[k]); });
+    double t_obstacles = time_calls(n_poses, n_passes, [&](int k) { return obstacles_only.clearance(frames[k]); });
+    double t_scene = time_calls(n_poses, n_passes, [&](int k) { return scene.clearance(frames[k]); });
+    double t_total = time_calls(n_poses, n_passes, [&](int k) { return scene.clearance(corpus[k].q); });
+    cout << std::fixed << std::setprecision(1);
+    cout << "ns per evaluation" << endl;
+    cout << "  franka_ik_q7_manipulability (all 8):  " << std::setw(8) << t_ik << endl;
+    cout << "  franka_fk_all_frames:                 " << std::setw(8) << t_fk << "   (franka_fk: " << t_eigen_fk << ")" << endl;
+    cout << "  self-collision pairs:                 " << std::setw(8) << t_self << endl;
+    cout << "  obstacles only (plane, box, sphere):  " << std::setw(8) << t_obstacles << endl;
+    cout << "  pairs and obstacles:                  " << std::setw(8) << t_scene << endl;
+    cout << "  clearance(q), frames included:        " << std::setw(8) << t_total << endl << endl;
+
+    // Weighted solves of the corpus poses in the scene
+    const int n_solves = 300;
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+    struct Setting { const char* name; const CollisionModel* model; double margin; double weight; };
+    const Setting settings[] = {
+        { "no collision model", nullptr, 0.0, 0.0 },
+        { "screen (margin 0)", &scene, 0.0, 0.0 },
+        { "screen + cost (margin 1 cm)", &scene, 0.01, 0.2 },
+    };
+    cout << "solve_q7_optimized on " << n_solves << " corpus poses, from the configuration of the pose:" << endl;
+    for (const Setting& setting : settings) {
+        solver.set_collision_model(setting.model, setting.margin, setting.weight);
+        double us = 0, clearance_sum = 0;
+        int solved = 0, colliding = 0;
+        for (int k = 0; k < n_solves; k++) {
+            const BenchmarkPose& pose = corpus[k];
+            auto start = high_resolution_clock::now();
+            WeightedIKResult result = solver.solve_q7_optimized(pose.position, pose.orientation, pose.q, q_low[6], q_up[6]);
+            us += duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+            if (!result.success) continue;
+            solved++;
+            double clearance = scene.clearance(result.joint_angles);
+            colliding += clearance < 0;
+            clearance_sum += clearance;
+        }
+        cout << "  " << std::left << std::setw(30) << setting.name << std::right << std::setw(8) << us / n_solves << " us, "
+             << solved << " solved, " << colliding << " in collision with the scene, mean clearance "
+             << std::setprecision(3) << clearance_sum / std::max(solved, 1) << " m" << std::setprecision(1) << endl;
+    }
+    return batch_mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+#ifndef BENCHMARK_CORPUS_H
+#define BENCHMARK_CORPUS_H
+
+#include <array>
+#include <vector>
+#include <random>
+#include "Eigen/Dense"
+#include "geofik.h"
+
+// Reachable target pose generated by forward kinematics of a random configuration
+struct BenchmarkPose {
+    std::array<double, 7> q;            // Configuration that produced the pose
+    std::array<double, 3> position;     // r_EO_O
+    std::array<double, 9> orientation;  // ROE (row-first format)
+};
+
+// Deterministic corpus of reachable poses shared by the benchmarks
+inline std::vector<BenchmarkPose> make_benchmark_corpus(int n_poses, unsigned int seed = 42) {
+    std::mt19937 rng(seed);
+    std::vector<BenchmarkPose> corpus(n_poses);
+    for (auto& pose : corpus) {
+        for (int j = 0; j < 7; j++) {
+            // Stay 5% away from the joint limits
+            double margin = 0.05 * (q_up[j] - q_low[j]);
+            std::uniform_real_distribution<double> dist(q_low[j] + margin, q_up[j] - margin);
+            pose.q[j] = dist(rng);
+        }
+        Eigen::Matrix4d T = franka_fk(pose.q);
+        pose.position = { T(0, 3), T(1, 3), T(2, 3) };
+        pose.orientation = { T(0, 0), T(0, 1), T(0, 2),
+                             T(1, 0), T(1, 1), T(1, 2),
+                             T(2, 0), T(2, 1), T(2, 2) };
+    }
+    return corpus;
+}
+
+#endif // BENCHMARK_CORPUS_H
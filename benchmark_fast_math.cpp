@@ -0,0 +1,237 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+#include "geofik.h"
+#include "geofik_math.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_fast_math.cpp geofik.cpp -O3 -o benchmark_fast_math.exe
+// add -DGEOFIK_FAST_MATH (to both files) for the fast tier of geofik_math.h, and compare the two runs.
+// usage: benchmark_fast_math.exe [SAVE [REFERENCE]]   saves the IK solutions of this tier to SAVE and
+//        compares them with the ones a run of the other tier saved to REFERENCE, e.g.
+//        exact.exe exact.sol && fast.exe fast.sol exact.sol
+
+// First part (independent of the tier): error of each fast_* function against long double libm
+// and its cost against libm. Second part (tier of this build): FK round trip of the q7, q4, q6 and
+// swivel IK over the benchmark corpus, distance of the closest solution to the configuration that
+// produced the pose, and time per IK call. With a REFERENCE, the joint differences of each
+// parameterization against the other tier.
+
+using namespace std::chrono;
+
+static volatile double sink;
+
+struct FunctionCase {
+    const char* name;
+    double low, high;   // Input range
+    std::function<double(double)> fast;
+    std::function<double(double)> libm;
+    std::function<long double(long double)> reference;
+};
+
+// Fastest of n_passes passes of f over x, in ns per call
+double time_function(const std::vector<double>& x, const std::function<double(double)>& f, int n_passes) {
+    double best = 1e300;
+    for (int pass = 0; pass < n_passes; pass++) {
+        double sum = 0.0;
+        auto start = high_resolution_clock::now();
+        for (double v : x) sum += f(v);
+        double ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)x.size();
+        sink = sum;
+        best = std::min(best, ns);
+    }
+    return best;
+}
+
+// Angle of the rotation R1^T R2 for small angles, |R1 - R2|_F / sqrt(2) (acos of the trace
+// cannot resolve angles below 1e-8)
+double rotation_error(const Eigen::Matrix3d& R1, const Eigen::Matrix3d& R2) {
+    return (R1 - R2).norm() / sqrt(2.0);
+}
+
+int main(int argc, char** argv) {
+#ifdef GEOFIK_FAST_MATH
+    const char* tier = "fast (GEOFIK_FAST_MATH)";
+#else
+    const char* tier = "exact (libm)";
+#endif
+    cout << "=== FAST MATH BENCHMARK ===" << endl;
+    cout << "Tier of this build: " << tier << endl;
+
+    // Functions
+    const int n_samples = 1000000;
+    const int n_passes = 7;
+    // The std::function wrappers cost the same for both columns; the batch row has none
+    const FunctionCase cases[] = {
+        { "sin", -2 * PI, 2 * PI, [](double x) { return fast_sin(x); }, [](double x) { return sin(x); }, [](long double x) { return sinl(x); } },
+        { "cos", -2 * PI, 2 * PI, [](double x) { return fast_cos(x); }, [](double x) { return cos(x); }, [](long double x) { return cosl(x); } },
+        { "asin", -1, 1, [](double x) { return fast_asin(x); }, [](double x) { return asin(x); }, [](long double x) { return asinl(x); } },
+        { "acos", -1, 1, [](double x) { return fast_acos(x); }, [](double x) { return acos(x); }, [](long double x) { return acosl(x); } },
+        { "atan", -20, 20, [](double x) { return fast_atan(x); }, [](double x) { return atan(x); }, [](long double x) { return atanl(x); } },
+        { "atan2(x, 0.3)", -2, 2, [](double x) { return fast_atan2(x, 0.3); }, [](double x) { return atan2(x, 0.3); }, [](long double x) { return atan2l(x, 0.3L); } },
+        { "atan2(0.3, x)", -2, 2, [](double x) { return fast_atan2(0.3, x); }, [](double x) { return atan2(0.3, x); }, [](long double x) { return atan2l(0.3L, x); } },
+    };
+    std::mt19937 rng(7);
+    cout << endl << std::left << std::setw(16) << "function" << std::right << std::setw(12) << "max error"
+         << std::setw(11) << "libm ns" << std::setw(11) << "fast ns" << std::setw(9) << "speedup" << endl;
+    for (const FunctionCase& c : cases) {
+        std::uniform_real_distribution<double> dist(c.low, c.high);
+        std::vector<double> x(n_samples);
+        for (double& v : x) v = dist(rng);
+        double max_error = 0.0;
+        for (double v : x) max_error = std::max(max_error, (double)fabsl((long double)c.fast(v) - c.reference(v)));
+        double libm_ns = time_function(x, c.libm, n_passes);
+        double fast_ns = time_function(x, c.fast, n_passes);
+        cout << std::left << std::setw(16) << c.name << std::right << std::scientific << std::setprecision(2)
+             << std::setw(12) << max_error << std::fixed << std::setprecision(2) << std::setw(11) << libm_ns
+             << std::setw(11) << fast_ns << std::setw(8) << libm_ns / fast_ns << "x" << endl;
+    }
+    {
+        // Array form over the same inputs: the fast loop vectorizes, libm does not
+        std::uniform_real_distribution<double> dist(-2 * PI, 2 * PI);
+        std::vector<double> x(n_samples), s(n_samples), c(n_samples);
+        for (double& v : x) v = dist(rng);
+        double libm_ns = 1e300, fast_ns = 1e300;
+        for (int pass = 0; pass < n_passes; pass++) {
+            auto start = high_resolution_clock::now();
+            for (int i = 0; i < n_samples; i++) {
+                s[i] = sin(x[i]);
+                c[i] = cos(x[i]);
+            }
+            libm_ns = std::min(libm_ns, duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)n_samples);
+            sink = s[pass] + c[pass];
+            start = high_resolution_clock::now();
+            for (int i = 0; i < n_samples; i++) fast_sincos(x[i], s[i], c[i]);
+            fast_ns = std::min(fast_ns, duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)n_samples);
+            sink = s[pass] + c[pass];
+        }
+        cout << std::left << std::setw(16) << "sincos (array)" << std::right << std::setw(12) << "-"
+             << std::setw(11) << libm_ns << std::setw(11) << fast_ns << std::setw(8) << libm_ns / fast_ns << "x" << endl;
+    }
+
+    // IK of this tier, for each free variable at its value in the generating configuration
+    const int n_poses = 2000;
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+    struct Parameterization {
+        const char* name;
+        std::function<void(const BenchmarkPose&, array<array<double, 7>, 8>&, IKValidity&)> ik;
+    };
+    const Parameterization parameterizations[] = {
+        { "q7", [](const BenchmarkPose& p, array<array<double, 7>, 8>& q, IKValidity& v) { franka_ik_q7(p.position, p.orientation, p.q[6], q, v); } },
+        { "q4", [](const BenchmarkPose& p, array<array<double, 7>, 8>& q, IKValidity& v) { franka_ik_q4(p.position, p.orientation, p.q[3], q, v); } },
+        { "q6", [](const BenchmarkPose& p, array<array<double, 7>, 8>& q, IKValidity& v) { franka_ik_q6(p.position, p.orientation, p.q[5], q, v); } },
+        { "swivel", [](const BenchmarkPose& p, array<array<double, 7>, 8>& q, IKValidity& v) { franka_ik_swivel(p.position, p.orientation, franka_swivel(p.q), q, v); } },
+    };
+    const int n_params = sizeof(parameterizations) / sizeof(parameterizations[0]);
+    auto percentiles = [](std::vector<double> v) {
+        if (v.empty()) return std::string("no samples");
+        std::sort(v.begin(), v.end());
+        std::ostringstream text;
+        text << std::scientific << std::setprecision(2) << "median " << v[v.size() / 2]
+             << ", p99 " << v[(size_t)(0.99 * (v.size() - 1))] << ", max " << v.back();
+        return text.str();
+    };
+    // Solutions of every pose and parameterization, invalid slots NaN, in the order they are saved
+    std::vector<array<array<double, 7>, 8>> solutions(n_params * n_poses);
+    // Near the singularities the IK clamps and its solutions are approximate in both tiers, so the
+    // tails are reported next to the median
+    cout << endl << "IK round trip over " << n_poses << " poses (free variable of the pose):" << endl;
+    for (int k = 0; k < n_params; k++) {
+        std::vector<double> position_errors, orientation_errors, joint_errors;
+        for (int n = 0; n < n_poses; n++) {
+            const BenchmarkPose& pose = corpus[n];
+            array<array<double, 7>, 8>& qsols = solutions[k * n_poses + n];
+            IKValidity validity;
+            parameterizations[k].ik(pose, qsols, validity);
+            for (int i = 0; i < 8; i++) {
+                if (!(validity.valid & (1u << i))) qsols[i].fill(std::numeric_limits<double>::quiet_NaN());
+            }
+            Eigen::Matrix3d R;
+            R << pose.orientation[0], pose.orientation[1], pose.orientation[2],
+                 pose.orientation[3], pose.orientation[4], pose.orientation[5],
+                 pose.orientation[6], pose.orientation[7], pose.orientation[8];
+            double closest = 1e300;
+            for (unsigned int m = validity.valid; m; ) {
+                int i = next_valid_solution(m);
+                Eigen::Matrix4d T = franka_fk(qsols[i]);
+                Eigen::Vector3d p(pose.position[0], pose.position[1], pose.position[2]);
+                position_errors.push_back((T.block<3, 1>(0, 3) - p).norm());
+                orientation_errors.push_back(rotation_error(T.block<3, 3>(0, 0), R));
+                double dq = 0.0;
+                for (int j = 0; j < 7; j++) dq = std::max(dq, fabs(qsols[i][j] - pose.q[j]));
+                closest = std::min(closest, dq);
+            }
+            if (closest < 1e300) joint_errors.push_back(closest);
+        }
+        cout << "  " << parameterizations[k].name << " (" << position_errors.size() << " valid solutions)" << endl
+             << "    |FK(IK) - pose| position (m):    " << percentiles(position_errors) << endl
+             << "    |FK(IK) - pose| orientation (rad): " << percentiles(orientation_errors) << endl
+             << "    closest solution to the generating q (rad): " << percentiles(joint_errors) << endl;
+    }
+
+    // Joint differences against the other tier, from the solutions a run of it saved
+    if (argc > 1) {
+        FILE* file = fopen(argv[1], "wb");
+        if (!file || fwrite(solutions.data(), sizeof(solutions[0]), solutions.size(), file) != solutions.size()) {
+            cerr << "ERROR: could not write " << argv[1] << endl;
+            if (file) fclose(file);
+            return 1;
+        }
+        fclose(file);
+    }
+    if (argc > 2) {
+        std::vector<array<array<double, 7>, 8>> reference(solutions.size());
+        FILE* file = fopen(argv[2], "rb");
+        if (!file || fread(reference.data(), sizeof(reference[0]), reference.size(), file) != reference.size()) {
+            cerr << "ERROR: could not read " << reference.size() << " solution sets from " << argv[2] << endl;
+            if (file) fclose(file);
+            return 1;
+        }
+        fclose(file);
+        cout << endl << "Joint differences against " << argv[2] << " (largest over the joints, solutions valid in both):" << endl;
+        for (int k = 0; k < n_params; k++) {
+            std::vector<double> differences;
+            int validity_changes = 0;
+            for (int n = 0; n < n_poses; n++) {
+                for (int i = 0; i < 8; i++) {
+                    const array<double, 7>& q = solutions[k * n_poses + n][i];
+                    const array<double, 7>& q_ref = reference[k * n_poses + n][i];
+                    if (std::isnan(q[0]) != std::isnan(q_ref[0])) validity_changes++;
+                    if (std::isnan(q[0]) || std::isnan(q_ref[0])) continue;
+                    double dq = 0.0;
+                    for (int j = 0; j < 7; j++) dq = std::max(dq, fabs(q[j] - q_ref[j]));
+                    differences.push_back(dq);
+                }
+            }
+            cout << "  " << std::left << std::setw(7) << parameterizations[k].name << std::right << percentiles(differences)
+                 << ", " << validity_changes << " solutions valid in one tier only" << endl;
+        }
+    }
+
+    std::vector<PreparedTarget> targets(n_poses);
+    for (int k = 0; k < n_poses; k++) prepare_target(corpus[k].position, corpus[k].orientation, targets[k]);
+    auto time_ik = [&](const std::function<unsigned int(int, array<array<double, 7>, 8>&, IKValidity&)>& ik) {
+        double best = 1e300;
+        array<array<double, 7>, 8> qsols;
+        IKValidity validity;
+        for (int pass = 0; pass < n_passes; pass++) {
+            unsigned int total = 0;
+            auto start = high_resolution_clock::now();
+            for (int k = 0; k < n_poses; k++) total += ik(k, qsols, validity);
+            best = std::min(best, duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)n_poses);
+            sink = total;
+        }
+        return best;
+    };
+    cout << std::fixed << std::setprecision(1) << "IK time per call (prepared target):"
+         << " q7 " << time_ik([&](int k, array<array<double, 7>, 8>& q, IKValidity& v) { return franka_ik_q7(targets[k], corpus[k].q[6], q, v); }) << " ns,"
+         << " q4 " << time_ik([&](int k, array<array<double, 7>, 8>& q, IKValidity& v) { return franka_ik_q4(targets[k], corpus[k].q[3], q, v); }) << " ns,"
+         << " q6 " << time_ik([&](int k, array<array<double, 7>, 8>& q, IKValidity& v) { return franka_ik_q6(targets[k], corpus[k].q[5], q, v); }) << " ns" << endl;
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include "geofik.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_fk_frames.cpp geofik.cpp -O3 -pthread -o benchmark_fk_frames.exe
+
+// Frames of every link for a large batch of configurations: franka_fk (4x4 products, frame E
+// only), franka_fk_all_frames into an array of FrankaFrames, and franka_fk_frames_soa on all frames, on
+// the frames of the collision capsules and on frame E only, on 1 to hardware-concurrency threads.
+// Checks the structure-of-arrays frames against the per-configuration ones, and the threaded
+// call against the single-threaded one.
+
+using namespace std::chrono;
+
+static volatile double sink;
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? (size_t)atol(argv[1]) : 1 << 16;
+    const int n_passes = 5;
+
+    // Configurations of the corpus, tiled, in structure-of-arrays rows. The rows are padded so
+    // they do not all start on the same cache sets
+    const size_t ld = n + 24;
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(4096);
+    std::vector<std::array<double, 7>> configurations(n);
+    std::vector<double> q(7 * ld);
+    for (size_t k = 0; k < n; k++) {
+        configurations[k] = corpus[k % corpus.size()].q;
+        for (int j = 0; j < 7; j++) q[j * ld + k] = configurations[k][j];
+    }
+    std::vector<double> R(90 * ld), p(30 * ld);
+    const FrankaFramesSoA soa = { R.data(), p.data(), ld };
+
+    // Fastest of the passes, in ns per configuration
+    auto time_batch = [&](const std::function<void()>& batch) {
+        double best = 1e300;
+        for (int pass = 0; pass < n_passes; pass++) {
+            auto start = high_resolution_clock::now();
+            batch();
+            best = std::min(best, duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)n);
+            sink = R[n / 2] + p[n / 2];
+        }
+        return best;
+    };
+
+    // Agreement with franka_fk_all_frames
+    franka_fk_frames_soa(q.data(), n, FRANKA_FRAMES_ALL, soa);
+    double max_R_error = 0, max_p_error = 0;
+    for (size_t k = 0; k < n; k += 7) {
+        FrankaFrames frames;
+        franka_fk_all_frames(configurations[k], frames);
+        for (int f = 0; f < 10; f++) {
+            for (int e = 0; e < 9; e++) max_R_error = std::max(max_R_error, fabs(R[(9 * f + e) * ld + k] - frames.R[f][e]));
+            for (int i = 0; i < 3; i++) max_p_error = std::max(max_p_error, fabs(p[(3 * f + i) * ld + k] - frames.p[f][i]));
+        }
+    }
+
+    // Split over threads, the same frames (3 threads even on fewer cores, for the ranges)
+    std::vector<double> R_single = R, p_single = p;
+    std::fill(R.begin(), R.end(), 0.0);
+    std::fill(p.begin(), p.end(), 0.0);
+    franka_fk_frames_soa(q.data(), n, FRANKA_FRAMES_ALL, soa, 3);
+    bool threads_agree = R == R_single && p == p_single;
+
+    // Frames 2 to 7 and E carry the capsules of CollisionModel
+    const unsigned int collision_mask = 0x2FC;
+    const unsigned int E_mask = 1u << 9;
+    std::vector<FrankaFrames> aos(n);
+    double t_eigen = time_batch([&] { for (size_t k = 0; k < n; k++) sink = franka_fk(configurations[k])(0, 3); });
+    double t_frames = time_batch([&] { franka_fk_all_frames(configurations[0].data(), n, 7, aos.data()); sink = aos[n / 2].p[9][0]; });
+    double t_all = time_batch([&] { franka_fk_frames_soa(q.data(), n, FRANKA_FRAMES_ALL, soa); });
+    double t_collision = time_batch([&] { franka_fk_frames_soa(q.data(), n, collision_mask, soa); });
+    double t_E = time_batch([&] { franka_fk_frames_soa(q.data(), n, E_mask, soa); });
+
+    cout << "=== FK OF ALL FRAMES, " << n << " CONFIGURATIONS ===" << endl;
+    cout << std::scientific << std::setprecision(2);
+    cout << "franka_fk_frames_soa against franka_fk_all_frames: rotations " << max_R_error << ", positions " << max_p_error << " m" << endl;
+    cout << "on 3 threads: " << (threads_agree ? "identical" : "DIFFERENT") << endl << endl;
+    cout << std::fixed << std::setprecision(1);
+    cout << "ns per configuration (1 thread)" << endl;
+    cout << "  franka_fk (4x4 products, frame E):       " << std::setw(8) << t_eigen << endl;
+    cout << "  franka_fk_all_frames into FrankaFrames:  " << std::setw(8) << t_frames << endl;
+    cout << "  franka_fk_frames_soa, all frames:        " << std::setw(8) << t_all << endl;
+    cout << "  franka_fk_frames_soa, collision frames:  " << std::setw(8) << t_collision << endl;
+    cout << "  franka_fk_frames_soa, frame E:           " << std::setw(8) << t_E << endl << endl;
+
+    int max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    cout << "franka_fk_frames_soa, all frames, million configurations per second" << endl;
+    for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        double t = time_batch([&] { franka_fk_frames_soa(q.data(), n, FRANKA_FRAMES_ALL, soa, n_threads); });
+        cout << "  " << std::setw(3) << n_threads << " threads: " << std::setw(8) << 1000.0 / t << endl;
+        if (n_threads < max_threads && 2 * n_threads > max_threads) n_threads = max_threads / 2;
+    }
+    return max_R_error < 1e-9 && max_p_error < 1e-9 && threads_agree ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include "weighted_ik.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_ik_branch.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o benchmark_ik_branch.exe
+
+// Branch-targeted IK against the full 8-solution IK: franka_q7_branch() on the configurations of
+// the benchmark corpus, bit-identity of every branch solution with its slot in franka_J_ik_q7(),
+// time per call of the targeted and full entry points, and solve_q7_optimized restricted to the
+// branch of the current pose.
+
+static volatile double sink;
+
+// Fastest of n_passes passes of call over the corpus, in ns per call
+static double time_calls(int n, int n_passes, const std::function<unsigned int(int)>& call) {
+    double best = 1e300;
+    for (int pass = 0; pass < n_passes; pass++) {
+        unsigned int total = 0;
+        auto start = high_resolution_clock::now();
+        for (int k = 0; k < n; k++) total += call(k);
+        best = std::min(best, duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)n);
+        sink = total;
+    }
+    return best;
+}
+
+static bool same_joints(const std::array<double, 7>& a, const std::array<double, 7>& b) {
+    for (int j = 0; j < 7; j++)
+        if (!(a[j] == b[j] || (std::isnan(a[j]) && std::isnan(b[j])))) return false;
+    return true;
+}
+
+int main() {
+    const int n_poses = 2000;
+    const int n_passes = 7;
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+    std::vector<PreparedTarget> targets(n_poses);
+    for (int k = 0; k < n_poses; k++) prepare_target(corpus[k].position, corpus[k].orientation, targets[k]);
+
+    cout << "=== BRANCH-TARGETED IK BENCHMARK ===" << endl;
+
+    // Classification: the branch of each configuration reproduces it
+    std::vector<int> branches(n_poses);
+    std::array<int, 8> histogram = {};
+    // At the shoulder singularity (s3 on the z axis, |q2| < ~3e-3) the IK sets q1 = q1_sing, so no
+    // branch reproduces q1 and q3 and the residual is large
+    int unclassified = 0, singular = 0, not_reproduced = 0;
+    double max_residual = 0;
+    for (int k = 0; k < n_poses; k++) {
+        double residual;
+        branches[k] = franka_q7_branch(corpus[k].q, &residual);
+        if (branches[k] < 0) {
+            unclassified++;
+            branches[k] = 0;
+            continue;
+        }
+        histogram[branches[k]]++;
+        if (residual > 1e-6) {
+            singular++;
+            continue;
+        }
+        max_residual = std::max(max_residual, residual);
+        std::array<double, 7> q;
+        franka_ik_q7_branch(targets[k], corpus[k].q[6], branches[k], q);
+        for (int j = 0; j < 7; j++)
+            if (!(fabs(q[j] - corpus[k].q[j]) < 1e-6)) { not_reproduced++; break; }
+    }
+    cout << "franka_q7_branch over " << n_poses << " configurations: " << unclassified << " unclassified, "
+         << singular << " at the shoulder singularity, " << not_reproduced << " others not reproduced by their branch,"
+         << " largest residual of the others " << std::scientific << std::setprecision(2) << max_residual << endl << "  branches:";
+    for (int b = 0; b < 8; b++) cout << " " << b << ":" << histogram[b];
+    cout << endl;
+
+    // Identity with the full IK at several q7 per pose
+    int branch_solutions = 0, mismatches = 0, uncovered = 0;
+    for (int k = 0; k < n_poses; k++) {
+        for (int s = 0; s < 8; s++) {
+            double q7 = q_low[6] + (s + 0.5) * (q_up[6] - q_low[6]) / 8;
+            std::array<std::array<double, 7>, 8> qsols;
+            std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
+            IKValidity validity;
+            franka_J_ik_q7(targets[k], q7, Jsols, qsols, validity, true);
+            unsigned int matched = 0;
+            for (unsigned int b = 0; b < 8; b++) {
+                std::array<double, 7> q;
+                std::array<std::array<double, 6>, 7> J;
+                if (!franka_J_ik_q7_branch(targets[k], q7, b, J, q)) continue;
+                branch_solutions++;
+                int slot = -1;
+                for (int i = 0; i < 8 && slot < 0; i++)
+                    if ((validity.valid >> i & 1) && same_joints(qsols[i], q) && Jsols[i] == J) slot = i;
+                if (slot < 0) mismatches++;
+                else matched |= 1u << slot;
+            }
+            uncovered += __builtin_popcount(validity.valid & ~matched);
+        }
+    }
+    cout << "Valid branch solutions at 8 q7 per pose: " << branch_solutions << ", " << mismatches
+         << " not bit-identical to a slot of franka_J_ik_q7, " << uncovered << " valid slots without a branch" << endl << endl;
+
+    // Time per call, branch of the configuration that produced each pose
+    std::array<std::array<double, 7>, 8> qsols;
+    std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
+    std::array<double, 7> q;
+    std::array<std::array<double, 6>, 7> J;
+    IKValidity validity;
+    IKSolutionSet sols;
+    auto q7_of = [&](int k) { return corpus[k].q[6]; };
+    double t_full_q = time_calls(n_poses, n_passes, [&](int k) { return franka_ik_q7(targets[k], q7_of(k), qsols, validity); });
+    double t_branch_q = time_calls(n_poses, n_passes, [&](int k) { return (unsigned int)franka_ik_q7_branch(targets[k], q7_of(k), branches[k], q); });
+    double t_full_J = time_calls(n_poses, n_passes, [&](int k) { return franka_J_ik_q7(targets[k], q7_of(k), Jsols, qsols, validity, true); });
+    double t_branch_J = time_calls(n_poses, n_passes, [&](int k) { return (unsigned int)franka_J_ik_q7_branch(targets[k], q7_of(k), branches[k], J, q); });
+    double t_full_m = time_calls(n_poses, n_passes, [&](int k) { return franka_ik_q7_manipulability(targets[k], q7_of(k), sols); });
+    double t_branch_m = time_calls(n_poses, n_passes, [&](int k) { return franka_ik_q7_branch_manipulability(targets[k], q7_of(k), branches[k], sols); });
+    cout << std::fixed << std::setprecision(1);
+    cout << std::left << std::setw(34) << "ns per call" << std::right << std::setw(10) << "all 8" << std::setw(10) << "branch" << std::setw(10) << "ratio" << endl;
+    auto row = [](const char* name, double full, double branch) {
+        cout << std::left << std::setw(34) << name << std::right << std::setw(10) << full << std::setw(10) << branch
+             << std::setw(9) << branch / full << "x" << endl;
+    };
+    row("joint angles", t_full_q, t_branch_q);
+    row("Jacobian and joint angles", t_full_J, t_branch_J);
+    row("manipulability and joint angles", t_full_m, t_branch_m);
+    cout << endl;
+
+    // Weighted solve from the configuration of the pose, on all branches and on its own
+    const int n_solves = 200;
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+    double all_us = 0, restricted_us = 0;
+    int all_success = 0, restricted_success = 0, branch_changes = 0;
+    for (int k = 0; k < n_solves; k++) {
+        const BenchmarkPose& pose = corpus[k];
+        solver.set_branch(-1);
+        auto start = high_resolution_clock::now();
+        WeightedIKResult all = solver.solve_q7_optimized(pose.position, pose.orientation, pose.q, q_low[6], q_up[6]);
+        all_us += duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+        solver.set_branch(branches[k]);
+        start = high_resolution_clock::now();
+        WeightedIKResult restricted = solver.solve_q7_optimized(pose.position, pose.orientation, pose.q, q_low[6], q_up[6]);
+        restricted_us += duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+        all_success += all.success;
+        restricted_success += restricted.success;
+        if (all.success && franka_q7_branch(all.joint_angles) != branches[k]) branch_changes++;
+    }
+    cout << "solve_q7_optimized from the configuration of the pose (" << n_solves << " poses):" << endl;
+    cout << "  all branches:       " << std::setw(8) << all_us / n_solves << " us, " << all_success << " solved, "
+         << branch_changes << " on another branch than the current pose" << endl;
+    cout << "  its branch only:    " << std::setw(8) << restricted_us / n_solves << " us, " << restricted_success << " solved" << endl;
+    return mismatches == 0 && not_reproduced == 0 ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cstdlib>
+#include "ik_jobs.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_ik_jobs.cpp ik_jobs.cpp path_ik.cpp ik_service.cpp ik_dataset.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -lrt -o benchmark_ik_jobs.exe
+// usage: benchmark_ik_jobs.exe [THREADS]   (default: hardware concurrency)
+
+// Runs one mixed workload (raw IK, swivel IK, q7 optimizations, q7 grid sweeps and paths) three
+// ways: a thread per request, the requests split statically over a fixed set of threads, and
+// IKJobPool with the raw IK requests at high priority. Reports the makespan and the latency of
+// the small requests from submission to completion.
+
+enum class WorkKind { RAW, SWIVEL, OPT, GRID, PATH };
+
+struct WorkItem {
+    WorkKind kind;
+    IKRequest request;  // RAW, SWIVEL, OPT
+    IKGridJob grid;     // GRID
+    IKPathJob path;     // PATH
+};
+
+struct RunStats {
+    double makespan_ms;
+    double raw_mean_us, raw_p99_us;
+    double opt_mean_us;
+    double grid_mean_ms;
+};
+
+const std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+
+// Runs a work item on the calling thread, as the pool would
+void run_item(WeightedIKSolver& solver, const WorkItem& item) {
+    if (item.kind == WorkKind::GRID) {
+        solver.solve_q7(item.grid.position, item.grid.orientation, item.grid.current_pose,
+                        item.grid.q7_start, item.grid.q7_end, item.grid.step_size);
+    } else if (item.kind == WorkKind::PATH) {
+        PathIKSolver path(solver, item.path.q7_samples, item.path.segment_length, 1);
+        path.solve(item.path.positions, item.path.orientations, item.path.current_pose, item.path.q7_min, item.path.q7_max);
+    } else {
+        IKResponse response;
+        IKServer::handle(solver, item.request, response);
+    }
+}
+
+RunStats summarize(const std::vector<WorkItem>& work, const std::vector<double>& latency_us, double makespan_ms) {
+    std::vector<double> raw;
+    double opt = 0.0, grid = 0.0;
+    int n_opt = 0, n_grid = 0;
+    for (size_t k = 0; k < work.size(); k++) {
+        if (work[k].kind == WorkKind::RAW) raw.push_back(latency_us[k]);
+        if (work[k].kind == WorkKind::OPT) { opt += latency_us[k]; n_opt++; }
+        if (work[k].kind == WorkKind::GRID) { grid += latency_us[k]; n_grid++; }
+    }
+    std::sort(raw.begin(), raw.end());
+    RunStats stats;
+    stats.makespan_ms = makespan_ms;
+    stats.raw_mean_us = 0.0;
+    for (double l : raw) stats.raw_mean_us += l;
+    stats.raw_mean_us /= std::max<size_t>(1, raw.size());
+    stats.raw_p99_us = raw.empty() ? 0.0 : raw[(size_t)(0.99 * (raw.size() - 1))];
+    stats.opt_mean_us = opt / std::max(1, n_opt);
+    stats.grid_mean_ms = grid / std::max(1, n_grid) / 1000.0;
+    return stats;
+}
+
+void report(const std::string& name, const RunStats& stats) {
+    cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+         << " makespan " << std::setw(8) << stats.makespan_ms << " ms"
+         << "   raw IK latency mean " << std::setw(9) << stats.raw_mean_us << " μs, p99 " << std::setw(9) << stats.raw_p99_us << " μs"
+         << "   opt mean " << std::setw(8) << stats.opt_mean_us / 1000.0 << " ms"
+         << "   grid mean " << std::setw(7) << stats.grid_mean_ms << " ms" << endl;
+}
+
+int main(int argc, char** argv) {
+    int n_threads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+    if (n_threads < 1) n_threads = 1;
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+
+    // Mixed workload in a fixed random order
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(2000);
+    std::vector<WorkItem> work;
+    auto request = [&](const BenchmarkPose& pose, IKServiceMode mode, double free_variable) {
+        WorkItem item{};
+        item.kind = mode == IKServiceMode::IK_Q7 ? WorkKind::RAW : (mode == IKServiceMode::IK_SWIVEL ? WorkKind::SWIVEL : WorkKind::OPT);
+        item.request = IKRequest{};
+        item.request.mode = mode;
+        item.request.max_iterations = 100;
+        item.request.free_variable = free_variable;
+        item.request.tolerance = 1e-6;
+        item.request.position = pose.position;
+        item.request.orientation = pose.orientation;
+        item.request.current_pose = neutral_pose;
+        return item;
+    };
+    for (int k = 0; k < 2000; k++) work.push_back(request(corpus[k], IKServiceMode::IK_Q7, corpus[k].q[6]));
+    for (int k = 0; k < 100; k++) work.push_back(request(corpus[k], IKServiceMode::IK_SWIVEL, 0.3));
+    for (int k = 0; k < 200; k++) work.push_back(request(corpus[k], IKServiceMode::OPT_Q7, 0.0));
+    for (int k = 0; k < 8; k++) {
+        WorkItem item{};
+        item.kind = WorkKind::GRID;
+        item.grid = IKGridJob{ corpus[k].position, corpus[k].orientation, neutral_pose, q_low[6], q_up[6], 0.002 };
+        work.push_back(item);
+    }
+    for (int k = 0; k < 2; k++) {
+        // Straight line between two corpus poses at a fixed orientation
+        WorkItem item{};
+        item.kind = WorkKind::PATH;
+        item.path.current_pose = neutral_pose;
+        item.path.q7_min = q_low[6];
+        item.path.q7_max = q_up[6];
+        const BenchmarkPose& from = corpus[10 + 2 * k];
+        const BenchmarkPose& to = corpus[11 + 2 * k];
+        for (int w = 0; w < 200; w++) {
+            double t = w / 199.0;
+            item.path.positions.push_back({ from.position[0] + t * (to.position[0] - from.position[0]),
+                                            from.position[1] + t * (to.position[1] - from.position[1]),
+                                            from.position[2] + t * (to.position[2] - from.position[2]) });
+            item.path.orientations.push_back(from.orientation);
+        }
+        work.push_back(item);
+    }
+    std::mt19937 rng(5);
+    std::shuffle(work.begin(), work.end(), rng);
+
+    cout << "=== IK JOB POOL BENCHMARK ===" << endl;
+    cout << "Workload: 2000 raw q7 IK, 100 swivel IK, 200 q7 optimizations, 8 q7 grid sweeps (step 0.002), "
+         << "2 paths of 200 waypoints; " << n_threads << " threads" << endl << endl;
+
+    std::vector<double> latency_us(work.size());
+    auto t0 = high_resolution_clock::now();
+    auto since = [](high_resolution_clock::time_point from) {
+        return duration_cast<nanoseconds>(high_resolution_clock::now() - from).count() / 1000.0;
+    };
+
+    // Thread per request
+    {
+        t0 = high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t k = 0; k < work.size(); k++) {
+            auto submitted = high_resolution_clock::now();
+            threads.emplace_back([&, k, submitted] {
+                WeightedIKSolver local(solver);
+                run_item(local, work[k]);
+                latency_us[k] = since(submitted);
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        report("thread per request", summarize(work, latency_us, since(t0) / 1000.0));
+    }
+
+    // Static partition: contiguous blocks of the request list
+    {
+        t0 = high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        size_t block = (work.size() + n_threads - 1) / n_threads;
+        for (int t = 0; t < n_threads; t++) {
+            threads.emplace_back([&, t] {
+                WeightedIKSolver local(solver);
+                for (size_t k = t * block; k < std::min(work.size(), (t + 1) * block); k++) {
+                    run_item(local, work[k]);
+                    latency_us[k] = since(t0);
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        report("static partition", summarize(work, latency_us, since(t0) / 1000.0));
+    }
+
+    // Work-stealing pool
+    {
+        IKJobPool pool(solver, n_threads);
+        std::atomic<int> remaining((int)work.size());
+        std::mutex done_mutex;
+        std::condition_variable all_done;
+        t0 = high_resolution_clock::now();
+        for (size_t k = 0; k < work.size(); k++) {
+            auto submitted = high_resolution_clock::now();
+            auto finish = [&, k, submitted] {
+                latency_us[k] = since(submitted);
+                if (remaining.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lock(done_mutex);
+                    all_done.notify_all();
+                }
+            };
+            const WorkItem& item = work[k];
+            if (item.kind == WorkKind::GRID) {
+                pool.submit_grid(item.grid, [finish](const IKJobResult<WeightedIKResult>&) { finish(); }, IKJobPriority::LOW);
+            } else if (item.kind == WorkKind::PATH) {
+                pool.submit_path(item.path, [finish](const IKJobResult<PathIKResult>&) { finish(); }, IKJobPriority::LOW);
+            } else {
+                IKJobPriority priority = item.kind == WorkKind::RAW ? IKJobPriority::HIGH : IKJobPriority::NORMAL;
+                pool.submit(item.request, [finish](const IKJobResult<IKResponse>&) { finish(); }, priority);
+            }
+        }
+        std::unique_lock<std::mutex> lock(done_mutex);
+        all_done.wait(lock, [&] { return remaining.load() == 0; });
+        report("work-stealing pool", summarize(work, latency_us, since(t0) / 1000.0));
+
+        // The split sweep finds the same optimum as one solve_q7 over the whole range
+        const IKGridJob& grid = std::find_if(work.begin(), work.end(), [](const WorkItem& w) { return w.kind == WorkKind::GRID; })->grid;
+        IKJobResult<WeightedIKResult> pooled = pool.submit_grid(grid).get();
+        WeightedIKResult direct = solver.solve_q7(grid.position, grid.orientation, grid.current_pose,
+                                                  grid.q7_start, grid.q7_end, grid.step_size);
+        cout << endl << "Grid sweep: pool score " << std::setprecision(9) << pooled.value.score << " at q7 "
+             << pooled.value.q7_optimal << ", solve_q7 score " << direct.score << " at q7 " << direct.q7_optimal << endl;
+
+        // Cancelling a sweep that is queued behind a busy pool
+        IKGridJob long_grid = grid;
+        long_grid.step_size = 0.0002;
+        auto cancel_start = high_resolution_clock::now();
+        IKJob<WeightedIKResult> job = pool.submit_grid(long_grid);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        job.cancel();
+        IKJobResult<WeightedIKResult> cancelled = job.get();
+        cout << "Cancelled sweep of " << (int)((long_grid.q7_end - long_grid.q7_start) / long_grid.step_size) + 1
+             << " samples after 2 ms: cancelled " << (cancelled.cancelled ? "yes" : "no") << ", returned after "
+             << std::setprecision(1) << since(cancel_start) / 1000.0 << " ms" << endl;
+    }
+    return 0;
+}
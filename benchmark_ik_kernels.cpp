@@ -0,0 +1,153 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <string>
+#include "geofik.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_ik_kernels.cpp geofik.cpp -O3 -o benchmark_ik_kernels.exe
+
+// Times each instantiation of the IK kernels against the runtime-flag entry point that gives the
+// same information: franka_ik_* for joint angles, franka_J_ik_* for Jacobians, franka_J_ik_* with
+// sqrt(det(J J^T)) per solution for manipulability. The links have no such entry point, they are
+// timed against franka_ik_* alone. Each figure is the fastest of several alternating passes over
+// the corpus.
+
+using namespace std::chrono;
+
+// Keeps the outputs alive so the timed calls are not optimized away
+static volatile double sink;
+
+// Free variable of a kernel, set from the configuration that produced the pose
+enum class FreeVariable { Q7, Q4, Q6, SWIVEL };
+
+struct KernelCase {
+    const char* name;
+    std::function<unsigned int(const PreparedTarget&, double)> kernel;
+    std::function<unsigned int(const PreparedTarget&, double)> baseline;
+    char Jacobian_ee;
+};
+
+// ns per call of one pass over the targets
+double time_pass(const std::vector<PreparedTarget>& targets, const std::vector<double>& values,
+                 const std::function<unsigned int(const PreparedTarget&, double)>& call) {
+    unsigned int total = 0;
+    auto start = high_resolution_clock::now();
+    for (size_t k = 0; k < targets.size(); k++) total += call(targets[k], values[k]);
+    double ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)targets.size();
+    sink = total;
+    return ns;
+}
+
+template <unsigned int Outputs>
+unsigned int run_kernel(FreeVariable fv, const PreparedTarget& target, double value, const IKKernelOutput& out) {
+    switch (fv) {
+        case FreeVariable::Q4: return franka_ik_q4_kernel<Outputs>(target, value, out);
+        case FreeVariable::Q6: return franka_ik_q6_kernel<Outputs>(target, value, out);
+        case FreeVariable::SWIVEL: return franka_ik_swivel_kernel<Outputs>(target, value, out);
+        default: return franka_ik_q7_kernel<Outputs>(target, value, out);
+    }
+}
+
+unsigned int run_ik(FreeVariable fv, const PreparedTarget& target, double value,
+                    array<array<double, 7>, 8>& qsols, IKValidity& validity) {
+    switch (fv) {
+        case FreeVariable::Q4: return franka_ik_q4(target, value, qsols, validity);
+        case FreeVariable::Q6: return franka_ik_q6(target, value, qsols, validity);
+        case FreeVariable::SWIVEL: return franka_ik_swivel(target, value, qsols, validity);
+        default: return franka_ik_q7(target, value, qsols, validity);
+    }
+}
+
+unsigned int run_J_ik(FreeVariable fv, const PreparedTarget& target, double value, array<array<array<double, 6>, 7>, 8>& Jsols,
+                      array<array<double, 7>, 8>& qsols, IKValidity& validity, bool joint_angles) {
+    switch (fv) {
+        case FreeVariable::Q4: return franka_J_ik_q4(target, value, Jsols, qsols, validity, joint_angles);
+        case FreeVariable::Q6: return franka_J_ik_q6(target, value, Jsols, qsols, validity, joint_angles);
+        case FreeVariable::SWIVEL: return franka_J_ik_swivel(target, value, Jsols, qsols, validity, joint_angles);
+        default: return franka_J_ik_q7(target, value, Jsols, qsols, validity, joint_angles);
+    }
+}
+
+int main() {
+    const int n_poses = 1000;
+    const int n_passes = 15;
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+
+    array<array<double, 7>, 8> qsols;
+    array<array<array<double, 6>, 7>, 8> Jsols;
+    array<double, 8> manipulability;
+    array<array<array<double, 3>, 2>, 8> links;
+    IKValidity validity;
+    IKKernelOutput out;
+    out.q = &qsols;
+    out.J = &Jsols;
+    out.manipulability = &manipulability;
+    out.links = &links;
+    out.validity = &validity;
+
+    cout << "=== IK KERNEL BENCHMARK ===" << endl;
+    cout << "Poses: " << n_poses << " (swivel: " << n_poses / 10 << "), fastest of " << n_passes
+         << " passes, ns per call" << endl;
+
+    const FreeVariable fvs[4] = { FreeVariable::Q7, FreeVariable::Q4, FreeVariable::Q6, FreeVariable::SWIVEL };
+    const char* fv_names[4] = { "q7", "q4", "q6", "swivel" };
+    for (int f = 0; f < 4; f++) {
+        FreeVariable fv = fvs[f];
+        int n = fv == FreeVariable::SWIVEL ? n_poses / 10 : n_poses;
+        std::vector<double> values(n);
+        for (int k = 0; k < n; k++) {
+            const std::array<double, 7>& q = corpus[k].q;
+            values[k] = fv == FreeVariable::Q4 ? q[3] : fv == FreeVariable::Q6 ? q[5] : fv == FreeVariable::SWIVEL ? franka_swivel(q) : q[6];
+        }
+
+        auto ik = [&](const PreparedTarget& t, double v) { return run_ik(fv, t, v, qsols, validity); };
+        auto J_ik = [&](bool joint_angles) {
+            return [&, joint_angles](const PreparedTarget& t, double v) { return run_J_ik(fv, t, v, Jsols, qsols, validity, joint_angles); };
+        };
+        const KernelCase cases[] = {
+            { "angles", [&](const PreparedTarget& t, double v) { return run_kernel<IK_ANGLES>(fv, t, v, out); }, ik, 'E' },
+            { "angles+validity", [&](const PreparedTarget& t, double v) { return run_kernel<IK_ANGLES | IK_VALIDITY>(fv, t, v, out); }, ik, 'E' },
+            { "J", [&](const PreparedTarget& t, double v) { return run_kernel<IK_JACOBIAN>(fv, t, v, out); }, J_ik(false), 'E' },
+            { "J+angles+validity", [&](const PreparedTarget& t, double v) { return run_kernel<IK_JACOBIAN | IK_ANGLES | IK_VALIDITY>(fv, t, v, out); }, J_ik(true), 'E' },
+            { "J wrist", [&](const PreparedTarget& t, double v) { return run_kernel<IK_JACOBIAN_WRIST>(fv, t, v, out); }, J_ik(false), '6' },
+            { "J wrist+angles+validity", [&](const PreparedTarget& t, double v) { return run_kernel<IK_JACOBIAN_WRIST | IK_ANGLES | IK_VALIDITY>(fv, t, v, out); }, J_ik(true), '6' },
+            { "manipulability", [&](const PreparedTarget& t, double v) { return run_kernel<IK_MANIPULABILITY | IK_ANGLES | IK_VALIDITY>(fv, t, v, out); },
+              [&](const PreparedTarget& t, double v) {
+                  unsigned int n_sols = run_J_ik(fv, t, v, Jsols, qsols, validity, true);
+                  for (unsigned int m = validity.valid; m; ) {
+                      int i = next_valid_solution(m);
+                      Eigen::Map<const Eigen::Matrix<double, 6, 7>> J(Jsols[i][0].data());
+                      manipulability[i] = sqrt((J * J.transpose()).determinant());
+                  }
+                  return n_sols;
+              }, 'E' },
+            { "links", [&](const PreparedTarget& t, double v) { return run_kernel<IK_LINKS>(fv, t, v, out); }, ik, 'E' },
+            { "links+angles+validity", [&](const PreparedTarget& t, double v) { return run_kernel<IK_LINKS | IK_ANGLES | IK_VALIDITY>(fv, t, v, out); }, ik, 'E' },
+        };
+
+        cout << endl << "--- " << fv_names[f] << " ---" << endl;
+        cout << std::left << std::setw(26) << "outputs" << std::right << std::setw(10) << "kernel"
+             << std::setw(12) << "runtime" << std::setw(9) << "ratio" << endl;
+        std::vector<PreparedTarget> targets_E(n), targets_6(n);
+        for (int k = 0; k < n; k++) {
+            prepare_target(corpus[k].position, corpus[k].orientation, targets_E[k], 'E');
+            prepare_target(corpus[k].position, corpus[k].orientation, targets_6[k], '6');
+        }
+        for (const KernelCase& c : cases) {
+            const std::vector<PreparedTarget>& targets = c.Jacobian_ee == '6' ? targets_6 : targets_E;
+            // Alternating passes, so both see the same machine state
+            double kernel_ns = 1e300, baseline_ns = 1e300;
+            for (int pass = 0; pass < n_passes; pass++) {
+                kernel_ns = std::min(kernel_ns, time_pass(targets, values, c.kernel));
+                baseline_ns = std::min(baseline_ns, time_pass(targets, values, c.baseline));
+            }
+            cout << std::left << std::setw(26) << c.name << std::right << std::fixed << std::setprecision(1)
+                 << std::setw(10) << kernel_ns << std::setw(12) << baseline_ns
+                 << std::setw(9) << std::setprecision(2) << kernel_ns / baseline_ns << endl;
+        }
+    }
+    cout << endl << "runtime: franka_ik_* (angles, links), franka_J_ik_* (Jacobians), franka_J_ik_* and sqrt(det(J J^T)) (manipulability)" << endl;
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <thread>
+#include <sys/wait.h>
+#include "ik_service.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_ik_service.cpp ik_service.cpp ik_dataset.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -lrt -o benchmark_ik_service.exe
+
+// Loopback benchmark of the shared-memory IK service: a forked server answers the requests
+// of this process and the round trip is compared against calling the solver in-process.
+
+struct LatencyStats {
+    double p50, p90, p99, max, mean;
+};
+
+LatencyStats latency_stats(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    LatencyStats stats;
+    auto percentile = [&](double p) { return samples[(size_t)(p * (samples.size() - 1))]; };
+    stats.p50 = percentile(0.50);
+    stats.p90 = percentile(0.90);
+    stats.p99 = percentile(0.99);
+    stats.max = samples.back();
+    stats.mean = 0.0;
+    for (double s : samples) stats.mean += s;
+    stats.mean /= samples.size();
+    return stats;
+}
+
+void report(const std::string& name, const LatencyStats& stats) {
+    cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(2)
+         << " p50: " << std::setw(9) << stats.p50
+         << "  p90: " << std::setw(9) << stats.p90
+         << "  p99: " << std::setw(9) << stats.p99
+         << "  max: " << std::setw(10) << stats.max
+         << "  mean: " << std::setw(9) << stats.mean << " μs" << endl;
+}
+
+IKRequest make_request(const BenchmarkPose& pose, IKServiceMode mode, const std::array<double, 7>& current_pose) {
+    IKRequest request;
+    request.id = 0;
+    request.mode = mode;
+    request.max_iterations = 100;
+    request.free_variable = pose.q[6];
+    request.range_min = 0.0;   // Full range
+    request.range_max = 0.0;
+    request.tolerance = 1e-6;
+    request.position = pose.position;
+    request.orientation = pose.orientation;
+    request.current_pose = current_pose;
+    return request;
+}
+
+// Round trips through a forked server, in microseconds. Returns false if the service failed.
+bool measure_service(const std::vector<IKRequest>& requests, IKWaitMode wait_mode, const std::string& name,
+                     WeightedIKSolver& solver, std::vector<double>& latencies) {
+    IKServer server(solver);
+    if (!server.create(name)) return false;
+    pid_t pid = fork();
+    if (pid < 0) {
+        cerr << "ERROR: fork failed" << endl;
+        return false;
+    }
+    if (pid == 0) {
+        server.run(wait_mode);
+        _exit(0);  // The parent owns the shared memory object
+    }
+
+    IKClient client;
+    bool ok = client.open(name);
+    IKResponse response;
+    latencies.clear();
+    for (size_t k = 0; ok && k < requests.size(); k++) {
+        IKRequest request = requests[k];
+        auto start = high_resolution_clock::now();
+        ok = client.call(request, response, wait_mode) && response.id == request.id;
+        latencies.push_back(duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() * 1e-3);
+    }
+    IKRequest shutdown = requests[0];
+    shutdown.mode = IKServiceMode::SHUTDOWN;
+    if (!client.call(shutdown, response, wait_mode)) server.stop();
+    waitpid(pid, nullptr, 0);
+    client.close();
+    server.close();
+    if (!ok) cerr << "ERROR: the service dropped a request" << endl;
+    return ok;
+}
+
+int main() {
+    const int n_poses = 500;
+    const int n_repeats = 4;
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+    const std::string name = "/geofik_bench_" + std::to_string(getpid());
+
+    cout << "=== SHARED-MEMORY IK SERVICE LOOPBACK BENCHMARK ===" << endl;
+    cout << "Requests: " << n_poses * n_repeats << " per run, hardware threads: "
+         << std::thread::hardware_concurrency() << endl;
+    if (std::thread::hardware_concurrency() < 2) {
+        cout << "(busy-polling client and server share one core, expect scheduler-bound latencies)" << endl;
+    }
+
+    const IKServiceMode modes[2] = { IKServiceMode::IK_Q7, IKServiceMode::OPT_Q7 };
+    const char* mode_names[2] = { "ik-q7", "opt-q7" };
+    for (int m = 0; m < 2; m++) {
+        std::vector<IKRequest> requests;
+        for (int r = 0; r < n_repeats; r++) {
+            for (const auto& pose : corpus) requests.push_back(make_request(pose, modes[m], neutral_pose));
+        }
+
+        // In-process baseline, same code path as the server minus the rings
+        std::vector<double> latencies;
+        IKResponse response;
+        for (const auto& request : requests) {
+            auto start = high_resolution_clock::now();
+            IKServer::handle(solver, request, response);
+            latencies.push_back(duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() * 1e-3);
+        }
+        cout << endl << "Mode " << mode_names[m] << ":" << endl;
+        LatencyStats in_process = latency_stats(latencies);
+        report("  in-process call", in_process);
+
+        const IKWaitMode wait_modes[2] = { IKWaitMode::BUSY_POLL, IKWaitMode::FUTEX };
+        const char* wait_names[2] = { "  shm round trip, poll", "  shm round trip, futex" };
+        for (int w = 0; w < 2; w++) {
+            if (!measure_service(requests, wait_modes[w], name, solver, latencies)) return 1;
+            LatencyStats stats = latency_stats(latencies);
+            report(wait_names[w], stats);
+            cout << std::left << std::setw(24) << "    transport overhead" << std::right
+                 << " p50: " << std::setw(9) << stats.p50 - in_process.p50 << " μs" << endl;
+        }
+    }
+    return 0;
+}
@@ -1,4 +1,8 @@
 #include "weighted_ik.h"
+#include "benchmark_corpus.h"
+#include <functional>
+#include <sstream>
+#include <thread>
 
 void run_benchmark(const std::string& test_name, double q7_min, double q7_max, double step_size) {
     // Test parameters
@@ -59,6 +63,123 @@ void run_benchmark(const std::string& test_name, double q7_min, double q7_max, d
     cout << endl << endl;
 }
 
+// Solver compared on the corpus, with its totals over the poses
+struct CorpusMethod {
+    std::string name;
+    std::function<WeightedIKResult(const BenchmarkPose&)> solve;
+    double evals = 0, microseconds = 0, shortfall = 0, gap = 0;
+    int worse = 0, violated = 0, with_gap = 0;
+};
+
+// Runs every method on each pose of the corpus. The reference score of a pose is the best any
+// method found; a certified result is violated if the reference beats it by more than its gap.
+void run_corpus_benchmark(const std::string& title, std::vector<CorpusMethod>& methods, int n_poses) {
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+    int n_solved = 0;
+    for (const BenchmarkPose& pose : corpus) {
+        std::vector<WeightedIKResult> results;
+        double reference = -std::numeric_limits<double>::infinity();
+        for (CorpusMethod& m : methods) {
+            auto start = std::chrono::high_resolution_clock::now();
+            results.push_back(m.solve(pose));
+            m.microseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            m.evals += results.back().q7_values_tested;
+            if (results.back().success) reference = std::max(reference, results.back().score);
+        }
+        if (std::isinf(reference)) continue;
+        n_solved++;
+        for (size_t k = 0; k < methods.size(); k++) {
+            // A failed method falls short by the whole reference score
+            double shortfall = results[k].success ? reference - results[k].score : fabs(reference);
+            methods[k].shortfall += shortfall;
+            if (shortfall > 1e-6) methods[k].worse++;
+            if (!std::isnan(results[k].optimality_gap)) {
+                methods[k].with_gap++;
+                methods[k].gap += results[k].optimality_gap;
+                if (shortfall > results[k].optimality_gap + 1e-9) methods[k].violated++;
+            }
+        }
+    }
+    
+    cout << "=== " << title << " ===" << endl;
+    cout << n_poses << " corpus poses (" << n_solved << " solvable), full q7 range, means per pose" << endl << endl;
+    cout << std::left << std::setw(22) << "method" << std::right << std::setw(9) << "evals" << std::setw(10) << "μs"
+         << std::setw(13) << "shortfall" << std::setw(8) << "worse" << std::setw(12) << "gap" << std::setw(10) << "violated" << endl;
+    for (const CorpusMethod& m : methods) {
+        cout << std::left << std::setw(22) << m.name << std::right << std::fixed << std::setprecision(0)
+             << std::setw(9) << m.evals / n_poses << std::setw(10) << m.microseconds / n_poses
+             << std::scientific << std::setprecision(2) << std::setw(13) << m.shortfall / std::max(1, n_solved)
+             << std::setw(8) << m.worse;
+        if (m.with_gap > 0) {
+            cout << std::setw(12) << m.gap / m.with_gap << std::setw(10) << m.violated;
+        }
+        cout << endl;
+    }
+    cout << "shortfall: reference score - score; worse: poses more than 1e-6 below the reference" << endl << endl;
+}
+
+const std::array<double, 7> corpus_neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+
+CorpusMethod grid_method(WeightedIKSolver& solver, double step) {
+    std::ostringstream name;
+    name << "grid " << step;
+    return { name.str(), [&solver, step](const BenchmarkPose& p) {
+        return solver.solve_q7(p.position, p.orientation, corpus_neutral_pose, q_low[6], q_up[6], step);
+    } };
+}
+
+CorpusMethod brent_method(WeightedIKSolver& solver) {
+    return { "Brent", [&solver](const BenchmarkPose& p) {
+        return solver.solve_q7_optimized(p.position, p.orientation, corpus_neutral_pose, q_low[6], q_up[6]);
+    } };
+}
+
+// Certified branch and bound against grids of several steps over the full q7 range, with a
+// 0.0005 rad grid among them for the reference
+void run_certified_benchmark(int n_poses) {
+    WeightedIKSolver solver(corpus_neutral_pose, 1.0, 0.5, 2.0, false);
+    auto certified = [&](double epsilon) {
+        std::ostringstream name;
+        name << "certified " << epsilon;
+        return CorpusMethod{ name.str(), [&solver, epsilon](const BenchmarkPose& p) {
+            CertifiedQ7Config config;
+            config.epsilon = epsilon;
+            return solver.solve_q7_certified(p.position, p.orientation, corpus_neutral_pose, q_low[6], q_up[6], config);
+        } };
+    };
+    std::vector<CorpusMethod> methods = {
+        grid_method(solver, 0.01), grid_method(solver, 0.002), grid_method(solver, 0.0005),
+        brent_method(solver), certified(1e-3), certified(1e-4),
+    };
+    run_corpus_benchmark("Certified Branch and Bound vs Grid", methods, n_poses);
+}
+
+// Brent on several brackets at once against one Brent search and the grid, wall time on all
+// hardware threads and on one
+void run_multi_bracket_benchmark(int n_poses) {
+    WeightedIKSolver solver(corpus_neutral_pose, 1.0, 0.5, 2.0, false);
+    int n_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    auto multi = [&](int n_brackets, bool aligned, int threads) {
+        std::ostringstream name;
+        name << "brackets " << n_brackets << (aligned ? " fe" : " eq") << " " << threads << "T";
+        return CorpusMethod{ name.str(), [&solver, n_brackets, aligned, threads](const BenchmarkPose& p) {
+            MultiBracketConfig config;
+            config.n_brackets = n_brackets;
+            config.align_to_feasible = aligned;
+            config.n_threads = threads;
+            return solver.solve_q7_multi_bracket(p.position, p.orientation, corpus_neutral_pose, q_low[6], q_up[6], config);
+        } };
+    };
+    std::vector<CorpusMethod> methods = {
+        grid_method(solver, 0.002), brent_method(solver),
+        multi(8, false, n_threads), multi(4, true, n_threads), multi(8, true, n_threads),
+        multi(16, true, n_threads), multi(8, true, 1),
+    };
+    run_corpus_benchmark("Multi-Bracket Brent vs Grid (" + std::to_string(n_threads) + " hardware threads)", methods, n_poses);
+    cout << "fe: brackets on the feasible intervals of a coarse scan, eq: equal parts of the range; "
+         << "the scan is included in evals and time" << endl << endl;
+}
+
 int main() {
     cout << "=== COMPREHENSIVE OPTIMIZATION BENCHMARK ===" << endl << endl;
     
@@ -77,6 +198,12 @@ int main() {
     // Test 5: Narrow range with very fine grid
     run_benchmark("Ultra-Fine Search", 0.4, 0.6, 0.0001);
     
+    // Test 6: Global optimality over the corpus
+    run_certified_benchmark(100);
+    
+    // Test 7: Several Brent brackets in parallel
+    run_multi_bracket_benchmark(100);
+    
     cout << "=== SUMMARY ===" << endl;
     cout << "The optimization method should show:" << endl;
     cout << "- Higher speedup for larger search ranges" << endl;
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include "weighted_ik.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_q7_tape.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o benchmark_q7_tape.exe
+
+// Re-scoring a recorded q7 sweep against solving it again: solve_q7 after a robot move and after
+// new weights, the best solution for many weight settings, and the Pareto front of the records.
+// Checks that the tape gives the same solutions as the sweep it replaces.
+
+static double microseconds_since(high_resolution_clock::time_point start) {
+    return duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+}
+
+static bool same_solution(const WeightedIKResult& a, const WeightedIKResult& b) {
+    return a.success == b.success && (!a.success || (a.score == b.score && a.q7_optimal == b.q7_optimal
+           && a.joint_angles == b.joint_angles && a.solution_index == b.solution_index));
+}
+
+int main() {
+    const int n_poses = 50;
+    const int n_weights = 100;
+    const double step = 0.002;
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses + 1);
+
+    // Weight settings of a tuning grid
+    std::vector<std::array<double, 3>> weights;
+    for (int i = 0; i < n_weights; i++) {
+        weights.push_back({ 0.5 + 0.1 * (i % 10), 0.1 * (i / 10), 2.0 });
+    }
+
+    double sweep_us = 0, record_us = 0, rescore_us = 0, weights_direct_us = 0, weights_tape_us = 0, front_us = 0;
+    double max_jacobian_diff = 0;
+    int mismatches = 0;
+    size_t records = 0, front_size = 0;
+    Q7SampleTape tape;
+    std::vector<WeightedIKResult> sweep_results;
+    std::vector<Q7TapeObjectives> front;
+    for (int k = 0; k < n_poses; k++) {
+        const BenchmarkPose& pose = corpus[k];
+        // The robot moves to the configuration of the next pose between solves
+        const std::array<double, 7>& moved = corpus[k + 1].q;
+        solver.update_weights(1.0, 0.5, 2.0);
+
+        auto start = high_resolution_clock::now();
+        WeightedIKResult direct = solver.solve_q7(pose.position, pose.orientation, neutral_pose, q_low[6], q_up[6], step);
+        sweep_us += microseconds_since(start);
+        start = high_resolution_clock::now();
+        solver.record_q7_tape(pose.position, pose.orientation, q_low[6], q_up[6], step, tape);
+        record_us += microseconds_since(start);
+        records += tape.records.size();
+
+        // Same current pose, moved robot, new weights: tape against a fresh sweep
+        for (int variant = 0; variant < 3; variant++) {
+            const std::array<double, 7>& current = variant == 0 ? neutral_pose : moved;
+            if (variant == 2) solver.update_weights(0.7, 1.0, 0.5);
+            if (variant > 0) direct = solver.solve_q7(pose.position, pose.orientation, current, q_low[6], q_up[6], step);
+            start = high_resolution_clock::now();
+            WeightedIKResult rescored = solver.solve_q7(tape, current);
+            rescore_us += microseconds_since(start) / 3;
+            if (!same_solution(direct, rescored)) mismatches++;
+            for (int j = 0; j < 7; j++) {
+                for (int i = 0; i < 6; i++) {
+                    max_jacobian_diff = std::max(max_jacobian_diff, fabs(direct.jacobian[j][i] - rescored.jacobian[j][i]));
+                }
+            }
+        }
+
+        // Weight sweep: the first 10 poses also against one solve_q7 per setting
+        start = high_resolution_clock::now();
+        solver.solve_q7_weight_sweep(tape, moved, weights, sweep_results);
+        weights_tape_us += microseconds_since(start);
+        if (k < 10) {
+            for (int w = 0; w < n_weights; w++) {
+                solver.update_weights(weights[w][0], weights[w][1], weights[w][2]);
+                start = high_resolution_clock::now();
+                direct = solver.solve_q7(pose.position, pose.orientation, moved, q_low[6], q_up[6], step);
+                weights_direct_us += microseconds_since(start);
+                if (!same_solution(direct, sweep_results[w])) mismatches++;
+            }
+        }
+
+        start = high_resolution_clock::now();
+        solver.q7_pareto_front(tape, moved, front);
+        front_us += microseconds_since(start);
+        front_size += front.size();
+    }
+
+    cout << "=== Q7 SAMPLE TAPE BENCHMARK ===" << endl;
+    cout << n_poses << " corpus poses, full q7 range, step " << step << " (" << (int)((q_up[6] - q_low[6]) / step) + 1
+         << " samples, " << records / n_poses << " valid solutions on average)" << endl << endl;
+    cout << std::fixed << std::setprecision(1);
+    cout << "solve_q7 sweep:                  " << std::setw(9) << sweep_us / n_poses << " μs" << endl;
+    cout << "record_q7_tape:                  " << std::setw(9) << record_us / n_poses << " μs" << endl;
+    cout << "solve_q7 on the tape:            " << std::setw(9) << rescore_us / n_poses << " μs  ("
+         << std::setprecision(0) << sweep_us / rescore_us << "x faster than the sweep)" << std::setprecision(1) << endl;
+    cout << n_weights << " weight settings, sweeps: " << std::setw(9) << weights_direct_us / 10 << " μs" << endl;
+    cout << n_weights << " weight settings, tape:   " << std::setw(9) << weights_tape_us / n_poses << " μs  ("
+         << std::setprecision(0) << (weights_direct_us / 10) / (weights_tape_us / n_poses) << "x)" << std::setprecision(1) << endl;
+    cout << "Pareto front:                    " << std::setw(9) << front_us / n_poses << " μs, "
+         << front_size / n_poses << " records on average" << endl << endl;
+    cout << "Results differing from a fresh sweep: " << mismatches << " of " << 3 * n_poses + 10 * n_weights
+         << ", largest Jacobian difference " << std::scientific << std::setprecision(2) << max_jacobian_diff << endl;
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include "weighted_ik.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_redundancy_params.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o benchmark_redundancy_params.exe
+
+struct ParamStats {
+    int successes = 0;
+    long evaluations = 0;
+    long duration_us = 0;
+    double score_sum = 0.0;
+};
+
+void report(const std::string& name, const ParamStats& stats, int n_poses) {
+    cout << std::left << std::setw(10) << name << std::right
+         << " success: " << std::setw(5) << std::fixed << std::setprecision(1) << 100.0 * stats.successes / n_poses << "%"
+         << ", evals/solve: " << std::setw(7) << std::setprecision(1) << (double)stats.evaluations / n_poses
+         << ", time/solve: " << std::setw(8) << std::setprecision(1) << (double)stats.duration_us / n_poses << " μs"
+         << ", mean score: " << std::setprecision(6)
+         << (stats.successes > 0 ? stats.score_sum / stats.successes : 0.0) << endl;
+}
+
+int main() {
+    const int n_poses = 200;
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false); // verbose = false for benchmarking
+    
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+    
+    const RedundancyParam params[4] = { RedundancyParam::Q7, RedundancyParam::Q4,
+                                        RedundancyParam::Q6, RedundancyParam::SWIVEL };
+    ParamStats stats[4];
+    ParamStats auto_stats;
+    int auto_choices[4] = { 0, 0, 0, 0 };
+    
+    cout << "=== REDUNDANCY PARAMETERIZATION BENCHMARK ===" << endl;
+    cout << "Poses: " << n_poses << ", full joint/swivel range per parameterization" << endl << endl;
+    
+    for (const auto& pose : corpus) {
+        // Current pose is the neutral pose so every target needs a real move
+        const std::array<double, 7>& current_pose = neutral_pose;
+        for (int p = 0; p < 4; p++) {
+            double lower, upper;
+            redundancy_param_limits(params[p], lower, upper);
+            WeightedIKResult result;
+            switch (params[p]) {
+                case RedundancyParam::Q4:
+                    result = solver.solve_q4_optimized(pose.position, pose.orientation, current_pose, lower, upper);
+                    break;
+                case RedundancyParam::Q6:
+                    result = solver.solve_q6_optimized(pose.position, pose.orientation, current_pose, lower, upper);
+                    break;
+                case RedundancyParam::SWIVEL:
+                    result = solver.solve_swivel_optimized(pose.position, pose.orientation, current_pose, lower, upper);
+                    break;
+                default:
+                    result = solver.solve_q7_optimized(pose.position, pose.orientation, current_pose, lower, upper);
+                    break;
+            }
+            stats[p].evaluations += result.q7_values_tested;
+            stats[p].duration_us += result.duration_microseconds;
+            if (result.success) {
+                stats[p].successes++;
+                stats[p].score_sum += result.score;
+            }
+        }
+        
+        WeightedIKResult result = solver.solve_auto_optimized(pose.position, pose.orientation, current_pose);
+        auto_stats.evaluations += result.q7_values_tested;
+        auto_stats.duration_us += result.duration_microseconds;
+        if (result.success) {
+            auto_stats.successes++;
+            auto_stats.score_sum += result.score;
+            auto_choices[(int)result.parameterization]++;
+        }
+    }
+    
+    for (int p = 0; p < 4; p++) {
+        report(redundancy_param_name(params[p]), stats[p], n_poses);
+    }
+    report("Auto", auto_stats, n_poses);
+    
+    cout << endl << "Auto mode choices:";
+    for (int p = 0; p < 4; p++) {
+        cout << " " << redundancy_param_name(params[p]) << "=" << auto_choices[p];
+    }
+    cout << endl;
+    
+    return 0;
+}
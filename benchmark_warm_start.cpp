@@ -0,0 +1,102 @@
+#include <random>
+#include <algorithm>
+#include "weighted_ik.h"
+#include "warm_start_index.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_warm_start.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o benchmark_warm_start.exe
+
+// Replays a stream of targets that revisit a set of work poses with small variations, as a
+// long-running cell does, and compares solve_q7_optimized with and without a WarmStartIndex.
+
+struct StreamTarget {
+    std::array<double, 3> position;
+    std::array<double, 9> orientation;
+};
+
+int main() {
+    const int n_work_poses = 200;
+    const int n_targets = 4000;
+    const double joint_noise = 0.02;  // rad, spread of the revisits around a work pose
+
+    std::vector<BenchmarkPose> work_poses = make_benchmark_corpus(n_work_poses);
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> pick(0, n_work_poses - 1);
+    std::normal_distribution<double> noise(0.0, joint_noise);
+    std::vector<StreamTarget> stream;
+    for (int k = 0; k < n_targets; k++) {
+        std::array<double, 7> q = work_poses[pick(rng)].q;
+        for (int j = 0; j < 7; j++) q[j] = std::min(q_up[j], std::max(q_low[j], q[j] + noise(rng)));
+        Eigen::Matrix4d T = franka_fk(q);
+        stream.push_back({ { T(0, 3), T(1, 3), T(2, 3) },
+                           { T(0, 0), T(0, 1), T(0, 2), T(1, 0), T(1, 1), T(1, 2), T(2, 0), T(2, 1), T(2, 2) } });
+    }
+
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver cold(neutral_pose, 1.0, 0.5, 2.0, false);
+    WeightedIKSolver warm(neutral_pose, 1.0, 0.5, 2.0, false);
+    WarmStartIndexConfig config;
+    config.capacity = 1024;
+    WarmStartIndex index(config);
+    warm.set_warm_start_index(&index);
+
+    cout << "=== WARM-START INDEX BENCHMARK ===" << endl;
+    cout << "Stream: " << n_targets << " targets around " << n_work_poses << " work poses (joint noise "
+         << joint_noise << " rad), index capacity " << config.capacity << ", match radius " << config.match_radius << endl;
+
+    struct Stats { int successes = 0; long evals = 0; long us = 0; };
+    Stats cold_stats, warm_stats;
+    int hits = 0, better = 0, worse = 0;
+    double seed_error = 0.0, score_loss = 0.0, max_score_loss = 0.0;
+    for (const auto& target : stream) {
+        WarmStartHit hit;
+        bool is_hit = index.nearest(RedundancyParam::Q7, target.position, target.orientation, hit);
+
+        WeightedIKResult c = cold.solve_q7_optimized(target.position, target.orientation, neutral_pose, q_low[6], q_up[6]);
+        WeightedIKResult w = warm.solve_q7_optimized(target.position, target.orientation, neutral_pose, q_low[6], q_up[6]);
+        cold_stats.evals += c.q7_values_tested;
+        cold_stats.us += c.duration_microseconds;
+        cold_stats.successes += c.success;
+        warm_stats.evals += w.q7_values_tested;
+        warm_stats.us += w.duration_microseconds;
+        warm_stats.successes += w.success;
+
+        if (is_hit) {
+            hits++;
+            if (c.success) seed_error += fabs(hit.q7 - c.q7_optimal);
+        }
+        if (c.success && w.success) {
+            double gap = w.score - c.score;
+            if (gap > 1e-9) better++;
+            if (gap < -1e-9) {
+                worse++;
+                score_loss += -gap;
+                max_score_loss = std::max(max_score_loss, -gap);
+            }
+        }
+    }
+
+    cout << std::fixed << std::setprecision(1);
+    cout << endl << "Hit rate: " << 100.0 * hits / n_targets << "%"
+         << ", mean |seed q7 - optimal q7| " << std::setprecision(4) << seed_error / std::max(1, hits) << " rad" << endl;
+    cout << std::setprecision(1);
+    cout << "  cold:  success " << 100.0 * cold_stats.successes / n_targets << "%, evals/solve "
+         << (double)cold_stats.evals / n_targets << ", time/solve " << (double)cold_stats.us / n_targets << " μs" << endl;
+    cout << "  warm:  success " << 100.0 * warm_stats.successes / n_targets << "%, evals/solve "
+         << (double)warm_stats.evals / n_targets << ", time/solve " << (double)warm_stats.us / n_targets << " μs" << endl;
+    cout << "  warm better on " << better << " targets, worse on " << worse << " (mean loss "
+         << std::setprecision(6) << score_loss / std::max(1, worse) << ", max " << max_score_loss << ")" << endl;
+
+    // Query cost of a full index
+    const int n_queries = 200000;
+    int found = 0;
+    auto start = high_resolution_clock::now();
+    for (int k = 0; k < n_queries; k++) {
+        WarmStartHit hit;
+        found += index.nearest(RedundancyParam::Q7, stream[k % n_targets].position, stream[k % n_targets].orientation, hit);
+    }
+    double query_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)n_queries;
+    cout << endl << "nearest(): " << std::setprecision(1) << query_ns << " ns with " << index.size() << " entries ("
+         << found << " hits)" << endl;
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include <random>
+#include "weighted_ik.h"
+#include "workspace_map.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 benchmark_workspace_map.cpp workspace_map.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o benchmark_workspace_map.exe
+// usage: benchmark_workspace_map.exe MAP   (build MAP with build_workspace_map first)
+
+// Measures lookup cost, rejection accuracy and the effect of bracket seeding on
+// solve_q7_optimized, using a map built by build_workspace_map.
+
+// Uniformly random rotation (row-first) from a random unit quaternion
+std::array<double, 9> random_orientation(std::mt19937& rng) {
+    std::normal_distribution<double> normal(0.0, 1.0);
+    double w = normal(rng), x = normal(rng), y = normal(rng), z = normal(rng);
+    double n = sqrt(w * w + x * x + y * y + z * z);
+    w /= n; x /= n; y /= n; z /= n;
+    return { 1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y),
+             2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+             2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y) };
+}
+
+// Ground truth: any valid solution on a dense q7 sweep
+bool reachable(const std::array<double, 3>& position, const std::array<double, 9>& orientation) {
+    std::array<std::array<double, 7>, 8> qsols;
+    for (int s = 0; s < 128; s++) {
+        double q7 = q_low[6] + s * (q_up[6] - q_low[6]) / 127;
+        unsigned int nsols = franka_ik_q7(position, orientation, q7, qsols);
+        for (unsigned int b = 0; b < nsols; b++) {
+            bool valid = true;
+            for (double q : qsols[b]) valid = valid && !std::isnan(q);
+            if (valid) return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " MAP" << endl;
+        return 1;
+    }
+    WorkspaceMap map;
+    if (!map.open(argv[1])) return 1;
+    const WorkspaceMapHeader& h = map.header();
+    cout << "=== WORKSPACE MAP BENCHMARK ===" << endl;
+    cout << "Map: " << h.dims[0] << "x" << h.dims[1] << "x" << h.dims[2] << " voxels of " << h.voxel_size << " m x "
+         << h.n_polar << "x" << h.n_azimuth << "x" << h.n_roll << " orientations, " << h.n_q7_samples << " q7 samples" << endl;
+
+    // Random targets in the mapped box, split by ground truth
+    std::mt19937 rng(7);
+    const int n_random = 2000;
+    std::vector<std::array<double, 3>> positions;
+    std::vector<std::array<double, 9>> orientations;
+    std::vector<bool> truth;
+    for (int k = 0; k < n_random; k++) {
+        std::array<double, 3> p;
+        for (int a = 0; a < 3; a++) {
+            std::uniform_real_distribution<double> u(h.origin[a], h.origin[a] + h.dims[a] * h.voxel_size);
+            p[a] = u(rng);
+        }
+        positions.push_back(p);
+        orientations.push_back(random_orientation(rng));
+        truth.push_back(reachable(p, orientations.back()));
+    }
+
+    // Lookup cost
+    const int n_lookups = 1000000;
+    long flags_sum = 0;
+    auto start = high_resolution_clock::now();
+    for (int k = 0; k < n_lookups; k++) {
+        const WorkspaceCell* cell = map.lookup(positions[k % n_random], orientations[k % n_random]);
+        if (cell) flags_sum += cell->flags;
+    }
+    double lookup_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / (double)n_lookups;
+    cout << endl << "Lookup: " << std::fixed << std::setprecision(1) << lookup_ns << " ns (checksum " << flags_sum << ")" << endl;
+
+    int n_reachable = 0, n_unreachable = 0, rejected_reachable = 0, rejected_unreachable = 0;
+    for (int k = 0; k < n_random; k++) {
+        bool rejected = map.unreachable(positions[k], orientations[k]);
+        if (truth[k]) { n_reachable++; rejected_reachable += rejected; }
+        else { n_unreachable++; rejected_unreachable += rejected; }
+    }
+    cout << "Random targets in the box: " << n_reachable << " reachable, " << n_unreachable << " unreachable" << endl;
+    cout << "  unreachable rejected instantly: " << std::setprecision(1)
+         << 100.0 * rejected_unreachable / std::max(1, n_unreachable) << "%" << endl;
+    cout << "  reachable rejected by mistake:  " << 100.0 * rejected_reachable / std::max(1, n_reachable) << "%" << endl;
+
+    // Optimization with and without the map
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver plain(neutral_pose, 1.0, 0.5, 2.0, false);
+    WeightedIKSolver mapped(neutral_pose, 1.0, 0.5, 2.0, false);
+    mapped.set_workspace_map(&map);
+
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(500);
+    struct Stats { int successes = 0; long evals = 0; long us = 0; double score = 0.0; };
+    Stats stats[2];
+    int better = 0, worse = 0;
+    WeightedIKSolver* solvers[2] = { &plain, &mapped };
+    for (const auto& pose : corpus) {
+        WeightedIKResult results[2];
+        for (int s = 0; s < 2; s++) {
+            results[s] = solvers[s]->solve_q7_optimized(pose.position, pose.orientation, neutral_pose, q_low[6], q_up[6]);
+            stats[s].evals += results[s].q7_values_tested;
+            stats[s].us += results[s].duration_microseconds;
+            if (results[s].success) {
+                stats[s].successes++;
+                stats[s].score += results[s].score;
+            }
+        }
+        double gap = (results[1].success ? results[1].score : -1e9) - (results[0].success ? results[0].score : -1e9);
+        if (gap > 1e-9) better++;
+        if (gap < -1e-9) worse++;
+    }
+    cout << endl << "solve_q7_optimized on " << corpus.size() << " reachable corpus poses:" << endl;
+    const char* names[2] = { "  full range:  ", "  map-seeded:  " };
+    for (int s = 0; s < 2; s++) {
+        cout << names[s] << "success " << std::setprecision(1) << 100.0 * stats[s].successes / corpus.size() << "%"
+             << ", evals/solve " << (double)stats[s].evals / corpus.size()
+             << ", time/solve " << (double)stats[s].us / corpus.size() << " μs"
+             << ", mean score " << std::setprecision(6) << stats[s].score / std::max(1, stats[s].successes) << endl;
+    }
+    cout << "  map-seeded better on " << better << " poses, worse on " << worse << endl;
+
+    // Rejection cost against a full failing solve
+    long plain_us = 0, mapped_us = 0;
+    int n_failed = 0;
+    for (int k = 0; k < n_random; k++) {
+        if (truth[k]) continue;
+        plain_us += plain.solve_q7_optimized(positions[k], orientations[k], neutral_pose, q_low[6], q_up[6]).duration_microseconds;
+        mapped_us += mapped.solve_q7_optimized(positions[k], orientations[k], neutral_pose, q_low[6], q_up[6]).duration_microseconds;
+        n_failed++;
+    }
+    cout << endl << "Unreachable targets: " << std::setprecision(1) << (double)plain_us / std::max(1, n_failed)
+         << " μs/solve without the map, " << (double)mapped_us / std::max(1, n_failed) << " μs/solve with it" << endl;
+    return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file    build_workspace_map.cpp
+ * @brief   offline builder of the workspace reachability/dexterity map of workspace_map.h.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <unistd.h>
+#include "weighted_ik.h"
+#include "workspace_map.h"
+
+// compile with: g++ -I/usr/include/eigen3 build_workspace_map.cpp workspace_map.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o build_workspace_map
+
+static int parse_doubles(const char* text, double* values, int n) {
+    int count = 0;
+    char* end;
+    while (count < n) {
+        double v = strtod(text, &end);
+        if (end == text) break;
+        values[count++] = v;
+        text = end;
+        while (*text == ',' || *text == ' ') text++;
+    }
+    return count;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -o FILE         output map (default workspace.map)\n"
+        "  -b X0,Y0,Z0,X1,Y1,Z1  position box in m (default -0.9,-0.9,-0.4,0.9,0.9,1.3)\n"
+        "  -r SIZE         voxel edge in m (default 0.1)\n"
+        "  -a P,A,R        orientation bins: approach polar, approach azimuth, roll (default 6,12,8)\n"
+        "  -s N            q7 samples per cell, 2 to 255 (default 32)\n"
+        "  -j N            threads (default: hardware concurrency)\n", program);
+}
+
+int main(int argc, char** argv) {
+    std::string path = "workspace.map";
+    WorkspaceMapSpec spec;
+    double box[6] = { -0.9, -0.9, -0.4, 0.9, 0.9, 1.3 };
+    double bins[3];
+    int n_threads = 0;
+
+    int opt;
+    bool valid = true;
+    while ((opt = getopt(argc, argv, "o:b:r:a:s:j:h")) != -1 && valid) {
+        switch (opt) {
+            case 'o': path = optarg; break;
+            case 'b': valid = parse_doubles(optarg, box, 6) == 6; break;
+            case 'r': spec.voxel_size = atof(optarg); break;
+            case 'a':
+                valid = parse_doubles(optarg, bins, 3) == 3;
+                spec.n_polar = (uint32_t)bins[0];
+                spec.n_azimuth = (uint32_t)bins[1];
+                spec.n_roll = (uint32_t)bins[2];
+                break;
+            case 's': spec.n_q7_samples = (uint32_t)atoi(optarg); break;
+            case 'j': n_threads = atoi(optarg); break;
+            default: valid = false; break;
+        }
+    }
+    if (!valid || !(spec.voxel_size > 0.0)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    for (int a = 0; a < 3; a++) {
+        spec.origin[a] = box[a];
+        spec.dims[a] = box[a + 3] > box[a] ? (uint32_t)ceil((box[a + 3] - box[a]) / spec.voxel_size - 1e-9) : 0;
+    }
+
+    uint64_t n_cells = (uint64_t)spec.dims[0] * spec.dims[1] * spec.dims[2] * spec.n_polar * spec.n_azimuth * spec.n_roll;
+    cerr << "Building " << path << ": " << spec.dims[0] << "x" << spec.dims[1] << "x" << spec.dims[2] << " voxels x "
+         << spec.n_polar << "x" << spec.n_azimuth << "x" << spec.n_roll << " orientations = " << n_cells << " cells, "
+         << spec.n_q7_samples << " q7 samples each" << endl;
+    auto start = high_resolution_clock::now();
+    if (!build_workspace_map(path, spec, n_threads, true)) return 1;
+    double seconds = duration_cast<milliseconds>(high_resolution_clock::now() - start).count() * 1e-3;
+    cerr << "Done in " << std::fixed << std::setprecision(1) << seconds << " s ("
+         << n_cells * sizeof(WorkspaceCell) / 1048576.0 << " MiB of cells)" << endl;
+    return 0;
+}
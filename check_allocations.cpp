@@ -0,0 +1,309 @@
+/**
+ * @file    check_allocations.cpp
+ * @brief   verifies that the IK, FK and weighted-solve entry points never touch the heap.
+ *
+ * @details Replaces malloc and friends for the whole process (operator new goes through
+ *          malloc too) and counts the calls made while an entry point is running. Every entry
+ *          point is run over the 2000 poses of the benchmark corpus the other benchmarks use,
+ *          without warm-up, after the solvers, the collision scene, the warm-start index and a
+ *          coarse workspace map have been set up. Exits with status 1 and lists the offenders if
+ *          any allocation happened. glibc only: the replacements forward to its __libc_*
+ *          implementations.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include "weighted_ik.h"
+#include "anytime_ik.h"
+#include "continuation_ik.h"
+#include "ik_service.h"
+#include "warm_start_index.h"
+#include "workspace_map.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 check_allocations.cpp anytime_ik.cpp continuation_ik.cpp ik_service.cpp ik_dataset.cpp workspace_map.cpp weighted_ik.cpp geofik.cpp -O2 -pthread -lrt -o check_allocations
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+static volatile bool g_tracking = false;
+static volatile long g_allocations = 0;
+
+// Results of the entry points land here so nothing is optimized away
+static volatile double sink = 0.0;
+
+static inline void note_allocation() {
+    if (g_tracking) g_allocations = g_allocations + 1;
+}
+
+extern "C" {
+void* malloc(size_t size) {
+    note_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    note_allocation();
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    note_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    note_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    note_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    note_allocation();
+    void* p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+}
+
+struct EntryPointReport {
+    const char* name;
+    long calls;
+    long allocations;
+};
+
+// Runs body once per corpus pose with allocation tracking enabled
+template <typename Body>
+EntryPointReport check(const char* name, const std::vector<BenchmarkPose>& corpus, Body body) {
+    EntryPointReport report = { name, 0, 0 };
+    for (const auto& pose : corpus) {
+        g_allocations = 0;
+        g_tracking = true;
+        body(pose);
+        g_tracking = false;
+        report.calls++;
+        report.allocations += g_allocations;
+    }
+    return report;
+}
+
+int main() {
+    const int n_poses = 2000;
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+    AnytimeIKSolver anytime(solver);
+    ContinuationIKSolver tracker(solver);
+    // The obstacles are stored in vectors, filled here
+    CollisionModel scene;
+    scene.add_plane({ 0.0, 0.0, 1.0 }, 0.0);
+    scene.add_box({ 0.55, 0.0, 0.15 }, { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0.1, 0.25, 0.15 });
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+    // Tape of the grid sweep of solve_q7 below, reserved for its samples
+    Q7SampleTape tape;
+    tape.reserve(Q7Sweep(corpus[0].position, corpus[0].orientation, q_low[6], q_up[6], 0.1).size());
+    // The index allocates its entries in the constructor; a coarse map is enough for the seeding path
+    WarmStartIndex index;
+    WorkspaceMapSpec spec;
+    spec.voxel_size = 0.3;
+    spec.dims = { 6, 6, 6 };
+    spec.n_q7_samples = 16;
+    const std::string map_path = "check_allocations.map";
+    WorkspaceMap map;
+    if (!build_workspace_map(map_path, spec) || !map.open(map_path)) {
+        fprintf(stderr, "ERROR: could not build the workspace map %s\n", map_path.c_str());
+        return 1;
+    }
+    remove(map_path.c_str());
+    std::vector<EntryPointReport> reports;
+    reports.reserve(48);
+
+    // Results land in these so nothing is optimized away
+    static std::array<std::array<double, 7>, 8> qsols;
+    static std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
+    static IKSolutionSet sols;
+    static FrankaFrames frames;
+    static PreparedTarget target;
+    static IKValidity validity;
+
+    reports.push_back(check("franka_fk", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_fk(p.q)(0, 3);
+    }));
+    reports.push_back(check("franka_fk_all_frames", corpus, [&](const BenchmarkPose& p) {
+        franka_fk_all_frames(p.q, frames);
+        sink = frames.p[9][0];
+    }));
+    reports.push_back(check("J_from_q", corpus, [&](const BenchmarkPose& p) {
+        sink = J_from_q(p.q)[0][0];
+    }));
+    reports.push_back(check("franka_swivel", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_swivel(p.q);
+    }));
+    reports.push_back(check("franka_ik_q7", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_ik_q7(p.position, p.orientation, p.q[6], qsols);
+    }));
+    reports.push_back(check("franka_ik_q4", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_ik_q4(p.position, p.orientation, p.q[3], qsols);
+    }));
+    reports.push_back(check("franka_ik_q6", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_ik_q6(p.position, p.orientation, p.q[5], qsols);
+    }));
+    reports.push_back(check("franka_ik_swivel", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_ik_swivel(p.position, p.orientation, franka_swivel(p.q), qsols);
+    }));
+    reports.push_back(check("franka_J_ik_q7", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_J_ik_q7(p.position, p.orientation, p.q[6], Jsols, qsols, true);
+    }));
+    reports.push_back(check("franka_J_ik_q4", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_J_ik_q4(p.position, p.orientation, p.q[3], Jsols, qsols, true);
+    }));
+    reports.push_back(check("franka_J_ik_q6", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_J_ik_q6(p.position, p.orientation, p.q[5], Jsols, qsols, true);
+    }));
+    reports.push_back(check("franka_J_ik_swivel", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_J_ik_swivel(p.position, p.orientation, franka_swivel(p.q), Jsols, qsols, true);
+    }));
+    reports.push_back(check("franka_J_ik_q7_branch", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_J_ik_q7_branch(p.position, p.orientation, p.q[6], franka_q7_branch(p.q), Jsols[0], qsols[0]);
+    }));
+    reports.push_back(check("franka_ik_q7_compact", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_ik_q7_compact(p.position, p.orientation, p.q[6], sols, true);
+    }));
+    reports.push_back(check("franka_ik_q7_manipulability", corpus, [&](const BenchmarkPose& p) {
+        sink = franka_ik_q7_manipulability(p.position, p.orientation, p.q[6], sols);
+    }));
+    reports.push_back(check("PreparedTarget overloads", corpus, [&](const BenchmarkPose& p) {
+        prepare_target(p.position, p.orientation, target);
+        sink = franka_ik_q7(target, p.q[6], qsols, validity);
+        sink = franka_ik_q4(target, p.q[3], qsols, validity);
+        sink = franka_ik_q6(target, p.q[5], qsols, validity);
+        sink = franka_ik_swivel(target, franka_swivel(p.q), qsols, validity);
+        sink = franka_J_ik_q7(target, p.q[6], Jsols, qsols, validity, true);
+        sink = franka_J_ik_q4(target, p.q[3], Jsols, qsols, validity, true);
+        sink = franka_J_ik_q6(target, p.q[5], Jsols, qsols, validity, true);
+        sink = franka_J_ik_swivel(target, franka_swivel(p.q), Jsols, qsols, validity, true);
+    }));
+    reports.push_back(check("PreparedTarget compact", corpus, [&](const BenchmarkPose& p) {
+        prepare_target(p.position, p.orientation, target);
+        sink = franka_ik_q7_compact(target, p.q[6], sols, true);
+        sink = franka_ik_q7_manipulability(target, p.q[6], sols);
+        sink = franka_ik_q4_compact(target, p.q[3], sols, true);
+        sink = franka_ik_q6_compact(target, p.q[5], sols, true);
+        sink = franka_ik_swivel_compact(target, franka_swivel(p.q), sols, true);
+    }));
+    reports.push_back(check("PreparedTarget branch", corpus, [&](const BenchmarkPose& p) {
+        prepare_target(p.position, p.orientation, target);
+        unsigned int branch = franka_q7_branch(p.q);
+        sink = franka_ik_q7_branch(target, p.q[6], branch, qsols[0]);
+        sink = franka_J_ik_q7_branch(target, p.q[6], branch, Jsols[0], qsols[0]);
+        sink = franka_ik_q7_branch_compact(target, p.q[6], branch, sols, true);
+        sink = franka_ik_q7_branch_manipulability(target, p.q[6], branch, sols);
+    }));
+    reports.push_back(check("solve_q7 (grid)", corpus, [&](const BenchmarkPose& p) {
+        sink = solver.solve_q7(p.position, p.orientation, neutral_pose, q_low[6], q_up[6], 0.1).score;
+    }));
+    reports.push_back(check("solve_q7 (tape)", corpus, [&](const BenchmarkPose& p) {
+        // Records the sweep, then re-scores it from another current pose
+        solver.set_q7_tape(&tape);
+        sink = solver.solve_q7(p.position, p.orientation, neutral_pose, q_low[6], q_up[6], 0.1).score;
+        sink = solver.solve_q7(p.position, p.orientation, p.q, q_low[6], q_up[6], 0.1).score;
+        solver.set_q7_tape(nullptr);
+    }));
+    reports.push_back(check("solve_q7_optimized", corpus, [&](const BenchmarkPose& p) {
+        sink = solver.solve_q7_optimized(p.position, p.orientation, neutral_pose, q_low[6], q_up[6]).score;
+    }));
+    reports.push_back(check("solve_q7 (one branch)", corpus, [&](const BenchmarkPose& p) {
+        solver.set_branch(franka_q7_branch(p.q));
+        sink = solver.solve_q7_optimized(p.position, p.orientation, p.q, q_low[6], q_up[6]).score;
+        solver.set_branch(-1);
+    }));
+    reports.push_back(check("franka_fk_frames_soa", corpus, [&](const BenchmarkPose& p) {
+        static std::array<double, 90> R;
+        static std::array<double, 30> P;
+        franka_fk_frames_soa(p.q.data(), 1, FRANKA_FRAMES_ALL, { R.data(), P.data(), 1 });
+        sink = R[0] + P[29];
+    }));
+    reports.push_back(check("CollisionModel::clearance", corpus, [&](const BenchmarkPose& p) {
+        sink = scene.clearance(p.q);
+    }));
+    reports.push_back(check("solve_q7 (collision model)", corpus, [&](const BenchmarkPose& p) {
+        solver.set_collision_model(&scene, 0.01, 0.2);
+        sink = solver.solve_q7_optimized(p.position, p.orientation, p.q, q_low[6], q_up[6]).score;
+        solver.set_collision_model(nullptr);
+    }));
+    reports.push_back(check("solve_q7 (warm-start index)", corpus, [&](const BenchmarkPose& p) {
+        // Inserts the solve, then seeds the same target again from the stored entry
+        solver.set_warm_start_index(&index);
+        sink = solver.solve_q7_optimized(p.position, p.orientation, neutral_pose, q_low[6], q_up[6]).score;
+        sink = solver.solve_q7_optimized(p.position, p.orientation, neutral_pose, q_low[6], q_up[6]).score;
+        solver.set_warm_start_index(nullptr);
+    }));
+    reports.push_back(check("solve_q7 (workspace map)", corpus, [&](const BenchmarkPose& p) {
+        solver.set_workspace_map(&map);
+        sink = solver.solve_q7_optimized(p.position, p.orientation, neutral_pose, q_low[6], q_up[6]).score;
+        solver.set_workspace_map(nullptr);
+    }));
+    reports.push_back(check("solve_q4_optimized", corpus, [&](const BenchmarkPose& p) {
+        sink = solver.solve_q4_optimized(p.position, p.orientation, neutral_pose, q_low[3], q_up[3]).score;
+    }));
+    reports.push_back(check("solve_q6_optimized", corpus, [&](const BenchmarkPose& p) {
+        sink = solver.solve_q6_optimized(p.position, p.orientation, neutral_pose, q_low[5], q_up[5]).score;
+    }));
+    reports.push_back(check("solve_swivel_optimized", corpus, [&](const BenchmarkPose& p) {
+        sink = solver.solve_swivel_optimized(p.position, p.orientation, neutral_pose, -PI, PI).score;
+    }));
+    reports.push_back(check("solve_auto_optimized", corpus, [&](const BenchmarkPose& p) {
+        sink = solver.solve_auto_optimized(p.position, p.orientation, neutral_pose).score;
+    }));
+    reports.push_back(check("score_solution", corpus, [&](const BenchmarkPose& p) {
+        sink = solver.score_solution(p.q, Jsols[0]) + solver.transition_cost(p.q, neutral_pose);
+    }));
+    reports.push_back(check("AnytimeIKSolver", corpus, [&](const BenchmarkPose& p) {
+        anytime.reset(RedundancyParam::Q7, p.position, p.orientation, neutral_pose, q_low[6], q_up[6]);
+        sink = anytime.solve_until(std::chrono::steady_clock::now() + std::chrono::seconds(1)).best.score;
+    }));
+    reports.push_back(check("ContinuationIKSolver", corpus, [&](const BenchmarkPose& p) {
+        tracker.reset(p.position, p.orientation, p.q);
+        std::array<double, 3> position = {p.position[0] + 1e-4, p.position[1], p.position[2]};
+        sink = tracker.track(position, p.orientation).solution.score;
+    }));
+    reports.push_back(check("IKServer::handle", corpus, [&](const BenchmarkPose& p) {
+        IKRequest request;
+        IKResponse response;
+        memset(&request, 0, sizeof(request));
+        request.mode = IKServiceMode::OPT_Q7;
+        request.max_iterations = 100;
+        request.tolerance = 1e-6;
+        request.position = p.position;
+        request.orientation = p.orientation;
+        request.current_pose = neutral_pose;
+        IKServer::handle(solver, request, response);
+        sink = response.weighted.score;
+    }));
+
+    long total = 0;
+    printf("=== HEAP ALLOCATION CHECK ===\n");
+    printf("Poses: %d, allocations counted from entry to return of each call\n\n", n_poses);
+    for (const auto& report : reports) {
+        printf("%-30s calls: %5ld  allocations: %ld%s\n", report.name, report.calls, report.allocations,
+               report.allocations > 0 ? "  <-- FAIL" : "");
+        total += report.allocations;
+    }
+    printf("\n%s\n", total == 0 ? "PASS: no heap allocation in any entry point" : "FAIL: heap allocations in the hot path");
+    return total == 0 ? 0 : 1;
+}
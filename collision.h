@@ -0,0 +1,353 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "geofik.h"
+
+// Link of the arm as a capsule: the segment from a to b, in frame `frame` of FrankaFrames (0 is
+// O, 8 the flange, 9 E), swept by a sphere of radius `radius`
+struct LinkCapsule {
+    int frame;
+    std::array<double, 3> a;
+    std::array<double, 3> b;
+    double radius;
+    bool environment;  // Checked against the obstacles (not the base, which sits on the table)
+};
+
+// Obstacle below a plane: the points x with normal . x < offset (normal of unit length)
+struct CollisionPlane {
+    std::array<double, 3> normal;
+    double offset;
+};
+
+// Oriented box: the columns of R (row-first) are its axes in frame O
+struct CollisionBox {
+    std::array<double, 3> center;
+    std::array<double, 9> R;
+    std::array<double, 3> half_extents;
+};
+
+struct CollisionSphere {
+    std::array<double, 3> center;
+    double radius;
+};
+
+// Capsule model of the arm and a small set of static obstacles, for the collision screen and
+// clearance cost of WeightedIKSolver (see WeightedIKSolver::set_collision_model()).
+//
+// clearance() is the smallest signed distance (m, negative when penetrating) between the capsules
+// of links at least two joints apart along the chain, and between the capsules and the obstacles.
+// The link frames come from franka_fk_all_frames(). The capsule pairs are distance-tested in
+// structure-of-arrays form by a branch-free loop the compiler vectorizes; capsule-obstacle tests
+// are closed form (exact for planes, spheres and boxes). Nothing allocates after the model is
+// built, and a const model may be shared by solvers on several threads.
+// Header-only, so WeightedIKSolver users need no extra translation unit.
+class CollisionModel {
+public:
+    static constexpr int MAX_CAPSULES = 16;
+    static constexpr int MAX_PAIRS = MAX_CAPSULES * (MAX_CAPSULES - 1) / 2;
+
+    // The Franka capsules (approximating the self-collision shapes of franka_description, hand and
+    // fingers included) with all their self-collision pairs, no obstacles
+    CollisionModel();
+
+    // Capsule of a tool or payload, e.g. on frame 9 (E); tested against every capsule at least two
+    // joints away. Returns false if the model is full or the capsule has no length.
+    bool add_capsule(const LinkCapsule& capsule);
+
+    // Stop testing capsules i and j against each other (indices in the order they were added)
+    void disable_pair(int i, int j);
+
+    void add_plane(const std::array<double, 3>& normal, double offset);
+    void add_box(const std::array<double, 3>& center, const std::array<double, 9>& R, const std::array<double, 3>& half_extents);
+    void add_sphere(const std::array<double, 3>& center, double radius);
+    void clear_obstacles();
+
+    // Skip the self-collision pairs (obstacles only)
+    void set_self_collision(bool enabled) { self_collision_ = enabled; }
+
+    double clearance(const FrankaFrames& frames) const;
+    double clearance(const std::array<double, 7>& q) const;
+
+    // clearance() of n configurations, configuration k at q + k * stride (as franka_fk_all_frames())
+    void clearances(const double* q, unsigned int n, size_t stride, double* out) const;
+
+    int capsule_count() const { return n_capsules_; }
+    int pair_count() const { return n_pairs_; }
+    const LinkCapsule& capsule(int i) const { return capsules_[i]; }
+
+private:
+    std::array<LinkCapsule, MAX_CAPSULES> capsules_;
+    std::array<double, MAX_CAPSULES> inverse_length2_;  // 1 / |b - a|^2, fixed since the links are rigid
+    int n_capsules_;
+    std::array<unsigned char, MAX_PAIRS> pair_i_;   // Self-collision pairs
+    std::array<unsigned char, MAX_PAIRS> pair_j_;
+    int n_pairs_;
+    bool self_collision_;
+    std::vector<CollisionPlane> planes_;
+    std::vector<CollisionBox> boxes_;
+    std::vector<CollisionSphere> spheres_;
+
+    // Position of frame f along the chain: E moves with the flange
+    static int chain_index(int frame) { return frame == 9 ? 8 : frame; }
+};
+
+// Approximate Franka link shapes, in the frame of each link (frame 9 holds the hand and fingers,
+// whose frame differs from E only by 0.1034 m along z)
+inline CollisionModel::CollisionModel() : n_capsules_(0), n_pairs_(0), self_collision_(true) {
+    const LinkCapsule franka[] = {
+        { 0, { -0.09, 0.0, 0.06 }, { -0.06, 0.0, 0.06 }, 0.06, false },
+        { 1, { 0.0, 0.0, -0.283 }, { 0.0, 0.0, -0.05 }, 0.06, false },
+        { 2, { 0.0, 0.0, -0.06 }, { 0.0, 0.0, 0.06 }, 0.06, true },
+        { 3, { 0.0, 0.0, -0.22 }, { 0.0, 0.0, -0.07 }, 0.06, true },
+        { 4, { 0.0, 0.0, -0.06 }, { 0.0, 0.0, 0.06 }, 0.06, true },
+        { 5, { 0.0, 0.0, -0.31 }, { 0.0, 0.0, -0.21 }, 0.06, true },
+        { 5, { 0.0, 0.08, -0.20 }, { 0.0, 0.08, -0.06 }, 0.025, true },
+        { 6, { 0.0, 0.0, -0.07 }, { 0.0, 0.0, 0.01 }, 0.05, true },
+        { 7, { 0.0, 0.0, -0.06 }, { 0.0, 0.0, 0.08 }, 0.04, true },
+        { 9, { 0.0, -0.05, -0.0634 }, { 0.0, 0.05, -0.0634 }, 0.04, true },
+        { 9, { 0.0, -0.05, -0.0034 }, { 0.0, 0.05, -0.0034 }, 0.02, true },
+    };
+    for (const LinkCapsule& capsule : franka) add_capsule(capsule);
+    // Links 1 and 3 only meet in the capsules of the shoulder: within the joint limits of q2 the
+    // real links stay apart, but the capsules overlap in about 15% of random configurations
+    disable_pair(1, 3);
+}
+
+inline bool CollisionModel::add_capsule(const LinkCapsule& capsule) {
+    double length2 = 0.0;
+    for (int i = 0; i < 3; i++) length2 += (capsule.b[i] - capsule.a[i]) * (capsule.b[i] - capsule.a[i]);
+    if (n_capsules_ == MAX_CAPSULES || capsule.frame < 0 || capsule.frame > 9 || !(length2 > 0.0)) return false;
+    int index = n_capsules_++;
+    capsules_[index] = capsule;
+    inverse_length2_[index] = 1.0 / length2;
+    for (int i = 0; i < index; i++) {
+        if (std::abs(chain_index(capsules_[i].frame) - chain_index(capsule.frame)) < 2) continue;
+        pair_i_[n_pairs_] = (unsigned char)i;
+        pair_j_[n_pairs_] = (unsigned char)index;
+        n_pairs_++;
+    }
+    return true;
+}
+
+inline void CollisionModel::disable_pair(int i, int j) {
+    int kept = 0;
+    for (int k = 0; k < n_pairs_; k++) {
+        if ((pair_i_[k] == i && pair_j_[k] == j) || (pair_i_[k] == j && pair_j_[k] == i)) continue;
+        pair_i_[kept] = pair_i_[k];
+        pair_j_[kept] = pair_j_[k];
+        kept++;
+    }
+    n_pairs_ = kept;
+}
+
+inline void CollisionModel::add_plane(const std::array<double, 3>& normal, double offset) {
+    double norm = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    planes_.push_back({ { normal[0] / norm, normal[1] / norm, normal[2] / norm }, offset / norm });
+}
+
+inline void CollisionModel::add_box(const std::array<double, 3>& center, const std::array<double, 9>& R,
+                                    const std::array<double, 3>& half_extents) {
+    boxes_.push_back({ center, R, half_extents });
+}
+
+inline void CollisionModel::add_sphere(const std::array<double, 3>& center, double radius) {
+    spheres_.push_back({ center, radius });
+}
+
+inline void CollisionModel::clear_obstacles() {
+    planes_.clear();
+    boxes_.clear();
+    spheres_.clear();
+}
+
+namespace collision_detail {
+
+// min(max(x, 0), 1) and max(x, y) without comparisons. GCC turns the clamps of a loop into
+// branches (it specializes the code that follows for s = 0 and s = 1), which keeps the loop from
+// vectorizing unless -fno-trapping-math is given.
+inline double clamp01(double x) { return 0.5 * (std::fabs(x) - std::fabs(x - 1.0) + 1.0); }
+inline double branchless_max(double x, double y) { return 0.5 * (x + y + std::fabs(x - y)); }
+
+// Signed distance from the segment a + t d, t in [0, 1], to the box |x_i| <= h_i (in box coordinates)
+inline double segment_box_distance(const double* a, const double* d, const std::array<double, 3>& h) {
+    // Outside, the squared distance sum_i max(|x_i(t)| - h_i, 0)^2 is a convex piecewise
+    // quadratic in t, with breakpoints where x_i(t) = +-h_i: minimize it on each piece
+    double breaks[8] = { 0.0, 1.0 };
+    int n = 2;
+    for (int i = 0; i < 3; i++) {
+        if (d[i] == 0.0) continue;
+        for (double side : { -h[i], h[i] }) {
+            double t = (side - a[i]) / d[i];
+            if (t > 0.0 && t < 1.0) breaks[n++] = t;
+        }
+    }
+    for (int k = 1; k < n; k++) {
+        for (int m = k; m > 0 && breaks[m] < breaks[m - 1]; m--) std::swap(breaks[m], breaks[m - 1]);
+    }
+    double best2 = std::numeric_limits<double>::infinity();
+    for (int k = 0; k + 1 < n; k++) {
+        double lo = breaks[k], hi = breaks[k + 1], mid = 0.5 * (lo + hi);
+        double A = 0.0, B = 0.0;
+        for (int i = 0; i < 3; i++) {
+            double x = a[i] + d[i] * mid;
+            double beta = x > h[i] ? a[i] - h[i] : (x < -h[i] ? a[i] + h[i] : NAN);
+            if (std::isnan(beta)) continue;
+            A += d[i] * d[i];
+            B += d[i] * beta;
+        }
+        double t = A > 0.0 ? std::min(std::max(-B / A, lo), hi) : lo;
+        double dist2 = 0.0;
+        for (int i = 0; i < 3; i++) {
+            double excess = std::fabs(a[i] + d[i] * t) - h[i];
+            if (excess > 0.0) dist2 += excess * excess;
+        }
+        best2 = std::min(best2, dist2);
+    }
+    // (a touching segment may come out a rounding error above 0)
+    if (best2 > 1e-24) return std::sqrt(best2);
+
+    // The segment enters the box: the depth max_i(|x_i(t)| - h_i) is convex and piecewise linear,
+    // so its minimum is at an end or where two of its six lines cross
+    double slope[6], intercept[6];
+    for (int i = 0; i < 3; i++) {
+        slope[2 * i] = d[i];
+        intercept[2 * i] = a[i] - h[i];
+        slope[2 * i + 1] = -d[i];
+        intercept[2 * i + 1] = -a[i] - h[i];
+    }
+    auto depth = [&](double t) {
+        double value = -std::numeric_limits<double>::infinity();
+        for (int l = 0; l < 6; l++) value = std::max(value, intercept[l] + slope[l] * t);
+        return value;
+    };
+    double best = std::min(depth(0.0), depth(1.0));
+    for (int l = 0; l < 6; l++) {
+        for (int m = l + 1; m < 6; m++) {
+            if (slope[l] == slope[m]) continue;
+            double t = (intercept[m] - intercept[l]) / (slope[l] - slope[m]);
+            if (t > 0.0 && t < 1.0) best = std::min(best, depth(t));
+        }
+    }
+    return best;
+}
+
+} // namespace collision_detail
+
+inline double CollisionModel::clearance(const FrankaFrames& frames) const {
+    // Capsule ends in frame O, structure of arrays
+    alignas(64) double ax[MAX_CAPSULES], ay[MAX_CAPSULES], az[MAX_CAPSULES];
+    alignas(64) double dx[MAX_CAPSULES], dy[MAX_CAPSULES], dz[MAX_CAPSULES];
+    for (int c = 0; c < n_capsules_; c++) {
+        const LinkCapsule& capsule = capsules_[c];
+        const std::array<double, 9>& R = frames.R[capsule.frame];
+        const std::array<double, 3>& p = frames.p[capsule.frame];
+        double end[2][3];
+        for (int e = 0; e < 2; e++) {
+            const std::array<double, 3>& x = e == 0 ? capsule.a : capsule.b;
+            for (int i = 0; i < 3; i++) end[e][i] = p[i] + R[3 * i] * x[0] + R[3 * i + 1] * x[1] + R[3 * i + 2] * x[2];
+        }
+        ax[c] = end[0][0]; ay[c] = end[0][1]; az[c] = end[0][2];
+        dx[c] = end[1][0] - end[0][0]; dy[c] = end[1][1] - end[0][1]; dz[c] = end[1][2] - end[0][2];
+    }
+
+    double clearance = std::numeric_limits<double>::infinity();
+    if (self_collision_ && n_pairs_ > 0) {
+        // Gather the pairs, then the closest points of each pair of segments (Ericson's clamped
+        // solution) over contiguous arrays
+        alignas(64) double p1x[MAX_PAIRS], p1y[MAX_PAIRS], p1z[MAX_PAIRS], d1x[MAX_PAIRS], d1y[MAX_PAIRS], d1z[MAX_PAIRS];
+        alignas(64) double p2x[MAX_PAIRS], p2y[MAX_PAIRS], p2z[MAX_PAIRS], d2x[MAX_PAIRS], d2y[MAX_PAIRS], d2z[MAX_PAIRS];
+        alignas(64) double inverse_a[MAX_PAIRS], inverse_e[MAX_PAIRS], radii[MAX_PAIRS];
+        for (int k = 0; k < n_pairs_; k++) {
+            int i = pair_i_[k], j = pair_j_[k];
+            p1x[k] = ax[i]; p1y[k] = ay[i]; p1z[k] = az[i]; d1x[k] = dx[i]; d1y[k] = dy[i]; d1z[k] = dz[i];
+            p2x[k] = ax[j]; p2y[k] = ay[j]; p2z[k] = az[j]; d2x[k] = dx[j]; d2y[k] = dy[j]; d2z[k] = dz[j];
+            inverse_a[k] = inverse_length2_[i];
+            inverse_e[k] = inverse_length2_[j];
+            radii[k] = capsules_[i].radius + capsules_[j].radius;
+        }
+        alignas(64) double distance2[MAX_PAIRS];
+        for (int k = 0; k < n_pairs_; k++) {
+            // One division per pair: the squared lengths a and e are those of the capsules
+            double rx = p1x[k] - p2x[k], ry = p1y[k] - p2y[k], rz = p1z[k] - p2z[k];
+            double a = d1x[k] * d1x[k] + d1y[k] * d1y[k] + d1z[k] * d1z[k];
+            double e = d2x[k] * d2x[k] + d2y[k] * d2y[k] + d2z[k] * d2z[k];
+            double b = d1x[k] * d2x[k] + d1y[k] * d2y[k] + d1z[k] * d2z[k];
+            double c = d1x[k] * rx + d1y[k] * ry + d1z[k] * rz;
+            double f = d2x[k] * rx + d2y[k] * ry + d2z[k] * rz;
+            // Any s will do for parallel segments (denom ~ 0), so the denominator is only bounded
+            // away from 0
+            double denom = collision_detail::branchless_max(a * e - b * b, 1e-12 * a * e);
+            double s = collision_detail::clamp01((b * f - c * e) / denom);
+            double t = collision_detail::clamp01((b * s + f) * inverse_e[k]);
+            s = collision_detail::clamp01((b * t - c) * inverse_a[k]);
+            double wx = rx + d1x[k] * s - d2x[k] * t;
+            double wy = ry + d1y[k] * s - d2y[k] * t;
+            double wz = rz + d1z[k] * s - d2z[k] * t;
+            distance2[k] = wx * wx + wy * wy + wz * wz;
+        }
+        // sqrt apart, since its errno path keeps the loop above from vectorizing
+        double self = std::numeric_limits<double>::infinity();
+        for (int k = 0; k < n_pairs_; k++) self = std::min(self, std::sqrt(distance2[k]) - radii[k]);
+        clearance = self;
+    }
+
+    for (int c = 0; c < n_capsules_; c++) {
+        if (!capsules_[c].environment) continue;
+        const double a[3] = { ax[c], ay[c], az[c] };
+        const double d[3] = { dx[c], dy[c], dz[c] };
+        double radius = capsules_[c].radius;
+        double half_length = 0.5 / std::sqrt(inverse_length2_[c]);
+        for (const CollisionPlane& plane : planes_) {
+            double na = plane.normal[0] * a[0] + plane.normal[1] * a[1] + plane.normal[2] * a[2];
+            double nd = plane.normal[0] * d[0] + plane.normal[1] * d[1] + plane.normal[2] * d[2];
+            clearance = std::min(clearance, na + std::min(nd, 0.0) - plane.offset - radius);
+        }
+        for (const CollisionSphere& sphere : spheres_) {
+            double r[3] = { sphere.center[0] - a[0], sphere.center[1] - a[1], sphere.center[2] - a[2] };
+            double t = (r[0] * d[0] + r[1] * d[1] + r[2] * d[2]) / (d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            t = std::min(std::max(t, 0.0), 1.0);
+            double w[3] = { r[0] - d[0] * t, r[1] - d[1] * t, r[2] - d[2] * t };
+            clearance = std::min(clearance, std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]) - sphere.radius - radius);
+        }
+        for (const CollisionBox& box : boxes_) {
+            // Segment in box coordinates: R^T (x - center)
+            double a_box[3], d_box[3];
+            for (int i = 0; i < 3; i++) {
+                a_box[i] = box.R[i] * (a[0] - box.center[0]) + box.R[3 + i] * (a[1] - box.center[1]) + box.R[6 + i] * (a[2] - box.center[2]);
+                d_box[i] = box.R[i] * d[0] + box.R[3 + i] * d[1] + box.R[6 + i] * d[2];
+            }
+            // Lower bound from the ball around the segment: boxes beyond the clearance so far are skipped
+            double outside2 = 0.0;
+            for (int i = 0; i < 3; i++) {
+                double excess = std::max(std::fabs(a_box[i] + 0.5 * d_box[i]) - box.half_extents[i], 0.0);
+                outside2 += excess * excess;
+            }
+            if (std::sqrt(outside2) - half_length - radius >= clearance) continue;
+            clearance = std::min(clearance, collision_detail::segment_box_distance(a_box, d_box, box.half_extents) - radius);
+        }
+    }
+    return clearance;
+}
+
+inline double CollisionModel::clearance(const std::array<double, 7>& q) const {
+    FrankaFrames frames;
+    franka_fk_all_frames(q, frames);
+    return clearance(frames);
+}
+
+inline void CollisionModel::clearances(const double* q, unsigned int n, size_t stride, double* out) const {
+    // FK in batches of 8 configurations (the solutions of one IK call)
+    FrankaFrames frames[8];
+    for (unsigned int start = 0; start < n; start += 8) {
+        unsigned int count = std::min(n - start, 8u);
+        franka_fk_all_frames(q + start * stride, count, stride, frames);
+        for (unsigned int k = 0; k < count; k++) out[start + k] = clearance(frames[k]);
+    }
+}
+
+#endif // COLLISION_H
@@ -0,0 +1,177 @@
+#include "continuation_ik.h"
+#include <algorithm>
+
+static Eigen::Matrix3d rotation_of(const std::array<double, 9>& ROE) {
+    Eigen::Matrix3d R;
+    R << ROE[0], ROE[1], ROE[2],
+         ROE[3], ROE[4], ROE[5],
+         ROE[6], ROE[7], ROE[8];
+    return R;
+}
+
+static double joint_distance(const std::array<double, 7>& q1, const std::array<double, 7>& q2) {
+    double distance = 0.0;
+    for (int j = 0; j < 7; j++) distance += (q1[j] - q2[j]) * (q1[j] - q2[j]);
+    return sqrt(distance);
+}
+
+ContinuationIKSolver::ContinuationIKSolver(WeightedIKSolver& solver, const ContinuationIKConfig& config)
+    : solver_(solver), config_(config), tracking_(false), position_{}, rotation_(Eigen::Matrix3d::Identity()),
+      q_{}, J_{}, branch_(-1), reference_score_(0.0) {
+}
+
+// Score of the solution of the tracked branch at q7 for target, -infinity if it is not valid
+double ContinuationIKSolver::branch_score(const PreparedTarget& target, double q7, std::array<double, 7>& q,
+                                          std::array<std::array<double, 6>, 7>& J) const {
+    if (!franka_J_ik_q7_branch(target, q7, branch_, J, q)) return -std::numeric_limits<double>::infinity();
+    return solver_.score_solution(q, J) - solver_.transition_cost(q_, q);
+}
+
+void ContinuationIKSolver::full_solve(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    ContinuationIKResult& result
+) {
+    // Stay on the tracked branch if it still has a solution, unless the caller restricted the solver
+    int restriction = solver_.get_branch();
+    bool on_branch = false;
+    result.solution.success = false;
+    if (restriction < 0 && config_.keep_branch && branch_ >= 0) {
+        solver_.set_branch(branch_);
+        result.solution = solver_.solve_q7_optimized(target_position, target_orientation, q_, q_low[6], q_up[6],
+                                                     config_.tolerance, config_.max_iterations);
+        solver_.set_branch(restriction);
+        on_branch = result.solution.success;
+    }
+    if (!result.solution.success) {
+        result.solution = solver_.solve_q7_optimized(target_position, target_orientation, q_, q_low[6], q_up[6],
+                                                     config_.tolerance, config_.max_iterations);
+    }
+    tracking_ = result.solution.success;
+    if (!tracking_) return;
+
+    // A restricted solve reports its branch, an unrestricted one its slot
+    branch_ = on_branch || restriction >= 0 ? result.solution.solution_index : franka_q7_branch(result.solution.joint_angles);
+    result.solution.solution_index = branch_;
+    q_ = result.solution.joint_angles;
+    J_ = result.solution.jacobian;
+    position_ = target_position;
+    rotation_ = rotation_of(target_orientation);
+    reference_score_ = solver_.score_solution(q_, J_);
+}
+
+ContinuationIKResult ContinuationIKSolver::reset(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose
+) {
+    auto start = steady_clock::now();
+    q_ = current_pose;
+    branch_ = -1;
+    ContinuationIKResult result;
+    result.escalation = ContinuationEscalation::START;
+    result.residual = NAN;
+    result.score_drift = 0.0;
+    full_solve(target_position, target_orientation, result);
+    result.duration_nanoseconds = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    return result;
+}
+
+ContinuationIKResult ContinuationIKSolver::track(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation
+) {
+    auto start = steady_clock::now();
+    ContinuationIKResult result;
+    result.escalation = ContinuationEscalation::NONE;
+    result.residual = NAN;
+    result.score_drift = 0.0;
+    if (!tracking_) {
+        result.escalation = ContinuationEscalation::START;
+        full_solve(target_position, target_orientation, result);
+        result.duration_nanoseconds = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        return result;
+    }
+
+    PreparedTarget target;
+    prepare_target(target_position, target_orientation, target);
+
+    // Pose change as a twist in the row order of the Jacobian: rotation vector, then displacement of E
+    Eigen::Matrix3d R = rotation_of(target_orientation);
+    Eigen::AngleAxisd rotation(R * rotation_.transpose());
+    Eigen::Matrix<double, 6, 1> dx;
+    dx.head<3>() = rotation.angle() * rotation.axis();
+    dx.tail<3>() << target_position[0] - position_[0], target_position[1] - position_[1], target_position[2] - position_[2];
+    Eigen::Map<const Eigen::Matrix<double, 6, 7>> J(J_[0].data());
+
+    // q7 of the prediction: its share of the minimum-norm step, plus the null-space motion. On a
+    // fixed branch the self-motion is parameterized by q7, so the derivative of the score along
+    // the null space of J is taken in q7, at the new target.
+    std::array<double, 7> q;
+    std::array<std::array<double, 6>, 7> J_new;
+    double q7 = q_[6];
+    int evaluations = 1;
+    if (!config_.hold_q7) {
+        Eigen::Matrix<double, 6, 6> JJt = J * J.transpose();
+        Eigen::Matrix<double, 7, 1> dq = J.transpose() * JJt.ldlt().solve(dx);
+        q7 += dq(6);
+        double h = config_.gradient_step;
+        double slope = (branch_score(target, q7 + h, q, J_new) - branch_score(target, q7 - h, q, J_new)) / (2 * h);
+        evaluations += 2;
+        if (std::isfinite(slope))
+            q7 += std::clamp(config_.null_space_gain * slope, -config_.max_null_step, config_.max_null_step);
+        q7 = std::clamp(q7, q_low[6], q_up[6]);
+    }
+
+    // Joints 1-6 for that q7 from the linearization, then the closed-form correction
+    Eigen::Matrix<double, 6, 1> rhs = dx - J.col(6) * (q7 - q_[6]);
+    Eigen::Matrix<double, 6, 1> dq6 = J.leftCols<6>().partialPivLu().solve(rhs);
+    bool valid = franka_J_ik_q7_branch(target, q7, branch_, J_new, q);
+    double residual = 0.0;
+    for (int j = 0; j < 6; j++) {
+        double d = q[j] - (q_[j] + dq6(j));
+        d -= 2 * PI * floor(d / (2 * PI) + 0.5);
+        residual = std::max(residual, fabs(d));
+    }
+    result.residual = valid ? residual : NAN;
+
+    double score = 0.0;
+    if (!valid || !(residual <= config_.residual_threshold)) {
+        result.escalation = valid ? ContinuationEscalation::RESIDUAL : ContinuationEscalation::INVALID;
+    } else {
+        score = solver_.score_solution(q, J_new);
+        result.score_drift = reference_score_ - score;
+        if (result.score_drift > config_.objective_drift) result.escalation = ContinuationEscalation::OBJECTIVE;
+    }
+    if (result.escalation != ContinuationEscalation::NONE) {
+        full_solve(target_position, target_orientation, result);
+        result.duration_nanoseconds = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        result.solution.duration_microseconds = result.duration_nanoseconds / 1000;
+        return result;
+    }
+
+    WeightedIKResult& solution = result.solution;
+    solution.success = true;
+    solution.joint_angles = q;
+    solution.q7_optimal = q7;
+    solution.free_variable_optimal = q7;
+    solution.jacobian = J_new;
+    solution.manipulability = solver_.calculate_manipulability(J_new);
+    solution.neutral_distance = joint_distance(q, solver_.get_neutral_pose());
+    solution.current_distance = joint_distance(q, q_);
+    solution.score = score - solver_.transition_cost(q_, q);
+    solution.solution_index = branch_;
+    solution.total_solutions_found = 1;
+    solution.valid_solutions_count = 1;
+    solution.q7_values_tested = evaluations;
+    solution.optimization_iterations = 0;
+    solution.parameterization = RedundancyParam::Q7;
+
+    q_ = q;
+    J_ = J_new;
+    position_ = target_position;
+    rotation_ = R;
+    result.duration_nanoseconds = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    solution.duration_microseconds = result.duration_nanoseconds / 1000;
+    return result;
+}
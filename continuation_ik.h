@@ -0,0 +1,86 @@
+#ifndef CONTINUATION_IK_H
+#define CONTINUATION_IK_H
+
+#include <array>
+#include "weighted_ik.h"
+
+// Settings of ContinuationIKSolver
+struct ContinuationIKConfig {
+    bool hold_q7 = false;             // Keep q7; otherwise move it along the self-motion towards a higher score
+    double null_space_gain = 0.05;    // q7 step (rad) per unit of d(score)/d(q7)
+    double max_null_step = 0.002;     // Largest q7 step of the null-space motion per tick (rad)
+    double gradient_step = 1e-3;      // q7 offset of the central difference of the score (rad)
+    double residual_threshold = 1e-3; // Largest joint difference between prediction and correction (rad)
+    double objective_drift = 0.05;    // Score loss since the last full solve that triggers a new one
+    bool keep_branch = true;          // Full solves first try the tracked branch, then all branches
+    double tolerance = 1e-6;          // Of the full solve (solve_q7_optimized)
+    int max_iterations = 100;
+};
+
+// Why a tick ran a full weighted solve
+enum class ContinuationEscalation {
+    NONE,        // Predicted and corrected on the tracked branch
+    START,       // No solution to continue from (first tick or after a failure)
+    INVALID,     // The branch has no solution within the joint limits at the predicted q7
+    RESIDUAL,    // The correction moved further from the prediction than residual_threshold
+    OBJECTIVE    // The score fell more than objective_drift below the last full solve
+};
+
+// Result of one tick
+struct ContinuationIKResult {
+    WeightedIKResult solution;         // solution_index is the branch (see IKBranch)
+    ContinuationEscalation escalation;
+    double residual;                   // Max |corrected - predicted| joint angle (NaN if not predicted)
+    double score_drift;                // Score of the last full solve minus this score
+    long duration_nanoseconds;
+};
+
+// Velocity-level continuation of WeightedIKSolver for high-rate tracking of a slowly moving target.
+// Each track() predicts the joint step for the pose change since the previous tick from the
+// Jacobian of the previous solution (q7 held, or moved along the self-motion by the derivative of
+// the score, taken by central difference of two branch solutions), then corrects it with one
+// closed-form franka_J_ik_q7_branch() call at the predicted q7 on the same branch. It falls back to
+// solve_q7_optimized when the correction is invalid, strays from the prediction or the score
+// drifts; otherwise a tick costs one to three branch IK calls and a 6x6 solve.
+class ContinuationIKSolver {
+private:
+    WeightedIKSolver& solver_;
+    ContinuationIKConfig config_;
+
+    // Previous tick
+    bool tracking_;
+    std::array<double, 3> position_;
+    Eigen::Matrix3d rotation_;
+    std::array<double, 7> q_;
+    std::array<std::array<double, 6>, 7> J_;   // J^T at q_, frame E
+    int branch_;
+    double reference_score_;                   // score_solution() after the last full solve
+
+    double branch_score(const PreparedTarget& target, double q7, std::array<double, 7>& q,
+                        std::array<std::array<double, 6>, 7>& J) const;
+    void full_solve(const std::array<double, 3>& target_position, const std::array<double, 9>& target_orientation,
+                    ContinuationIKResult& result);
+
+public:
+    explicit ContinuationIKSolver(WeightedIKSolver& solver, const ContinuationIKConfig& config = ContinuationIKConfig());
+
+    // Full weighted solve of the first target from current_pose; the next ticks continue from it
+    ContinuationIKResult reset(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose
+    );
+
+    // One tick towards the new target, from the solution of the previous tick
+    ContinuationIKResult track(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation
+    );
+
+    bool tracking() const { return tracking_; }
+    int branch() const { return branch_; }
+    const std::array<double, 7>& joint_angles() const { return q_; }
+    void set_config(const ContinuationIKConfig& config) { config_ = config; }
+};
+
+#endif // CONTINUATION_IK_H
@@ -0,0 +1,82 @@
+#include "anytime_ik.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 example_anytime_ik.cpp anytime_ik.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o example_anytime_ik.exe
+
+// Solves a pose corpus under per-tick time budgets and compares the best-so-far result
+// against the unbounded solve_q7_optimized result for the same target.
+
+int main() {
+    const int n_poses = 200;
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+    AnytimeIKSolver anytime(solver);
+    std::vector<BenchmarkPose> corpus = make_benchmark_corpus(n_poses);
+
+    std::vector<WeightedIKResult> reference;
+    for (const auto& pose : corpus) {
+        reference.push_back(solver.solve_q7_optimized(pose.position, pose.orientation, neutral_pose,
+                                                      q_low[6], q_up[6]));
+    }
+
+    cout << "=== ANYTIME IK UNDER A DEADLINE ===" << endl;
+    cout << "Poses: " << n_poses << ", q7 over the full joint range, one solve_until() per pose" << endl << endl;
+
+    const long budgets_us[6] = { 5, 10, 20, 50, 100, 1000000 };
+    for (long budget_us : budgets_us) {
+        int successes = 0, converged = 0, matches = 0, overruns = 0;
+        double convergence_sum = 0.0, gap_sum = 0.0, evaluations_sum = 0.0;
+        long worst_overrun_ns = 0;
+        for (int k = 0; k < n_poses; k++) {
+            anytime.reset(RedundancyParam::Q7, corpus[k].position, corpus[k].orientation, neutral_pose,
+                          q_low[6], q_up[6]);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us);
+            AnytimeIKResult result = anytime.solve_until(deadline);
+            long overrun_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - deadline).count();
+            if (overrun_ns > 0) {
+                overruns++;
+                worst_overrun_ns = std::max(worst_overrun_ns, overrun_ns);
+            }
+            convergence_sum += result.convergence;
+            evaluations_sum += result.evaluations;
+            if (result.converged) converged++;
+            if (result.best.success) {
+                successes++;
+                if (reference[k].success) {
+                    double gap = reference[k].score - result.best.score;
+                    gap_sum += gap;
+                    if (fabs(gap) < 1e-12) matches++;
+                }
+            }
+        }
+        cout << (budget_us >= 1000000 ? std::string("unbounded") : std::to_string(budget_us) + " μs") << ":" << endl;
+        cout << std::fixed << std::setprecision(1)
+             << "  success: " << 100.0 * successes / n_poses << "%"
+             << ", converged: " << 100.0 * converged / n_poses << "%"
+             << ", mean convergence: " << std::setprecision(3) << convergence_sum / n_poses
+             << ", evals: " << std::setprecision(1) << evaluations_sum / n_poses << endl;
+        cout << "  mean score gap to solve_q7_optimized: " << std::scientific << std::setprecision(2)
+             << (successes > 0 ? gap_sum / successes : 0.0) << std::fixed
+             << ", identical: " << std::setprecision(1) << 100.0 * matches / n_poses << "%"
+             << ", overruns: " << overruns << " (worst " << worst_overrun_ns / 1000.0 << " μs)" << endl;
+    }
+
+    // The same solve spread over control ticks with 10 μs of IK time each
+    cout << endl << "Spread over ticks of 10 μs:" << endl;
+    long ticks_sum = 0;
+    int max_ticks = 0;
+    for (const auto& pose : corpus) {
+        anytime.reset(RedundancyParam::Q7, pose.position, pose.orientation, neutral_pose, q_low[6], q_up[6]);
+        int ticks = 0;
+        while (!anytime.done() && ticks < 1000) {
+            anytime.solve_until(std::chrono::steady_clock::now() + std::chrono::microseconds(10));
+            ticks++;
+        }
+        ticks_sum += ticks;
+        max_ticks = std::max(max_ticks, ticks);
+    }
+    cout << "  ticks to finish: mean " << std::setprecision(1) << (double)ticks_sum / n_poses
+         << ", max " << max_ticks << endl;
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include "continuation_ik.h"
+#include "benchmark_corpus.h"
+
+// compile with: g++ -I/usr/include/eigen3 example_continuation_ik.cpp continuation_ik.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o example_continuation_ik.exe
+
+// Tracks 1 kHz trajectories (a 3 cm circle with a +-0.2 rad twist about z in 2 s, around poses of
+// the benchmark corpus) with ContinuationIKSolver, q7 held and moved along the null space, against
+// a solve_q7_optimized per tick from the previous solution.
+
+// Pose of tick t of the trajectory around pose
+static void trajectory_pose(const BenchmarkPose& pose, int t, int n_ticks,
+                            std::array<double, 3>& position, std::array<double, 9>& orientation) {
+    double phase = 2 * PI * t / n_ticks;
+    const double radius = 0.03;
+    position = { pose.position[0] + radius * (cos(phase) - 1), pose.position[1] + radius * sin(phase), pose.position[2] };
+    Eigen::Matrix3d R;
+    R << pose.orientation[0], pose.orientation[1], pose.orientation[2],
+         pose.orientation[3], pose.orientation[4], pose.orientation[5],
+         pose.orientation[6], pose.orientation[7], pose.orientation[8];
+    R = Eigen::AngleAxisd(0.2 * sin(phase), Eigen::Vector3d::UnitZ()).toRotationMatrix() * R;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++) orientation[3 * i + j] = R(i, j);
+}
+
+int main() {
+    const int n_trajectories = 20;
+    const int n_ticks = 2000;
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+    std::vector<BenchmarkPose> candidates = make_benchmark_corpus(10 * n_trajectories);
+
+    // Per-tick full solve from the previous solution, the reference. Only trajectories it tracks
+    // exactly at every tick are kept: at the edge of the workspace the IK clamps the elbow and
+    // returns approximate solutions, with or without continuation.
+    std::vector<BenchmarkPose> corpus;
+    std::vector<std::vector<double>> full_scores;
+    double full_us = 0;
+    int full_ticks = 0;
+    for (size_t c = 0; c < candidates.size() && (int)corpus.size() < n_trajectories; c++) {
+        std::array<double, 7> current = candidates[c].q;
+        std::vector<double> scores(n_ticks);
+        double us = 0;
+        bool exact = true;
+        for (int t = 0; t < n_ticks && exact; t++) {
+            std::array<double, 3> position;
+            std::array<double, 9> orientation;
+            trajectory_pose(candidates[c], t, n_ticks, position, orientation);
+            auto start = high_resolution_clock::now();
+            WeightedIKResult result = solver.solve_q7_optimized(position, orientation, current, q_low[6], q_up[6]);
+            us += duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+            Eigen::Matrix4d T = franka_fk(result.joint_angles);
+            exact = result.success && (T.block<3, 1>(0, 3) - Eigen::Vector3d(position[0], position[1], position[2])).norm() < 1e-9;
+            scores[t] = solver.score_solution(result.joint_angles, result.jacobian);
+            current = result.joint_angles;
+        }
+        if (!exact) continue;
+        corpus.push_back(candidates[c]);
+        full_scores.push_back(scores);
+        full_us += us;
+        full_ticks += n_ticks;
+    }
+    cout << corpus.size() << " of the first " << candidates.size() << " corpus poses tracked exactly by the per-tick solve" << endl;
+    cout << std::fixed << std::setprecision(2);
+    cout << "solve_q7_optimized per tick: " << full_us / full_ticks << " us" << endl << endl;
+
+    for (int mode = 0; mode < 2; mode++) {
+        ContinuationIKConfig config;
+        config.hold_q7 = mode == 0;
+        ContinuationIKSolver tracker(solver, config);
+        std::array<int, 5> escalations = {};
+        double continued_ns = 0, escalated_ns = 0, score_gap = 0, max_step = 0, max_escalated_step = 0, max_position_error = 0;
+        int continued = 0, escalated = 0, compared = 0, failures = 0;
+        for (size_t k = 0; k < corpus.size(); k++) {
+            std::array<double, 3> position;
+            std::array<double, 9> orientation;
+            trajectory_pose(corpus[k], 0, n_ticks, position, orientation);
+            tracker.reset(position, orientation, corpus[k].q);
+            std::array<double, 7> previous = tracker.joint_angles();
+            for (int t = 1; t < n_ticks; t++) {
+                trajectory_pose(corpus[k], t, n_ticks, position, orientation);
+                ContinuationIKResult result = tracker.track(position, orientation);
+                escalations[(int)result.escalation]++;
+                if (result.escalation == ContinuationEscalation::NONE) {
+                    continued_ns += result.duration_nanoseconds;
+                    continued++;
+                } else {
+                    escalated_ns += result.duration_nanoseconds;
+                    escalated++;
+                }
+                if (!result.solution.success) {
+                    failures++;
+                    continue;
+                }
+                const std::array<double, 7>& q = result.solution.joint_angles;
+                double step = 0;
+                for (int j = 0; j < 7; j++) step = std::max(step, fabs(q[j] - previous[j]));
+                // Escalated ticks may change configuration, continued ones stay on the branch
+                if (result.escalation == ContinuationEscalation::NONE) max_step = std::max(max_step, step);
+                else max_escalated_step = std::max(max_escalated_step, step);
+                previous = q;
+                Eigen::Matrix4d T = franka_fk(q);
+                max_position_error = std::max(max_position_error, (T.block<3, 1>(0, 3) - Eigen::Vector3d(position[0], position[1], position[2])).norm());
+                score_gap += full_scores[k][t] - solver.score_solution(q, result.solution.jacobian);
+                compared++;
+            }
+        }
+        cout << (mode == 0 ? "q7 held:" : "q7 along the null space:") << endl;
+        cout << "  continued ticks:  " << continued << ", " << continued_ns / std::max(continued, 1) / 1000.0 << " us per tick" << endl;
+        cout << "  escalated ticks:  " << escalated << " (invalid " << escalations[(int)ContinuationEscalation::INVALID]
+             << ", residual " << escalations[(int)ContinuationEscalation::RESIDUAL]
+             << ", objective " << escalations[(int)ContinuationEscalation::OBJECTIVE]
+             << ", restart " << escalations[(int)ContinuationEscalation::START] << "), "
+             << escalated_ns / std::max(escalated, 1) / 1000.0 << " us per tick" << endl;
+        cout << "  all ticks:        " << (continued_ns + escalated_ns) / (continued + escalated) / 1000.0 << " us per tick, "
+             << failures << " without solution" << endl;
+        cout << "  score below the per-tick solve: " << std::setprecision(4) << score_gap / std::max(compared, 1)
+             << " on average; largest position error " << std::scientific << max_position_error << " m" << std::fixed << endl;
+        cout << "  largest joint step: " << max_step << " rad continued, " << max_escalated_step << " rad escalated"
+             << std::setprecision(2) << endl << endl;
+    }
+    return 0;
+}
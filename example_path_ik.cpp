@@ -0,0 +1,77 @@
+#include "path_ik.h"
+
+// compile with: g++ -I/usr/include/eigen3 example_path_ik.cpp path_ik.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o example_path_ik.exe
+
+int main() {
+    std::array<double, 7> neutral_pose = {0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0};
+    std::array<double, 7> current_pose = {-1.5, 0.5, 1.5, -1.5, 0.5, 0.5, 1.5};
+    
+    WeightedIKSolver solver(neutral_pose, 1.0, 0.5, 2.0, false);
+    
+    // Straight line of 200 waypoints with constant orientation
+    const int n_waypoints = 200;
+    std::array<double, 3> start = {0.23189, -0.0815989, 0.607269};
+    std::array<double, 9> orientation = {
+        -0.189536, 0.0420467, -0.980973,
+         0.404078, -0.907217, -0.116958,
+        -0.894873, -0.418557, 0.15496
+    };
+    std::vector<std::array<double, 3>> positions(n_waypoints);
+    std::vector<std::array<double, 9>> orientations(n_waypoints, orientation);
+    for (int w = 0; w < n_waypoints; w++) {
+        double t = (double)w / (n_waypoints - 1);
+        positions[w] = { start[0] + 0.15 * t, start[1] + 0.3 * t, start[2] - 0.1 * t };
+    }
+    
+    cout << "=== Whole-Path IK (" << n_waypoints << " waypoints) ===" << endl << endl;
+    
+    // Independent per-waypoint optimization, each waypoint starting from the previous result
+    auto start1 = high_resolution_clock::now();
+    std::array<double, 7> pose = current_pose;
+    std::array<double, 7> prev_pose = current_pose;
+    int flips = 0, prev_index = -1, failures = 0;
+    double max_step = 0.0;
+    for (int w = 0; w < n_waypoints; w++) {
+        WeightedIKResult result = solver.solve_q7_optimized(positions[w], orientations[w], pose, -2.8, 2.8);
+        if (!result.success) {
+            failures++;
+            continue;
+        }
+        if (w > 0) {
+            for (int k = 0; k < 7; k++) {
+                max_step = std::max(max_step, fabs(result.joint_angles[k] - prev_pose[k]));
+            }
+            if (result.solution_index != prev_index) flips++;
+        }
+        prev_index = result.solution_index;
+        prev_pose = result.joint_angles;
+        pose = result.joint_angles;
+    }
+    auto duration1 = duration_cast<microseconds>(high_resolution_clock::now() - start1);
+    
+    cout << "Per-waypoint solve_q7_optimized:" << endl;
+    cout << "  Failures: " << failures << ", branch flips: " << flips
+         << ", max joint step: " << std::setprecision(4) << max_step << " rad" << endl;
+    cout << "  Duration: " << duration1.count() << " μs" << endl << endl;
+    
+    // Dynamic programming over the whole path
+    PathIKSolver path_solver(solver, 32, 256, 0, 0.5);  // at most 0.5 rad per joint between waypoints
+    PathIKResult path = path_solver.solve(positions, orientations, current_pose, -2.8, 2.8);
+    
+    cout << "PathIKSolver:" << endl;
+    if (path.success) {
+        flips = 0;
+        for (int w = 1; w < n_waypoints; w++) {
+            if (path.solution_indices[w] != path.solution_indices[w - 1]) flips++;
+        }
+        cout << "  Branch flips: " << flips
+             << ", max joint step: " << std::setprecision(4) << path.max_joint_step << " rad" << endl;
+        cout << "  Total score: " << std::setprecision(6) << path.total_score
+             << ", candidates scored: " << path.nodes_evaluated << endl;
+    } else {
+        cout << "  No continuous solution, first failing waypoint: " << path.failed_waypoint << endl;
+    }
+    cout << "  Duration: " << path.duration_microseconds << " μs" << endl;
+    
+    return 0;
+}
@@ -12,8 +12,10 @@
  */
 
 #include "geofik.h"
-#include <iostream>
-#include <vector>
+#include "geofik_math.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
 
 
 #define d1 0.333
@@ -38,6 +40,14 @@
 
 // error threshold for swivel angle solver
 # define ERR_THRESH 0.01 // this slightly smaller than 1deg
+
+// diagnostics are compiled out unless GEOFIK_DEBUG_MESSAGES is defined: unreachable poses are
+// routine inside the optimizers, and printing would allocate and block in the solver's hot path
+#ifdef GEOFIK_DEBUG_MESSAGES
+# define GEOFIK_DEBUG(...) fprintf(stderr, __VA_ARGS__)
+#else
+# define GEOFIK_DEBUG(...) ((void)0)
+#endif
 // max number of points in discretisation for swivel angle solver
 const unsigned int MAX_N_POINTS = 1000;
 
@@ -45,24 +55,16 @@ const array<double, 7> q_low = { -2.8973, -1.7628, -2.8973, -3.0718, -2.8973, -0
 const array<double, 7> q_up = { 2.8973, 1.762, 2.8973, -0.0698, 2.8973, 3.7525, 2.8973 };
 const array<double, 7> q_mid = { 0.0, 0.0, 0.0, -1.5708, 0.0, 1.8675, 0.0 };
 
-// Jacobian at home configuration (orientation only)
-const Eigen::Matrix<double, 3, 7> J0_S({ {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
-                                        {0.0, 1.0, 0.0, -1.0, 0.0, -1.0, 0.0},
-                                        {1.0, 0.0, 1.0, 0.0, 1.0, 0.0, -1.0} });
-
-Eigen::Matrix3d tmp_R;
-Eigen::Matrix<double, 3, 7> tmp_J;
-Eigen::Matrix<double, 6, 7> tmp_J_6d;
-Eigen::Matrix<double, 3, 7> J_old;
-Eigen::Matrix<double, 3, 4> J_old_low;
-Eigen::Vector3d s;
+// scratch matrices shared by the helper functions below, one copy per thread so the IK can run concurrently
+thread_local Eigen::Matrix3d tmp_R;
+thread_local Eigen::Matrix<double, 6, 7> tmp_J_6d;
 
 void R_axis_angle(const Eigen::Vector3d& s, double theta) {
     double x = s[0];
     double y = s[1];
     double z = s[2];
-    double ct = cos(theta);
-    double st = sin(theta);
+    double ct, st;
+    geofik_sincos(theta, st, ct);
     double one_minus_ct = 1 - ct;
     tmp_R << ct + x * x * one_minus_ct, x* y* one_minus_ct - z * st, x* z* one_minus_ct + y * st,
         y* x* one_minus_ct + z * st, ct + y * y * one_minus_ct, y* z* one_minus_ct - x * st,
@@ -73,8 +75,8 @@ void R_axis_angle(const array<double, 3>& s, double theta) {
     double x = s[0];
     double y = s[1];
     double z = s[2];
-    double ct = cos(theta);
-    double st = sin(theta);
+    double ct, st;
+    geofik_sincos(theta, st, ct);
     double one_minus_ct = 1 - ct;
     tmp_R << ct + x * x * one_minus_ct, x* y* one_minus_ct - z * st, x* z* one_minus_ct + y * st,
         y* x* one_minus_ct + z * st, ct + y * y * one_minus_ct, y* z* one_minus_ct - x * st,
@@ -133,13 +135,8 @@ double Norm(const array<double, 3>& u) {
     return sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
 }
 
-void J_dir(const array<double, 3>& s2, const array<double, 3>& s3, const array<double, 3>& s4, const array<double, 3>& s5, const array<double, 3>& s6, const array<double, 3>& s7) {
-    tmp_J << 0, s2[0], s3[0], s4[0], s5[0], s6[0], s7[0],
-        0, s2[1], s3[1], s4[1], s5[1], s6[1], s7[1],
-        1, s2[2], s3[2], s4[2], s5[2], s6[2], s7[2];
-}
-
-void save_J_sol(const array<double, 3>& s2,
+template <bool Wrist>
+static void save_J_sol(const array<double, 3>& s2,
     const array<double, 3>& s3,
     const array<double, 3>& s4,
     const array<double, 3>& s5,
@@ -147,111 +144,209 @@ void save_J_sol(const array<double, 3>& s2,
     const array<double, 3>& s7,
     const array<double, 3>& r4,
     const array<double, 3>& r5,
-    const array<double, 3>& r_EO_O,
-    array<array<array<double, 6>, 7>, 8>& Jsols,
-    const int index,
-    const char Jacobian_ee) {
-    // saves the two Jacobian solutions for the given joint axes at Jsols[2*index] and Jsols[2*index+1]. 
-    // Jacobian_ee is the frame of the Jacobian end-effector ('6', '8', 'F' or 'E')
+    const array<double, 3>& r_See_O,
+    array<array<double, 6>, 7>& J1,
+    array<array<double, 6>, 7>& J2) {
+    // saves the two Jacobian solutions for the given joint axes at J1 and J2 (second shoulder solution).
+    // The end-effector of the Jacobian is frame 6 if Wrist, otherwise the one of r_See_O ('8', 'F' or 'E')
     // r4 = r_4S_O
     // r5 = r_5S_O
+    // r_See_O = r_S,ee_O (PreparedTarget::r_See), not used for '6'
     array<double, 3> r_1ee_O, r_4ee_O, r_5ee_O;
-    if (Jacobian_ee == '6') {
+    if constexpr (Wrist) {
         // r_P6_O = r_PS_O + r_S6_O
         //          r_PS_O - r_6S_O remember r_6S_O = r_5S_O
         r_1ee_O = { -r5[0], -r5[1], -r5[2] };
         r_4ee_O = { r4[0] - r5[0], r4[1] - r5[1] , r4[2] - r5[2] };
         r_5ee_O = { 0, 0 , 0 };
     }
-    else if (Jacobian_ee == '8' || Jacobian_ee == 'F') {
-        // r_PF_O = r_PE_O + r_EF_O
-        //        = r_PS_O - rEO_O + rSO_O + r_EF_O
-        //        = r_PS_O - rEO_O + (0,0,d1) + 0.1034*s7_O
-        r_1ee_O = { -r_EO_O[0] + 0.1034 * s7[0], -r_EO_O[1] + 0.1034 * s7[1], d1 - r_EO_O[2] + 0.1034 * s7[2] };
-        r_4ee_O = { r4[0] - r_EO_O[0] + 0.1034 * s7[0], r4[1] - r_EO_O[1] + 0.1034 * s7[1], d1 + r4[2] - r_EO_O[2] + 0.1034 * s7[2] };
-        r_5ee_O = { r5[0] - r_EO_O[0] + 0.1034 * s7[0], r5[1] - r_EO_O[1] + 0.1034 * s7[1], d1 + r5[2] - r_EO_O[2] + 0.1034 * s7[2] };
-    }
     else {
-        // r_PE_O = r_PS_O + r_SE_O
-        //        = r_PS_O - r_ES_O
-        //        = r_PS_O - (r_EO_O + r_OS_O) = r_PS_O - r_EO_O + r_SO_O
-        r_1ee_O = { -r_EO_O[0], -r_EO_O[1], d1 - r_EO_O[2] };
-        r_4ee_O = { r4[0] - r_EO_O[0], r4[1] - r_EO_O[1], d1 + r4[2] - r_EO_O[2] };
-        r_5ee_O = { r5[0] - r_EO_O[0], r5[1] - r_EO_O[1], d1 + r5[2] - r_EO_O[2] };
+        // r_Pee_O = r_PS_O + r_See_O, r_See_O only depends on the target (see prepare_target())
+        r_1ee_O = r_See_O;
+        r_4ee_O = { r4[0] + r_See_O[0], r4[1] + r_See_O[1], r4[2] + r_See_O[2] };
+        r_5ee_O = { r5[0] + r_See_O[0], r5[1] + r_See_O[1], r5[2] + r_See_O[2] };
     }
 
     array<double, 3> m;
-    Jsols[2 * index][0] = { 0, 0, 1, r_1ee_O[1], -r_1ee_O[0], 0 }; // r_1ee_O x (0,0,1) = (r_1ee_O[1], -r_1ee_O[0], 0)
-    Jsols[2 * index + 1][0] = { 0, 0, 1, r_1ee_O[1], -r_1ee_O[0], 0 };
+    J1[0] = { 0, 0, 1, r_1ee_O[1], -r_1ee_O[0], 0 }; // r_1ee_O x (0,0,1) = (r_1ee_O[1], -r_1ee_O[0], 0)
+    J2[0] = { 0, 0, 1, r_1ee_O[1], -r_1ee_O[0], 0 };
     Cross_(r_1ee_O, s2, m); // r_2ee_O = r_1ee_O
-    Jsols[2 * index][1] = { s2[0], s2[1], s2[2], m[0], m[1], m[2] };
-    Jsols[2 * index + 1][1] = { -s2[0], -s2[1], -s2[2], -m[0], -m[1], -m[2] }; // second solution of spherical shoulder
+    J1[1] = { s2[0], s2[1], s2[2], m[0], m[1], m[2] };
+    J2[1] = { -s2[0], -s2[1], -s2[2], -m[0], -m[1], -m[2] }; // second solution of spherical shoulder
     Cross_(r_1ee_O, s3, m); //  r3_ee = r1_ee
-    Jsols[2 * index][2] = { s3[0], s3[1], s3[2], m[0], m[1], m[2] };
-    Jsols[2 * index + 1][2] = { s3[0], s3[1], s3[2], m[0], m[1], m[2] };
+    J1[2] = { s3[0], s3[1], s3[2], m[0], m[1], m[2] };
+    J2[2] = { s3[0], s3[1], s3[2], m[0], m[1], m[2] };
     Cross_(r_4ee_O, s4, m);
-    Jsols[2 * index][3] = { s4[0], s4[1], s4[2], m[0], m[1], m[2] };
-    Jsols[2 * index + 1][3] = { s4[0], s4[1], s4[2], m[0], m[1], m[2] };
+    J1[3] = { s4[0], s4[1], s4[2], m[0], m[1], m[2] };
+    J2[3] = { s4[0], s4[1], s4[2], m[0], m[1], m[2] };
     Cross_(r_5ee_O, s5, m);
-    Jsols[2 * index][4] = { s5[0], s5[1], s5[2], m[0], m[1], m[2] };
-    Jsols[2 * index + 1][4] = { s5[0], s5[1], s5[2], m[0], m[1], m[2] };
+    J1[4] = { s5[0], s5[1], s5[2], m[0], m[1], m[2] };
+    J2[4] = { s5[0], s5[1], s5[2], m[0], m[1], m[2] };
     Cross_(r_5ee_O, s6, m); // r6 = r5
-    Jsols[2 * index][5] = { s6[0], s6[1], s6[2], m[0], m[1], m[2] };
-    Jsols[2 * index + 1][5] = { s6[0], s6[1], s6[2], m[0], m[1], m[2] };
-    if (Jacobian_ee == '6') {
-        Jsols[2 * index][6] = { 0, 0, 0, 0, 0, 0 };
-        Jsols[2 * index + 1][6] = { 0, 0, 0, 0, 0, 0 };
+    J1[5] = { s6[0], s6[1], s6[2], m[0], m[1], m[2] };
+    J2[5] = { s6[0], s6[1], s6[2], m[0], m[1], m[2] };
+    if constexpr (Wrist) {
+        J1[6] = { 0, 0, 0, 0, 0, 0 };
+        J2[6] = { 0, 0, 0, 0, 0, 0 };
     }
     else {
-        Jsols[2 * index][6] = { s7[0], s7[1], s7[2], 0, 0, 0 };
-        Jsols[2 * index + 1][6] = { s7[0], s7[1], s7[2], 0, 0, 0 };
+        J1[6] = { s7[0], s7[1], s7[2], 0, 0, 0 };
+        J2[6] = { s7[0], s7[1], s7[2], 0, 0, 0 };
+    }
+}
+
+double manipulability_from_axes(const array<double, 3>& s2,
+    const array<double, 3>& s3,
+    const array<double, 3>& s4,
+    const array<double, 3>& s5,
+    const array<double, 3>& s6,
+    const array<double, 3>& s7,
+    const array<double, 3>& r4,
+    const array<double, 3>& r5,
+    const array<double, 3>& r7) {
+    // sqrt(det(J J^T)) of the Jacobian save_J_sol<false> would build for ee 'E', 'F' or '8', without forming J.
+    // det(J J^T) does not depend on the reference point, so take the shoulder point S: the columns of
+    // joints 1-3 are then (s_i, 0) and the others (s_i, b_i) with b_i = r_iS_O x s_i. By Cauchy-Binet
+    // det(J J^T) is the sum of the squared 6x6 minors J_k (J without column k):
+    // - k = 4..7: J_k is block triangular, det = det[s1 s2 s3] * M_k, M_k the 3x3 minor of b4..b7 without b_k.
+    // - k = 1..3: Laplace expansion along the moment rows, det = sum_l +-det[s_i s_j s_l] M_l (i, j != k).
+    // Flipping s2 only changes signs, so both shoulder solutions share the value.
+    // r7 is any point of axis 7 relative to S, e.g. r_ES_O.
+    array<double, 3> b4, b5, b6, b7, b67, b45;
+    Cross_(r4, s4, b4);
+    Cross_(r5, s5, b5);
+    Cross_(r5, s6, b6);
+    Cross_(r7, s7, b7);
+    Cross_(b6, b7, b67);
+    Cross_(b4, b5, b45);
+    double M[4] = { Dot(b5, b67), Dot(b4, b67), Dot(b45, b7), Dot(b45, b6) };
+    // s_i x s_j for the pairs left when removing joint 1, 2 or 3 (s1 = z_O)
+    array<double, 3> c[3];
+    Cross_(s2, s3, c[0]);
+    c[1] = { -s3[1], s3[0], 0 };
+    c[2] = { -s2[1], s2[0], 0 };
+    double T123 = Dot(c[2], s3);
+    double det = T123 * T123 * (M[0] * M[0] + M[1] * M[1] + M[2] * M[2] + M[3] * M[3]);
+    for (int k = 0; k < 3; k++) {
+        double D = Dot(c[k], s4) * M[0] - Dot(c[k], s5) * M[1] + Dot(c[k], s6) * M[2] - Dot(c[k], s7) * M[3];
+        det += D * D;
     }
+    return sqrt(det);
 }
 
 double signed_angle(const Eigen::Vector3d& v1, const Eigen::Vector3d& v2, const Eigen::Vector3d& s) {
-    return atan2(Dot(Cross(v1, v2), s), Dot(v1, v2));
+    return geofik_atan2(Dot(Cross(v1, v2), s), Dot(v1, v2));
 }
 
 double signed_angle(const array<double, 3>& v1, const array<double, 3>& v2, const array<double, 3>& s) {
     //return atan2(s[2]*(v1[0]*v2[1] - v1[1]*v2[0]) - s[1]*(v1[0]*v2[2] - v1[2]*v2[0]) + s[0]*(v1[1]*v2[2] - v1[2]*v2[1]), v1[0]*v2[0] + v1[1]*v2[1] + v1[2]*v2[2]);
-    return atan2(Dot(Cross(v1, v2), s), Dot(v1, v2));
+    return geofik_atan2(Dot(Cross(v1, v2), s), Dot(v1, v2));
 }
 
-void check_limits(array<double, 7>& q, int n) {
-    for (int i; i < n; i++) {
-        q[i] = q_mid[i] + atan2(sin(q[i] - q_mid[i]), cos(q[i] - q_mid[i]));
-        if (q[i] < q_low[i] || q[i] > q_up[i]) q[i] = NAN;
+// Joint limits and wrap centers of all 8 solutions, laid out like the rows of qsols
+struct SolutionLimits {
+    double mid[56], low[56], up[56];
+};
+
+static const SolutionLimits solution_limits = [] {
+    SolutionLimits t;
+    for (int k = 0; k < 56; k++) {
+        t.mid[k] = q_mid[k % 7];
+        t.low[k] = q_low[k % 7];
+        t.up[k] = q_up[k % 7];
+    }
+    return t;
+}();
+
+unsigned int screen_solutions(array<array<double, 7>, 8>& qsols, const unsigned int n, array<unsigned char, 8>& violations) {
+    // Wraps every joint of every solution to within pi of the middle of its range and replaces the
+    // joints outside the limits (or undefined) with NaN, in one branch-free pass over the 8x7 block.
+    // Rows past n are NaN already and stay so.
+    // OUTPUT: validity mask, bit i set if solution i < n has all joints within limits.
+    //         violations[i], bit j set if joint j of solution i is invalid (0 for i >= n).
+    static_assert(sizeof(qsols) == 56 * sizeof(double), "solutions must be contiguous");
+    const double two_pi = 2 * PI;
+    const double inv_two_pi = 1 / (2 * PI);
+    double* q = qsols[0].data();
+    unsigned char out[56];
+    for (int k = 0; k < 56; k++) {
+        double d = q[k] - solution_limits.mid[k];
+        d -= two_pi * floor(d * inv_two_pi + 0.5);
+        double v = solution_limits.mid[k] + d;
+        bool bad = !(v >= solution_limits.low[k] && v <= solution_limits.up[k]);
+        q[k] = bad ? NAN : v;
+        out[k] = bad;
     }
+    unsigned int valid = 0;
+    for (unsigned int i = 0; i < 8; i++) {
+        unsigned char bits = 0;
+        for (int j = 0; j < 7; j++)
+            bits |= out[7 * i + j] << j;
+        violations[i] = i < n ? bits : 0;
+        if (i < n && bits == 0) valid |= 1u << i;
+    }
+    return valid;
 }
 
-// whole rotational part of J
-array<double, 6> q_from_J(const Eigen::Matrix<double, 3, 7>& J) {
-    const int dof = 7;
-    array<double, dof - 1> q;
-    J_old = J0_S; // [3,dof]
-    for (int i = 0; i < dof - 1; i++) {
-        s = J.col(i);
-        q[i] = signed_angle(J_old.col(i + 1), J.col(i + 1), s);
-        if (i == dof - 2) break;
-        R_axis_angle(s, q[i]);
-        J_old.block(0, i + 1, 3, dof - (i + 1)) = tmp_R * J_old.block(0, i + 1, 3, dof - (i + 1));
+bool screen_solution(array<double, 7>& q) {
+    // Same as screen_solutions() for a single solution. OUTPUT: true if all joints are within limits.
+    const double two_pi = 2 * PI;
+    const double inv_two_pi = 1 / (2 * PI);
+    bool valid = true;
+    for (int j = 0; j < 7; j++) {
+        double d = q[j] - solution_limits.mid[j];
+        d -= two_pi * floor(d * inv_two_pi + 0.5);
+        double v = solution_limits.mid[j] + d;
+        bool bad = !(v >= solution_limits.low[j] && v <= solution_limits.up[j]);
+        q[j] = bad ? NAN : v;
+        valid &= !bad;
     }
-    return q;
+    return valid;
 }
 
-// lower rotationa part of J
-array<double, 3> q_from_low_J(const Eigen::Matrix<double, 3, 7>& J) {
-    const int dof = 4;
-    array<double, dof - 1> q;
-    J_old_low = J0_S.block(0, 0, 3, dof); // [3,dof]
-    for (int i = 0; i < dof - 1; i++) {
-        s = J.col(i);
-        q[i] = signed_angle(J_old_low.col(i + 1), J.col(i + 1), s);
-        if (i == dof - 2) break;
-        R_axis_angle(s, q[i]);
-        J_old_low.block(0, i + 1, 3, dof - (i + 1)) = tmp_R * J_old_low.block(0, i + 1, 3, dof - (i + 1));
-    }
-    return q;
+// q1, ..., q6 from the joint axes s2, ..., s7 (s1 = z_O), one atan2 per joint.
+// q_i is the angle about s_i from where s_(i+1) is at q_i = 0 to where it is. Consecutive axes are
+// perpendicular and at the home configuration s_(i+1) = +-s_(i-1), so that reference is +-s_(i-1),
+// which joint i does not move (s1 = z_O and s3 = z_O at home, s4 = -s2, s5 = s3, s6 = s4, s7 = -s5).
+void q_from_axes(const array<double, 3>& s2,
+    const array<double, 3>& s3,
+    const array<double, 3>& s4,
+    const array<double, 3>& s5,
+    const array<double, 3>& s6,
+    const array<double, 3>& s7,
+    double* q) {
+    array<double, 3> n;
+    q[0] = geofik_atan2(-s2[0], s2[1]); // reference y_O
+    q[1] = geofik_atan2(s2[1] * s3[0] - s2[0] * s3[1], s3[2]); // reference z_O
+    Cross_(s2, s4, n);
+    q[2] = geofik_atan2(-Dot(n, s3), -Dot(s2, s4));
+    Cross_(s3, s5, n);
+    q[3] = geofik_atan2(Dot(n, s4), Dot(s3, s5));
+    Cross_(s4, s6, n);
+    q[4] = geofik_atan2(Dot(n, s5), Dot(s4, s6));
+    Cross_(s5, s7, n);
+    q[5] = geofik_atan2(-Dot(n, s6), -Dot(s5, s7));
+}
+
+void save_q_sols(const array<double, 3>& s2,
+    const array<double, 3>& s3,
+    const array<double, 3>& s4,
+    const array<double, 3>& s5,
+    const array<double, 3>& s6,
+    const array<double, 3>& s7,
+    const double q7,
+    array<array<double, 7>, 8>& qsols,
+    const int index) {
+    // saves the two joint solutions for the given joint axes at qsols[2*index] and qsols[2*index+1].
+    // The second shoulder solution has s2 flipped, which turns q2 into -q2 and shifts q1 and q3 by pi.
+    array<double, 7>& sol1 = qsols[2 * index];
+    array<double, 7>& sol2 = qsols[2 * index + 1];
+    q_from_axes(s2, s3, s4, s5, s6, s7, sol1.data());
+    sol1[6] = q7;
+    sol2 = sol1;
+    sol2[0] = sol1[0] > 0 ? sol1[0] - PI : sol1[0] + PI;
+    sol2[1] = -sol1[1];
+    sol2[2] = sol1[2] > 0 ? sol1[2] - PI : sol1[2] + PI;
 }
 
 // whole Jacobian and q
@@ -259,10 +354,6 @@ array<double, 7> J_to_q(const array<array<double, 6>, 7>& J, const array<array<d
     // J is the transpose of the Jacobian
     // R is the rotation matrix of frame ee
     // ee must be a frame attached to the gripper: "E", "F" or "8".
-    Eigen::Matrix<double, 3, 7> Jrot;
-    Jrot << J[0][0], J[1][0], J[2][0], J[3][0], J[4][0], J[5][0], J[6][0],
-        J[0][1], J[1][1], J[2][1], J[3][1], J[4][1], J[5][1], J[6][1],
-        J[0][2], J[1][2], J[2][2], J[3][2], J[4][2], J[5][2], J[6][2];
     const int dof = 7;
     array<double, dof> q;
     array<double, 3> i7, ie, s6, s7;
@@ -271,14 +362,8 @@ array<double, 7> J_to_q(const array<array<double, 6>, 7>& J, const array<array<d
     Cross_(s6, s7, i7);
     ie = { R[0][0], R[1][0], R[2][0] };
     q[6] = signed_angle(i7, ie, s7) + (ee == 'E' ? -PI / 4 : 0);
-    J_old = J0_S; // [3,dof]
-    for (int i = 0; i < dof - 1; i++) {
-        s = Jrot.col(i);
-        q[i] = signed_angle(J_old.col(i + 1), Jrot.col(i + 1), s);
-        if (i == dof - 2) break;
-        R_axis_angle(s, q[i]);
-        J_old.block(0, i + 1, 3, dof - (i + 1)) = tmp_R * J_old.block(0, i + 1, 3, dof - (i + 1));
-    }
+    q_from_axes({ J[1][0], J[1][1], J[1][2] }, { J[2][0], J[2][1], J[2][2] }, { J[3][0], J[3][1], J[3][2] },
+        { J[4][0], J[4][1], J[4][2] }, s6, s7, q.data());
     return q;
 }
 
@@ -397,28 +482,370 @@ void franka_fk_all_frames(array<Eigen::Matrix4d, 9>& Ts, const array<double, 7>&
         Ts[i] = Ts[i - 1] * Ti[i];
 }
 
+// Frame f from frame f - 1: R_f = R_{f-1} RotX(alpha) RotZ(q), p_f = p_{f-1} + R_{f-1} t, with
+// alpha = 0 or +-pi/2 (sa = sin(alpha) = 0 or +-1), the form of every joint in get_frame_transforms()
+static inline void fk_joint_step(const array<double, 9>& Rp, const array<double, 3>& pp, const double sa,
+                                 const double tx, const double ty, const double tz, const double c, const double s,
+                                 array<double, 9>& R, array<double, 3>& p) {
+    // Columns of RotX(alpha) RotZ(q): (c, ca s, sa s), (-s, ca c, sa c), (0, -sa, ca), ca = 1 - |sa|
+    const double ca = 1.0 - fabs(sa);
+    for (int i = 0; i < 3; i++) {
+        const double* row = &Rp[3 * i];
+        R[3 * i] = row[0] * c + (row[1] * ca + row[2] * sa) * s;
+        R[3 * i + 1] = -row[0] * s + (row[1] * ca + row[2] * sa) * c;
+        R[3 * i + 2] = -row[1] * sa + row[2] * ca;
+        p[i] = pp[i] + row[0] * tx + row[1] * ty + row[2] * tz;
+    }
+}
 
-unsigned int franka_ik_q7(const array<double, 3>& r,
-                          const array<double, 9>& ROE,
-                          const double q7,
-                          array<array<double, 7>, 8>& qsols,
-                          const double q1_sing) {
-    // IK with q7 as free variable
-    // INPUT: r = r_EO_O, position of frame E in frame O
-    //        ROE, orientation of frame E in frame O
-    //        q7, joint angle of joint 7
-    //        qsols, array to store 8 solutions
-    //        q1_sing, emergency value of q1 in case of singularity at shoulder joints.
+void franka_fk_all_frames(const array<double, 7>& q, FrankaFrames& frames) {
+    // Same frames as franka_fk_all_frames(Ts, q), shifted by one (frame O first). libm in both
+    // accuracy tiers, like the other FK
+    array<double, 7> c, s;
+    for (int j = 0; j < 7; j++) {
+        s[j] = sin(q[j]);
+        c[j] = cos(q[j]);
+    }
+    frames.R[0] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+    frames.p[0] = { 0, 0, 0 };
+    fk_joint_step(frames.R[0], frames.p[0], 0, 0, 0, d1, c[0], s[0], frames.R[1], frames.p[1]);
+    fk_joint_step(frames.R[1], frames.p[1], -1, 0, 0, 0, c[1], s[1], frames.R[2], frames.p[2]);
+    fk_joint_step(frames.R[2], frames.p[2], 1, 0, -d3, 0, c[2], s[2], frames.R[3], frames.p[3]);
+    fk_joint_step(frames.R[3], frames.p[3], 1, a4, 0, 0, c[3], s[3], frames.R[4], frames.p[4]);
+    fk_joint_step(frames.R[4], frames.p[4], -1, -a5, d5, 0, c[4], s[4], frames.R[5], frames.p[5]);
+    fk_joint_step(frames.R[5], frames.p[5], 1, 0, 0, 0, c[5], s[5], frames.R[6], frames.p[6]);
+    fk_joint_step(frames.R[6], frames.p[6], 1, a7, 0, 0, c[6], s[6], frames.R[7], frames.p[7]);
+    // Flange: 0.107 along z7; E: 0.1034 further and -pi/4 about z
+    const array<double, 9>& R7 = frames.R[7];
+    frames.R[8] = R7;
+    for (int i = 0; i < 3; i++) frames.p[8][i] = frames.p[7][i] + 0.107 * R7[3 * i + 2];
+    const double h = sqrt(0.5);
+    for (int i = 0; i < 3; i++) {
+        frames.R[9][3 * i] = h * (R7[3 * i] - R7[3 * i + 1]);
+        frames.R[9][3 * i + 1] = h * (R7[3 * i] + R7[3 * i + 1]);
+        frames.R[9][3 * i + 2] = R7[3 * i + 2];
+        frames.p[9][i] = frames.p[7][i] + dE * R7[3 * i + 2];
+    }
+}
+
+void franka_fk_all_frames(const double* q, unsigned int n, size_t stride, FrankaFrames* frames) {
+    array<double, 7> qk;
+    for (unsigned int k = 0; k < n; k++) {
+        std::copy_n(q + k * stride, 7, qk.begin());
+        franka_fk_all_frames(qk, frames[k]);
+    }
+}
+
+// Configurations per block of franka_fk_frames_soa: the loops over a block are the vector loops
+static constexpr size_t FK_BLOCK = 8;
+
+// Twist and offset of each joint in fk_joint_step() form
+struct FKJointConstants {
+    double sa, tx, ty, tz;
+};
+static constexpr FKJointConstants FK_JOINTS[7] = {
+    { 0, 0, 0, d1 }, { -1, 0, 0, 0 }, { 1, 0, -d3, 0 }, { 1, a4, 0, 0 }, { -1, -a5, d5, 0 }, { 1, 0, 0, 0 }, { 1, a7, 0, 0 },
+};
+
+// fk_joint_step() of joint j on every configuration of a block, in place. One instantiation per
+// joint, so the terms multiplied by the zero constants drop out.
+template <int j>
+static inline void fk_joint_step_soa(double (&R)[9][FK_BLOCK], double (&p)[3][FK_BLOCK],
+                                     const double (&c)[FK_BLOCK], const double (&s)[FK_BLOCK]) {
+    constexpr FKJointConstants joint = FK_JOINTS[j];
+    constexpr double ca = 1.0 - (joint.sa < 0 ? -joint.sa : joint.sa);
+    for (int i = 0; i < 3; i++) {
+        for (size_t k = 0; k < FK_BLOCK; k++) {
+            const double r0 = R[3 * i][k], r1 = R[3 * i + 1][k], r2 = R[3 * i + 2][k];
+            const double u = r1 * ca + r2 * joint.sa;
+            p[i][k] += r0 * joint.tx + r1 * joint.ty + r2 * joint.tz;
+            R[3 * i][k] = r0 * c[k] + u * s[k];
+            R[3 * i + 1][k] = -r0 * s[k] + u * c[k];
+            R[3 * i + 2][k] = -r1 * joint.sa + r2 * ca;
+        }
+    }
+}
+
+// Row of a block into its output row, configurations [0, count) of the block. A full block is a
+// fixed-size copy, which compiles to vector moves rather than a memmove call
+static inline void fk_store_row(const double (&row)[FK_BLOCK], size_t count, double* out) {
+    if (count == FK_BLOCK) {
+        for (size_t k = 0; k < FK_BLOCK; k++) out[k] = row[k];
+    }
+    else {
+        for (size_t k = 0; k < count; k++) out[k] = row[k];
+    }
+}
+
+// Frame f of a block into its rows
+static inline void fk_store_soa(const double (&R)[9][FK_BLOCK], const double (&p)[3][FK_BLOCK], int f,
+                                size_t count, const FrankaFramesSoA& frames, size_t start) {
+    for (int e = 0; e < 9; e++) fk_store_row(R[e], count, frames.R + (9 * f + e) * frames.ld + start);
+    for (int i = 0; i < 3; i++) fk_store_row(p[i], count, frames.p + (3 * f + i) * frames.ld + start);
+}
+
+// franka_fk_frames_soa() in blocks of FK_BLOCK, with the joint rows of q ld apart
+static void fk_frames_soa_blocks(const double* q, size_t ld, size_t n, unsigned int mask, const FrankaFramesSoA& frames) {
+    for (size_t start = 0; start < n; start += FK_BLOCK) {
+        const size_t count = std::min(n - start, FK_BLOCK);
+        // The last block is padded with zero angles, computed and not stored
+        double s[7][FK_BLOCK], c[7][FK_BLOCK], angles[FK_BLOCK] = {};
+        for (int j = 0; j < 7; j++) {
+            std::copy_n(q + j * ld + start, count, angles);
+            for (size_t k = 0; k < FK_BLOCK; k++) fast_sincos(angles[k], s[j][k], c[j][k]);
+        }
+
+        double R[9][FK_BLOCK], p[3][FK_BLOCK];
+        if (mask & 1u) {
+            for (int e = 0; e < 9; e++) std::fill_n(R[e], FK_BLOCK, e % 4 == 0 ? 1.0 : 0.0);
+            for (int i = 0; i < 3; i++) std::fill_n(p[i], FK_BLOCK, 0.0);
+            fk_store_soa(R, p, 0, count, frames, start);
+        }
+        // Frame 1: RotZ(q1) at (0, 0, d1), the step of joint 1 from the identity
+        for (size_t k = 0; k < FK_BLOCK; k++) {
+            R[0][k] = c[0][k]; R[1][k] = -s[0][k]; R[2][k] = 0.0;
+            R[3][k] = s[0][k]; R[4][k] = c[0][k];  R[5][k] = 0.0;
+            R[6][k] = 0.0;     R[7][k] = 0.0;      R[8][k] = 1.0;
+            p[0][k] = 0.0;     p[1][k] = 0.0;      p[2][k] = d1;
+        }
+        if (mask & 2u) fk_store_soa(R, p, 1, count, frames, start);
+        // Frames 2 to 7, stopping after the last one needed
+        if (mask >> 2) { fk_joint_step_soa<1>(R, p, c[1], s[1]); if (mask & (1u << 2)) fk_store_soa(R, p, 2, count, frames, start); }
+        if (mask >> 3) { fk_joint_step_soa<2>(R, p, c[2], s[2]); if (mask & (1u << 3)) fk_store_soa(R, p, 3, count, frames, start); }
+        if (mask >> 4) { fk_joint_step_soa<3>(R, p, c[3], s[3]); if (mask & (1u << 4)) fk_store_soa(R, p, 4, count, frames, start); }
+        if (mask >> 5) { fk_joint_step_soa<4>(R, p, c[4], s[4]); if (mask & (1u << 5)) fk_store_soa(R, p, 5, count, frames, start); }
+        if (mask >> 6) { fk_joint_step_soa<5>(R, p, c[5], s[5]); if (mask & (1u << 6)) fk_store_soa(R, p, 6, count, frames, start); }
+        if (mask >> 7) { fk_joint_step_soa<6>(R, p, c[6], s[6]); if (mask & (1u << 7)) fk_store_soa(R, p, 7, count, frames, start); }
+        if (!(mask >> 8)) continue;
+
+        // Flange: 0.107 along z7; E: 0.1034 further and -pi/4 about z
+        const double h = sqrt(0.5);
+        double p_end[3][FK_BLOCK];
+        if (mask & (1u << 8)) {
+            for (int i = 0; i < 3; i++)
+                for (size_t k = 0; k < FK_BLOCK; k++) p_end[i][k] = p[i][k] + 0.107 * R[3 * i + 2][k];
+            fk_store_soa(R, p_end, 8, count, frames, start);
+        }
+        if (mask & (1u << 9)) {
+            for (int i = 0; i < 3; i++) {
+                for (size_t k = 0; k < FK_BLOCK; k++) {
+                    const double x = R[3 * i][k], y = R[3 * i + 1][k];
+                    R[3 * i][k] = h * (x - y);
+                    R[3 * i + 1][k] = h * (x + y);
+                    p_end[i][k] = p[i][k] + dE * R[3 * i + 2][k];
+                }
+            }
+            fk_store_soa(R, p_end, 9, count, frames, start);
+        }
+    }
+}
+
+// Configurations per tile: the frames of a tile are computed into a buffer on the stack (120 KB),
+// then copied row by row. Stored straight from the blocks, 8 doubles to each of 120 rows at a
+// time, large batches ran at half the speed
+static constexpr size_t FK_TILE = 128;
+
+void franka_fk_frames_soa(const double* q, size_t n, unsigned int mask, const FrankaFramesSoA& frames) {
+    double R[90 * FK_TILE], p[30 * FK_TILE];
+    const FrankaFramesSoA tile = { R, p, FK_TILE };
+    for (size_t start = 0; start < n; start += FK_TILE) {
+        const size_t count = std::min(n - start, FK_TILE);
+        fk_frames_soa_blocks(q + start, frames.ld, count, mask, tile);
+        for (int f = 0; f < 10; f++) {
+            if (!(mask & (1u << f))) continue;
+            for (int e = 0; e < 9; e++) std::copy_n(R + (9 * f + e) * FK_TILE, count, frames.R + (9 * f + e) * frames.ld + start);
+            for (int i = 0; i < 3; i++) std::copy_n(p + (3 * f + i) * FK_TILE, count, frames.p + (3 * f + i) * frames.ld + start);
+        }
+    }
+}
+
+void franka_fk_frames_soa(const double* q, size_t n, unsigned int mask, const FrankaFramesSoA& frames, int n_threads) {
+    if (n_threads <= 0) n_threads = max(1, (int)std::thread::hardware_concurrency());
+    // Whole blocks per thread, at least one
+    const size_t n_blocks = (n + FK_BLOCK - 1) / FK_BLOCK;
+    const size_t n_workers = std::min((size_t)n_threads, n_blocks);
+    if (n_workers <= 1) {
+        franka_fk_frames_soa(q, n, mask, frames);
+        return;
+    }
+    auto work = [&](size_t worker) {
+        const size_t begin = std::min(n, worker * n_blocks / n_workers * FK_BLOCK);
+        const size_t end = std::min(n, (worker + 1) * n_blocks / n_workers * FK_BLOCK);
+        const FrankaFramesSoA range = { frames.R + begin, frames.p + begin, frames.ld };
+        franka_fk_frames_soa(q + begin, end - begin, mask, range);
+    };
+    vector<std::thread> threads;
+    for (size_t t = 1; t < n_workers; t++) threads.emplace_back(work, t);
+    work(0);
+    for (auto& thread : threads) thread.join();
+}
+
+
+void prepare_target(const array<double, 3>& r,
+                    const array<double, 9>& ROE,
+                    PreparedTarget& target,
+                    const char Jacobian_ee) {
+    // Everything the IK functions derive from the pose alone
+    // NOTATION: see franka_ik_q7(), u_7S = r_O7S_O/norm(r_O7S_O)
+    target.r = r;
+    target.ROE = ROE;
+    target.i_E = { ROE[0], ROE[3], ROE[6] };
+    target.k_E = { ROE[2], ROE[5], ROE[8] };
+    const array<double, 3>& k_E_O = target.k_E;
+    target.r_ES = { r[0], r[1], r[2] - d1 };
+    array<double, 3> tmp_v;
+    Cross_(target.r_ES, k_E_O, tmp_v);
+    target.s7_through_S = tmp_v[0] * tmp_v[0] + tmp_v[1] * tmp_v[1] + tmp_v[2] * tmp_v[2] < SING_TOL;
+    //r_O7S_O = r_EO_O + r_OS_O + r_O7E_O = r_EO_O - (0,0,d1) - dE*k_E_O
+    const array<double, 3>& r_O7S_O = target.r_7S = { target.r_ES[0] - dE * k_E_O[0], target.r_ES[1] - dE * k_E_O[1], target.r_ES[2] - dE * k_E_O[2] };
+    target.r_7S_E = { ROE[0] * r_O7S_O[0] + ROE[3] * r_O7S_O[1] + ROE[6] * r_O7S_O[2],
+                      ROE[1] * r_O7S_O[0] + ROE[4] * r_O7S_O[1] + ROE[7] * r_O7S_O[2],
+                      ROE[2] * r_O7S_O[0] + ROE[5] * r_O7S_O[1] + ROE[8] * r_O7S_O[2] };
+    target.L_7S_E = sqrt(target.r_7S_E[0] * target.r_7S_E[0] + target.r_7S_E[1] * target.r_7S_E[1]);
+    target.phi_7S_E = geofik_atan2(-target.r_7S_E[1], -target.r_7S_E[0]);
+    // Rodrigues: R(k_E_O, a) * i_E_O = i_par + cos(a) * i_perp + sin(a) * (k_E_O x i_E_O)
+    double tmp = Dot(k_E_O, target.i_E);
+    target.i_par = { tmp * k_E_O[0], tmp * k_E_O[1], tmp * k_E_O[2] };
+    target.i_perp = { target.i_E[0] - target.i_par[0], target.i_E[1] - target.i_par[1], target.i_E[2] - target.i_par[2] };
+    Cross_(k_E_O, target.i_E, target.j_perp);
+    tmp = sqrt(r_O7S_O[1] * r_O7S_O[1] + r_O7S_O[0] * r_O7S_O[0]);
+    target.n1_defined = tmp >= SING_TOL;
+    if (target.n1_defined)
+        target.n1 = { r_O7S_O[1] / tmp, -r_O7S_O[0] / tmp, 0 };
+    else
+        target.n1 = { NAN, NAN, NAN };
+    tmp = Norm(r_O7S_O);
+    target.u_7S = { r_O7S_O[0] / tmp, r_O7S_O[1] / tmp, r_O7S_O[2] / tmp };
+    target.Jacobian_ee = Jacobian_ee;
+    if (Jacobian_ee == '8' || Jacobian_ee == 'F') {
+        // r_SF_O = r_SE_O + r_EF_O = -r_ES_O + 0.1034*s7_O
+        target.r_See = { -target.r_ES[0] + 0.1034 * k_E_O[0], -target.r_ES[1] + 0.1034 * k_E_O[1], -target.r_ES[2] + 0.1034 * k_E_O[2] };
+    }
+    else {
+        // r_SE_O = -r_ES_O ('6' depends on the solution, see save_J_sol())
+        target.r_See = { -target.r_ES[0], -target.r_ES[1], -target.r_ES[2] };
+    }
+}
+
+static void q7_frame(const PreparedTarget& target,
+                     const double q7,
+                     array<double, 3>& s6,
+                     array<double, 3>& r6) {
+    // frame of joint 6 for a value of q7: i_6_O = R(k_E_O, -(q7 - PI/4)) * i_E_O, s6 = k_E_O x i_6_O
+    // and r6 = r_O7S_O - a7 * i_6_O
+    double c, s;
+    geofik_sincos(-(q7 - PI / 4), s, c);
+    array<double, 3> i_6_O = { target.i_par[0] + c * target.i_perp[0] + s * target.j_perp[0],
+                               target.i_par[1] + c * target.i_perp[1] + s * target.j_perp[1],
+                               target.i_par[2] + c * target.i_perp[2] + s * target.j_perp[2] };
+    Cross_(target.k_E, i_6_O, s6);
+    r6 = { target.r_7S[0] - a7 * i_6_O[0], target.r_7S[1] - a7 * i_6_O[1], target.r_7S[2] - a7 * i_6_O[2] };
+}
+
+// IK KERNELS =============================================================================================
+// One kernel per free variable, compiled for each combination of outputs listed in geofik.h (see
+// IKOutput). Every requested output is written for the solutions found and NaN past them, the others
+// are not touched.
+
+// Outputs that need the points r4 and r6 of the solutions
+static constexpr unsigned int IK_POINTS = IK_JACOBIAN | IK_JACOBIAN_WRIST | IK_MANIPULABILITY | IK_LINKS;
+
+template <unsigned int Outputs>
+static void store_solution(const PreparedTarget& target,
+                           const array<double, 3>& s2,
+                           const array<double, 3>& s3,
+                           const array<double, 3>& s4,
+                           const array<double, 3>& s5,
+                           const array<double, 3>& s6,
+                           const array<double, 3>& r4,
+                           const array<double, 3>& r6,
+                           const double q7,
+                           const IKKernelOutput& out,
+                           const int index) {
+    // stores the requested outputs of the two shoulder solutions of one set of joint axes at 2*index and 2*index+1
+    // r4 = r_4S_O, r6 = r_6S_O (only set by the kernels if Outputs & IK_POINTS)
+    const array<double, 3>& s7 = target.k_E;
+    if constexpr ((Outputs & IK_ANGLES) != 0)
+        save_q_sols(s2, s3, s4, s5, s6, s7, q7, *out.q, index);
+    if constexpr ((Outputs & IK_JACOBIAN) != 0)
+        save_J_sol<false>(s2, s3, s4, s5, s6, s7, r4, r6, target.r_See, (*out.J)[2 * index], (*out.J)[2 * index + 1]);
+    if constexpr ((Outputs & IK_JACOBIAN_WRIST) != 0)
+        save_J_sol<true>(s2, s3, s4, s5, s6, s7, r4, r6, target.r_See, (*out.J)[2 * index], (*out.J)[2 * index + 1]);
+    if constexpr ((Outputs & IK_MANIPULABILITY) != 0)
+        (*out.manipulability)[2 * index] = (*out.manipulability)[2 * index + 1] = manipulability_from_axes(s2, s3, s4, s5, s6, s7, r4, r6, target.r_ES);
+    if constexpr ((Outputs & IK_LINKS) != 0) {
+        // r_iO_O = r_iS_O + (0, 0, d1), the same for both shoulder solutions
+        (*out.links)[2 * index][0] = { r4[0], r4[1], r4[2] + d1 };
+        (*out.links)[2 * index][1] = { r6[0], r6[1], r6[2] + d1 };
+        (*out.links)[2 * index + 1] = (*out.links)[2 * index];
+    }
+}
+
+template <unsigned int Outputs>
+static unsigned int finish_solutions(const IKKernelOutput& out, const unsigned int n) {
+    // NaN past the n solutions found in every requested output, then the validity of the n solutions
+    static_assert((Outputs & IK_VALIDITY) == 0 || (Outputs & IK_ANGLES) != 0, "IK_VALIDITY needs IK_ANGLES");
+    static_assert((Outputs & IK_JACOBIAN) == 0 || (Outputs & IK_JACOBIAN_WRIST) == 0, "one Jacobian per call");
+    for (unsigned int i = n; i < 8; i++) {
+        if constexpr ((Outputs & IK_ANGLES) != 0)
+            fill((*out.q)[i].begin(), (*out.q)[i].end(), NAN);
+        if constexpr ((Outputs & (IK_JACOBIAN | IK_JACOBIAN_WRIST)) != 0)
+            for (auto& row : (*out.J)[i])
+                fill(row.begin(), row.end(), NAN);
+        if constexpr ((Outputs & IK_MANIPULABILITY) != 0)
+            (*out.manipulability)[i] = NAN;
+        if constexpr ((Outputs & IK_LINKS) != 0)
+            for (auto& point : (*out.links)[i])
+                fill(point.begin(), point.end(), NAN);
+    }
+    if (out.validity) {
+        if constexpr ((Outputs & IK_VALIDITY) != 0) {
+            out.validity->valid = screen_solutions(*out.q, n, out.validity->violations);
+        }
+        else {
+            out.validity->valid = (1u << n) - 1;
+            out.validity->violations.fill(0);
+        }
+    }
+    return n;
+}
+
+// Outputs of the franka_J_ik_* entry points and Q7Sweep::J_ik
+static IKKernelOutput J_ik_output(array<array<array<double, 6>, 7>, 8>& Jsols,
+                                  array<array<double, 7>, 8>& qsols,
+                                  IKValidity& validity) {
+    IKKernelOutput out;
+    out.q = &qsols;
+    out.J = &Jsols;
+    out.validity = &validity;
+    return out;
+}
+
+static unsigned int without_angles(array<array<double, 7>, 8>& qsols, const unsigned int n) {
+    // franka_J_ik_* with joint_angles = false return NaN joint angles
+    for (auto& q : qsols)
+        fill(q.begin(), q.end(), NAN);
+    return n;
+}
+
+template <unsigned int Outputs>
+static unsigned int ik_q7_from_frame(const PreparedTarget& target,
+                                     const array<double, 3>& s6,
+                                     const array<double, 3>& r6,
+                                     const double q7,
+                                     const IKKernelOutput& out,
+                                     const double q1_sing) {
+    // IK with q7 as free variable once the frame of joint 6 for that q7 is known.
+    // INPUT: target, prepared pose of frame E in frame O (and end-effector frame of the Jacobian)
+    //        s6 = k_E_O x i_6_O, axis of joint 6
+    //        r6 = r_O7S_O - a7 * i_6_O
+    //        q7, value of joint angle of joint 7
+    //        out, arrays of the requested outputs (see IKKernelOutput)
+    //        q1_sing, emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
     // OUTPUT: number of solutions found.
+    // NOTATION:
     // ri = r_iS_O, i = 1,2,3,4,5,6,7
     // si = s_i_O
-    Eigen::Vector3d i_E_O(ROE[0], ROE[3], ROE[6]);
-    array<double, 3> k_E_O = { ROE[2], ROE[5], ROE[8] };
-    R_axis_angle(k_E_O, -(q7 - PI / 4));
-    Eigen::Vector3d i_6_O = tmp_R * i_E_O;
-    array<double, 3> s6;
-    Cross_(k_E_O, i_6_O, s6);
-    array<double, 3> r6 = { r[0] - dE * k_E_O[0] - a7 * i_6_O[0], r[1] - dE * k_E_O[1] - a7 * i_6_O[1], r[2] - d1 - dE * k_E_O[2] - a7 * i_6_O[2] };
     double l = Norm(r6);
     double tmp = (b1 * b1 - l * l - b2 * b2) / (-2 * l * b2);
     if (tmp > 1) {
@@ -426,22 +853,17 @@ unsigned int franka_ik_q7(const array<double, 3>& r,
             tmp = 1;
         }
         else {
-            cout << "ERROR: unable to assembly kinematic chain";
-            for (int i = 0; i < 8; ++i) {
-                fill(qsols[i].begin(), qsols[i].end(), NAN);
-            }
-            return 0;
+            GEOFIK_DEBUG("ERROR: unable to assembly kinematic chain\n");
+            return finish_solutions<Outputs>(out, 0);
         }
     }
-    double actmp = acos(tmp);
+    double actmp = geofik_acos(tmp);
     double alpha2 = beta2 + actmp;
     array<double, 3> k_C_O = { -r6[0] / l, -r6[1] / l, -r6[2] / l };
-    array<double, 3> i_C_O;
-    Cross_(k_C_O, s6, i_C_O);
+    array<double, 3> i_C_O = Cross(k_C_O, s6);
     tmp = Norm(i_C_O);
     i_C_O = { i_C_O[0] / tmp, i_C_O[1] / tmp, i_C_O[2] / tmp };
-    array<double, 3> j_C_O;
-    Cross_(k_C_O, i_C_O, j_C_O);
+    array<double, 3> j_C_O = Cross(k_C_O, i_C_O);
     double ry = s6[0] * j_C_O[0] + s6[1] * j_C_O[1] + s6[2] * j_C_O[2];
     double rz = s6[0] * k_C_O[0] + s6[1] * k_C_O[1] + s6[2] * k_C_O[2];
     array<array<double, 3>, 4> s5s;
@@ -451,19 +873,18 @@ unsigned int franka_ik_q7(const array<double, 3>& r,
     if (d3 + d5 < l && l < b1 + b2) n_alphs = 2;
     double v[3];
     for (int i = 0; i < n_alphs; i++) {
-        sa2 = sin(alpha2);
-        ca2 = cos(alpha2);
+        geofik_sincos(alpha2, sa2, ca2);
         tmp = -rz * ca2 / (ry * sa2);
         if (tmp * tmp > 1)
             continue;
-        tmp = asin(tmp);
-        v[0] = -sa2 * cos(tmp);
-        v[1] = -sa2 * sin(tmp);
+        tmp = geofik_asin(tmp);
+        v[0] = -sa2 * geofik_cos(tmp);
+        v[1] = -sa2 * geofik_sin(tmp);
         v[2] = -ca2;
         s5s[n_sols] = { i_C_O[0] * v[0] + j_C_O[0] * v[1] + k_C_O[0] * v[2],
                        i_C_O[1] * v[0] + j_C_O[1] * v[1] + k_C_O[1] * v[2],
                        i_C_O[2] * v[0] + j_C_O[2] * v[1] + k_C_O[2] * v[2] };
-        tmp = 2 * sa2 * cos(tmp);
+        tmp = 2 * sa2 * geofik_cos(tmp);
         //s5[n_sols+1] = s5s[n_sols] + (2*sa2*cos(tmp)*i_C_O);
         s5s[n_sols + 1] = { s5s[n_sols][0] + tmp * i_C_O[0],
                         s5s[n_sols][1] + tmp * i_C_O[1],
@@ -471,16 +892,16 @@ unsigned int franka_ik_q7(const array<double, 3>& r,
         n_sols += 2;
         alpha2 = beta2 - actmp;
     }
-    array<double, 6> sol1;
-    array<double, 3> sol2;
     array<double, 3> s4, r4, s3, s2, s5;
     for (int i = 0; i < n_sols; i++) {
         s5 = s5s[i];
         Cross_(s5, r6, s4);
         tmp = Norm(s4);
         s4 = { s4[0] / tmp, s4[1] / tmp, s4[2] / tmp };
+        //r4 = r6 - d5 * s5 + a5 * Cross(s5, s4);
         Cross_(s5, s4, r4);
         r4 = { r6[0] - d5 * s5[0] + a5 * r4[0], r6[1] - d5 * s5[1] + a5 * r4[1], r6[2] - d5 * s5[2] + a5 * r4[2] };
+        //s3 = R_axis_angle(s4, beta1) * r4;
         R_axis_angle(s4, beta1);
         s3 = { tmp_R(0,0) * r4[0] + tmp_R(0,1) * r4[1] + tmp_R(0,2) * r4[2],
               tmp_R(1,0) * r4[0] + tmp_R(1,1) * r4[1] + tmp_R(1,2) * r4[2],
@@ -492,84 +913,195 @@ unsigned int franka_ik_q7(const array<double, 3>& r,
             s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
         }
         else {
-            s2 = { sin(q1_sing), cos(q1_sing), 0 };
+            s2 = { geofik_sin(q1_sing), geofik_cos(q1_sing), 0 };
         }
-        J_dir(s2, s3, s4, s5, s6, k_E_O);
-        sol1 = q_from_J(tmp_J);
-        tmp_J.col(1) = -1 * tmp_J.col(1);
-        sol2 = q_from_low_J(tmp_J);
-        qsols[2 * i] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7 };
-        check_limits(qsols[2 * i], 7);
-        qsols[2 * i + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * i][3], qsols[2 * i][4], qsols[2 * i][5], qsols[2 * i][6] };
-        check_limits(qsols[2 * i + 1], 3);
+        store_solution<Outputs>(target, s2, s3, s4, s5, s6, r4, r6, q7, out, i);
     }
-    for (int i = 2 * n_sols; i < 8; i++)
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    return 2 * n_sols;
+    return finish_solutions<Outputs>(out, 2 * n_sols);
 }
 
+template <unsigned int Outputs>
+unsigned int franka_ik_q7_kernel(const PreparedTarget& target,
+                                 const double q7,
+                                 const IKKernelOutput& out,
+                                 const double q1_sing) {
+    // IK with q7 as free variable, see ik_q7_from_frame()
+    array<double, 3> s6, r6;
+    q7_frame(target, q7, s6, r6);
+    return ik_q7_from_frame<Outputs>(target, s6, r6, q7, out, q1_sing);
+}
 
-unsigned int franka_ik_q4(const array<double, 3>& r,
-                          const array<double, 9>& ROE,
-                          const double q4,
-                          array<array<double, 7>, 8>& qsols,
-                          const double q1_sing,
-                          const double q7_sing) {
-    // IK with q4 as free variable
-    // INPUT: r = r_EO_O, position of frame E in frame O
-    //        ROE, orientation of frame E in frame O (row-first format)
-    //        q4, joint angle of joint 4
-    //        qsols, array to store 8 solutions
+template <unsigned int Outputs>
+static bool ik_q7_branch_from_frame(const PreparedTarget& target,
+                                    const array<double, 3>& s6,
+                                    const array<double, 3>& r6,
+                                    const double q7,
+                                    const unsigned int branch,
+                                    array<double, 7>* q,
+                                    array<array<double, 6>, 7>* J,
+                                    double* manipulability,
+                                    const double q1_sing) {
+    // Same as ik_q7_from_frame() for the one solution of the given branch (see IKBranch): only its
+    // elbow angle, its root s5 and its shoulder solution are computed, with the same arithmetic, so
+    // it is bit-identical to the solution of that branch in the 8-slot output.
+    // Outputs may contain IK_ANGLES, IK_JACOBIAN or IK_JACOBIAN_WRIST and IK_MANIPULABILITY, written
+    // to q, J and manipulability (NaN if the branch does not exist). No joint-limit screen.
+    // OUTPUT: true if the branch exists.
+    static_assert((Outputs & ~(IK_ANGLES | IK_JACOBIAN | IK_JACOBIAN_WRIST | IK_MANIPULABILITY)) == 0, "unsupported output");
+    double l = Norm(r6);
+    double tmp = (b1 * b1 - l * l - b2 * b2) / (-2 * l * b2);
+    bool exists = true;
+    if (tmp > 1) {
+        if ((tmp - 1) * (tmp - 1) < SING_TOL)
+            tmp = 1;
+        else
+            exists = false;
+    }
+    // The second elbow angle only exists strictly inside the reachable shell
+    if ((branch & IK_BRANCH_ELBOW) && !(d3 + d5 < l && l < b1 + b2))
+        exists = false;
+    double sa2 = 0, ca2 = 0;
+    array<double, 3> k_C_O, i_C_O, j_C_O;
+    if (exists) {
+        double actmp = geofik_acos(tmp);
+        double alpha2 = (branch & IK_BRANCH_ELBOW) ? beta2 - actmp : beta2 + actmp;
+        k_C_O = { -r6[0] / l, -r6[1] / l, -r6[2] / l };
+        i_C_O = Cross(k_C_O, s6);
+        tmp = Norm(i_C_O);
+        i_C_O = { i_C_O[0] / tmp, i_C_O[1] / tmp, i_C_O[2] / tmp };
+        j_C_O = Cross(k_C_O, i_C_O);
+        double ry = s6[0] * j_C_O[0] + s6[1] * j_C_O[1] + s6[2] * j_C_O[2];
+        double rz = s6[0] * k_C_O[0] + s6[1] * k_C_O[1] + s6[2] * k_C_O[2];
+        geofik_sincos(alpha2, sa2, ca2);
+        tmp = -rz * ca2 / (ry * sa2);
+        exists = tmp * tmp <= 1;
+    }
+    if (!exists) {
+        if constexpr ((Outputs & IK_ANGLES) != 0)
+            fill(q->begin(), q->end(), NAN);
+        if constexpr ((Outputs & (IK_JACOBIAN | IK_JACOBIAN_WRIST)) != 0)
+            for (auto& row : *J)
+                fill(row.begin(), row.end(), NAN);
+        if constexpr ((Outputs & IK_MANIPULABILITY) != 0)
+            *manipulability = NAN;
+        return false;
+    }
+    tmp = geofik_asin(tmp);
+    double v[3] = { -sa2 * geofik_cos(tmp), -sa2 * geofik_sin(tmp), -ca2 };
+    array<double, 3> s5 = { i_C_O[0] * v[0] + j_C_O[0] * v[1] + k_C_O[0] * v[2],
+                            i_C_O[1] * v[0] + j_C_O[1] * v[1] + k_C_O[1] * v[2],
+                            i_C_O[2] * v[0] + j_C_O[2] * v[1] + k_C_O[2] * v[2] };
+    if (branch & IK_BRANCH_WRIST) {
+        tmp = 2 * sa2 * geofik_cos(tmp);
+        s5 = { s5[0] + tmp * i_C_O[0], s5[1] + tmp * i_C_O[1], s5[2] + tmp * i_C_O[2] };
+    }
+    array<double, 3> s4, r4, s3, s2;
+    Cross_(s5, r6, s4);
+    tmp = Norm(s4);
+    s4 = { s4[0] / tmp, s4[1] / tmp, s4[2] / tmp };
+    Cross_(s5, s4, r4);
+    r4 = { r6[0] - d5 * s5[0] + a5 * r4[0], r6[1] - d5 * s5[1] + a5 * r4[1], r6[2] - d5 * s5[2] + a5 * r4[2] };
+    R_axis_angle(s4, beta1);
+    s3 = { tmp_R(0,0) * r4[0] + tmp_R(0,1) * r4[1] + tmp_R(0,2) * r4[2],
+          tmp_R(1,0) * r4[0] + tmp_R(1,1) * r4[1] + tmp_R(1,2) * r4[2],
+          tmp_R(2,0) * r4[0] + tmp_R(2,1) * r4[1] + tmp_R(2,2) * r4[2] };
+    tmp = Norm(s3);
+    s3 = { s3[0] / tmp, s3[1] / tmp, s3[2] / tmp };
+    tmp = s3[1] * s3[1] + s3[0] * s3[0];
+    if (tmp > SING_TOL)
+        s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
+    else
+        s2 = { geofik_sin(q1_sing), geofik_cos(q1_sing), 0 };
+
+    const array<double, 3>& s7 = target.k_E;
+    const bool shoulder = (branch & IK_BRANCH_SHOULDER) != 0;
+    if constexpr ((Outputs & IK_ANGLES) != 0) {
+        // As the second solution of save_q_sols()
+        array<double, 7>& sol = *q;
+        q_from_axes(s2, s3, s4, s5, s6, s7, sol.data());
+        sol[6] = q7;
+        if (shoulder) {
+            sol[0] = sol[0] > 0 ? sol[0] - PI : sol[0] + PI;
+            sol[1] = -sol[1];
+            sol[2] = sol[2] > 0 ? sol[2] - PI : sol[2] + PI;
+        }
+    }
+    if constexpr ((Outputs & (IK_JACOBIAN | IK_JACOBIAN_WRIST)) != 0) {
+        array<array<double, 6>, 7> other;
+        if (shoulder)
+            save_J_sol<(Outputs & IK_JACOBIAN_WRIST) != 0>(s2, s3, s4, s5, s6, s7, r4, r6, target.r_See, other, *J);
+        else
+            save_J_sol<(Outputs & IK_JACOBIAN_WRIST) != 0>(s2, s3, s4, s5, s6, s7, r4, r6, target.r_See, *J, other);
+    }
+    if constexpr ((Outputs & IK_MANIPULABILITY) != 0)
+        *manipulability = manipulability_from_axes(s2, s3, s4, s5, s6, s7, r4, r6, target.r_ES);
+    return true;
+}
+
+template <unsigned int Outputs>
+static bool franka_ik_q7_branch_kernel(const PreparedTarget& target,
+                                       const double q7,
+                                       const unsigned int branch,
+                                       array<double, 7>* q,
+                                       array<array<double, 6>, 7>* J,
+                                       double* manipulability,
+                                       const double q1_sing) {
+    // IK with q7 as free variable for one branch, see ik_q7_branch_from_frame()
+    array<double, 3> s6, r6;
+    q7_frame(target, q7, s6, r6);
+    return ik_q7_branch_from_frame<Outputs>(target, s6, r6, q7, branch, q, J, manipulability, q1_sing);
+}
+
+template <unsigned int Outputs>
+unsigned int franka_ik_q4_kernel(const PreparedTarget& target,
+                                 const double q4,
+                                 const IKKernelOutput& out,
+                                 const double q1_sing,
+                                 const double q7_sing) {
+    // IK with q4 as free variable.
+    // INPUT: target, prepared pose of frame E in frame O (and end-effector frame of the Jacobian)
+    //        q4, value of joint angle of joint 4
+    //        out, arrays of the requested outputs (see IKKernelOutput)
     //        q1_sing, emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
-    //        q7_sing, emergency value of q7 in case of singularity of S7 intersecting S (type-2 singularity).
+    //        q7_sing, emergency value of q7 in case S7 intersects S (type-2 singularity)
     // OUTPUT: number of solutions found.
+    // NOTATION:
     // ri = r_iS_O, i = 1,2,3,4,5,6,7
     // si = s_i_O
-    array<double, 3> r_ES_O = { r[0], r[1], r[2] - d1 };
-    array<double, 3> tmp_v = { r_ES_O[1] * ROE[8] - r_ES_O[2] * ROE[5],
-                               r_ES_O[2] * ROE[2] - r_ES_O[0] * ROE[8],
-                               r_ES_O[0] * ROE[5] - r_ES_O[1] * ROE[2] };
-    if (tmp_v[0] * tmp_v[0] + tmp_v[1] * tmp_v[1] + tmp_v[2] * tmp_v[2] < SING_TOL)
-        return franka_ik_q7(r, ROE, q7_sing, qsols, q1_sing);
-    array<double, 3> r_O7S_O = { r_ES_O[0] - dE * ROE[2], r_ES_O[1] - dE * ROE[5], r_ES_O[2] - dE * ROE[8] };
-    array<double, 3> r_O7S_E = { ROE[0] * r_O7S_O[0] + ROE[3] * r_O7S_O[1] + ROE[6] * r_O7S_O[2],
-                                 ROE[1] * r_O7S_O[0] + ROE[4] * r_O7S_O[1] + ROE[7] * r_O7S_O[2],
-                                 ROE[2] * r_O7S_O[0] + ROE[5] * r_O7S_O[1] + ROE[8] * r_O7S_O[2] };
+    if (target.s7_through_S)
+        return franka_ik_q7_kernel<Outputs>(target, q7_sing, out, q1_sing);
+    const array<double, 9>& ROE = target.ROE;
+    const array<double, 3>& r_O7S_O = target.r_7S;
+    const array<double, 3>& r_O7S_E = target.r_7S_E;
+    array<double, 3> tmp_v;
     double alpha = q4 + beta1 + beta2 - PI;
-    double lo2 = b1 * b1 + b2 * b2 - 2 * b1 * b2 * cos(alpha);
+    double lo2 = b1 * b1 + b2 * b2 - 2 * b1 * b2 * geofik_cos(alpha);
     double lp2 = lo2 - r_O7S_E[2] * r_O7S_E[2];
     if (lp2 * lp2 < SING_TOL) lp2 = 0;
     if (lp2 < 0) {
-        cout << "ERROR: unable to assembly kinematic chain";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-        }
-        return 0;
+        GEOFIK_DEBUG("ERROR: unable to assembly kinematic chain\n");
+        return finish_solutions<Outputs>(out, 0);
     }
-    double gamma2 = beta2 + asin(b1 * sin(alpha) / sqrt(lo2));
-    double cg2 = cos(gamma2), sg2 = sin(gamma2);
-    double Lp2 = r_O7S_E[0] * r_O7S_E[0] + r_O7S_E[1] * r_O7S_E[1], phi = atan2(-r_O7S_E[1], -r_O7S_E[0]);
-    double tmp = (Lp2 + a7 * a7 - lp2) / (2 * sqrt(Lp2) * a7);
+    double gamma2 = beta2 + geofik_asin(b1 * geofik_sin(alpha) / sqrt(lo2));
+    double cg2, sg2;
+    geofik_sincos(gamma2, sg2, cg2);
+    double Lp = target.L_7S_E, phi = target.phi_7S_E;
+    double tmp = (Lp * Lp + a7 * a7 - lp2) / (2 * Lp * a7);
     if ((tmp - 1) * (tmp - 1) < SING_TOL)
         tmp = 1.0;
     if (tmp > 1.0) {
-        cout << "ERROR: unable to assembly kinematic chain";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-        }
-        return 0;
+        GEOFIK_DEBUG("ERROR: unable to assembly kinematic chain\n");
+        return finish_solutions<Outputs>(out, 0);
     }
-    double psi = acos(tmp), ry, rz;
+    double psi = geofik_acos(tmp), ry, rz;
     double q7s[2] = { -phi - psi - 3 * PI / 4, -phi + psi - 3 * PI / 4 };
     double gammas[2] = { 0,0 };
-    unsigned int ind = 0;
+    size_t ind = 0;
     array<double, 3> s2, s3, s4, s5, s6, r4, r6, i_C_O, j_C_O, k_C_O;
-    array<double, 6> sol1;
-    array<double, 3> sol2;
     for (auto q7 : q7s) {
-        tmp_v = { cos(-q7 + 3 * PI / 4), sin(-q7 + 3 * PI / 4), 0 };
+        tmp_v = { geofik_cos(-q7 + 3 * PI / 4), geofik_sin(-q7 + 3 * PI / 4), 0 };
         s6 = { ROE[0] * tmp_v[0] + ROE[1] * tmp_v[1], ROE[3] * tmp_v[0] + ROE[4] * tmp_v[1], ROE[6] * tmp_v[0] + ROE[7] * tmp_v[1] };
-        tmp_v = { -a7 * cos(-q7 + PI / 4), -a7 * sin(-q7 + PI / 4), 0 };
+        tmp_v = { -a7 * geofik_cos(-q7 + PI / 4), -a7 * geofik_sin(-q7 + PI / 4), 0 };
         r6 = { ROE[0] * tmp_v[0] + ROE[1] * tmp_v[1], ROE[3] * tmp_v[0] + ROE[4] * tmp_v[1], ROE[6] * tmp_v[0] + ROE[7] * tmp_v[1] };
         r6 = { r6[0] + r_O7S_O[0], r6[1] + r_O7S_O[1], r6[2] + r_O7S_O[2] };
         tmp = Norm(r6);
@@ -582,11 +1114,11 @@ unsigned int franka_ik_q4(const array<double, 3>& r,
         rz = s6[0] * k_C_O[0] + s6[1] * k_C_O[1] + s6[2] * k_C_O[2];
         tmp = -rz * cg2 / (ry * sg2);
         if (tmp * tmp > 1) continue;
-        tmp = asin(tmp);
+        tmp = geofik_asin(tmp);
         gammas[0] = tmp;
         gammas[1] = PI - tmp;
         for (auto gamma : gammas) {
-            tmp_v = { -sg2 * cos(gamma), -sg2 * sin(gamma), -cg2 };
+            tmp_v = { -sg2 * geofik_cos(gamma), -sg2 * geofik_sin(gamma), -cg2 };
             s5 = { i_C_O[0] * tmp_v[0] + j_C_O[0] * tmp_v[1] + k_C_O[0] * tmp_v[2],
                   i_C_O[1] * tmp_v[0] + j_C_O[1] * tmp_v[1] + k_C_O[1] * tmp_v[2],
                   i_C_O[2] * tmp_v[0] + j_C_O[2] * tmp_v[1] + k_C_O[2] * tmp_v[2] };
@@ -605,71 +1137,58 @@ unsigned int franka_ik_q4(const array<double, 3>& r,
             if (tmp > SING_TOL)
                 s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
             else
-                s2 = { sin(q1_sing), cos(q1_sing), 0 };
-            J_dir(s2, s3, s4, s5, s6, array<double, 3>{ROE[2], ROE[5], ROE[8]});
-            sol1 = q_from_J(tmp_J);
-            tmp_J.col(1) = -1 * tmp_J.col(1);
-            sol2 = q_from_low_J(tmp_J);
-            qsols[2 * ind] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7 };
-            check_limits(qsols[2 * ind], 7);
-            qsols[2 * ind + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * ind][3], qsols[2 * ind][4], qsols[2 * ind][5], qsols[2 * ind][6] };
-            check_limits(qsols[2 * ind + 1], 3);
+                s2 = { geofik_sin(q1_sing), geofik_cos(q1_sing), 0 };
+            store_solution<Outputs>(target, s2, s3, s4, s5, s6, r4, r6, q7, out, ind);
             ind++;
         }
     }
-    for (int i = 2 * ind; i < 8; ++i) {
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    }
-    return 2 * ind;
+    return finish_solutions<Outputs>(out, 2 * ind);
 }
 
-
-unsigned int franka_ik_q6_parallel(const array<double, 3>& r_ES_O,
-                                   const array<double, 9>& ROE,
+template <unsigned int Outputs>
+static unsigned int ik_q6_parallel(const PreparedTarget& target,
                                    const int sgn,
-                                   array<array<double, 7>, 8>& qsols,
+                                   const IKKernelOutput& out,
                                    const double q1_sing) {
-    // Parallel case of the IK with q6 as free variable. Only called by franka_ik_q6(), not by the user.
-    // INPUT: r_ES_O, ROE, sgn  = sign(cos(q6)), qsols, q1_sing.
+    // Parallel case of the IK with q6 as free variable. Only called by franka_ik_q6_kernel(), not by the user.
+    // INPUT: target, sgn  = sign(cos(q6)), out, q1_sing.
     // OUTPUT: number of solutions found.
     // NOTATION:
     // ri = r_iS_O, i = 1,2,3,4,5,6,7
     // si = s_i_O
-    // Q is a frame that is parallel to frame E and has origin at Q
-    array<double, 3> s7 = { ROE[2],ROE[5],ROE[8] };
+    // Q is a frame that is parallel to frame E and has origin at Q (Q is called E' in the paper)
+    const array<double, 3>& r_ES_O = target.r_ES;
+    const array<double, 9>& ROE = target.ROE;
+    const array<double, 3>& s7 = target.k_E;
     array<double, 3> r_QS_O = { r_ES_O[0] + (-dE + sgn * d5) * s7[0], r_ES_O[1] + (-dE + sgn * d5) * s7[1], r_ES_O[2] + (-dE + sgn * d5) * s7[2] };
     array<double, 3> r_SQ_Q = { -ROE[0] * r_QS_O[0] - ROE[3] * r_QS_O[1] - ROE[6] * r_QS_O[2],
-                              -ROE[1] * r_QS_O[0] - ROE[4] * r_QS_O[1] - ROE[7] * r_QS_O[2],
-                              -ROE[2] * r_QS_O[0] - ROE[5] * r_QS_O[1] - ROE[8] * r_QS_O[2] };
+                                -ROE[1] * r_QS_O[0] - ROE[4] * r_QS_O[1] - ROE[7] * r_QS_O[2],
+                                -ROE[2] * r_QS_O[0] - ROE[5] * r_QS_O[1] - ROE[8] * r_QS_O[2] };
     double tmp = b1 * b1 - r_SQ_Q[2] * r_SQ_Q[2];
     if (tmp * tmp < SING_TOL)
         tmp = 0;
     if (tmp < 0) {
-        cout << "ERROR: unable to assembly kinematic chain";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-        }
-        return 0;
+        GEOFIK_DEBUG("ERROR: unable to assembly kinematic chain\n");
+        return finish_solutions<Outputs>(out, 0);
     }
     double lp = sqrt(tmp);
     array<double, 3> r_SpQ_Q = { r_SQ_Q[0], r_SQ_Q[1], 0 };
     double l_SpQ = sqrt(r_SQ_Q[0] * r_SQ_Q[0] + r_SQ_Q[1] * r_SQ_Q[1]);
     double alphas[2], Ls[2];
     double q7;
-    Ls[0] = a5 + lp;
-    Ls[1] = a5 - lp;
-    array<double, 3> tmp_v, r_O6pQ_Q, i_4_Q, r_O4Q_Q, s6_Q, r_O6_Q, s4_Q, s3_Q, s2, s3, s4, s5, s6;
+    Ls[0] = a5 + lp,
+        Ls[1] = a5 - lp;
+    array<double, 3> tmp_v, r_O6pQ_Q, i_4_Q, r_O4Q_Q, s6_Q, r_O6Q_Q, s4_Q, s3_Q, s2, s3, s4, s5, s6, r4, r6;
     Eigen::Matrix<double, 3, 4> partial_J_Q, partial_J_O;
+    Eigen::Matrix<double, 3, 2> rs;
     Eigen::Matrix3d ROQ;
     ROQ << ROE[0], ROE[1], ROE[2],
-           ROE[3], ROE[4], ROE[5],
-           ROE[6], ROE[7], ROE[8];
+        ROE[3], ROE[4], ROE[5],
+        ROE[6], ROE[7], ROE[8];
     const array<double, 3> k{ {0,0,1} };
     array<double, 3> s5_Q{ {0,0,-1.0 * sgn} };
     int tmp_sgn;
     unsigned int ind = 0;
-    array<double, 6> sol1;
-    array<double, 3> sol2;
     for (auto L : Ls) {
         tmp = (-L * L + a7 * a7 + l_SpQ * l_SpQ) / (2 * a7 * l_SpQ);
         if ((tmp - 1) * (tmp - 1) < SING_TOL)
@@ -678,8 +1197,8 @@ unsigned int franka_ik_q6_parallel(const array<double, 3>& r_ES_O,
             tmp = -1;
         if (tmp * tmp > 1)
             continue;
-        alphas[0] = acos(tmp);
-        alphas[1] = -acos(tmp);
+        alphas[0] = geofik_acos(tmp);
+        alphas[1] = -geofik_acos(tmp);
         for (auto alpha : alphas) {
             rotate_by_axis_angle(k, alpha, r_SpQ_Q, r_O6pQ_Q);
             r_O6pQ_Q = { a7 * r_O6pQ_Q[0] / l_SpQ, a7 * r_O6pQ_Q[1] / l_SpQ, a7 * r_O6pQ_Q[2] / l_SpQ };
@@ -689,99 +1208,93 @@ unsigned int franka_ik_q6_parallel(const array<double, 3>& r_ES_O,
             i_4_Q = { tmp_sgn * i_4_Q[0] / tmp, tmp_sgn * i_4_Q[1] / tmp, tmp_sgn * i_4_Q[2] / tmp };
             r_O4Q_Q = { r_O6pQ_Q[0] + a5 * i_4_Q[0], r_O6pQ_Q[1] + a5 * i_4_Q[1], r_O6pQ_Q[2] + a5 * i_4_Q[2] };
             Cross_(r_O6pQ_Q, k, s6_Q);
-            r_O6_Q = { r_O6pQ_Q[0], r_O6pQ_Q[1], r_O6pQ_Q[2] - sgn * d5 };
+            r_O6Q_Q = { r_O6pQ_Q[0], r_O6pQ_Q[1], r_O6pQ_Q[2] - sgn * d5 };
+            if constexpr ((Outputs & IK_POINTS) != 0) {
+                rs << r_O4Q_Q[0], r_O6Q_Q[0],
+                      r_O4Q_Q[1], r_O6Q_Q[1],
+                      r_O4Q_Q[2], r_O6Q_Q[2];
+                rs = ROQ * rs; // r_O4Q_O, r_O6Q_O
+                r4 = { rs(0,0) + r_QS_O[0], rs(1,0) + r_QS_O[1], rs(2,0) + r_QS_O[2] };
+                r6 = { rs(0,1) + r_QS_O[0], rs(1,1) + r_QS_O[1], rs(2,1) + r_QS_O[2] };
+            }
             Cross_(i_4_Q, s5_Q, s4_Q);
             tmp_v = { r_O4Q_Q[0] - r_SQ_Q[0], r_O4Q_Q[1] - r_SQ_Q[1], r_O4Q_Q[2] - r_SQ_Q[2] };
             rotate_by_axis_angle(s4_Q, beta1, tmp_v, s3_Q);
             tmp = Norm(s3_Q);
+            //s3_Q = {s3_Q[0]/tmp,s3_Q[1]/tmp,s3_Q[2]/tmp};
             partial_J_Q << s3_Q[0] / tmp, s4_Q[0], s5_Q[0], s6_Q[0],
-                s3_Q[1] / tmp, s4_Q[1], s5_Q[1], s6_Q[1],
-                s3_Q[2] / tmp, s4_Q[2], s5_Q[2], s6_Q[2];
+                           s3_Q[1] / tmp, s4_Q[1], s5_Q[1], s6_Q[1],
+                           s3_Q[2] / tmp, s4_Q[2], s5_Q[2], s6_Q[2];
             partial_J_O = ROQ * partial_J_Q;
             s3 = { partial_J_O(0,0), partial_J_O(1,0), partial_J_O(2,0) };
             s4 = { partial_J_O(0,1), partial_J_O(1,1), partial_J_O(2,1) };
             s5 = { partial_J_O(0,2), partial_J_O(1,2), partial_J_O(2,2) };
             s6 = { partial_J_O(0,3), partial_J_O(1,3), partial_J_O(2,3) };
-            q7 = atan2(r_O6pQ_Q[1], -r_O6pQ_Q[0]) + PI / 4;
+            q7 = geofik_atan2(r_O6pQ_Q[1], -r_O6pQ_Q[0]) + PI / 4;
             tmp = s3[1] * s3[1] + s3[0] * s3[0];
             if (tmp > SING_TOL)
                 s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
             else
-                s2 = { sin(q1_sing), cos(q1_sing), 0 };
-            J_dir(s2, s3, s4, s5, s6, s7);
-            sol1 = q_from_J(tmp_J);
-            tmp_J.col(1) = -1 * tmp_J.col(1);
-            sol2 = q_from_low_J(tmp_J);
-            qsols[2 * ind] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7 };
-            check_limits(qsols[2 * ind], 7);
-            qsols[2 * ind + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * ind][3], qsols[2 * ind][4], qsols[2 * ind][5], qsols[2 * ind][6] };
-            check_limits(qsols[2 * ind + 1], 3);
+                s2 = { geofik_sin(q1_sing), geofik_cos(q1_sing), 0 };
+            store_solution<Outputs>(target, s2, s3, s4, s5, s6, r4, r6, q7, out, ind);
             ind++;
         }
     }
-    for (int i = 2 * ind; i < 8; ++i) {
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    }
-    return 2 * ind;
+    return finish_solutions<Outputs>(out, 2 * ind);
 }
 
-unsigned int franka_ik_q6(const array<double, 3>& r,
-                          const array<double, 9>& ROE,
-                          const double q6,
-                          array<array<double, 7>, 8>& qsols,
-                          const double q1_sing,
-                          const double q7_sing) {
-    // IK with q6 as free variable
-    // INPUT: r = r_EO_O, position of frame E in frame O
-    //        ROE, orientation of frame E in frame O (row-first format)
-    //        q6, joint angle of joint 6
-    //        qsols, array to store 8 solutions
+template <unsigned int Outputs>
+unsigned int franka_ik_q6_kernel(const PreparedTarget& target,
+                                 const double q6,
+                                 const IKKernelOutput& out,
+                                 const double q1_sing,
+                                 const double q7_sing) {
+    // IK with q6 as free variable.
+    // INPUT: target, prepared pose of frame E in frame O (and end-effector frame of the Jacobian)
+    //        q6, value of joint angle of joint 6
+    //        out, arrays of the requested outputs (see IKKernelOutput)
     //        q1_sing, emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
-    //        q7_sing, emergency value of q7 in case of singularity of S7 intersecting S (type-2 singularity).
+    //        q7_sing, emergency value of q7 in case S7 intersects S (type-2 singularity)
     // OUTPUT: number of solutions found.
     // NOTATION:
     // ri = r_iS_O, i = 1,2,3,4,5,6,7
     // si = s_i_O
-    array<double, 3> r_ES_O = { r[0], r[1], r[2] - d1 };
-    array<double, 3> tmp_v = { r_ES_O[1] * ROE[8] - r_ES_O[2] * ROE[5],
-                               r_ES_O[2] * ROE[2] - r_ES_O[0] * ROE[8],
-                               r_ES_O[0] * ROE[5] - r_ES_O[1] * ROE[2] };
-    if (tmp_v[0] * tmp_v[0] + tmp_v[1] * tmp_v[1] + tmp_v[2] * tmp_v[2] < SING_TOL)
-        return franka_ik_q7(r, ROE, q7_sing, qsols, q1_sing);
-    if (sin(q6) * sin(q6) < SING_TOL)
+    if (target.s7_through_S)
+        return franka_ik_q7_kernel<Outputs>(target, q7_sing, out, q1_sing);
+    if (geofik_sin(q6) * geofik_sin(q6) < SING_TOL)
         // PARALLEL CASE:
-        return franka_ik_q6_parallel(r_ES_O, ROE, cos(q6) >= 0 ? 1 : -1, qsols, q1_sing);
+        return ik_q6_parallel<Outputs>(target, geofik_cos(q6) >= 0 ? 1 : -1, out, q1_sing);
     // NON-PARALLEL CASE:
-    array<double, 3> s7 = { ROE[2],ROE[5],ROE[8] };
+    const array<double, 9>& ROE = target.ROE;
+    const array<double, 3>& s7 = target.k_E;
     double gamma1 = PI - q6;
-    double cg1 = cos(gamma1);
-    double sg1 = sin(gamma1);
-    array<double, 3> r_O7S_O = { r_ES_O[0] - dE * ROE[2], r_ES_O[1] - dE * ROE[5], r_ES_O[2] - dE * ROE[8] };
+    double cg1, sg1;
+    geofik_sincos(gamma1, sg1, cg1);
+    const array<double, 3>& r_O7S_O = target.r_7S;
     array<double, 3> r_PS_O = { r_O7S_O[0] + (a7 / tan(gamma1)) * s7[0], r_O7S_O[1] + (a7 / tan(gamma1)) * s7[1], r_O7S_O[2] + (a7 / tan(gamma1)) * s7[2] };
     double lP = Norm(r_PS_O);
     double lC = a7 / sg1;
-    double Cx = -(ROE[0] * r_PS_O[0] + ROE[3] * r_PS_O[1] + ROE[6] * r_PS_O[2]);
-    double Cy = -(ROE[1] * r_PS_O[0] + ROE[4] * r_PS_O[1] + ROE[7] * r_PS_O[2]);
-    double Cz = -(ROE[2] * r_PS_O[0] + ROE[5] * r_PS_O[1] + ROE[8] * r_PS_O[2]);
+    // -r_PS_E, with r_PS_E = r_O7S_E + (a7 / tan(gamma1)) * (0,0,1)
+    double Cx = -target.r_7S_E[0];
+    double Cy = -target.r_7S_E[1];
+    double Cz = -(target.r_7S_E[2] + a7 / tan(gamma1));
+    array<double, 3> tmp_v;
     double c = sqrt(a5 * a5 + (lC + d5) * (lC + d5));
     double tmp = (-b1 * b1 + lP * lP + c * c) / (2 * lP * c);
     if ((tmp - 1) * (tmp - 1) < SING_TOL)
         tmp = 1.0;
     if (tmp > 1.0) {
-        cout << "ERROR: unable to assembly kinematic chain";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-        }
-        return 0;
+        GEOFIK_DEBUG("ERROR: unable to assembly kinematic chain\n");
+        return finish_solutions<Outputs>(out, 0);
     }
-    double tau = acos(tmp);
+    double tau = geofik_acos(tmp);
     unsigned int n_gamma_sols = 1;
     if ((d3 + d5 + lC < lP) && (lP < b1 + c)) n_gamma_sols = 2;
     double gamma2s[2];
     if (d5 < -lC)
-        gamma2s[0] = tau + atan(a5 / (d5 + lC)) + PI;
+        gamma2s[0] = tau + geofik_atan(a5 / (d5 + lC)) + PI;
     else
-        gamma2s[0] = tau + atan(a5 / (d5 + lC));
+        gamma2s[0] = tau + geofik_atan(a5 / (d5 + lC));
     if (n_gamma_sols > 1)
         gamma2s[1] = gamma2s[0] - 2 * tau;
     array<array<double, 3>, 4> s5s;
@@ -789,7 +1302,7 @@ unsigned int franka_ik_q6(const array<double, 3>& r,
     double d, u1, u2;
     unsigned int n_sols = 0;
     for (int i = 0; i < n_gamma_sols; i++) {
-        d = lP * cos(gamma2s[i]);
+        d = lP * geofik_cos(gamma2s[i]);
         tmp = (d + Cz * cg1) / (sqrt(Cx * Cx * sg1 * sg1 + Cy * Cy * sg1 * sg1));
         if ((tmp - 1) * (tmp - 1) < SING_TOL)
             tmp = 1;
@@ -797,22 +1310,19 @@ unsigned int franka_ik_q6(const array<double, 3>& r,
             tmp = -1;
         if (tmp * tmp > 1)
             continue;
-        u1 = asin(tmp);
-        u2 = atan2(Cx * sg1, Cy * sg1);
+        u1 = geofik_asin(tmp);
+        u2 = geofik_atan2(Cx * sg1, Cy * sg1);
         q7s[n_sols] = 5 * PI / 4 - u1 + u2;
-        tmp_v = { -sg1 * cos(u1 - u2), -sg1 * sin(u1 - u2), cg1 };
+        tmp_v = { -sg1 * geofik_cos(u1 - u2), -sg1 * geofik_sin(u1 - u2), cg1 };
         column_1s_times_vec(ROE, tmp_v, s5s[n_sols]);
         n_sols++;
         q7s[n_sols] = PI / 4 + u1 + u2;
-        tmp_v = { -sg1 * cos(PI - u1 - u2), -sg1 * sin(PI - u1 - u2), cg1 };
+        tmp_v = { -sg1 * geofik_cos(PI - u1 - u2), -sg1 * geofik_sin(PI - u1 - u2), cg1 };
         column_1s_times_vec(ROE, tmp_v, s5s[n_sols]);
         n_sols++;
     }
     array<double, 3> s2, s3, s4, s6, r4, r6;
-    array<double, 6> sol1;
-    array<double, 3> sol2;
-    //vector<array<double,7>> sols(2*n_sols);
-    for (int i; i < n_sols; i++) {
+    for (int i = 0; i < n_sols; i++) {
         r6 = { r_PS_O[0] - lC * s5s[i][0], r_PS_O[1] - lC * s5s[i][1], r_PS_O[2] - lC * s5s[i][2] };
         tmp_v = { r_O7S_O[0] - r6[0], r_O7S_O[1] - r6[1], r_O7S_O[2] - r6[2] };
         Cross_(s7, tmp_v, s6);
@@ -830,45 +1340,28 @@ unsigned int franka_ik_q6(const array<double, 3>& r,
         if (tmp > SING_TOL)
             s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
         else
-            s2 = { sin(q1_sing), cos(q1_sing), 0 };
-        J_dir(s2, s3, s4, s5s[i], s6, s7);
-        sol1 = q_from_J(tmp_J);
-        tmp_J.col(1) = -1 * tmp_J.col(1);
-        sol2 = q_from_low_J(tmp_J);
-        qsols[2 * i] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7s[i] };
-        check_limits(qsols[2 * i], 7);
-        qsols[2 * i + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * i][3], qsols[2 * i][4], qsols[2 * i][5], qsols[2 * i][6] };
-        check_limits(qsols[2 * i + 1], 3);
-    }
-    for (int i = 2 * n_sols; i < 8; ++i) {
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
+            s2 = { geofik_sin(q1_sing), geofik_cos(q1_sing), 0 };
+        store_solution<Outputs>(target, s2, s3, s4, s5s[i], s6, r4, r6, q7s[i], out, i);
     }
-    return 2 * n_sols;
+    return finish_solutions<Outputs>(out, 2 * n_sols);
 }
 
 // FUNCTIONS FOR SWIVEL ANGLE
 
-array<double, 2> theta_err_from_q7(const double q7,
-                                   const double theta,
-                                   const Eigen::Vector3d& i_E_O,
-                                   const array<double, 3>& k_E_O,
-                                   Eigen::Vector3d& i_6_O,
-                                   const array<double, 3>& n1_O,
-                                   const array<double, 3>& r_O7S_O,
-                                   const array<double, 3>& u_O7S_O) {
-    // Calculates the error in swivel angle given the necessary geometry, q7, and the desired swivel angle theta
+array<double, 2> theta_err_from_frame(const double theta,
+                                      const array<double, 3>& s6,
+                                      const array<double, 3>& r6,
+                                      const array<double, 3>& n1_O,
+                                      const array<double, 3>& r_O7S_O,
+                                      const array<double, 3>& u_O7S_O) {
+    // Calculates the error in swivel angle given the necessary geometry, the frame of joint 6 for one q7
+    // (s6 and r6 = r_O7S_O - a7 * i_6_O, see Q7Sweep), and the desired swivel angle theta
     // NOTATION: u_O7S_O = r_O7S_O/norm(r_O7S_O), precalculated to improve speed
-    R_axis_angle(k_E_O, -(q7 - PI / 4));
-    i_6_O = tmp_R * i_E_O;
-    array<double, 3> s6;
-    Cross_(k_E_O, i_6_O, s6);
-    //r6 = r_O7S_O - a7 * i_6_O
-    array<double, 3> r6 = { r_O7S_O[0] - a7 * i_6_O[0], r_O7S_O[1] - a7 * i_6_O[1], r_O7S_O[2] - a7 * i_6_O[2] };
     double l = Norm(r6);
     double tmp = (b1 * b1 - l * l - b2 * b2) / (-2 * l * b2);
     if (tmp * tmp > 1)
         return array<double, 2>{1e10, 1e10};
-    double actmp = acos(tmp);
+    double actmp = geofik_acos(tmp);
     double alpha2 = beta2 + actmp;
     array<double, 3> k_C_O = { -r6[0] / l, -r6[1] / l, -r6[2] / l };
     array<double, 3> i_C_O = Cross(k_C_O, s6);
@@ -879,18 +1372,17 @@ array<double, 2> theta_err_from_q7(const double q7,
     double ry = s6[0] * j_C_O[0] + s6[1] * j_C_O[1] + s6[2] * j_C_O[2];
     double rz = s6[0] * k_C_O[0] + s6[1] * k_C_O[1] + s6[2] * k_C_O[2];
     double sa2, ca2;
-    sa2 = sin(alpha2);
-    ca2 = cos(alpha2);
+    geofik_sincos(alpha2, sa2, ca2);
     tmp = -rz * ca2 / (ry * sa2);
     if (tmp * tmp > 1)
         return array<double, 2>{1e10, 1e10};
-    tmp = asin(tmp);
-    double v[3] = { -sa2 * cos(tmp), -sa2 * sin(tmp), -ca2 };
+    tmp = geofik_asin(tmp);
+    double v[3] = { -sa2 * geofik_cos(tmp), -sa2 * geofik_sin(tmp), -ca2 };
     array<array<double, 3>, 2> s5s;
     s5s[0] = { i_C_O[0] * v[0] + j_C_O[0] * v[1] + k_C_O[0] * v[2],
               i_C_O[1] * v[0] + j_C_O[1] * v[1] + k_C_O[1] * v[2],
               i_C_O[2] * v[0] + j_C_O[2] * v[1] + k_C_O[2] * v[2] };
-    tmp = 2 * sa2 * cos(tmp);
+    tmp = 2 * sa2 * geofik_cos(tmp);
     s5s[1] = { s5s[0][0] + tmp * i_C_O[0],
               s5s[0][1] + tmp * i_C_O[1],
               s5s[0][2] + tmp * i_C_O[2] };
@@ -914,24 +1406,20 @@ array<double, 2> theta_err_from_q7(const double q7,
     return errs;
 }
 
-void franka_ik_q7_one_sol(const double q7,
-                          const Eigen::Vector3d& i_E_O,
-                          const array<double, 3>& k_E_O,
-                          Eigen::Vector3d& i_6_O,
-                          const array<double, 3>& r_O7S_O,
+template <unsigned int Outputs>
+static void ik_q7_one_sol(const PreparedTarget& target,
+                          const double q7,
                           const unsigned int branch,
-                          array<array<double, 7>, 8>& qsols,
+                          const IKKernelOutput& out,
                           unsigned int ind,
                           const double q1_sing) {
-    // returns the two solution related to one single branch of the IK with q7 as free variable. The results are stored in qsols[s*ind] and qsols[2*ind+1]
-    R_axis_angle(k_E_O, -(q7 - PI / 4));
-    i_6_O = tmp_R * i_E_O;
-    array<double, 3> s6 = Cross(k_E_O, i_6_O);
-    array<double, 3> r6 = { r_O7S_O[0] - a7 * i_6_O[0], r_O7S_O[1] - a7 * i_6_O[1], r_O7S_O[2] - a7 * i_6_O[2] };
+    // returns the two solution related to one single branch of the IK with q7 as free variable. The results are stored at 2*ind and 2*ind+1
+    array<double, 3> s6, r6;
+    q7_frame(target, q7, s6, r6);
     double l = Norm(r6);
     double tmp = (b1 * b1 - l * l - b2 * b2) / (-2 * l * b2);
     // The exception tmp*tmp>1 was already handled when Errs was generated
-    double actmp = acos(tmp);
+    double actmp = geofik_acos(tmp);
     double alpha2 = beta2 + actmp;
     array<double, 3> k_C_O = { -r6[0] / l, -r6[1] / l, -r6[2] / l };
     array<double, 3> i_C_O = Cross(k_C_O, s6);
@@ -942,25 +1430,22 @@ void franka_ik_q7_one_sol(const double q7,
     double rz = s6[0] * k_C_O[0] + s6[1] * k_C_O[1] + s6[2] * k_C_O[2];
     array<array<double, 3>, 4> s5s;
     double sa2, ca2;
-    sa2 = sin(alpha2);
-    ca2 = cos(alpha2);
+    geofik_sincos(alpha2, sa2, ca2);
     tmp = -rz * ca2 / (ry * sa2);
     // The exception tmp*tmp>1 was already handled when Errs was generated
-    tmp = asin(tmp);
-    double v[3] = { -sa2 * cos(tmp), -sa2 * sin(tmp), -ca2 };
+    tmp = geofik_asin(tmp);
+    double v[3] = { -sa2 * geofik_cos(tmp), -sa2 * geofik_sin(tmp), -ca2 };
     array<double, 3> s5;
     s5 = { i_C_O[0] * v[0] + j_C_O[0] * v[1] + k_C_O[0] * v[2],
           i_C_O[1] * v[0] + j_C_O[1] * v[1] + k_C_O[1] * v[2],
           i_C_O[2] * v[0] + j_C_O[2] * v[1] + k_C_O[2] * v[2] };
     if (branch == 1) {
-        tmp = 2 * sa2 * cos(tmp);
+        tmp = 2 * sa2 * geofik_cos(tmp);
         s5 = { s5[0] + tmp * i_C_O[0],
               s5[1] + tmp * i_C_O[1],
               s5[2] + tmp * i_C_O[2] };
     }
     array<double, 3> s4, r4, s3, s2;
-    array<double, 6> sol1;
-    array<double, 3> sol2;
     s4 = Cross(s5, r6);
     tmp = Norm(s4);
     s4 = { s4[0] / tmp, s4[1] / tmp, s4[2] / tmp };
@@ -978,57 +1463,44 @@ void franka_ik_q7_one_sol(const double q7,
     if (tmp > SING_TOL)
         s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
     else
-        s2 = { sin(q1_sing), cos(q1_sing), 0 };
-    J_dir(s2, s3, s4, s5, s6, k_E_O);
-    sol1 = q_from_J(tmp_J);
-    tmp_J.col(1) = -1 * tmp_J.col(1);
-    sol2 = q_from_low_J(tmp_J);
-    qsols[2 * ind] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7 };
-    check_limits(qsols[2 * ind], 7);
-    qsols[2 * ind + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * ind][3], qsols[2 * ind][4], qsols[2 * ind][5], qsols[2 * ind][6] };
-    check_limits(qsols[2 * ind + 1], 3);
+        s2 = { geofik_sin(q1_sing), geofik_cos(q1_sing), 0 };
+    store_solution<Outputs>(target, s2, s3, s4, s5, s6, r4, r6, q7, out, ind);
 }
 
-unsigned int franka_ik_swivel(const array<double, 3>& r,
-                              const array<double, 9>& ROE,
-                              const double theta,
-                              array<array<double, 7>, 8>& qsols,
-                              const double q1_sing,
-                              const unsigned int n_points) {
-    // IK with swivel angle as free variable (numerical)
-    // INPUT: r = r_EO_O, position of frame E in frame O
-    //        ROE, orientation of frame E in frame O (row-first format)
-    //        theta, swivel angle (see paper for geometric defninition)
-    //        qsols, array to store 8 solutions
+template <unsigned int Outputs>
+unsigned int franka_ik_swivel_kernel(const PreparedTarget& target,
+                                     const double theta,
+                                     const IKKernelOutput& out,
+                                     const double q1_sing,
+                                     const unsigned int n_points) {
+    // IK with swivel angle as free variable (numerical).
+    // INPUT: target, prepared pose of frame E in frame O (and end-effector frame of the Jacobian)
+    //        theta, swivel angle (see paper for geometric definition)
+    //        out, arrays of the requested outputs (see IKKernelOutput)
     //        q1_sing, emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
-    //        n_points, number of points to discretise the range of q7.
+    //        n_points, number of points to discretise the range of q7
     // OUTPUT: number of solutions found.
     // NOTATION:
     // ri = r_iS_O, 
-    // si - s_i_O
-    array<double, 3> k_E_O = { ROE[2], ROE[5], ROE[8] };
-    array<double, 3> r_O7S_O = { r[0] - dE * k_E_O[0], r[1] - dE * k_E_O[1], r[2] - d1 - dE * k_E_O[2] };
-    double tmp = sqrt(r_O7S_O[1] * r_O7S_O[1] + r_O7S_O[0] * r_O7S_O[0]);
-    if (tmp < SING_TOL) {
-        cout << "ERROR: n1_O is undefined";
-        for (int i = 0; i < 8; i++)
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-        return 0;
-    }
-    array<double, 3> n1_O = { r_O7S_O[1] / tmp, -r_O7S_O[0] / tmp, 0 };
-    Eigen::Vector3d i_E_O(ROE[0], ROE[3], ROE[6]);
-    Eigen::Vector3d i_6_O;
-    tmp = Norm(r_O7S_O);
-    array<double, 3> u_O7S_O = { r_O7S_O[0] / tmp, r_O7S_O[1] / tmp, r_O7S_O[2] / tmp };
+    // si - s_i_O,
+    if (!target.n1_defined) {
+        GEOFIK_DEBUG("ERROR: n1_O is undefined\n");
+        return finish_solutions<Outputs>(out, 0);
+    }
+    const array<double, 3>& r_O7S_O = target.r_7S;
+    const array<double, 3>& n1_O = target.n1;
+    const array<double, 3>& u_7O_O = target.u_7S;
+    double tmp;
     double q7_step = (q_up[6] - q_low[6]) / (n_points - 1);
     double q7;
     array<array<double, 2>, MAX_N_POINTS> Errs;
-    array<array<unsigned int, 2>, MAX_N_POINTS> close_cases;
+    array<array<unsigned int, 2>, 2 * MAX_N_POINTS> close_cases;  // up to two cases per q7 sample
     array<double, MAX_N_POINTS> q7s;
     unsigned int n_close_cases = 0;
-    for (int i = 0; i < n_points; i++) {
-        q7s[i] = q_low[6] + i * q7_step;
-        Errs[i] = theta_err_from_q7(q7s[i], theta, i_E_O, k_E_O, i_6_O, n1_O, r_O7S_O, u_O7S_O);
+    Q7Sweep sweep(target, q_low[6], q_up[6], q7_step);
+    for (int i = 0; i < n_points; i++, sweep.next()) {
+        q7s[i] = sweep.q7();
+        Errs[i] = theta_err_from_frame(theta, sweep.s6(), sweep.r6(), n1_O, r_O7S_O, u_7O_O);
         if (Errs[i][0] < ERR_THRESH)
         {
             close_cases[n_close_cases][0] = i;
@@ -1042,9 +1514,14 @@ unsigned int franka_ik_swivel(const array<double, 3>& r,
             n_close_cases += 1;
         }
     }
-
+    if (n_close_cases == 0) {
+        // no value of q7 attains the requested swivel angle
+        return finish_solutions<Outputs>(out, 0);
+    }
     array<unsigned int, 2> min = close_cases[0];
-    vector<array<unsigned int, 2>> best;
+    // only the first 4 groups are solved, the rest are just counted for the warning below
+    array<array<unsigned int, 2>, 4> best;
+    unsigned int n_best = 0;
     for (int i = 1; i < n_close_cases; i++) {
         // identify repeated cases i.e. cases where several consecutive solutions passed the threshold
         if (close_cases[i][0] == close_cases[i - 1][0] + 1) {
@@ -1053,14 +1530,16 @@ unsigned int franka_ik_swivel(const array<double, 3>& r,
             }
         }
         else {
-            best.push_back(min);
+            if (n_best < 4) best[n_best] = min;
+            n_best++;
             min = close_cases[i];
         }
     }
-    best.push_back(min);
-    unsigned int n_sols = static_cast<unsigned int>(best.size());
+    if (n_best < 4) best[n_best] = min;
+    n_best++;
+    unsigned int n_sols = n_best;
     if (n_sols > 4) {
-        cout << "WARNING: Number of solutions is" << 2 * n_sols << "- Only the first 8 solutions found will be returned.";
+        GEOFIK_DEBUG("WARNING: Number of solutions is %u - Only the first 8 solutions found will be returned.\n", 2 * n_sols);
         n_sols = 4;
     }
     double e0, e1, e2, e3, q71, q72, q7_opt;
@@ -1093,14 +1572,27 @@ unsigned int franka_ik_swivel(const array<double, 3>& r,
                     q7_opt = tmp;
             }
         }
-        franka_ik_q7_one_sol(q7_opt, i_E_O, k_E_O, i_6_O, r_O7S_O, m[1], qsols, i, q1_sing);
+        ik_q7_one_sol<Outputs>(target, q7_opt, m[1], out, i, q1_sing);
     }
-    for (int i = 2 * n_sols; i < 8; ++i) {
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    }
-    return 2 * n_sols;
+    return finish_solutions<Outputs>(out, 2 * n_sols);
 }
 
+#define GEOFIK_INSTANTIATE_KERNELS(OUTPUTS) \
+    template unsigned int franka_ik_q7_kernel<OUTPUTS>(const PreparedTarget&, const double, const IKKernelOutput&, const double); \
+    template unsigned int franka_ik_q4_kernel<OUTPUTS>(const PreparedTarget&, const double, const IKKernelOutput&, const double, const double); \
+    template unsigned int franka_ik_q6_kernel<OUTPUTS>(const PreparedTarget&, const double, const IKKernelOutput&, const double, const double); \
+    template unsigned int franka_ik_swivel_kernel<OUTPUTS>(const PreparedTarget&, const double, const IKKernelOutput&, const double, const unsigned int);
+GEOFIK_INSTANTIATE_KERNELS(IK_ANGLES)
+GEOFIK_INSTANTIATE_KERNELS(IK_ANGLES | IK_VALIDITY)
+GEOFIK_INSTANTIATE_KERNELS(IK_JACOBIAN)
+GEOFIK_INSTANTIATE_KERNELS(IK_JACOBIAN | IK_ANGLES | IK_VALIDITY)
+GEOFIK_INSTANTIATE_KERNELS(IK_JACOBIAN_WRIST)
+GEOFIK_INSTANTIATE_KERNELS(IK_JACOBIAN_WRIST | IK_ANGLES | IK_VALIDITY)
+GEOFIK_INSTANTIATE_KERNELS(IK_MANIPULABILITY | IK_ANGLES | IK_VALIDITY)
+GEOFIK_INSTANTIATE_KERNELS(IK_LINKS)
+GEOFIK_INSTANTIATE_KERNELS(IK_LINKS | IK_ANGLES | IK_VALIDITY)
+#undef GEOFIK_INSTANTIATE_KERNELS
+
 double franka_swivel(const array<double, 7>& q) {
     // swivel angle for a configuration q
     array<Eigen::Matrix4d, 9> Ts;
@@ -1110,7 +1602,7 @@ double franka_swivel(const array<double, 7>& q) {
     array<double, 3> s4 = { Ts[3](0,2), Ts[3](1,2), Ts[3](2,2) };
     double tmp = sqrt(r7[1] * r7[1] + r7[0] * r7[0]);
     if (tmp < SING_TOL) {
-        cout << "ERROR: n1_O is undefined";
+        GEOFIK_DEBUG("ERROR: n1_O is undefined\n");
         return NAN;
     }
     array<double, 3> n1_O = { r7[1] / tmp, -r7[0] / tmp, 0 };
@@ -1123,6 +1615,37 @@ double franka_swivel(const array<double, 7>& q) {
     return signed_angle(n1_O, n2_O, array<double, 3>{r7[0] / tmp, r7[1] / tmp, r7[2] / tmp});
 }
 
+int franka_q7_branch(const array<double, 7>& q, double* residual) {
+    // branch of a configuration q: the one whose solution for the pose and q7 of q is closest to q
+    // (largest joint difference, modulo 2 pi)
+    Eigen::Matrix4d T = franka_fk(q);
+    array<double, 3> r = { T(0,3), T(1,3), T(2,3) };
+    array<double, 9> ROE = { T(0,0), T(0,1), T(0,2), T(1,0), T(1,1), T(1,2), T(2,0), T(2,1), T(2,2) };
+    PreparedTarget target;
+    prepare_target(r, ROE, target);
+    array<double, 3> s6, r6;
+    q7_frame(target, q[6], s6, r6);
+    int best = -1;
+    double best_error = INFINITY;
+    array<double, 7> sol;
+    for (unsigned int branch = 0; branch < 8; branch++) {
+        if (!ik_q7_branch_from_frame<IK_ANGLES>(target, s6, r6, q[6], branch, &sol, nullptr, nullptr, PI / 2))
+            continue;
+        double error = 0;
+        for (int j = 0; j < 6; j++) {
+            double d = sol[j] - q[j];
+            d -= 2 * PI * floor(d / (2 * PI) + 0.5);
+            error = fmax(error, fabs(d));
+        }
+        if (error < best_error) {
+            best_error = error;
+            best = (int)branch;
+        }
+    }
+    if (residual)
+        *residual = best_error;
+    return best;
+}
 
 
 
@@ -1137,134 +1660,305 @@ double franka_swivel(const array<double, 7>& q) {
 
 
 
-// FUNCTIONS FOR JACOBIAN MATRIX ==========================================================================
 
-unsigned int franka_J_ik_q7(const array<double, 3>& r,
-                            const array<double, 9>& ROE,
-                            const double q7,
-                            array<array<array<double, 6>, 7>, 8>& Jsols,
-                            array<array<double, 7>, 8>& qsols,
-                            const bool joint_angles,
-                            const char Jacobian_ee,
-                            const double q1_sing) {
-    // IK to calculate Jacobian and joint angles with q7 as free variable.
-    // INPUT: r = r_EO_O, position of frame E in frame O
-    //        ROE, orientation of frame E in frame O (row-first format)
-    //        q7, value of joint angle of joint 7
-    //        Jsols, array to store 8 Jacobian solutions
-    //        qsols, array to store 8 joint-angle solutions
-    //        joint_angles, if false only Jacobians are returned
-    //        Jacobian_ee, end-effector frame of the Jacobian, not the IK. Only 'E', 'F', '8' and '6' are supported.
-    //        q1_sing, emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
-    // OUTPUT: number of solutions found.
-    // NOTATION:
-    // ri = r_iS_O, 
-    // si - s_i_O,
-    Eigen::Vector3d i_E_O(ROE[0], ROE[3], ROE[6]);
-    array<double, 3> k_E_O = { ROE[2], ROE[5], ROE[8] };
-    R_axis_angle(k_E_O, -(q7 - PI / 4));
-    Eigen::Vector3d i_6_O = tmp_R * i_E_O;
-    array<double, 3> s6;
-    Cross_(k_E_O, i_6_O, s6);
-    array<double, 3> r6 = { r[0] - dE * k_E_O[0] - a7 * i_6_O[0], r[1] - dE * k_E_O[1] - a7 * i_6_O[1], r[2] - d1 - dE * k_E_O[2] - a7 * i_6_O[2] };
-    double l = Norm(r6);
-    double tmp = (b1 * b1 - l * l - b2 * b2) / (-2 * l * b2);
-    if (tmp > 1) {
-        if ((tmp - 1) * (tmp - 1) < SING_TOL) {
-            tmp = 1;
-        }
-        else {
-            cout << "ERROR: unable to assembly kinematic chain";
-            for (int i = 0; i < 8; ++i) {
-                fill(qsols[i].begin(), qsols[i].end(), NAN);
-                for (auto& row : Jsols[i])
-                    fill(row.begin(), row.end(), NAN);
-            }
-            return 0;
-        }
+// SWEEPS OF q7 ===========================================================================================
+
+Q7Sweep::Q7Sweep(const array<double, 3>& r,
+                 const array<double, 9>& ROE,
+                 const double q7_start,
+                 const double q7_end,
+                 const double q7_step)
+    : q7_start_(q7_start),
+      q7_step_(q7_step) {
+    prepare_target(r, ROE, target_);
+    start(q7_end);
+}
+
+Q7Sweep::Q7Sweep(const PreparedTarget& target,
+                 const double q7_start,
+                 const double q7_end,
+                 const double q7_step)
+    : target_(target),
+      q7_start_(q7_start),
+      q7_step_(q7_step) {
+    start(q7_end);
+}
+
+void Q7Sweep::start(const double q7_end) {
+    // i_6_O = R(k_E_O, a) * i_E_O, see prepare_target()
+    n_ = 0;
+    k_ = 0;
+    if (q7_step_ > 0 && q7_end >= q7_start_)
+        n_ = (unsigned int)((q7_end - q7_start_) / q7_step_ + 1e-9) + 1;
+    geofik_sincos(q7_step_, s_step_, c_step_);
+    set_angle(-(q7_start_ - PI / 4));
+}
+
+void Q7Sweep::set_angle(double angle) {
+    geofik_sincos(angle, s_, c_);
+    update_frame();
+}
+
+void Q7Sweep::update_frame() {
+    const PreparedTarget& t = target_;
+    i6_ = { t.i_par[0] + c_ * t.i_perp[0] + s_ * t.j_perp[0],
+            t.i_par[1] + c_ * t.i_perp[1] + s_ * t.j_perp[1],
+            t.i_par[2] + c_ * t.i_perp[2] + s_ * t.j_perp[2] };
+    Cross_(t.k_E, i6_, s6_);
+    r6_ = { t.r_7S[0] - a7 * i6_[0], t.r_7S[1] - a7 * i6_[1], t.r_7S[2] - a7 * i6_[2] };
+}
+
+void Q7Sweep::next() {
+    k_++;
+    if (k_ % RESYNC == 0) {
+        // Drop the rounding error accumulated by the recurrence
+        set_angle(-(q7() - PI / 4));
+        return;
     }
-    double actmp = acos(tmp);
-    double alpha2 = beta2 + actmp;
-    array<double, 3> k_C_O = { -r6[0] / l, -r6[1] / l, -r6[2] / l };
-    array<double, 3> i_C_O = Cross(k_C_O, s6);
-    tmp = Norm(i_C_O);
-    i_C_O = { i_C_O[0] / tmp, i_C_O[1] / tmp, i_C_O[2] / tmp };
-    array<double, 3> j_C_O = Cross(k_C_O, i_C_O);
-    double ry = s6[0] * j_C_O[0] + s6[1] * j_C_O[1] + s6[2] * j_C_O[2];
-    double rz = s6[0] * k_C_O[0] + s6[1] * k_C_O[1] + s6[2] * k_C_O[2];
-    array<array<double, 3>, 4> s5s;
-    double sa2, ca2;
-    int n_alphs = 1;
-    unsigned int n_sols = 0;
-    if (d3 + d5 < l && l < b1 + b2) n_alphs = 2;
-    double v[3];
-    for (int i = 0; i < n_alphs; i++) {
-        sa2 = sin(alpha2);
-        ca2 = cos(alpha2);
-        tmp = -rz * ca2 / (ry * sa2);
-        if (tmp * tmp > 1)
-            continue;
-        tmp = asin(tmp);
-        v[0] = -sa2 * cos(tmp);
-        v[1] = -sa2 * sin(tmp);
-        v[2] = -ca2;
-        s5s[n_sols] = { i_C_O[0] * v[0] + j_C_O[0] * v[1] + k_C_O[0] * v[2],
-                       i_C_O[1] * v[0] + j_C_O[1] * v[1] + k_C_O[1] * v[2],
-                       i_C_O[2] * v[0] + j_C_O[2] * v[1] + k_C_O[2] * v[2] };
-        tmp = 2 * sa2 * cos(tmp);
-        //s5[n_sols+1] = s5s[n_sols] + (2*sa2*cos(tmp)*i_C_O);
-        s5s[n_sols + 1] = { s5s[n_sols][0] + tmp * i_C_O[0],
-                        s5s[n_sols][1] + tmp * i_C_O[1],
-                        s5s[n_sols][2] + tmp * i_C_O[2] };
-        n_sols += 2;
-        alpha2 = beta2 - actmp;
+    // The angle decreases by q7_step
+    double c = c_ * c_step_ + s_ * s_step_;
+    s_ = s_ * c_step_ - c_ * s_step_;
+    c_ = c;
+    update_frame();
+}
+
+unsigned int Q7Sweep::J_ik(array<array<array<double, 6>, 7>, 8>& Jsols,
+                           array<array<double, 7>, 8>& qsols,
+                           IKValidity& validity,
+                           const bool joint_angles,
+                           const double q1_sing) const {
+    IKKernelOutput out = J_ik_output(Jsols, qsols, validity);
+    if (target_.Jacobian_ee == '6') {
+        if (joint_angles)
+            return ik_q7_from_frame<IK_JACOBIAN_WRIST | IK_ANGLES | IK_VALIDITY>(target_, s6_, r6_, q7(), out, q1_sing);
+        return without_angles(qsols, ik_q7_from_frame<IK_JACOBIAN_WRIST>(target_, s6_, r6_, q7(), out, q1_sing));
     }
-    //Jsols.resize(2 * n_sols);
-    //vector<array<double, 7>> sols;
-    array<double, 6> sol1;
-    array<double, 3> sol2;
-    array<double, 3> s4, r4, s3, s2, s5;
-    for (int i = 0; i < n_sols; i++) {
-        s5 = s5s[i];
-        Cross_(s5, r6, s4);
-        tmp = Norm(s4);
-        s4 = { s4[0] / tmp, s4[1] / tmp, s4[2] / tmp };
-        //r4 = r6 - d5 * s5 + a5 * Cross(s5, s4);
-        Cross_(s5, s4, r4);
-        r4 = { r6[0] - d5 * s5[0] + a5 * r4[0], r6[1] - d5 * s5[1] + a5 * r4[1], r6[2] - d5 * s5[2] + a5 * r4[2] };
-        //s3 = R_axis_angle(s4, beta1) * r4;
-        R_axis_angle(s4, beta1);
-        s3 = { tmp_R(0,0) * r4[0] + tmp_R(0,1) * r4[1] + tmp_R(0,2) * r4[2],
-              tmp_R(1,0) * r4[0] + tmp_R(1,1) * r4[1] + tmp_R(1,2) * r4[2],
-              tmp_R(2,0) * r4[0] + tmp_R(2,1) * r4[1] + tmp_R(2,2) * r4[2] };
-        tmp = Norm(s3);
-        s3 = { s3[0] / tmp, s3[1] / tmp, s3[2] / tmp };
-        tmp = s3[1] * s3[1] + s3[0] * s3[0];
-        if (tmp > SING_TOL) {
-            s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
-        }
-        else {
-            s2 = { sin(q1_sing), cos(q1_sing), 0 };
-        }
-        save_J_sol(s2, s3, s4, s5, s6, k_E_O, r4, r6, r, Jsols, i, Jacobian_ee);
-        if (joint_angles) {
-            J_dir(s2, s3, s4, s5, s6, k_E_O);
-            sol1 = q_from_J(tmp_J);
-            tmp_J.col(1) = -1 * tmp_J.col(1);
-            sol2 = q_from_low_J(tmp_J);
-            qsols[2 * i] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7 };
-            check_limits(qsols[2 * i], 7);
-            qsols[2 * i + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * i][3], qsols[2 * i][4], qsols[2 * i][5], qsols[2 * i][6] };
-            check_limits(qsols[2 * i + 1], 3);
-        }
+    if (joint_angles)
+        return ik_q7_from_frame<IK_JACOBIAN | IK_ANGLES | IK_VALIDITY>(target_, s6_, r6_, q7(), out, q1_sing);
+    return without_angles(qsols, ik_q7_from_frame<IK_JACOBIAN>(target_, s6_, r6_, q7(), out, q1_sing));
+}
+
+unsigned int Q7Sweep::J_ik_branch(const unsigned int branch,
+                                  array<array<double, 6>, 7>& J,
+                                  array<double, 7>& q,
+                                  bool& valid,
+                                  const double q1_sing) const {
+    bool exists = target_.Jacobian_ee == '6'
+        ? ik_q7_branch_from_frame<IK_JACOBIAN_WRIST | IK_ANGLES>(target_, s6_, r6_, q7(), branch, &q, &J, nullptr, q1_sing)
+        : ik_q7_branch_from_frame<IK_JACOBIAN | IK_ANGLES>(target_, s6_, r6_, q7(), branch, &q, &J, nullptr, q1_sing);
+    valid = screen_solution(q);
+    return exists ? 1 : 0;
+}
+
+// ENTRY POINTS ON A PREPARED TARGET
+// The runtime joint_angles flag and Jacobian end-effector of the target select the kernel outputs
+
+unsigned int franka_ik_q7(const PreparedTarget& target,
+                          const double q7,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing) {
+    IKKernelOutput out;
+    out.q = &qsols;
+    out.validity = &validity;
+    return franka_ik_q7_kernel<IK_ANGLES | IK_VALIDITY>(target, q7, out, q1_sing);
+}
+
+unsigned int franka_ik_q4(const PreparedTarget& target,
+                          const double q4,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing,
+                          const double q7_sing) {
+    IKKernelOutput out;
+    out.q = &qsols;
+    out.validity = &validity;
+    return franka_ik_q4_kernel<IK_ANGLES | IK_VALIDITY>(target, q4, out, q1_sing, q7_sing);
+}
+
+unsigned int franka_ik_q6(const PreparedTarget& target,
+                          const double q6,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing,
+                          const double q7_sing) {
+    IKKernelOutput out;
+    out.q = &qsols;
+    out.validity = &validity;
+    return franka_ik_q6_kernel<IK_ANGLES | IK_VALIDITY>(target, q6, out, q1_sing, q7_sing);
+}
+
+unsigned int franka_ik_swivel(const PreparedTarget& target,
+                              const double theta,
+                              array<array<double, 7>, 8>& qsols,
+                              IKValidity& validity,
+                              const double q1_sing,
+                              const unsigned int n_points) {
+    IKKernelOutput out;
+    out.q = &qsols;
+    out.validity = &validity;
+    return franka_ik_swivel_kernel<IK_ANGLES | IK_VALIDITY>(target, theta, out, q1_sing, n_points);
+}
+
+unsigned int franka_J_ik_q7(const PreparedTarget& target,
+                            const double q7,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
+                            const bool joint_angles,
+                            const double q1_sing) {
+    IKKernelOutput out = J_ik_output(Jsols, qsols, validity);
+    if (target.Jacobian_ee == '6') {
+        if (joint_angles)
+            return franka_ik_q7_kernel<IK_JACOBIAN_WRIST | IK_ANGLES | IK_VALIDITY>(target, q7, out, q1_sing);
+        return without_angles(qsols, franka_ik_q7_kernel<IK_JACOBIAN_WRIST>(target, q7, out, q1_sing));
+    }
+    if (joint_angles)
+        return franka_ik_q7_kernel<IK_JACOBIAN | IK_ANGLES | IK_VALIDITY>(target, q7, out, q1_sing);
+    return without_angles(qsols, franka_ik_q7_kernel<IK_JACOBIAN>(target, q7, out, q1_sing));
+}
+
+unsigned int franka_J_ik_q4(const PreparedTarget& target,
+                            const double q4,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
+                            const bool joint_angles,
+                            const double q1_sing,
+                            const double q7_sing) {
+    IKKernelOutput out = J_ik_output(Jsols, qsols, validity);
+    if (target.Jacobian_ee == '6') {
+        if (joint_angles)
+            return franka_ik_q4_kernel<IK_JACOBIAN_WRIST | IK_ANGLES | IK_VALIDITY>(target, q4, out, q1_sing, q7_sing);
+        return without_angles(qsols, franka_ik_q4_kernel<IK_JACOBIAN_WRIST>(target, q4, out, q1_sing, q7_sing));
+    }
+    if (joint_angles)
+        return franka_ik_q4_kernel<IK_JACOBIAN | IK_ANGLES | IK_VALIDITY>(target, q4, out, q1_sing, q7_sing);
+    return without_angles(qsols, franka_ik_q4_kernel<IK_JACOBIAN>(target, q4, out, q1_sing, q7_sing));
+}
+
+unsigned int franka_J_ik_q6(const PreparedTarget& target,
+                            const double q6,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
+                            const bool joint_angles,
+                            const double q1_sing,
+                            const double q7_sing) {
+    IKKernelOutput out = J_ik_output(Jsols, qsols, validity);
+    if (target.Jacobian_ee == '6') {
+        if (joint_angles)
+            return franka_ik_q6_kernel<IK_JACOBIAN_WRIST | IK_ANGLES | IK_VALIDITY>(target, q6, out, q1_sing, q7_sing);
+        return without_angles(qsols, franka_ik_q6_kernel<IK_JACOBIAN_WRIST>(target, q6, out, q1_sing, q7_sing));
     }
-    for (int i = 2 * n_sols; i < 8; ++i) {
-        for (auto& row : Jsols[i])
-            fill(row.begin(), row.end(), NAN);
+    if (joint_angles)
+        return franka_ik_q6_kernel<IK_JACOBIAN | IK_ANGLES | IK_VALIDITY>(target, q6, out, q1_sing, q7_sing);
+    return without_angles(qsols, franka_ik_q6_kernel<IK_JACOBIAN>(target, q6, out, q1_sing, q7_sing));
+}
+
+unsigned int franka_J_ik_swivel(const PreparedTarget& target,
+                                const double theta,
+                                array<array<array<double, 6>, 7>, 8>& Jsols,
+                                array<array<double, 7>, 8>& qsols,
+                                IKValidity& validity,
+                                const bool joint_angles,
+                                const double q1_sing,
+                                const unsigned int n_points) {
+    IKKernelOutput out = J_ik_output(Jsols, qsols, validity);
+    if (target.Jacobian_ee == '6') {
+        if (joint_angles)
+            return franka_ik_swivel_kernel<IK_JACOBIAN_WRIST | IK_ANGLES | IK_VALIDITY>(target, theta, out, q1_sing, n_points);
+        return without_angles(qsols, franka_ik_swivel_kernel<IK_JACOBIAN_WRIST>(target, theta, out, q1_sing, n_points));
     }
-    for (int i = joint_angles ? 2 * n_sols : 0; i < 8; i++)
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    return 2 * n_sols;
+    if (joint_angles)
+        return franka_ik_swivel_kernel<IK_JACOBIAN | IK_ANGLES | IK_VALIDITY>(target, theta, out, q1_sing, n_points);
+    return without_angles(qsols, franka_ik_swivel_kernel<IK_JACOBIAN>(target, theta, out, q1_sing, n_points));
+}
+
+bool franka_ik_q7_branch(const PreparedTarget& target,
+                         const double q7,
+                         const unsigned int branch,
+                         array<double, 7>& q,
+                         const double q1_sing) {
+    // A branch that does not exist leaves q NaN, which the screen rejects
+    franka_ik_q7_branch_kernel<IK_ANGLES>(target, q7, branch, &q, nullptr, nullptr, q1_sing);
+    return screen_solution(q);
+}
+
+bool franka_J_ik_q7_branch(const PreparedTarget& target,
+                           const double q7,
+                           const unsigned int branch,
+                           array<array<double, 6>, 7>& J,
+                           array<double, 7>& q,
+                           const double q1_sing) {
+    if (target.Jacobian_ee == '6')
+        franka_ik_q7_branch_kernel<IK_JACOBIAN_WRIST | IK_ANGLES>(target, q7, branch, &q, &J, nullptr, q1_sing);
+    else
+        franka_ik_q7_branch_kernel<IK_JACOBIAN | IK_ANGLES>(target, q7, branch, &q, &J, nullptr, q1_sing);
+    return screen_solution(q);
+}
+
+// ENTRY POINTS ON A RAW POSE
+
+unsigned int franka_ik_q7(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q7,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target);
+    return franka_ik_q7(target, q7, qsols, validity, q1_sing);
+}
+
+unsigned int franka_ik_q4(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q4,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing,
+                          const double q7_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target);
+    return franka_ik_q4(target, q4, qsols, validity, q1_sing, q7_sing);
+}
+
+unsigned int franka_ik_q6(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q6,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing,
+                          const double q7_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target);
+    return franka_ik_q6(target, q6, qsols, validity, q1_sing, q7_sing);
+}
+
+unsigned int franka_ik_swivel(const array<double, 3>& r,
+                              const array<double, 9>& ROE,
+                              const double theta,
+                              array<array<double, 7>, 8>& qsols,
+                              IKValidity& validity,
+                              const double q1_sing,
+                              const unsigned int n_points) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target);
+    return franka_ik_swivel(target, theta, qsols, validity, q1_sing, n_points);
+}
+
+unsigned int franka_J_ik_q7(const array<double, 3>& r,
+                            const array<double, 9>& ROE,
+                            const double q7,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
+                            const bool joint_angles,
+                            const char Jacobian_ee,
+                            const double q1_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_J_ik_q7(target, q7, Jsols, qsols, validity, joint_angles, q1_sing);
 }
 
 unsigned int franka_J_ik_q4(const array<double, 3>& r,
@@ -1272,470 +1966,147 @@ unsigned int franka_J_ik_q4(const array<double, 3>& r,
                             const double q4,
                             array<array<array<double, 6>, 7>, 8>& Jsols,
                             array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
                             const bool joint_angles,
                             const char Jacobian_ee,
                             const double q1_sing,
                             const double q7_sing) {
-    // IK to calculate Jacobian and joint angles with q4 as free variable.
-    // INPUT: r = r_EO_O, position of frame E in frame O
-    //        ROE, orientation of frame E in frame O (row-first format)
-    //        q4, value of joint angle of joint 4
-    //        Jsols, array to store 8 Jacobian solutions
-    //        qsols, array to store 8 joint-angle solutions
-    //        joint_angles, if false only Jacobians are returned
-    //        Jacobian_ee, end-effector frame of the Jacobian, not the IK. Only 'E', 'F', '8' and '6' are supported.
-    //        q1_sing, emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
-    //        q7_sing, emergency value of q7 in case S7 intersects S (type-2 singularity)
-    // OUTPUT: number of solutions found.
-    // NOTATION:
-    // ri = r_iS_O, 
-    // si - s_i_O,
-    array<double, 3> r_ES_O = { r[0], r[1], r[2] - d1 };
-    array<double, 3> tmp_v = { r_ES_O[1] * ROE[8] - r_ES_O[2] * ROE[5],
-                               r_ES_O[2] * ROE[2] - r_ES_O[0] * ROE[8],
-                               r_ES_O[0] * ROE[5] - r_ES_O[1] * ROE[2] };
-    if (tmp_v[0] * tmp_v[0] + tmp_v[1] * tmp_v[1] + tmp_v[2] * tmp_v[2] < SING_TOL)
-        return franka_J_ik_q7(r, ROE, q7_sing, Jsols, qsols, joint_angles, Jacobian_ee, q1_sing);
-    array<double, 3> r_O7S_O = { r_ES_O[0] - dE * ROE[2], r_ES_O[1] - dE * ROE[5], r_ES_O[2] - dE * ROE[8] };
-    array<double, 3> r_O7S_E = { ROE[0] * r_O7S_O[0] + ROE[3] * r_O7S_O[1] + ROE[6] * r_O7S_O[2],
-                                 ROE[1] * r_O7S_O[0] + ROE[4] * r_O7S_O[1] + ROE[7] * r_O7S_O[2],
-                                 ROE[2] * r_O7S_O[0] + ROE[5] * r_O7S_O[1] + ROE[8] * r_O7S_O[2] };
-    double alpha = q4 + beta1 + beta2 - PI;
-    double lo2 = b1 * b1 + b2 * b2 - 2 * b1 * b2 * cos(alpha);
-    double lp2 = lo2 - r_O7S_E[2] * r_O7S_E[2];
-    if (lp2 * lp2 < SING_TOL) lp2 = 0;
-    if (lp2 < 0) {
-        cout << "ERROR: unable to assembly kinematic chain";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-            for (auto& row : Jsols[i])
-                fill(row.begin(), row.end(), NAN);
-        }
-        return 0;
-    }
-    double gamma2 = beta2 + asin(b1 * sin(alpha) / sqrt(lo2));
-    double cg2 = cos(gamma2), sg2 = sin(gamma2);
-    double Lp2 = r_O7S_E[0] * r_O7S_E[0] + r_O7S_E[1] * r_O7S_E[1], phi = atan2(-r_O7S_E[1], -r_O7S_E[0]);
-    double tmp = (Lp2 + a7 * a7 - lp2) / (2 * sqrt(Lp2) * a7);
-    if ((tmp - 1) * (tmp - 1) < SING_TOL)
-        tmp = 1.0;
-    if (tmp > 1.0) {
-        cout << "ERROR: unable to assembly kinematic chain";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-            for (auto& row : Jsols[i])
-                fill(row.begin(), row.end(), NAN);
-        }
-        return 0;
-    }
-    double psi = acos(tmp), ry, rz;
-    double q7s[2] = { -phi - psi - 3 * PI / 4, -phi + psi - 3 * PI / 4 };
-    double gammas[2] = { 0,0 };
-    size_t ind = 0;
-    array<double, 3> s2, s3, s4, s5, s6, r4, r6, i_C_O, j_C_O, k_C_O;
-    array<double, 3> s7 = { ROE[2],ROE[5],ROE[8] };
-    array<double, 6> sol1;
-    array<double, 3> sol2;
-    for (auto q7 : q7s) {
-        tmp_v = { cos(-q7 + 3 * PI / 4), sin(-q7 + 3 * PI / 4), 0 };
-        s6 = { ROE[0] * tmp_v[0] + ROE[1] * tmp_v[1], ROE[3] * tmp_v[0] + ROE[4] * tmp_v[1], ROE[6] * tmp_v[0] + ROE[7] * tmp_v[1] };
-        tmp_v = { -a7 * cos(-q7 + PI / 4), -a7 * sin(-q7 + PI / 4), 0 };
-        r6 = { ROE[0] * tmp_v[0] + ROE[1] * tmp_v[1], ROE[3] * tmp_v[0] + ROE[4] * tmp_v[1], ROE[6] * tmp_v[0] + ROE[7] * tmp_v[1] };
-        r6 = { r6[0] + r_O7S_O[0], r6[1] + r_O7S_O[1], r6[2] + r_O7S_O[2] };
-        tmp = Norm(r6);
-        k_C_O = { -r6[0] / tmp, -r6[1] / tmp, -r6[2] / tmp };
-        Cross_(k_C_O, s6, i_C_O);
-        tmp = Norm(i_C_O);
-        i_C_O = { i_C_O[0] / tmp, i_C_O[1] / tmp, i_C_O[2] / tmp };
-        Cross_(k_C_O, i_C_O, j_C_O);
-        ry = s6[0] * j_C_O[0] + s6[1] * j_C_O[1] + s6[2] * j_C_O[2];
-        rz = s6[0] * k_C_O[0] + s6[1] * k_C_O[1] + s6[2] * k_C_O[2];
-        tmp = -rz * cg2 / (ry * sg2);
-        if (tmp * tmp > 1) continue;
-        tmp = asin(tmp);
-        gammas[0] = tmp;
-        gammas[1] = PI - tmp;
-        for (auto gamma : gammas) {
-            tmp_v = { -sg2 * cos(gamma), -sg2 * sin(gamma), -cg2 };
-            s5 = { i_C_O[0] * tmp_v[0] + j_C_O[0] * tmp_v[1] + k_C_O[0] * tmp_v[2],
-                  i_C_O[1] * tmp_v[0] + j_C_O[1] * tmp_v[1] + k_C_O[1] * tmp_v[2],
-                  i_C_O[2] * tmp_v[0] + j_C_O[2] * tmp_v[1] + k_C_O[2] * tmp_v[2] };
-            Cross_(s5, r6, s4);
-            tmp = Norm(s4);
-            s4 = { s4[0] / tmp, s4[1] / tmp, s4[2] / tmp };
-            Cross_(s5, s4, r4);
-            r4 = { r6[0] - d5 * s5[0] + a5 * r4[0], r6[1] - d5 * s5[1] + a5 * r4[1], r6[2] - d5 * s5[2] + a5 * r4[2] };
-            R_axis_angle(s4, beta1);
-            s3 = { tmp_R(0,0) * r4[0] + tmp_R(0,1) * r4[1] + tmp_R(0,2) * r4[2],
-                  tmp_R(1,0) * r4[0] + tmp_R(1,1) * r4[1] + tmp_R(1,2) * r4[2],
-                  tmp_R(2,0) * r4[0] + tmp_R(2,1) * r4[1] + tmp_R(2,2) * r4[2] };
-            tmp = Norm(s3);
-            s3 = { s3[0] / tmp, s3[1] / tmp, s3[2] / tmp };
-            tmp = s3[1] * s3[1] + s3[0] * s3[0];
-            if (tmp > SING_TOL)
-                s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
-            else
-                s2 = { sin(q1_sing), cos(q1_sing), 0 };
-            save_J_sol(s2, s3, s4, s5, s6, s7, r4, r6, r, Jsols, ind, Jacobian_ee);
-            if (joint_angles) {
-                J_dir(s2, s3, s4, s5, s6, s7);
-                sol1 = q_from_J(tmp_J);
-                tmp_J.col(1) = -1 * tmp_J.col(1);
-                sol2 = q_from_low_J(tmp_J);
-                qsols[2 * ind] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7 };
-                check_limits(qsols[2 * ind], 7);
-                qsols[2 * ind + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * ind][3], qsols[2 * ind][4], qsols[2 * ind][5], qsols[2 * ind][6] };
-                check_limits(qsols[2 * ind + 1], 3);
-            }
-            ind++;
-        }
-    }
-    for (int i = 2 * ind; i < 8; ++i) {
-        for (auto& row : Jsols[i])
-            fill(row.begin(), row.end(), NAN);
-    }
-    for (int i = joint_angles ? 2 * ind : 0; i < 8; i++)
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    return 2 * ind;
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_J_ik_q4(target, q4, Jsols, qsols, validity, joint_angles, q1_sing, q7_sing);
 }
 
-unsigned int franka_J_ik_q6_parallel(const array<double, 3>& r,
-                                     const array<double, 3>& r_ES_O,
-                                     const array<double, 9>& ROE,
-                                     const int sgn,
-                                     array<array<array<double, 6>, 7>, 8>& Jsols,
-                                     array<array<double, 7>, 8>& qsols,
-                                     const bool joint_angles,
-                                     const char Jacobian_ee,
-                                     const double q1_sing) {
-    // Parallel case of the Jacobian IK with q6 as free variable. Only called by franka_J_ik_q6(), not by the user.
-    // INPUT: r, r_ES_O, ROE, sgn  = sign(cos(q6)), Jsols, qsols, joint_angles, Jacobian_ee, q1_sing.
-    // OUTPUT: number of solutions found.
-    // NOTATION:
-    // ri = r_iS_O, i = 1,2,3,4,5,6,7
-    // si = s_i_O
-    // Q is a frame that is parallel to frame E and has origin at Q (Q is called E' in the paper)
-    array<double, 3> s7 = { ROE[2],ROE[5],ROE[8] };
-    array<double, 3> r_QS_O = { r_ES_O[0] + (-dE + sgn * d5) * s7[0], r_ES_O[1] + (-dE + sgn * d5) * s7[1], r_ES_O[2] + (-dE + sgn * d5) * s7[2] };
-    array<double, 3> r_SQ_Q = { -ROE[0] * r_QS_O[0] - ROE[3] * r_QS_O[1] - ROE[6] * r_QS_O[2],
-                                -ROE[1] * r_QS_O[0] - ROE[4] * r_QS_O[1] - ROE[7] * r_QS_O[2],
-                                -ROE[2] * r_QS_O[0] - ROE[5] * r_QS_O[1] - ROE[8] * r_QS_O[2] };
-    double tmp = b1 * b1 - r_SQ_Q[2] * r_SQ_Q[2];
-    if (tmp * tmp < SING_TOL)
-        tmp = 0;
-    if (tmp < 0) {
-        cout << "ERROR: unable to assembly kinematic chain";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-            for (auto& row : Jsols[i])
-                fill(row.begin(), row.end(), NAN);
-        }
-        return 0;
-    }
-    double lp = sqrt(tmp);
-    array<double, 3> r_SpQ_Q = { r_SQ_Q[0], r_SQ_Q[1], 0 };
-    double l_SpQ = sqrt(r_SQ_Q[0] * r_SQ_Q[0] + r_SQ_Q[1] * r_SQ_Q[1]);
-    double alphas[2], Ls[2];
-    double q7;
-    Ls[0] = a5 + lp,
-        Ls[1] = a5 - lp;
-    array<double, 3> tmp_v, r_O6pQ_Q, i_4_Q, r_O4Q_Q, s6_Q, r_O6Q_Q, s4_Q, s3_Q, s2, s3, s4, s5, s6, r4, r6;
-    Eigen::Matrix<double, 3, 4> partial_J_Q, partial_J_O;
-    Eigen::Matrix<double, 3, 2> rs;
-    Eigen::Matrix3d ROQ;
-    ROQ << ROE[0], ROE[1], ROE[2],
-        ROE[3], ROE[4], ROE[5],
-        ROE[6], ROE[7], ROE[8];
-    const array<double, 3> k{ {0,0,1} };
-    array<double, 3> s5_Q{ {0,0,-1.0 * sgn} };
-    int tmp_sgn;
-    unsigned int ind = 0;
-    array<double, 6> sol1;
-    array<double, 3> sol2;
-    for (auto L : Ls) {
-        tmp = (-L * L + a7 * a7 + l_SpQ * l_SpQ) / (2 * a7 * l_SpQ);
-        if ((tmp - 1) * (tmp - 1) < SING_TOL)
-            tmp = 1;
-        else if ((tmp + 1) * (tmp + 1) < SING_TOL)
-            tmp = -1;
-        if (tmp * tmp > 1)
-            continue;
-        alphas[0] = acos(tmp);
-        alphas[1] = -acos(tmp);
-        for (auto alpha : alphas) {
-            rotate_by_axis_angle(k, alpha, r_SpQ_Q, r_O6pQ_Q);
-            r_O6pQ_Q = { a7 * r_O6pQ_Q[0] / l_SpQ, a7 * r_O6pQ_Q[1] / l_SpQ, a7 * r_O6pQ_Q[2] / l_SpQ };
-            i_4_Q = { r_SpQ_Q[0] - r_O6pQ_Q[0], r_SpQ_Q[1] - r_O6pQ_Q[1], r_SpQ_Q[2] - r_O6pQ_Q[2] };
-            tmp = Norm(i_4_Q);
-            tmp_sgn = L < 0 ? -1 : 1;
-            i_4_Q = { tmp_sgn * i_4_Q[0] / tmp, tmp_sgn * i_4_Q[1] / tmp, tmp_sgn * i_4_Q[2] / tmp };
-            r_O4Q_Q = { r_O6pQ_Q[0] + a5 * i_4_Q[0], r_O6pQ_Q[1] + a5 * i_4_Q[1], r_O6pQ_Q[2] + a5 * i_4_Q[2] };
-            Cross_(r_O6pQ_Q, k, s6_Q);
-            r_O6Q_Q = { r_O6pQ_Q[0], r_O6pQ_Q[1], r_O6pQ_Q[2] - sgn * d5 };
-            rs << r_O4Q_Q[0], r_O6Q_Q[0],
-                  r_O4Q_Q[1], r_O6Q_Q[1],
-                  r_O4Q_Q[2], r_O6Q_Q[2];
-            rs = ROQ * rs; // r_O4Q_O, r_O6Q_O
-            r4 = { rs(0,0) + r_QS_O[0], rs(1,0) + r_QS_O[1], rs(2,0) + r_QS_O[2] };
-            r6 = { rs(0,1) + r_QS_O[0], rs(1,1) + r_QS_O[1], rs(2,1) + r_QS_O[2] };
-            Cross_(i_4_Q, s5_Q, s4_Q);
-            tmp_v = { r_O4Q_Q[0] - r_SQ_Q[0], r_O4Q_Q[1] - r_SQ_Q[1], r_O4Q_Q[2] - r_SQ_Q[2] };
-            rotate_by_axis_angle(s4_Q, beta1, tmp_v, s3_Q);
-            tmp = Norm(s3_Q);
-            //s3_Q = {s3_Q[0]/tmp,s3_Q[1]/tmp,s3_Q[2]/tmp};
-            partial_J_Q << s3_Q[0] / tmp, s4_Q[0], s5_Q[0], s6_Q[0],
-                           s3_Q[1] / tmp, s4_Q[1], s5_Q[1], s6_Q[1],
-                           s3_Q[2] / tmp, s4_Q[2], s5_Q[2], s6_Q[2];
-            partial_J_O = ROQ * partial_J_Q;
-            s3 = { partial_J_O(0,0), partial_J_O(1,0), partial_J_O(2,0) };
-            s4 = { partial_J_O(0,1), partial_J_O(1,1), partial_J_O(2,1) };
-            s5 = { partial_J_O(0,2), partial_J_O(1,2), partial_J_O(2,2) };
-            s6 = { partial_J_O(0,3), partial_J_O(1,3), partial_J_O(2,3) };
-            q7 = atan2(r_O6pQ_Q[1], -r_O6pQ_Q[0]) + PI / 4;
-            tmp = s3[1] * s3[1] + s3[0] * s3[0];
-            if (tmp > SING_TOL)
-                s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
-            else
-                s2 = { sin(q1_sing), cos(q1_sing), 0 };
-            save_J_sol(s2, s3, s4, s5, s6, s7, r4, r6, r, Jsols, ind, Jacobian_ee);
-            if (joint_angles) {
-                J_dir(s2, s3, s4, s5, s6, s7);
-                sol1 = q_from_J(tmp_J);
-                tmp_J.col(1) = -1 * tmp_J.col(1);
-                sol2 = q_from_low_J(tmp_J);
-                qsols[2 * ind] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7 };
-                check_limits(qsols[2 * ind], 7);
-                qsols[2 * ind + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * ind][3], qsols[2 * ind][4], qsols[2 * ind][5], qsols[2 * ind][6] };
-                check_limits(qsols[2 * ind + 1], 3);
-            }
-            ind++;
-        }
-    }
-    for (int i = 2 * ind; i < 8; ++i) {
-        for (auto& row : Jsols[i])
-            fill(row.begin(), row.end(), NAN);
-    }
-    for (int i = joint_angles ? 2 * ind : 0; i < 8; i++)
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    return 2 * ind;
+unsigned int franka_J_ik_q6(const array<double, 3>& r,
+                            const array<double, 9>& ROE,
+                            const double q6,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
+                            const bool joint_angles,
+                            const char Jacobian_ee,
+                            const double q1_sing,
+                            const double q7_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_J_ik_q6(target, q6, Jsols, qsols, validity, joint_angles, q1_sing, q7_sing);
+}
+
+unsigned int franka_J_ik_swivel(const array<double, 3>& r,
+                                const array<double, 9>& ROE,
+                                const double theta,
+                                array<array<array<double, 6>, 7>, 8>& Jsols,
+                                array<array<double, 7>, 8>& qsols,
+                                IKValidity& validity,
+                                const bool joint_angles,
+                                const char Jacobian_ee,
+                                const double q1_sing,
+                                const unsigned int n_points) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_J_ik_swivel(target, theta, Jsols, qsols, validity, joint_angles, q1_sing, n_points);
+}
+
+bool franka_ik_q7_branch(const array<double, 3>& r,
+                         const array<double, 9>& ROE,
+                         const double q7,
+                         const unsigned int branch,
+                         array<double, 7>& q,
+                         const double q1_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target);
+    return franka_ik_q7_branch(target, q7, branch, q, q1_sing);
+}
+
+bool franka_J_ik_q7_branch(const array<double, 3>& r,
+                           const array<double, 9>& ROE,
+                           const double q7,
+                           const unsigned int branch,
+                           array<array<double, 6>, 7>& J,
+                           array<double, 7>& q,
+                           const char Jacobian_ee,
+                           const double q1_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_J_ik_q7_branch(target, q7, branch, J, q, q1_sing);
+}
+
+// ENTRY POINTS WITHOUT VALIDITY OUTPUT
+
+unsigned int franka_ik_q7(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q7,
+                          array<array<double, 7>, 8>& qsols,
+                          const double q1_sing) {
+    IKValidity validity;
+    return franka_ik_q7(r, ROE, q7, qsols, validity, q1_sing);
 }
 
-unsigned int franka_J_ik_q6(const array<double, 3>& r,
+unsigned int franka_ik_q4(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q4,
+                          array<array<double, 7>, 8>& qsols,
+                          const double q1_sing,
+                          const double q7_sing) {
+    IKValidity validity;
+    return franka_ik_q4(r, ROE, q4, qsols, validity, q1_sing, q7_sing);
+}
+
+unsigned int franka_ik_q6(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q6,
+                          array<array<double, 7>, 8>& qsols,
+                          const double q1_sing,
+                          const double q7_sing) {
+    IKValidity validity;
+    return franka_ik_q6(r, ROE, q6, qsols, validity, q1_sing, q7_sing);
+}
+
+unsigned int franka_ik_swivel(const array<double, 3>& r,
+                              const array<double, 9>& ROE,
+                              const double theta,
+                              array<array<double, 7>, 8>& qsols,
+                              const double q1_sing,
+                              const unsigned int n_points) {
+    IKValidity validity;
+    return franka_ik_swivel(r, ROE, theta, qsols, validity, q1_sing, n_points);
+}
+
+unsigned int franka_J_ik_q7(const array<double, 3>& r,
                             const array<double, 9>& ROE,
-                            const double q6,
+                            const double q7,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            const bool joint_angles,
+                            const char Jacobian_ee,
+                            const double q1_sing) {
+    IKValidity validity;
+    return franka_J_ik_q7(r, ROE, q7, Jsols, qsols, validity, joint_angles, Jacobian_ee, q1_sing);
+}
+
+unsigned int franka_J_ik_q4(const array<double, 3>& r,
+                            const array<double, 9>& ROE,
+                            const double q4,
                             array<array<array<double, 6>, 7>, 8>& Jsols,
                             array<array<double, 7>, 8>& qsols,
                             const bool joint_angles,
                             const char Jacobian_ee,
                             const double q1_sing,
                             const double q7_sing) {
-    // IK to calculate Jacobian and joint angles with q6 as free variable.
-    // INPUT: r = r_EO_O, position of frame E in frame O
-    //        ROE, orientation of frame E in frame O (row-first format)
-    //        q6, value of joint angle of joint 6
-    //        Jsols, array to store 8 Jacobian solutions
-    //        qsols, array to store 8 joint-angle solutions
-    //        joint_angles, if false only Jacobians are returned
-    //        Jacobian_ee, end-effector frame of the Jacobian, not the IK. Only 'E', 'F', '8' and '6' are supported.
-    //        q1_sing, emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
-    //        q7_sing, emergency value of q7 in case S7 intersects S (type-2 singularity)
-    // OUTPUT: number of solutions found.
-    // NOTATION:
-    // ri = r_iS_O, 
-    // si - s_i_O,
-    array<double, 3> r_ES_O = { r[0], r[1], r[2] - d1 };
-    array<double, 3> tmp_v = { r_ES_O[1] * ROE[8] - r_ES_O[2] * ROE[5],
-                               r_ES_O[2] * ROE[2] - r_ES_O[0] * ROE[8],
-                               r_ES_O[0] * ROE[5] - r_ES_O[1] * ROE[2] };
-    if (tmp_v[0] * tmp_v[0] + tmp_v[1] * tmp_v[1] + tmp_v[2] * tmp_v[2] < SING_TOL)
-        return franka_J_ik_q7(r, ROE, q7_sing, Jsols, qsols, joint_angles, Jacobian_ee, q1_sing);
-    if (sin(q6) * sin(q6) < SING_TOL)
-        // PARALLEL CASE:
-        return franka_J_ik_q6_parallel(r, r_ES_O, ROE, cos(q6) >= 0 ? 1 : -1, Jsols, qsols, joint_angles, Jacobian_ee, q1_sing);
-    // NON-PARALLEL CASE:
-    array<double, 3> s7 = { ROE[2],ROE[5],ROE[8] };
-    double gamma1 = PI - q6;
-    double cg1 = cos(gamma1);
-    double sg1 = sin(gamma1);
-    array<double, 3> r_O7S_O = { r_ES_O[0] - dE * ROE[2], r_ES_O[1] - dE * ROE[5], r_ES_O[2] - dE * ROE[8] };
-    array<double, 3> r_PS_O = { r_O7S_O[0] + (a7 / tan(gamma1)) * s7[0], r_O7S_O[1] + (a7 / tan(gamma1)) * s7[1], r_O7S_O[2] + (a7 / tan(gamma1)) * s7[2] };
-    double lP = Norm(r_PS_O);
-    double lC = a7 / sg1;
-    double Cx = -(ROE[0] * r_PS_O[0] + ROE[3] * r_PS_O[1] + ROE[6] * r_PS_O[2]);
-    double Cy = -(ROE[1] * r_PS_O[0] + ROE[4] * r_PS_O[1] + ROE[7] * r_PS_O[2]);
-    double Cz = -(ROE[2] * r_PS_O[0] + ROE[5] * r_PS_O[1] + ROE[8] * r_PS_O[2]);
-    double c = sqrt(a5 * a5 + (lC + d5) * (lC + d5));
-    double tmp = (-b1 * b1 + lP * lP + c * c) / (2 * lP * c);
-    if ((tmp - 1) * (tmp - 1) < SING_TOL)
-        tmp = 1.0;
-    if (tmp > 1.0) {
-        cout << "ERROR: unable to assembly kinematic chain";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-            for (auto& row : Jsols[i])
-                fill(row.begin(), row.end(), NAN);
-        }
-        return 0;
-    }
-    double tau = acos(tmp);
-    unsigned int n_gamma_sols = 1;
-    if ((d3 + d5 + lC < lP) && (lP < b1 + c)) n_gamma_sols = 2;
-    double gamma2s[2];
-    if (d5 < -lC)
-        gamma2s[0] = tau + atan(a5 / (d5 + lC)) + PI;
-    else
-        gamma2s[0] = tau + atan(a5 / (d5 + lC));
-    if (n_gamma_sols > 1)
-        gamma2s[1] = gamma2s[0] - 2 * tau;
-    array<array<double, 3>, 4> s5s;
-    double q7s[4];
-    double d, u1, u2;
-    unsigned int n_sols = 0;
-    for (int i = 0; i < n_gamma_sols; i++) {
-        d = lP * cos(gamma2s[i]);
-        tmp = (d + Cz * cg1) / (sqrt(Cx * Cx * sg1 * sg1 + Cy * Cy * sg1 * sg1));
-        if ((tmp - 1) * (tmp - 1) < SING_TOL)
-            tmp = 1;
-        else if ((tmp + 1) * (tmp + 1) < SING_TOL)
-            tmp = -1;
-        if (tmp * tmp > 1)
-            continue;
-        u1 = asin(tmp);
-        u2 = atan2(Cx * sg1, Cy * sg1);
-        q7s[n_sols] = 5 * PI / 4 - u1 + u2;
-        tmp_v = { -sg1 * cos(u1 - u2), -sg1 * sin(u1 - u2), cg1 };
-        column_1s_times_vec(ROE, tmp_v, s5s[n_sols]);
-        n_sols++;
-        q7s[n_sols] = PI / 4 + u1 + u2;
-        tmp_v = { -sg1 * cos(PI - u1 - u2), -sg1 * sin(PI - u1 - u2), cg1 };
-        column_1s_times_vec(ROE, tmp_v, s5s[n_sols]);
-        n_sols++;
-    }
-    array<double, 3> s2, s3, s4, s6, r4, r6;
-    array<double, 6> sol1;
-    array<double, 3> sol2;
-    for (int i; i < n_sols; i++) {
-        r6 = { r_PS_O[0] - lC * s5s[i][0], r_PS_O[1] - lC * s5s[i][1], r_PS_O[2] - lC * s5s[i][2] };
-        tmp_v = { r_O7S_O[0] - r6[0], r_O7S_O[1] - r6[1], r_O7S_O[2] - r6[2] };
-        Cross_(s7, tmp_v, s6);
-        tmp = Norm(s6);
-        s6 = { s6[0] / tmp,s6[1] / tmp,s6[2] / tmp };
-        Cross_(s5s[i], r6, s4);
-        tmp = Norm(s4);
-        s4 = { s4[0] / tmp,s4[1] / tmp,s4[2] / tmp };
-        Cross_(s5s[i], s4, tmp_v);
-        r4 = { r6[0] - d5 * s5s[i][0] + a5 * tmp_v[0], r6[1] - d5 * s5s[i][1] + a5 * tmp_v[1], r6[2] - d5 * s5s[i][2] + a5 * tmp_v[2] };
-        rotate_by_axis_angle(s4, beta1, r4, s3);
-        tmp = Norm(s3);
-        s3 = { s3[0] / tmp,s3[1] / tmp,s3[2] / tmp };
-        tmp = s3[1] * s3[1] + s3[0] * s3[0];
-        if (tmp > SING_TOL)
-            s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
-        else
-            s2 = { sin(q1_sing), cos(q1_sing), 0 };
-        save_J_sol(s2, s3, s4, s5s[i], s6, s7, r4, r6, r, Jsols, i, Jacobian_ee);
-        if (joint_angles) {
-            J_dir(s2, s3, s4, s5s[i], s6, s7);
-            sol1 = q_from_J(tmp_J);
-            tmp_J.col(1) = -1 * tmp_J.col(1);
-            sol2 = q_from_low_J(tmp_J);
-            qsols[2 * i] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7s[i] };
-            check_limits(qsols[2 * i], 7);
-            qsols[2 * i + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * i][3], qsols[2 * i][4], qsols[2 * i][5], qsols[2 * i][6] };
-            check_limits(qsols[2 * i + 1], 3);
-        }
-    }
-    for (int i = 2 * n_sols; i < 8; ++i) {
-        for (auto& row : Jsols[i])
-            fill(row.begin(), row.end(), NAN);
-    }
-    for (int i = joint_angles ? 2 * n_sols : 0; i < 8; i++)
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    return 2 * n_sols;
+    IKValidity validity;
+    return franka_J_ik_q4(r, ROE, q4, Jsols, qsols, validity, joint_angles, Jacobian_ee, q1_sing, q7_sing);
 }
 
-// FUNCTIONS FOR SWIVEL ANGLE (JACOBIAN)
-
-void franka_J_ik_q7_one_sol(const double q7,
-                            const Eigen::Vector3d& i_E_O,
-                            const array<double, 3>& k_E_O,
-                            Eigen::Vector3d& i_6_O,
-                            const array<double, 3>& r_O7S_O,
-                            const array<double, 3>& r,
+unsigned int franka_J_ik_q6(const array<double, 3>& r,
+                            const array<double, 9>& ROE,
+                            const double q6,
                             array<array<array<double, 6>, 7>, 8>& Jsols,
                             array<array<double, 7>, 8>& qsols,
-                            unsigned int ind,
                             const bool joint_angles,
                             const char Jacobian_ee,
-                            const unsigned int branch,
-                            const double q1_sing) {
-    // returns the two solution related to one single branch of the IK with q7 as free variable. The results are stored in Jsols[2*ind] and Jsols[2*ind+1]
-    R_axis_angle(k_E_O, -(q7 - PI / 4));
-    i_6_O = tmp_R * i_E_O;
-    array<double, 3> s6 = Cross(k_E_O, i_6_O);
-    array<double, 3> r6 = { r_O7S_O[0] - a7 * i_6_O[0], r_O7S_O[1] - a7 * i_6_O[1], r_O7S_O[2] - a7 * i_6_O[2] };
-    double l = Norm(r6);
-    double tmp = (b1 * b1 - l * l - b2 * b2) / (-2 * l * b2);
-    // The exception tmp*tmp>1 was already handled when Errs was generated
-    double actmp = acos(tmp);
-    double alpha2 = beta2 + actmp;
-    array<double, 3> k_C_O = { -r6[0] / l, -r6[1] / l, -r6[2] / l };
-    array<double, 3> i_C_O = Cross(k_C_O, s6);
-    tmp = Norm(i_C_O);
-    i_C_O = { i_C_O[0] / tmp, i_C_O[1] / tmp, i_C_O[2] / tmp };
-    array<double, 3> j_C_O = Cross(k_C_O, i_C_O);
-    double ry = s6[0] * j_C_O[0] + s6[1] * j_C_O[1] + s6[2] * j_C_O[2];
-    double rz = s6[0] * k_C_O[0] + s6[1] * k_C_O[1] + s6[2] * k_C_O[2];
-    array<array<double, 3>, 4> s5s;
-    double sa2, ca2;
-    sa2 = sin(alpha2);
-    ca2 = cos(alpha2);
-    tmp = -rz * ca2 / (ry * sa2);
-    // The exception tmp*tmp>1 was already handled when Errs was generated
-    tmp = asin(tmp);
-    double v[3] = { -sa2 * cos(tmp), -sa2 * sin(tmp), -ca2 };
-    array<double, 3> s5;
-    s5 = { i_C_O[0] * v[0] + j_C_O[0] * v[1] + k_C_O[0] * v[2],
-          i_C_O[1] * v[0] + j_C_O[1] * v[1] + k_C_O[1] * v[2],
-          i_C_O[2] * v[0] + j_C_O[2] * v[1] + k_C_O[2] * v[2] };
-    if (branch == 1) {
-        tmp = 2 * sa2 * cos(tmp);
-        s5 = { s5[0] + tmp * i_C_O[0],
-              s5[1] + tmp * i_C_O[1],
-              s5[2] + tmp * i_C_O[2] };
-    }
-    array<double, 3> s4, r4, s3, s2;
-    array<double, 6> sol1;
-    array<double, 3> sol2;
-    s4 = Cross(s5, r6);
-    tmp = Norm(s4);
-    s4 = { s4[0] / tmp, s4[1] / tmp, s4[2] / tmp };
-    r4 = Cross(s5, s4);
-    r4 = { r6[0] - d5 * s5[0] + a5 * r4[0],
-          r6[1] - d5 * s5[1] + a5 * r4[1],
-          r6[2] - d5 * s5[2] + a5 * r4[2] };
-    R_axis_angle(s4, beta1);
-    s3 = { tmp_R(0,0) * r4[0] + tmp_R(0,1) * r4[1] + tmp_R(0,2) * r4[2],
-          tmp_R(1,0) * r4[0] + tmp_R(1,1) * r4[1] + tmp_R(1,2) * r4[2],
-          tmp_R(2,0) * r4[0] + tmp_R(2,1) * r4[1] + tmp_R(2,2) * r4[2] };
-    tmp = Norm(s3);
-    s3 = { s3[0] / tmp, s3[1] / tmp, s3[2] / tmp };
-    tmp = s3[1] * s3[1] + s3[0] * s3[0];
-    if (tmp > SING_TOL)
-        s2 = { -s3[1] / sqrt(tmp), s3[0] / sqrt(tmp), 0 };
-    else
-        s2 = { sin(q1_sing), cos(q1_sing), 0 };
-    save_J_sol(s2, s3, s4, s5, s6, k_E_O, r4, r6, r, Jsols, ind, Jacobian_ee);
-    if (joint_angles) {
-        J_dir(s2, s3, s4, s5, s6, k_E_O);
-        sol1 = q_from_J(tmp_J);
-        tmp_J.col(1) = -1 * tmp_J.col(1);
-        sol2 = q_from_low_J(tmp_J);
-        qsols[2 * ind] = { sol1[0], sol1[1], sol1[2], sol1[3], sol1[4], sol1[5], q7 };
-        check_limits(qsols[2 * ind], 7);
-        qsols[2 * ind + 1] = { sol2[0], sol2[1], sol2[2], qsols[2 * ind][3], qsols[2 * ind][4], qsols[2 * ind][5], qsols[2 * ind][6] };
-        check_limits(qsols[2 * ind + 1], 3);
-    }
+                            const double q1_sing,
+                            const double q7_sing) {
+    IKValidity validity;
+    return franka_J_ik_q6(r, ROE, q6, Jsols, qsols, validity, joint_angles, Jacobian_ee, q1_sing, q7_sing);
 }
 
 unsigned int franka_J_ik_swivel(const array<double, 3>& r,
@@ -1747,122 +2118,233 @@ unsigned int franka_J_ik_swivel(const array<double, 3>& r,
                                 const char Jacobian_ee,
                                 const double q1_sing,
                                 const unsigned int n_points) {
-    // IK to calculate Jacobian and joint angles with swivel angle as free variable (numerical).
-    // INPUT: r = r_EO_O, position of frame E in frame O
-    //        ROE, orientation of frame E in frame O (row-first format)
-    //        theta, swivel angle (see paper for gemetric definition)
-    //        Jsols, array to store 8 Jacobian solutions
-    //        qsols, array to store 8 joint-angle solutions
-    //        joint_angles, if false only Jacobians are returned
-    //        Jacobian_ee, end-effector frame of the Jacobian, not the IK. Only 'E', 'F', '8' and '6' are supported.
-    //        q1_sing, emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
-    //        n_points, number of points to descritise the range of q7
-    // OUTPUT: number of solutions found.
-    // NOTATION:
-    // ri = r_iS_O, 
-    // si - s_i_O,
-    array<double, 3> k_E_O = { ROE[2], ROE[5], ROE[8] };
-    //r_O7S_O = r_EO_O + r_OS_O + r_O7E_O = r_EO_O - (0,0,d1) - dE*k_E_O
-    array<double, 3> r_O7S_O = { r[0] - dE * k_E_O[0], r[1] - dE * k_E_O[1], r[2] - d1 - dE * k_E_O[2] };
-    double tmp = sqrt(r_O7S_O[1] * r_O7S_O[1] + r_O7S_O[0] * r_O7S_O[0]);
-    if (tmp < SING_TOL) {
-        cout << "ERROR: n1_O is undefined";
-        for (int i = 0; i < 8; ++i) {
-            fill(qsols[i].begin(), qsols[i].end(), NAN);
-            for (auto& row : Jsols[i])
-                fill(row.begin(), row.end(), NAN);
-        }
-        return 0;
+    IKValidity validity;
+    return franka_J_ik_swivel(r, ROE, theta, Jsols, qsols, validity, joint_angles, Jacobian_ee, q1_sing, n_points);
+}
+
+// COMPACT SOLUTION RECORDS
+
+unsigned int compact_solutions(const array<array<double, 7>, 8>& qsols,
+                               const array<array<array<double, 6>, 7>, 8>* Jsols,
+                               const array<double, 8>* manipulability,
+                               const unsigned int n_found,
+                               const IKValidity& validity,
+                               IKSolutionSet& sols) {
+    // Copies the valid solutions (and their Jacobians or manipulabilities if given) to the front of sols
+    unsigned int count = 0;
+    for (unsigned int mask = validity.valid; mask; ) {
+        int i = next_valid_solution(mask);
+        for (int j = 0; j < 7; j++)
+            sols.q[count][j] = qsols[i][j];
+        sols.q[count][7] = 0;
+        if (Jsols)
+            memcpy(sols.J[count].data(), (*Jsols)[i][0].data(), 42 * sizeof(double));
+        if (manipulability)
+            sols.manipulability[count] = (*manipulability)[i];
+        sols.branch[count] = (unsigned char)i;
+        count++;
     }
-    array<double, 3> n1_O = { r_O7S_O[1] / tmp, -r_O7S_O[0] / tmp, 0 };
-    Eigen::Vector3d i_E_O(ROE[0], ROE[3], ROE[6]);
-    Eigen::Vector3d i_6_O;
-    tmp = Norm(r_O7S_O);
-    array<double, 3> u_7O_O = { r_O7S_O[0] / tmp, r_O7S_O[1] / tmp, r_O7S_O[2] / tmp };
-    double q7_step = (q_up[6] - q_low[6]) / (n_points - 1);
-    double q7;
-    array<array<double, 2>, MAX_N_POINTS> Errs;
-    array<array<unsigned int, 2>, MAX_N_POINTS> close_cases;
-    array<double, MAX_N_POINTS> q7s;
-    unsigned int n_close_cases = 0;
-    for (int i = 0; i < n_points; i++) {
-        q7s[i] = q_low[6] + i * q7_step;
-        Errs[i] = theta_err_from_q7(q7s[i], theta, i_E_O, k_E_O, i_6_O, n1_O, r_O7S_O, u_7O_O);
-        if (Errs[i][0] < ERR_THRESH)
-        {
-            close_cases[n_close_cases][0] = i;
-            close_cases[n_close_cases][1] = 0;
-            n_close_cases += 1;
-        }
-        if (Errs[i][1] < ERR_THRESH)
-        {
-            close_cases[n_close_cases][0] = i;
-            close_cases[n_close_cases][1] = 1;
-            n_close_cases += 1;
-        }
+    sols.count = count;
+    sols.n_found = n_found;
+    sols.has_jacobians = Jsols != nullptr;
+    sols.has_manipulability = manipulability != nullptr;
+    return count;
+}
+
+unsigned int franka_ik_q7_compact(const PreparedTarget& target,
+                                  const double q7,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians,
+                                  const double q1_sing) {
+    array<array<double, 7>, 8> qsols;
+    IKValidity validity;
+    if (!jacobians) {
+        unsigned int n = franka_ik_q7(target, q7, qsols, validity, q1_sing);
+        return compact_solutions(qsols, nullptr, nullptr, n, validity, sols);
     }
-    array<unsigned int, 2> min = close_cases[0];
-    //array<array<unsigned int, 2>, 16> best; //setting 16 as maximum number of solutions
-    vector<array<unsigned int, 2>> best;
-    //unsigned int num_best = 0;
-    for (int i = 1; i < n_close_cases; i++) {
-        // identify repeated cases i.e. cases where several consecutive solutions passed the threshold
-        if (close_cases[i][0] == close_cases[i - 1][0] + 1) {
-            if (Errs[close_cases[i][0]][close_cases[i][1]] < Errs[min[0]][min[1]]) {
-                min = close_cases[i];
-            }
-        }
-        else {
-            //best[num_best++] = min;
-            best.push_back(min);
-            min = close_cases[i];
-            //if (num_best == 16) break;
-        }
+    array<array<array<double, 6>, 7>, 8> Jsols;
+    unsigned int n = franka_J_ik_q7(target, q7, Jsols, qsols, validity, true, q1_sing);
+    return compact_solutions(qsols, &Jsols, nullptr, n, validity, sols);
+}
+
+unsigned int franka_ik_q7_manipulability(const PreparedTarget& target,
+                                         const double q7,
+                                         IKSolutionSet& sols,
+                                         const double q1_sing) {
+    // The manipulability does not depend on the end-effector frame of the Jacobian
+    array<array<double, 7>, 8> qsols;
+    array<double, 8> manipulability;
+    IKValidity validity;
+    IKKernelOutput out;
+    out.q = &qsols;
+    out.manipulability = &manipulability;
+    out.validity = &validity;
+    unsigned int n = franka_ik_q7_kernel<IK_MANIPULABILITY | IK_ANGLES | IK_VALIDITY>(target, q7, out, q1_sing);
+    return compact_solutions(qsols, nullptr, &manipulability, n, validity, sols);
+}
+
+static unsigned int compact_branch(array<double, 7>& q,
+                                   const array<array<double, 6>, 7>* J,
+                                   const double* manipulability,
+                                   const bool exists,
+                                   const unsigned int branch,
+                                   IKSolutionSet& sols) {
+    // Stores the solution of one branch in sols if it is within the joint limits
+    unsigned int count = screen_solution(q) ? 1 : 0;
+    if (count) {
+        for (int j = 0; j < 7; j++)
+            sols.q[0][j] = q[j];
+        sols.q[0][7] = 0;
+        if (J)
+            memcpy(sols.J[0].data(), (*J)[0].data(), 42 * sizeof(double));
+        if (manipulability)
+            sols.manipulability[0] = *manipulability;
+        sols.branch[0] = (unsigned char)branch;
     }
-    //if (num_best < 16) best[num_best++] = min;
-    best.push_back(min);
-    unsigned int n_sols = static_cast<unsigned int>(best.size());
-    if (n_sols > 4) {
-        cout << "WARNING: Number of solutions is" << 2 * n_sols << "- Only the first 8 solutions found will be returned.";
-        n_sols = 4;
+    sols.count = count;
+    sols.n_found = exists ? 1 : 0;
+    sols.has_jacobians = J != nullptr;
+    sols.has_manipulability = manipulability != nullptr;
+    return count;
+}
+
+unsigned int franka_ik_q7_branch_compact(const PreparedTarget& target,
+                                         const double q7,
+                                         const unsigned int branch,
+                                         IKSolutionSet& sols,
+                                         const bool jacobians,
+                                         const double q1_sing) {
+    array<double, 7> q;
+    if (!jacobians) {
+        bool exists = franka_ik_q7_branch_kernel<IK_ANGLES>(target, q7, branch, &q, nullptr, nullptr, q1_sing);
+        return compact_branch(q, nullptr, nullptr, exists, branch, sols);
     }
-    double e0, e1, e2, e3, q71, q72, q7_opt;
-    array<unsigned int, 2> m;
-    for (int i = 0; i < n_sols; i++) {
-        m = best[i];
-        q7_opt = q7s[m[0]];
-        if (m[0] > 1 && m[0] < n_points - 2) {
-            if (Errs[m[0] - 2][m[1]] < ERR_THRESH && Errs[m[0] + 2][m[1]] < ERR_THRESH) {
-                if (Errs[m[0] + 1][m[1]] < Errs[m[0] - 1][m[1]]) {
-                    // 0=i-1, 1=i, 2=i+1, 3=i+2
-                    e0 = Errs[m[0] - 1][m[1]];
-                    e1 = Errs[m[0]][m[1]];
-                    e2 = Errs[m[0] + 1][m[1]];
-                    e3 = Errs[m[0] + 2][m[1]];
-                    q71 = q7s[m[0]];
-                    q72 = q7s[m[0] + 1];
-                }
-                else {
-                    // 0=i-2, 1=i-1, 2=i, 3=i+1
-                    e0 = Errs[m[0] - 2][m[1]];
-                    e1 = Errs[m[0] - 1][m[1]];
-                    e2 = Errs[m[0]][m[1]];
-                    e3 = Errs[m[0] + 1][m[1]];
-                    q71 = q7s[m[0] - 1];
-                    q72 = q7s[m[0]];
-                }
-                tmp = ((e1 - e0) * q71 - (e3 - e2) * q72 + (e2 - e1) * q7_step) / (e1 - e0 - e3 + e2);
-                if (tmp > q71 && tmp < q72)
-                    q7_opt = tmp;
-            }
-        }
-        franka_J_ik_q7_one_sol(q7_opt, i_E_O, k_E_O, i_6_O, r_O7S_O, r, Jsols, qsols, i, joint_angles, Jacobian_ee, m[1], q1_sing);
+    array<array<double, 6>, 7> J;
+    bool exists = target.Jacobian_ee == '6'
+        ? franka_ik_q7_branch_kernel<IK_JACOBIAN_WRIST | IK_ANGLES>(target, q7, branch, &q, &J, nullptr, q1_sing)
+        : franka_ik_q7_branch_kernel<IK_JACOBIAN | IK_ANGLES>(target, q7, branch, &q, &J, nullptr, q1_sing);
+    return compact_branch(q, &J, nullptr, exists, branch, sols);
+}
+
+unsigned int franka_ik_q7_branch_manipulability(const PreparedTarget& target,
+                                                const double q7,
+                                                const unsigned int branch,
+                                                IKSolutionSet& sols,
+                                                const double q1_sing) {
+    array<double, 7> q;
+    double manipulability;
+    bool exists = franka_ik_q7_branch_kernel<IK_MANIPULABILITY | IK_ANGLES>(target, q7, branch, &q, nullptr, &manipulability, q1_sing);
+    return compact_branch(q, nullptr, &manipulability, exists, branch, sols);
+}
+
+unsigned int franka_ik_q4_compact(const PreparedTarget& target,
+                                  const double q4,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians,
+                                  const double q1_sing,
+                                  const double q7_sing) {
+    array<array<double, 7>, 8> qsols;
+    IKValidity validity;
+    if (!jacobians) {
+        unsigned int n = franka_ik_q4(target, q4, qsols, validity, q1_sing, q7_sing);
+        return compact_solutions(qsols, nullptr, nullptr, n, validity, sols);
+    }
+    array<array<array<double, 6>, 7>, 8> Jsols;
+    unsigned int n = franka_J_ik_q4(target, q4, Jsols, qsols, validity, true, q1_sing, q7_sing);
+    return compact_solutions(qsols, &Jsols, nullptr, n, validity, sols);
+}
+
+unsigned int franka_ik_q6_compact(const PreparedTarget& target,
+                                  const double q6,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians,
+                                  const double q1_sing,
+                                  const double q7_sing) {
+    array<array<double, 7>, 8> qsols;
+    IKValidity validity;
+    if (!jacobians) {
+        unsigned int n = franka_ik_q6(target, q6, qsols, validity, q1_sing, q7_sing);
+        return compact_solutions(qsols, nullptr, nullptr, n, validity, sols);
     }
-    for (int i = 2 * n_sols; i < 8; ++i) {
-        for (auto& row : Jsols[i])
-            fill(row.begin(), row.end(), NAN);
+    array<array<array<double, 6>, 7>, 8> Jsols;
+    unsigned int n = franka_J_ik_q6(target, q6, Jsols, qsols, validity, true, q1_sing, q7_sing);
+    return compact_solutions(qsols, &Jsols, nullptr, n, validity, sols);
+}
+
+unsigned int franka_ik_swivel_compact(const PreparedTarget& target,
+                                      const double theta,
+                                      IKSolutionSet& sols,
+                                      const bool jacobians,
+                                      const double q1_sing,
+                                      const unsigned int n_points) {
+    array<array<double, 7>, 8> qsols;
+    IKValidity validity;
+    if (!jacobians) {
+        unsigned int n = franka_ik_swivel(target, theta, qsols, validity, q1_sing, n_points);
+        return compact_solutions(qsols, nullptr, nullptr, n, validity, sols);
     }
-    for (int i = joint_angles ? 2 * n_sols : 0; i < 8; i++)
-        fill(qsols[i].begin(), qsols[i].end(), NAN);
-    return 2 * n_sols;
+    array<array<array<double, 6>, 7>, 8> Jsols;
+    unsigned int n = franka_J_ik_swivel(target, theta, Jsols, qsols, validity, true, q1_sing, n_points);
+    return compact_solutions(qsols, &Jsols, nullptr, n, validity, sols);
+}
+
+unsigned int franka_ik_q7_compact(const array<double, 3>& r,
+                                  const array<double, 9>& ROE,
+                                  const double q7,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians,
+                                  const char Jacobian_ee,
+                                  const double q1_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_ik_q7_compact(target, q7, sols, jacobians, q1_sing);
+}
+
+unsigned int franka_ik_q7_manipulability(const array<double, 3>& r,
+                                         const array<double, 9>& ROE,
+                                         const double q7,
+                                         IKSolutionSet& sols,
+                                         const double q1_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target);
+    return franka_ik_q7_manipulability(target, q7, sols, q1_sing);
+}
+
+unsigned int franka_ik_q4_compact(const array<double, 3>& r,
+                                  const array<double, 9>& ROE,
+                                  const double q4,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians,
+                                  const char Jacobian_ee,
+                                  const double q1_sing,
+                                  const double q7_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_ik_q4_compact(target, q4, sols, jacobians, q1_sing, q7_sing);
+}
+
+unsigned int franka_ik_q6_compact(const array<double, 3>& r,
+                                  const array<double, 9>& ROE,
+                                  const double q6,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians,
+                                  const char Jacobian_ee,
+                                  const double q1_sing,
+                                  const double q7_sing) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_ik_q6_compact(target, q6, sols, jacobians, q1_sing, q7_sing);
+}
+
+unsigned int franka_ik_swivel_compact(const array<double, 3>& r,
+                                      const array<double, 9>& ROE,
+                                      const double theta,
+                                      IKSolutionSet& sols,
+                                      const bool jacobians,
+                                      const char Jacobian_ee,
+                                      const double q1_sing,
+                                      const unsigned int n_points) {
+    PreparedTarget target;
+    prepare_target(r, ROE, target, Jacobian_ee);
+    return franka_ik_swivel_compact(target, theta, sols, jacobians, q1_sing, n_points);
 }
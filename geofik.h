@@ -8,6 +8,100 @@ using namespace std;
 
 constexpr double PI = 3.14159265359;
 
+/**
+ * @brief Lower and upper joint limits of the Franka arm (radians).
+ */
+extern const array<double, 7> q_low;
+extern const array<double, 7> q_up;
+
+/**
+ * @brief Validity of the solutions returned by an IK call.
+ * @details valid has bit i set if solution i exists and all its joints are within limits, so the
+ *          valid solutions can be visited with next_valid_solution() instead of scanning for NaN.
+ *          violations[i] has bit j set if joint j of solution i is outside its limits or undefined
+ *          (0 past the number of solutions). Without joint angles (joint_angles = false) limits
+ *          cannot be checked and valid only marks the solutions that exist.
+ */
+struct IKValidity {
+    unsigned int valid;
+    array<unsigned char, 8> violations;
+};
+
+/**
+ * @brief Index of the lowest set bit of a validity mask, clearing it.
+ * @details for (unsigned int m = validity.valid; m; ) { int i = next_valid_solution(m); ... }
+ */
+inline int next_valid_solution(unsigned int& mask) {
+    int i = __builtin_ctz(mask);
+    mask &= mask - 1;
+    return i;
+}
+
+/**
+ * @brief Dense record of the valid solutions of one IK call (see franka_ik_q7_compact()).
+ * @details Only the first count entries are written: no NaN padding, and Jacobians only when
+ *          requested. Each row of q is padded to 8 doubles and each Jacobian is stored column-major
+ *          in 48 doubles (J^T row by row, as in Jsols, 42 used), both 64-byte aligned, so
+ *          jacobian(k) maps it as an Eigen 6x7 matrix without a transposing copy.
+ */
+struct alignas(64) IKSolutionSet {
+    array<array<double, 8>, 8> q;       // Joint angles of solution k in q[k][0..6]
+    array<array<double, 48>, 8> J;      // Column-major 6x7 Jacobian of solution k, if has_jacobians
+    unsigned int count;                 // Solutions within the joint limits
+    unsigned int n_found;               // Solutions before the joint-limit screen
+    array<unsigned char, 8> branch;     // Slot of solution k in the 8-slot output of franka_ik_*, which
+                                        // identifies its shoulder/elbow/wrist configuration
+    array<double, 8> manipulability;    // Manipulability of solution k, if has_manipulability
+    bool has_jacobians;
+    bool has_manipulability;
+
+    Eigen::Map<const Eigen::Matrix<double, 6, 7>, Eigen::Aligned16> jacobian(unsigned int k) const {
+        return Eigen::Map<const Eigen::Matrix<double, 6, 7>, Eigen::Aligned16>(J[k].data());
+    }
+    Eigen::Map<const Eigen::Matrix<double, 7, 1>, Eigen::Aligned16> joint_angles(unsigned int k) const {
+        return Eigen::Map<const Eigen::Matrix<double, 7, 1>, Eigen::Aligned16>(q[k].data());
+    }
+};
+
+/**
+ * @brief Quantities of an IK target that do not depend on the free variable (see prepare_target()).
+ * @details Built once per target and Jacobian end-effector, then passed to the PreparedTarget
+ *          overloads of the IK functions, so repeated evaluations of one pose (an optimizer, a
+ *          sweep, a swivel scan) do not re-derive them on every call.
+ */
+struct PreparedTarget {
+    array<double, 3> r;         // r_EO_O
+    array<double, 9> ROE;       // Row-first
+    array<double, 3> i_E;       // First column of ROE
+    array<double, 3> k_E;       // Third column of ROE, s7
+    array<double, 3> r_ES;      // r_ES_O = r - (0, 0, d1)
+    array<double, 3> r_7S;      // r_O7S_O, origin of frame 7 relative to the shoulder S
+    array<double, 3> r_7S_E;    // r_7S in frame E
+    double L_7S_E;              // Length of the projection of r_7S_E on the xy plane of E
+    double phi_7S_E;            // atan2(-r_7S_E[1], -r_7S_E[0])
+    bool s7_through_S;          // Type-2 singularity: s7 passes through S (q4 and q6 IK fall back to q7)
+    array<double, 3> i_par;     // i_E = i_par + i_perp, i_par along s7: the q7 rotation of i_E about s7
+    array<double, 3> i_perp;    // is i_par + cos(a) i_perp + sin(a) j_perp
+    array<double, 3> j_perp;    // s7 x i_E
+    bool n1_defined;            // False if S7 lies on the z axis of O (swivel angle undefined)
+    array<double, 3> n1;        // Normal of the reference plane of the swivel angle
+    array<double, 3> u_7S;      // r_7S / |r_7S|
+    char Jacobian_ee;           // Frame of the Jacobian end-effector ('E', 'F', '8' or '6')
+    array<double, 3> r_See;     // r_S,ee_O, S relative to the Jacobian end-effector (unused for '6')
+};
+
+/**
+ * @brief Fills a PreparedTarget.
+ * @param r             position of frame E with respect to frame O.
+ * @param ROE           rotation matrix of frame E with respect to frame O (row-first format).
+ * @param target        prepared target.
+ * @param Jacobian_ee   [optional] ee frame of the Jacobians computed from it ('E', 'F', '8' or '6').
+ */
+void prepare_target(const array<double, 3>& r,
+                    const array<double, 9>& ROE,
+                    PreparedTarget& target,
+                    const char Jacobian_ee = 'E');
+
 /**
  * @brief Computes the joint angles given a Jacobian and the rotation matrix of the ee frame.
  * @param J         transpose of J.
@@ -33,6 +127,71 @@ array<array<double, 6>, 7> J_from_q(const array<double, 7>& q, const char ee = '
  */
 Eigen::Matrix4d franka_fk(const array<double, 7>& q, const char ee = 'E');
 
+/**
+ * @brief Poses of all frames of the arm with respect to frame O.
+ * @details Index f is frame f: 0 is O, 1-7 the joint frames, 8 the flange (F) and 9 frame E.
+ *          Rotations are row-first, as ROE.
+ */
+struct FrankaFrames {
+    array<array<double, 9>, 10> R;
+    array<array<double, 3>, 10> p;
+};
+
+/**
+ * @brief Forward kinematics of all frames, without 4x4 products (one sincos per joint, the
+ *        constant link twists folded in).
+ * @param q         joint angles.
+ * @param frames    poses of frames O to E.
+ */
+void franka_fk_all_frames(const array<double, 7>& q, FrankaFrames& frames);
+
+/**
+ * @brief franka_fk_all_frames() of n configurations, configuration k at q + k * stride (stride 7
+ *        for arrays of array<double, 7>, 8 for the rows of IKSolutionSet::q).
+ */
+void franka_fk_all_frames(const double* q, unsigned int n, size_t stride, FrankaFrames* frames);
+
+/**
+ * @brief Mask of franka_fk_frames_soa() with every frame: bit f is frame f of FrankaFrames.
+ */
+constexpr unsigned int FRANKA_FRAMES_ALL = 0x3FF;
+
+/**
+ * @brief Frames of many configurations in structure-of-arrays layout: one row of ld doubles per
+ *        scalar, configuration k in column k.
+ * @details Element e (row-first) of the rotation of frame f is R[(9 * f + e) * ld + k] and
+ *          coordinate i of its origin p[(3 * f + i) * ld + k], frame f as in FrankaFrames. R holds
+ *          90 rows and p 30.
+ */
+struct FrankaFramesSoA {
+    double* R;
+    double* p;
+    size_t ld;
+};
+
+/**
+ * @brief Forward kinematics of n configurations in structure-of-arrays layout, vectorized across
+ *        configurations (blocks of 8, the link twists and offsets folded in at compile time).
+ * @param q         joint j of configuration k at q[j * ld + k], ld = frames.ld.
+ * @param n         number of configurations.
+ * @param mask      frames to write (bit f for frame f, FRANKA_FRAMES_ALL for all): the rows of
+ *                  the other frames are left untouched.
+ * @param frames    output rows.
+ * @details Uses fast_sincos() in both accuracy tiers (error below 1e-11, see geofik_math.h) so the
+ *          angles vectorize too, unlike franka_fk_all_frames(). Configurations are independent:
+ *          a range [begin, end) is the call on q + begin, end - begin and the rows + begin.
+ *          Tiles of 128 configurations go through a 120 KB buffer on the stack. Pad ld so that
+ *          rows are not a large power of two bytes apart, or they share cache sets.
+ */
+void franka_fk_frames_soa(const double* q, size_t n, unsigned int mask, const FrankaFramesSoA& frames);
+
+/**
+ * @brief franka_fk_frames_soa() split into contiguous ranges over n_threads threads (0 = hardware
+ *        concurrency). Starts its threads on every call, so it pays off from a few thousand
+ *        configurations.
+ */
+void franka_fk_frames_soa(const double* q, size_t n, unsigned int mask, const FrankaFramesSoA& frames, int n_threads);
+
 /**
  * @brief IK with q7 as free variable.
  * @param r         position of frame E with respect to frame O.
@@ -48,6 +207,17 @@ unsigned int franka_ik_q7(const array<double, 3>& r,
                           array<array<double, 7>, 8>& qsols,
                           const double q1_sing = PI / 2);
 
+/**
+ * @brief Same as franka_ik_q7(), also reporting which solutions are valid.
+ * @param validity  validity mask and per-joint limit violations of the solutions.
+ */
+unsigned int franka_ik_q7(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q7,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing = PI / 2);
+
 /**
  * @brief IK with q4 as free variable.
  * @param r         position of frame E with respect to frame O.
@@ -65,6 +235,18 @@ unsigned int franka_ik_q4(const array<double, 3>& r,
                           const double q1_sing = PI / 2,
                           const double q7_sing = 0);
 
+/**
+ * @brief Same as franka_ik_q4(), also reporting which solutions are valid.
+ * @param validity  validity mask and per-joint limit violations of the solutions.
+ */
+unsigned int franka_ik_q4(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q4,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing = PI / 2,
+                          const double q7_sing = 0);
+
 /**
  * @brief IK with q6 as free variable.
  * @param r         position of frame E with respect to frame O.
@@ -82,6 +264,18 @@ unsigned int franka_ik_q6(const array<double, 3>& r,
                           const double q1_sing = PI / 2,
                           const double q7_sing = 0);
 
+/**
+ * @brief Same as franka_ik_q6(), also reporting which solutions are valid.
+ * @param validity  validity mask and per-joint limit violations of the solutions.
+ */
+unsigned int franka_ik_q6(const array<double, 3>& r,
+                          const array<double, 9>& ROE,
+                          const double q6,
+                          array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity,
+                          const double q1_sing = PI / 2,
+                          const double q7_sing = 0);
+
 /**
  * @brief IK with swivel angle as free variable (numerical).
  * @param r         position of frame E with respect to frame O.
@@ -99,6 +293,18 @@ unsigned int franka_ik_swivel(const array<double, 3>& r,
                               const double q1_sing = PI / 2,
                               const unsigned int n_points = 600);
 
+/**
+ * @brief Same as franka_ik_swivel(), also reporting which solutions are valid.
+ * @param validity  validity mask and per-joint limit violations of the solutions.
+ */
+unsigned int franka_ik_swivel(const array<double, 3>& r,
+                              const array<double, 9>& ROE,
+                              const double theta,
+                              array<array<double, 7>, 8>& qsols,
+                              IKValidity& validity,
+                              const double q1_sing = PI / 2,
+                              const unsigned int n_points = 600);
+
 /**
  * @brief Calculates the swivel angle given the joint angles q.
  * @param q         joint angles.
@@ -127,6 +333,20 @@ unsigned int franka_J_ik_q7(const array<double, 3>& r,
                             const char Jacobian_ee = 'E',
                             const double q1_sing = PI / 2);
 
+/**
+ * @brief Same as franka_J_ik_q7(), also reporting which solutions are valid.
+ * @param validity  validity mask and per-joint limit violations of the solutions.
+ */
+unsigned int franka_J_ik_q7(const array<double, 3>& r,
+                            const array<double, 9>& ROE,
+                            const double q7,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
+                            const bool joint_angles = false,
+                            const char Jacobian_ee = 'E',
+                            const double q1_sing = PI / 2);
+
 /**
  * @brief IK to calculate Jacobian and joint angles with q4 as free variable.
  * @param r             position of frame E with respect to frame O.
@@ -150,6 +370,21 @@ unsigned int franka_J_ik_q4(const array<double, 3>& r,
                             const double q1_sing = PI / 2,
                             const double q7_sing = 0);
 
+/**
+ * @brief Same as franka_J_ik_q4(), also reporting which solutions are valid.
+ * @param validity  validity mask and per-joint limit violations of the solutions.
+ */
+unsigned int franka_J_ik_q4(const array<double, 3>& r,
+                            const array<double, 9>& ROE,
+                            const double q4,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
+                            const bool joint_angles = false,
+                            const char Jacobian_ee = 'E',
+                            const double q1_sing = PI / 2,
+                            const double q7_sing = 0);
+
 /**
  * @brief IK to calculate Jacobian and joint angles with q6 as free variable.
  * @param r             position of frame E with respect to frame O.
@@ -173,6 +408,21 @@ unsigned int franka_J_ik_q6(const array<double, 3>& r,
                             const double q1_sing = PI / 2,
                             const double q7_sing = 0);
 
+/**
+ * @brief Same as franka_J_ik_q6(), also reporting which solutions are valid.
+ * @param validity  validity mask and per-joint limit violations of the solutions.
+ */
+unsigned int franka_J_ik_q6(const array<double, 3>& r,
+                            const array<double, 9>& ROE,
+                            const double q6,
+                            array<array<array<double, 6>, 7>, 8>& Jsols,
+                            array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity,
+                            const bool joint_angles = false,
+                            const char Jacobian_ee = 'E',
+                            const double q1_sing = PI / 2,
+                            const double q7_sing = 0);
+
 /**
  * @brief IK to calculate Jacobian and joint angles with swivel angle as free variable (numerical).
  * @param r             position of frame E with respect to frame O.
@@ -196,4 +446,344 @@ unsigned int franka_J_ik_swivel(const array<double, 3>& r,
                                 const double q1_sing = PI / 2,
                                 const unsigned int n_points = 600);
 
+/**
+ * @brief Same as franka_J_ik_swivel(), also reporting which solutions are valid.
+ * @param validity  validity mask and per-joint limit violations of the solutions.
+ */
+unsigned int franka_J_ik_swivel(const array<double, 3>& r,
+                                const array<double, 9>& ROE,
+                                const double theta,
+                                array<array<array<double, 6>, 7>, 8>& Jsols,
+                                array<array<double, 7>, 8>& qsols,
+                                IKValidity& validity,
+                                const bool joint_angles = false,
+                                const char Jacobian_ee = 'E',
+                                const double q1_sing = PI / 2,
+                                const unsigned int n_points = 600);
+
+
+/**
+ * @brief IK with q7 as free variable, returning only the valid solutions in a dense record.
+ * @param r             position of frame E with respect to frame O.
+ * @param ROE           rotation matrix of frame E with respect to frame O (row-first format).
+ * @param q7            joint angle of joint 7 (radians).
+ * @param sols          record to store the valid solutions.
+ * @param jacobians     [optional] also store the Jacobians (otherwise only joint angles are computed).
+ * @param Jacobian_ee   [optional] ee frame of the Jacobian, not the IK ('E', 'F', '8' or '6').
+ * @param q1_sing       [optional] emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
+ * @return              number of valid solutions (sols.count).
+ */
+unsigned int franka_ik_q7_compact(const array<double, 3>& r,
+                                  const array<double, 9>& ROE,
+                                  const double q7,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians = false,
+                                  const char Jacobian_ee = 'E',
+                                  const double q1_sing = PI / 2);
+
+/**
+ * @brief IK with q7 as free variable, returning the valid solutions with their manipulability
+ *        sqrt(det(J J^T)) but no Jacobians. The manipulability is computed from the joint axes
+ *        (Cauchy-Binet over the 6x6 minors) without forming J, once per pair of shoulder solutions,
+ *        and is the same for the Jacobians of frames 'E', 'F' and '8'.
+ * @param r             position of frame E with respect to frame O.
+ * @param ROE           rotation matrix of frame E with respect to frame O (row-first format).
+ * @param q7            joint angle of joint 7 (radians).
+ * @param sols          record to store the valid solutions (sols.manipulability is set).
+ * @param q1_sing       [optional] emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
+ * @return              number of valid solutions (sols.count).
+ */
+unsigned int franka_ik_q7_manipulability(const array<double, 3>& r,
+                                         const array<double, 9>& ROE,
+                                         const double q7,
+                                         IKSolutionSet& sols,
+                                         const double q1_sing = PI / 2);
+
+/**
+ * @brief Same as franka_ik_q7_compact() with q4 as free variable.
+ * @param q7_sing       [optional] emergency value of q7 in case of singularity of S7 intersecting S (type-2 singularity).
+ */
+unsigned int franka_ik_q4_compact(const array<double, 3>& r,
+                                  const array<double, 9>& ROE,
+                                  const double q4,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians = false,
+                                  const char Jacobian_ee = 'E',
+                                  const double q1_sing = PI / 2,
+                                  const double q7_sing = 0);
+
+/**
+ * @brief Same as franka_ik_q7_compact() with q6 as free variable.
+ * @param q7_sing       [optional] emergency value of q7 in case of singularity of S7 intersecting S (type-2 singularity).
+ */
+unsigned int franka_ik_q6_compact(const array<double, 3>& r,
+                                  const array<double, 9>& ROE,
+                                  const double q6,
+                                  IKSolutionSet& sols,
+                                  const bool jacobians = false,
+                                  const char Jacobian_ee = 'E',
+                                  const double q1_sing = PI / 2,
+                                  const double q7_sing = 0);
+
+/**
+ * @brief Same as franka_ik_q7_compact() with the swivel angle as free variable (numerical).
+ * @param n_points      [optional] number of points to discretise the range of q7.
+ */
+unsigned int franka_ik_swivel_compact(const array<double, 3>& r,
+                                      const array<double, 9>& ROE,
+                                      const double theta,
+                                      IKSolutionSet& sols,
+                                      const bool jacobians = false,
+                                      const char Jacobian_ee = 'E',
+                                      const double q1_sing = PI / 2,
+                                      const unsigned int n_points = 600);
+
+/**
+ * @brief PreparedTarget overloads: same as the functions above for the target given to
+ *        prepare_target(). The Jacobians use the end-effector frame of the target.
+ */
+unsigned int franka_ik_q7(const PreparedTarget& target, const double q7, array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity, const double q1_sing = PI / 2);
+unsigned int franka_ik_q4(const PreparedTarget& target, const double q4, array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity, const double q1_sing = PI / 2, const double q7_sing = 0);
+unsigned int franka_ik_q6(const PreparedTarget& target, const double q6, array<array<double, 7>, 8>& qsols,
+                          IKValidity& validity, const double q1_sing = PI / 2, const double q7_sing = 0);
+unsigned int franka_ik_swivel(const PreparedTarget& target, const double theta, array<array<double, 7>, 8>& qsols,
+                              IKValidity& validity, const double q1_sing = PI / 2, const unsigned int n_points = 600);
+unsigned int franka_J_ik_q7(const PreparedTarget& target, const double q7,
+                            array<array<array<double, 6>, 7>, 8>& Jsols, array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity, const bool joint_angles = false, const double q1_sing = PI / 2);
+unsigned int franka_J_ik_q4(const PreparedTarget& target, const double q4,
+                            array<array<array<double, 6>, 7>, 8>& Jsols, array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity, const bool joint_angles = false, const double q1_sing = PI / 2,
+                            const double q7_sing = 0);
+unsigned int franka_J_ik_q6(const PreparedTarget& target, const double q6,
+                            array<array<array<double, 6>, 7>, 8>& Jsols, array<array<double, 7>, 8>& qsols,
+                            IKValidity& validity, const bool joint_angles = false, const double q1_sing = PI / 2,
+                            const double q7_sing = 0);
+unsigned int franka_J_ik_swivel(const PreparedTarget& target, const double theta,
+                                array<array<array<double, 6>, 7>, 8>& Jsols, array<array<double, 7>, 8>& qsols,
+                                IKValidity& validity, const bool joint_angles = false, const double q1_sing = PI / 2,
+                                const unsigned int n_points = 600);
+unsigned int franka_ik_q7_compact(const PreparedTarget& target, const double q7, IKSolutionSet& sols,
+                                  const bool jacobians = false, const double q1_sing = PI / 2);
+unsigned int franka_ik_q7_manipulability(const PreparedTarget& target, const double q7, IKSolutionSet& sols,
+                                         const double q1_sing = PI / 2);
+unsigned int franka_ik_q4_compact(const PreparedTarget& target, const double q4, IKSolutionSet& sols,
+                                  const bool jacobians = false, const double q1_sing = PI / 2, const double q7_sing = 0);
+unsigned int franka_ik_q6_compact(const PreparedTarget& target, const double q6, IKSolutionSet& sols,
+                                  const bool jacobians = false, const double q1_sing = PI / 2, const double q7_sing = 0);
+unsigned int franka_ik_swivel_compact(const PreparedTarget& target, const double theta, IKSolutionSet& sols,
+                                      const bool jacobians = false, const double q1_sing = PI / 2,
+                                      const unsigned int n_points = 600);
+
+/**
+ * @brief Configuration bits of a solution of the IK with q7 as free variable, its branch.
+ * @details branch = IK_BRANCH_ELBOW * elbow + IK_BRANCH_WRIST * wrist + IK_BRANCH_SHOULDER * shoulder:
+ *          elbow selects the second root of the elbow angle (beta2 - acos instead of beta2 + acos),
+ *          wrist the second of the two s5 on the elbow circle, shoulder the second shoulder
+ *          solution (q2 < 0, q1 and q3 shifted by pi). It is the slot of the solution in the output
+ *          of franka_ik_q7() and franka_J_ik_q7() when all 8 solutions exist; when the first elbow
+ *          root has no wrist solution, the solutions of the second one move to slots 0-3.
+ */
+enum IKBranch : unsigned int {
+    IK_BRANCH_SHOULDER = 1u << 0,
+    IK_BRANCH_WRIST = 1u << 1,
+    IK_BRANCH_ELBOW = 1u << 2
+};
+
+/**
+ * @brief IK with q7 as free variable for one branch only: computes only the elbow root, the s5
+ *        and the shoulder solution of that branch, bit-identical to the same solution of franka_ik_q7().
+ * @param r         position of frame E with respect to frame O.
+ * @param ROE       rotation matrix of frame E with respect to frame O (row-first format).
+ * @param q7        joint angle of joint 7 (radians).
+ * @param branch    configuration of the solution (0-7, see IKBranch).
+ * @param q         joint angles, wrapped into the joint ranges; NaN for joints outside the limits
+ *                  and for all joints if the branch does not exist at this q7.
+ * @param q1_sing   [optional] emergency value of q1 in case of singularity at shoulder joints (type-1 singularity).
+ * @return          true if the branch exists and is within the joint limits.
+ */
+bool franka_ik_q7_branch(const array<double, 3>& r,
+                         const array<double, 9>& ROE,
+                         const double q7,
+                         const unsigned int branch,
+                         array<double, 7>& q,
+                         const double q1_sing = PI / 2);
+
+/**
+ * @brief Same as franka_ik_q7_branch(), also computing the Jacobian of the solution.
+ * @param J             transpose of the Jacobian (NaN if the branch does not exist).
+ * @param Jacobian_ee   [optional] ee frame of the Jacobian, not the IK ('E', 'F', '8' or '6').
+ */
+bool franka_J_ik_q7_branch(const array<double, 3>& r,
+                           const array<double, 9>& ROE,
+                           const double q7,
+                           const unsigned int branch,
+                           array<array<double, 6>, 7>& J,
+                           array<double, 7>& q,
+                           const char Jacobian_ee = 'E',
+                           const double q1_sing = PI / 2);
+
+/**
+ * @brief PreparedTarget overloads of the branch functions. The compact ones store the solution at
+ *        index 0 of sols if it is valid (count 0 or 1, n_found 1 if the branch exists, branch[0] = branch).
+ */
+bool franka_ik_q7_branch(const PreparedTarget& target, const double q7, const unsigned int branch,
+                         array<double, 7>& q, const double q1_sing = PI / 2);
+bool franka_J_ik_q7_branch(const PreparedTarget& target, const double q7, const unsigned int branch,
+                           array<array<double, 6>, 7>& J, array<double, 7>& q, const double q1_sing = PI / 2);
+unsigned int franka_ik_q7_branch_compact(const PreparedTarget& target, const double q7, const unsigned int branch,
+                                         IKSolutionSet& sols, const bool jacobians = false,
+                                         const double q1_sing = PI / 2);
+unsigned int franka_ik_q7_branch_manipulability(const PreparedTarget& target, const double q7, const unsigned int branch,
+                                                IKSolutionSet& sols, const double q1_sing = PI / 2);
+
+/**
+ * @brief Branch (see IKBranch) of a configuration: the branch whose solution for the pose and q7
+ *        of q is closest to q.
+ * @param q         joint angles.
+ * @param residual  [optional] largest joint difference (radians, modulo 2 pi) between q and the
+ *                  solution of that branch. It is far above rounding (~1e-9) only at the shoulder
+ *                  singularity (|q2| below ~3e-3), where the IK replaces q1 with q1_sing.
+ * @return          branch of q, or -1 if no branch exists at its pose (which FK cannot produce).
+ */
+int franka_q7_branch(const array<double, 7>& q, double* residual = nullptr);
+
+/**
+ * @brief Outputs of the IK kernels, combined as a bit mask in their template argument.
+ * @details IK_VALIDITY needs IK_ANGLES. IK_JACOBIAN is J^T at the end-effector of the target
+ *          ('E', 'F' or '8', which differ only by r_See), IK_JACOBIAN_WRIST at frame 6; at most one
+ *          of them per call. IK_LINKS are the elbow (origin of frame 4) and wrist (origin of
+ *          frame 6) points of each solution in frame O.
+ */
+enum IKOutput : unsigned int {
+    IK_ANGLES = 1u << 0,
+    IK_VALIDITY = 1u << 1,
+    IK_JACOBIAN = 1u << 2,
+    IK_JACOBIAN_WRIST = 1u << 3,
+    IK_MANIPULABILITY = 1u << 4,
+    IK_LINKS = 1u << 5
+};
+
+/**
+ * @brief Destinations of the IK kernel outputs, in the 8-slot layout of franka_ik_*.
+ * @details Only the members requested by the template argument are written (solutions past the
+ *          number found are NaN). If validity is set it receives the joint-limit screen with
+ *          IK_VALIDITY, otherwise the mask of the solutions found with no violations.
+ */
+struct IKKernelOutput {
+    array<array<double, 7>, 8>* q = nullptr;
+    array<array<array<double, 6>, 7>, 8>* J = nullptr;
+    array<double, 8>* manipulability = nullptr;
+    array<array<array<double, 3>, 2>, 8>* links = nullptr;   // links[i][0] elbow, links[i][1] wrist
+    IKValidity* validity = nullptr;
+};
+
+/**
+ * @brief IK kernels: the franka_ik_* computations with the outputs fixed at compile time, so no
+ *        branch on them is left in the loops and nothing is computed for an output nobody reads.
+ *        The franka_ik_*, franka_J_ik_* and compact functions are wrappers around them.
+ * @details Instantiated (in geofik.cpp) for Outputs =
+ *          IK_ANGLES, IK_ANGLES | IK_VALIDITY,
+ *          IK_JACOBIAN, IK_JACOBIAN | IK_ANGLES | IK_VALIDITY,
+ *          IK_JACOBIAN_WRIST, IK_JACOBIAN_WRIST | IK_ANGLES | IK_VALIDITY,
+ *          IK_MANIPULABILITY | IK_ANGLES | IK_VALIDITY,
+ *          IK_LINKS and IK_LINKS | IK_ANGLES | IK_VALIDITY.
+ * @return  number of solutions found (before the joint-limit screen).
+ */
+template <unsigned int Outputs>
+unsigned int franka_ik_q7_kernel(const PreparedTarget& target, const double q7, const IKKernelOutput& out,
+                                 const double q1_sing = PI / 2);
+template <unsigned int Outputs>
+unsigned int franka_ik_q4_kernel(const PreparedTarget& target, const double q4, const IKKernelOutput& out,
+                                 const double q1_sing = PI / 2, const double q7_sing = 0);
+template <unsigned int Outputs>
+unsigned int franka_ik_q6_kernel(const PreparedTarget& target, const double q6, const IKKernelOutput& out,
+                                 const double q1_sing = PI / 2, const double q7_sing = 0);
+template <unsigned int Outputs>
+unsigned int franka_ik_swivel_kernel(const PreparedTarget& target, const double theta, const IKKernelOutput& out,
+                                     const double q1_sing = PI / 2, const unsigned int n_points = 600);
+
+/**
+ * @brief Evenly spaced samples q7_start + k * q7_step over [q7_start, q7_end] of the IK with q7 as
+ *        free variable, for one pose.
+ * @details Consecutive samples differ by a fixed rotation of the frame of joint 6 about s7, so
+ *          i_6, s6 and r6 are advanced by that rotation (a 2x2 recurrence on the cosine and sine
+ *          of the angle) instead of calling cos/sin per sample. They are recomputed exactly every
+ *          RESYNC samples, which bounds the drift of the recurrence to a few ulps.
+ *          for (Q7Sweep sweep(r, ROE, q7_start, q7_end, step); !sweep.done(); sweep.next()) { sweep.J_ik(...); }
+ */
+class Q7Sweep {
+public:
+    static constexpr unsigned int RESYNC = 64;
+
+    /**
+     * @param r         position of frame E with respect to frame O.
+     * @param ROE       rotation matrix of frame E with respect to frame O (row-first format).
+     * @param q7_start  first sample (radians).
+     * @param q7_end    last sample, included if it is within 1e-9 steps of a sample.
+     * @param q7_step   spacing of the samples, > 0 (otherwise the sweep is empty).
+     */
+    Q7Sweep(const array<double, 3>& r,
+            const array<double, 9>& ROE,
+            const double q7_start,
+            const double q7_end,
+            const double q7_step);
+
+    /**
+     * @brief Same sweep for a prepared target (copied), whose Jacobian end-effector J_ik() uses.
+     */
+    Q7Sweep(const PreparedTarget& target,
+            const double q7_start,
+            const double q7_end,
+            const double q7_step);
+
+    unsigned int size() const { return n_; }
+    unsigned int index() const { return k_; }
+    bool done() const { return k_ >= n_; }
+    double q7() const { return q7_start_ + k_ * q7_step_; }
+
+    // Moves to the next sample
+    void next();
+
+    // Frame of joint 6 at the current sample: i_6_O, s6 = s7 x i_6_O and r6 = r_6S_O
+    const array<double, 3>& i6() const { return i6_; }
+    const array<double, 3>& s6() const { return s6_; }
+    const array<double, 3>& r6() const { return r6_; }
+
+    const PreparedTarget& target() const { return target_; }
+
+    /**
+     * @brief Same as franka_J_ik_q7() at the current sample.
+     */
+    unsigned int J_ik(array<array<array<double, 6>, 7>, 8>& Jsols,
+                      array<array<double, 7>, 8>& qsols,
+                      IKValidity& validity,
+                      const bool joint_angles = false,
+                      const double q1_sing = PI / 2) const;
+
+    /**
+     * @brief Same as franka_J_ik_q7_branch() at the current sample, valid receiving its result.
+     * @return 1 if the branch exists at this sample, otherwise 0.
+     */
+    unsigned int J_ik_branch(const unsigned int branch,
+                             array<array<double, 6>, 7>& J,
+                             array<double, 7>& q,
+                             bool& valid,
+                             const double q1_sing = PI / 2) const;
+
+private:
+    PreparedTarget target_;
+    double q7_start_, q7_step_;
+    double c_, s_;              // cos and sin of the rotation from i_E to i_6, -(q7 - PI / 4)
+    double c_step_, s_step_;    // cos and sin of q7_step
+    unsigned int n_, k_;
+    array<double, 3> i6_, s6_, r6_;
+
+    void start(const double q7_end);
+    void set_angle(double angle);
+    void update_frame();
+};
+
 #endif
\ No newline at end of file
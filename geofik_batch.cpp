@@ -0,0 +1,531 @@
+/**
+ * @file    geofik_batch.cpp
+ * @brief   streaming batch IK tool.
+ *
+ * @details Reads target poses from a file or stdin, solves them on a worker pool and writes
+ *          the results in input order. Reading, solving and writing run concurrently and are
+ *          connected by bounded queues of chunks, and at most 2 * queue depth + workers chunks
+ *          are in flight (a slow chunk stalls the reader rather than growing the reorder buffer),
+ *          so memory stays constant for any input size.
+ *
+ *          Input record (CSV: one line of comma/space separated values, '#' starts a comment;
+ *          binary: native-endian doubles, no header):
+ *          - x y z r00 r01 r02 r10 r11 r12 r20 r21 r22            (12 values, ROE row-first)
+ *          - ... followed by q1..q7 of the current pose with -c  (19 values)
+ *
+ *          Output record:
+ *          - ik-* modes:  index nsols q[0][0..6] ... q[7][0..6]              (2 + 56 values, NaN for invalid)
+ *          - opt-* modes: index success score manipulability neutral_distance current_distance
+ *                         free_variable q1..q7                                (14 values)
+ *          - copy mode:   the input record
+ *
+ *          The map format is the IK dataset of ik_dataset.h. Mapped inputs are solved in place
+ *          and mapped outputs are preallocated and written directly by the workers. A mapped
+ *          output holds the poses plus the result sections of the mode (IK_NSOLS and IK_QSOLS
+ *          for ik-*, IK_WEIGHTED for opt-*); it needs a mapped or regular input file so the
+ *          number of records is known up front.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <unistd.h>
+#include "weighted_ik.h"
+#include "bounded_queue.h"
+#include "ik_dataset.h"
+
+// compile with: g++ -I/usr/include/eigen3 geofik_batch.cpp ik_dataset.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -o geofik_batch
+
+enum class BatchFormat { CSV, BIN, MAP };
+
+struct BatchOptions {
+    std::string input_path = "-";
+    std::string output_path = "-";
+    BatchFormat input_format = BatchFormat::CSV;
+    BatchFormat output_format = BatchFormat::CSV;
+    bool output_format_set = false;
+    bool with_current_pose = false;
+    bool copy_only = false;
+    bool optimize = true;
+    bool auto_param = false;
+    RedundancyParam param = RedundancyParam::Q7;
+    double free_variable = PI / 4;       // ik-* modes
+    bool range_set = false;
+    double range_min = 0.0;              // opt-* modes
+    double range_max = 0.0;
+    double tolerance = 1e-6;
+    int max_iterations = 100;
+    std::array<double, 3> weights = { 1.0, 0.5, 2.0 };
+    std::array<double, 7> neutral_pose = { 0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0 };
+    int n_workers = 0;
+    int chunk_size = 256;
+    int queue_depth = 16;
+};
+
+struct BatchRecord {
+    std::array<double, 3> position;
+    std::array<double, 9> orientation;
+    std::array<double, 7> current_pose;
+};
+
+// Record inside a chunk or inside the mapped input
+struct BatchRecordView {
+    const std::array<double, 3>* position;
+    const std::array<double, 9>* orientation;
+    const std::array<double, 7>* current_pose;
+};
+
+struct BatchResult {
+    unsigned int nsols;
+    std::array<std::array<double, 7>, 8> qsols;
+    WeightedIKResult weighted;
+};
+
+struct BatchChunk {
+    long sequence;
+    long first_index;
+    long count;
+    long n_solved;
+    std::vector<BatchRecord> records;   // Empty when the input is mapped
+    std::vector<BatchResult> results;   // Empty when the output is mapped
+};
+
+void print_usage(const char* program) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -i FILE     input file, '-' for stdin (default)\n"
+        "  -o FILE     output file, '-' for stdout (default)\n"
+        "  -f FORMAT   input format: csv (default), bin or map\n"
+        "  -F FORMAT   output format: csv, bin or map (default: input format)\n"
+        "  -c          records include the current pose (q1..q7), implied by mapped inputs that have one\n"
+        "  -m MODE     ik-q7, ik-q4, ik-q6, ik-swivel, opt-q7 (default), opt-q4, opt-q6, opt-swivel, opt-auto,\n"
+        "              or copy to only convert the input\n"
+        "  -v VALUE    free variable for ik-* modes (default pi/4)\n"
+        "  -r MIN,MAX  free variable range for opt-* modes (default: full range)\n"
+        "  -t TOL      optimization tolerance (default 1e-6)\n"
+        "  -n ITER     max optimization iterations (default 100)\n"
+        "  -w M,N,C    weights for manipulability, neutral and current distance (default 1,0.5,2)\n"
+        "  -p q1,..,q7 neutral pose, also used as current pose without -c\n"
+        "  -j N        worker threads (default: hardware concurrency)\n"
+        "  -b N        records per chunk (default 256)\n"
+        "  -q N        chunks per queue (default 16); 2 N + workers chunks in flight\n",
+        program);
+}
+
+// Parses up to n comma separated doubles, returns how many were read
+int parse_list(const char* text, double* values, int n) {
+    int count = 0;
+    char* end;
+    while (count < n) {
+        double v = strtod(text, &end);
+        if (end == text) break;
+        values[count++] = v;
+        text = end;
+        while (*text == ',' || *text == ' ') text++;
+    }
+    return count;
+}
+
+bool parse_format(const char* text, BatchFormat& format) {
+    if (strcmp(text, "csv") == 0) format = BatchFormat::CSV;
+    else if (strcmp(text, "bin") == 0) format = BatchFormat::BIN;
+    else if (strcmp(text, "map") == 0) format = BatchFormat::MAP;
+    else return false;
+    return true;
+}
+
+bool parse_mode(const char* text, BatchOptions& options) {
+    std::string mode(text);
+    options.copy_only = mode == "copy";
+    if (options.copy_only) return true;
+    options.optimize = mode.compare(0, 4, "opt-") == 0;
+    if (!options.optimize && mode.compare(0, 3, "ik-") != 0) return false;
+    std::string name = mode.substr(options.optimize ? 4 : 3);
+    options.auto_param = false;
+    if (name == "q7") options.param = RedundancyParam::Q7;
+    else if (name == "q4") options.param = RedundancyParam::Q4;
+    else if (name == "q6") options.param = RedundancyParam::Q6;
+    else if (name == "swivel") options.param = RedundancyParam::SWIVEL;
+    else if (name == "auto" && options.optimize) options.auto_param = true;
+    else return false;
+    return true;
+}
+
+bool parse_options(int argc, char** argv, BatchOptions& options) {
+    int opt;
+    double values[7];
+    while ((opt = getopt(argc, argv, "i:o:f:F:cm:v:r:t:n:w:p:j:b:q:h")) != -1) {
+        switch (opt) {
+            case 'i': options.input_path = optarg; break;
+            case 'o': options.output_path = optarg; break;
+            case 'f': if (!parse_format(optarg, options.input_format)) return false; break;
+            case 'F':
+                if (!parse_format(optarg, options.output_format)) return false;
+                options.output_format_set = true;
+                break;
+            case 'c': options.with_current_pose = true; break;
+            case 'm': if (!parse_mode(optarg, options)) return false; break;
+            case 'v': options.free_variable = atof(optarg); break;
+            case 'r':
+                if (parse_list(optarg, values, 2) != 2) return false;
+                options.range_set = true;
+                options.range_min = values[0];
+                options.range_max = values[1];
+                break;
+            case 't': options.tolerance = atof(optarg); break;
+            case 'n': options.max_iterations = atoi(optarg); break;
+            case 'w':
+                if (parse_list(optarg, values, 3) != 3) return false;
+                options.weights = { values[0], values[1], values[2] };
+                break;
+            case 'p':
+                if (parse_list(optarg, values, 7) != 7) return false;
+                for (int j = 0; j < 7; j++) options.neutral_pose[j] = values[j];
+                break;
+            case 'j': options.n_workers = atoi(optarg); break;
+            case 'b': options.chunk_size = atoi(optarg); break;
+            case 'q': options.queue_depth = atoi(optarg); break;
+            default: return false;
+        }
+    }
+    if (!options.output_format_set) options.output_format = options.input_format;
+    if (options.n_workers <= 0) options.n_workers = (int)std::thread::hardware_concurrency();
+    if (options.n_workers <= 0) options.n_workers = 1;
+    if (options.chunk_size <= 0) options.chunk_size = 1;
+    return true;
+}
+
+// Reads the next record, returns false at end of input
+bool read_record(std::istream& in, const BatchOptions& options, BatchRecord& record, long& line_number) {
+    const int n_values = options.with_current_pose ? 19 : 12;
+    double values[19];
+    if (options.input_format == BatchFormat::BIN) {
+        in.read(reinterpret_cast<char*>(values), n_values * sizeof(double));
+        if (in.gcount() != (std::streamsize)(n_values * sizeof(double))) {
+            if (in.gcount() != 0) cerr << "WARNING: truncated binary record ignored" << endl;
+            return false;
+        }
+    } else {
+        std::string line;
+        while (true) {
+            if (!std::getline(in, line)) return false;
+            line_number++;
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) line.erase(comment);
+            const char* text = line.c_str();
+            while (*text == ' ' || *text == '\t') text++;
+            if (*text == '\0' || *text == '\r') continue;
+            if (parse_list(text, values, n_values) == n_values) break;
+            cerr << "WARNING: skipping malformed line " << line_number << endl;
+        }
+    }
+    record.position = { values[0], values[1], values[2] };
+    for (int k = 0; k < 9; k++) record.orientation[k] = values[3 + k];
+    if (options.with_current_pose) {
+        for (int j = 0; j < 7; j++) record.current_pose[j] = values[12 + j];
+    } else {
+        record.current_pose = options.neutral_pose;
+    }
+    return true;
+}
+
+// Counts the records of a regular input file so a mapped output can be preallocated
+long count_records(const BatchOptions& options) {
+    std::ifstream in(options.input_path, options.input_format == BatchFormat::BIN ? std::ios::binary : std::ios::in);
+    if (!in) return -1;
+    if (options.input_format == BatchFormat::BIN) {
+        in.seekg(0, std::ios::end);
+        return (long)(in.tellg() / (std::streamoff)((options.with_current_pose ? 19 : 12) * sizeof(double)));
+    }
+    long count = 0, line_number = 0;
+    BatchRecord record;
+    while (read_record(in, options, record, line_number)) count++;
+    return count;
+}
+
+BatchRecordView record_view(const BatchOptions& options, const IKDataset& input_map, const BatchChunk& chunk, long k) {
+    BatchRecordView record;
+    if (input_map.is_open()) {
+        long index = chunk.first_index + k;
+        record.position = &input_map.poses()[index].position;
+        record.orientation = &input_map.poses()[index].orientation;
+        record.current_pose = options.with_current_pose ? &input_map.current_poses()[index] : &options.neutral_pose;
+    } else {
+        record.position = &chunk.records[k].position;
+        record.orientation = &chunk.records[k].orientation;
+        record.current_pose = &chunk.records[k].current_pose;
+    }
+    return record;
+}
+
+unsigned int solve_ik_record(const BatchOptions& options, const BatchRecordView& record,
+                             std::array<std::array<double, 7>, 8>& qsols) {
+    switch (options.param) {
+        case RedundancyParam::Q4:
+            return franka_ik_q4(*record.position, *record.orientation, options.free_variable, qsols);
+        case RedundancyParam::Q6:
+            return franka_ik_q6(*record.position, *record.orientation, options.free_variable, qsols);
+        case RedundancyParam::SWIVEL:
+            return franka_ik_swivel(*record.position, *record.orientation, options.free_variable, qsols);
+        default:
+            return franka_ik_q7(*record.position, *record.orientation, options.free_variable, qsols);
+    }
+}
+
+WeightedIKResult solve_weighted_record(WeightedIKSolver& solver, const BatchOptions& options, const BatchRecordView& record) {
+    if (options.auto_param) {
+        return solver.solve_auto_optimized(*record.position, *record.orientation, *record.current_pose,
+                                           options.tolerance, options.max_iterations);
+    }
+    double lower = options.range_min, upper = options.range_max;
+    if (!options.range_set) redundancy_param_limits(options.param, lower, upper);
+    return solver.solve_optimized(options.param, *record.position, *record.orientation, *record.current_pose,
+                                  lower, upper, options.tolerance, options.max_iterations);
+}
+
+// Solves one record, writing into the mapped output when there is one. Returns true if solved.
+bool solve_record(WeightedIKSolver& solver, const BatchOptions& options, const BatchRecordView& record,
+                  long index, IKDataset& output, BatchResult* result) {
+    if (output.is_open()) {
+        output.poses()[index].position = *record.position;
+        output.poses()[index].orientation = *record.orientation;
+        if (output.has(IK_CURRENT_POSES)) output.current_poses()[index] = *record.current_pose;
+    }
+    if (options.copy_only) {
+        return true;
+    }
+    if (!options.optimize) {
+        if (output.is_open()) {
+            output.nsols()[index] = solve_ik_record(options, record, output.qsols()[index]);
+            return output.nsols()[index] > 0;
+        }
+        result->nsols = solve_ik_record(options, record, result->qsols);
+        return result->nsols > 0;
+    }
+    if (output.is_open()) {
+        WeightedIKResult w = solve_weighted_record(solver, options, record);
+        store_weighted_result(w, output.weighted()[index]);
+        return w.success;
+    }
+    result->weighted = solve_weighted_record(solver, options, record);
+    return result->weighted.success;
+}
+
+void write_result(std::ostream& out, const BatchOptions& options, long index,
+                  const BatchRecordView& record, const BatchResult& result) {
+    double values[58];
+    int n_values;
+    if (options.copy_only) {
+        for (int k = 0; k < 3; k++) values[k] = (*record.position)[k];
+        for (int k = 0; k < 9; k++) values[3 + k] = (*record.orientation)[k];
+        for (int j = 0; j < 7; j++) values[12 + j] = (*record.current_pose)[j];
+        n_values = options.with_current_pose ? 19 : 12;
+    } else if (!options.optimize) {
+        values[0] = (double)index;
+        values[1] = result.nsols;
+        for (int i = 0; i < 8; i++)
+            for (int j = 0; j < 7; j++)
+                values[2 + 7 * i + j] = result.qsols[i][j];
+        n_values = 58;
+    } else {
+        IKWeightedRecord w;
+        store_weighted_result(result.weighted, w);
+        values[0] = (double)index;
+        values[1] = w.success;
+        values[2] = w.score;
+        values[3] = w.manipulability;
+        values[4] = w.neutral_distance;
+        values[5] = w.current_distance;
+        values[6] = w.free_variable;
+        for (int j = 0; j < 7; j++) values[7 + j] = w.joint_angles[j];
+        n_values = 14;
+    }
+    if (options.output_format == BatchFormat::BIN) {
+        out.write(reinterpret_cast<const char*>(values), n_values * sizeof(double));
+    } else {
+        char buffer[32];
+        for (int k = 0; k < n_values; k++) {
+            if (k == 0 && !options.copy_only) {
+                out << index;
+                continue;
+            }
+            snprintf(buffer, sizeof(buffer), k == 0 ? "%.17g" : ",%.17g", values[k]);
+            out << buffer;
+        }
+        out << '\n';
+    }
+}
+
+int main(int argc, char** argv) {
+    BatchOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Diagnostics may reach cerr from the other threads (reader warnings, or geofik built with
+    // GEOFIK_DEBUG_MESSAGES). Keep the standard streams on stdio (whose calls are locked) and
+    // stop cerr from flushing cout under the writer.
+    std::cerr.tie(nullptr);
+    std::ifstream input_file;
+    std::ofstream output_file;
+    std::istream* in = &std::cin;
+    std::ostream* out = &std::cout;
+    IKDataset input_map, output_map;
+    long n_input = -1;  // Unknown for streamed inputs
+
+    if (options.input_format == BatchFormat::MAP) {
+        if (!input_map.open(options.input_path) || !input_map.has(IK_POSES)) {
+            cerr << "ERROR: " << options.input_path << " has no pose section" << endl;
+            return 1;
+        }
+        n_input = (long)input_map.count();
+        options.with_current_pose = input_map.has(IK_CURRENT_POSES);
+    } else if (options.input_path != "-") {
+        input_file.open(options.input_path, options.input_format == BatchFormat::BIN ? std::ios::binary : std::ios::in);
+        if (!input_file) {
+            cerr << "ERROR: cannot open " << options.input_path << endl;
+            return 1;
+        }
+        in = &input_file;
+    }
+
+    if (options.output_format == BatchFormat::MAP) {
+        if (n_input < 0 && options.input_path != "-") n_input = count_records(options);
+        if (n_input < 0 || options.output_path == "-") {
+            cerr << "ERROR: a mapped output needs an input file and an output file" << endl;
+            return 1;
+        }
+        uint32_t sections = ik_section_bit(IK_POSES);
+        if (options.with_current_pose) sections |= ik_section_bit(IK_CURRENT_POSES);
+        if (!options.copy_only && !options.optimize) sections |= ik_section_bit(IK_NSOLS) | ik_section_bit(IK_QSOLS);
+        if (!options.copy_only && options.optimize) sections |= ik_section_bit(IK_WEIGHTED);
+        if (!output_map.create(options.output_path, (uint64_t)n_input, sections)) {
+            return 1;
+        }
+    } else if (options.output_path != "-") {
+        output_file.open(options.output_path, options.output_format == BatchFormat::BIN ? std::ios::binary : std::ios::out);
+        if (!output_file) {
+            cerr << "ERROR: cannot open " << options.output_path << endl;
+            return 1;
+        }
+        out = &output_file;
+    }
+
+    BoundedQueue<BatchChunk> todo(options.queue_depth);
+    BoundedQueue<BatchChunk> done(options.queue_depth);
+    // Chunks in flight between the reader and the writer: the reader takes a slot for each chunk
+    // and the writer gives it back once the chunk is written, so a slow chunk stalls the reader
+    // instead of growing the reorder buffer
+    const int window = 2 * options.queue_depth + options.n_workers;
+    BoundedQueue<char> slots(window);
+    for (int k = 0; k < window; k++) slots.push(0);
+    std::atomic<int> active_workers(options.n_workers);
+    auto start = high_resolution_clock::now();
+
+    // Stage 1: read chunks of records, or only cut the mapped input into index ranges
+    std::thread reader([&]() {
+        long sequence = 0, index = 0, line_number = 0;
+        bool more = true;
+        while (more) {
+            BatchChunk chunk;
+            chunk.sequence = sequence++;
+            chunk.first_index = index;
+            chunk.n_solved = 0;
+            if (input_map.is_open()) {
+                chunk.count = std::min((long)options.chunk_size, n_input - index);
+                more = index + chunk.count < n_input;
+            } else {
+                chunk.records.reserve(options.chunk_size);
+                BatchRecord record;
+                while ((int)chunk.records.size() < options.chunk_size) {
+                    // A mapped output was sized from a first pass, never write past it
+                    if (output_map.is_open() && index + (long)chunk.records.size() >= n_input) {
+                        more = false;
+                        break;
+                    }
+                    if (!read_record(*in, options, record, line_number)) {
+                        more = false;
+                        break;
+                    }
+                    chunk.records.push_back(record);
+                }
+                chunk.count = (long)chunk.records.size();
+            }
+            index += chunk.count;
+            if (chunk.count > 0) {
+                char slot;
+                slots.pop(slot);
+                todo.push(std::move(chunk));
+            }
+        }
+        todo.close();
+    });
+
+    // Stage 2: solve chunks on the worker pool
+    std::vector<std::thread> workers;
+    for (int t = 0; t < options.n_workers; t++) {
+        workers.emplace_back([&]() {
+            WeightedIKSolver solver(options.neutral_pose, options.weights[0], options.weights[1], options.weights[2], false);
+            BatchChunk chunk;
+            while (todo.pop(chunk)) {
+                if (!output_map.is_open()) chunk.results.resize(chunk.count);
+                for (long k = 0; k < chunk.count; k++) {
+                    long index = chunk.first_index + k;
+                    BatchRecordView record = record_view(options, input_map, chunk, k);
+                    if (solve_record(solver, options, record, index, output_map,
+                                     output_map.is_open() ? nullptr : &chunk.results[k])) {
+                        chunk.n_solved++;
+                    }
+                }
+                done.push(std::move(chunk));
+            }
+            if (--active_workers == 0) done.close();
+        });
+    }
+
+    // Stage 3: write results in input order on this thread (mapped outputs are already written)
+    std::map<long, BatchChunk> pending;
+    long next_sequence = 0, n_records = 0, n_solved = 0;
+    BatchChunk chunk;
+    while (done.pop(chunk)) {
+        if (output_map.is_open()) {
+            n_records += chunk.count;
+            n_solved += chunk.n_solved;
+            slots.push(0);
+            continue;
+        }
+        long sequence = chunk.sequence;
+        pending.emplace(sequence, std::move(chunk));
+        for (auto it = pending.find(next_sequence); it != pending.end(); it = pending.find(next_sequence)) {
+            const BatchChunk& ready = it->second;
+            for (long k = 0; k < ready.count; k++) {
+                write_result(*out, options, ready.first_index + k, record_view(options, input_map, ready, k), ready.results[k]);
+            }
+            n_records += ready.count;
+            n_solved += ready.n_solved;
+            pending.erase(it);
+            next_sequence++;
+            slots.push(0);
+        }
+    }
+    out->flush();
+
+    reader.join();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    output_map.close();
+
+    double seconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count() * 1e-6;
+    cerr << "Records: " << n_records << ", solved: " << n_solved
+         << ", workers: " << options.n_workers
+         << ", time: " << std::fixed << std::setprecision(3) << seconds << " s"
+         << ", throughput: " << std::setprecision(1) << (seconds > 0 ? n_records / seconds : 0.0) << " poses/s" << endl;
+    return 0;
+}
@@ -0,0 +1,208 @@
+#ifndef GEOFIK_MATH_H
+#define GEOFIK_MATH_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+/**
+ * @file    geofik_math.h
+ * @brief   trigonometric functions of the IK, in an accuracy tier chosen at compile time.
+ *
+ * @details The IK calls geofik_sin, geofik_cos, geofik_sincos, geofik_asin, geofik_acos, geofik_atan
+ *          and geofik_atan2. By default (exact tier) they are the libm functions. Compiled with
+ *          -DGEOFIK_FAST_MATH (fast tier) they are the fast_* functions below: polynomial
+ *          approximations with an absolute error below 1e-11 (sin, cos) and 1e-12 rad (asin, acos,
+ *          atan, atan2). The IK amplifies these errors near singular configurations. Over the
+ *          2000 poses of the benchmark corpus, the joint angles differ from the libm build by about
+ *          1e-11 rad at the median for every free variable; at the 99th percentile and at the
+ *          largest difference, by 4.8e-10 and 5.2e-9 rad (q7), 6.5e-10 and 1.6e-8 rad (q4),
+ *          5.2e-10 and 3.1e-9 rad (q6), and 2.2e-10 and 1.4e-9 rad (swivel). Near singularities
+ *          the fast tier therefore misses a 1e-9 rad agreement with libm; use the exact tier where
+ *          that is required. The fast tier does not set errno and assumes
+ *          |x| < 1e6 for sin and cos; out-of-domain inputs of asin and acos still give NaN.
+ *
+ *          The fast_* functions are always available. They are branch-free (selects instead of
+ *          jumps, quadrant from the bits of a rounded double), so loops over them vectorize:
+ *          geofik_sincos_n and geofik_atan2_n are the array forms. Forward kinematics keep libm in
+ *          both tiers, so FK(IK(pose)) measures the error of the tier (see benchmark_fast_math.cpp);
+ *          only the batched franka_fk_frames_soa uses fast_sincos in both.
+ *
+ *          Coefficients: least-squares fits on Chebyshev nodes refined by Lawson reweighting to
+ *          the minimax polynomial of the degree below, in long double.
+ *          Does not work with -ffast-math (the rounding trick is reassociated away).
+ */
+
+namespace geofik_math_detail {
+
+// pi/2 split in three parts for Cody-Waite reduction: k * PIO2_1 and k * PIO2_2 are exact for |k| < 2^20
+constexpr double PIO2_1 = 1.57079632673412561417e+00;
+constexpr double PIO2_2 = 6.07710050630396597660e-11;
+constexpr double PIO2_3 = 2.02226624871116645580e-21;
+constexpr double TWO_OVER_PI = 6.36619772367581382433e-01;
+constexpr double HALF_PI = 1.57079632679489661923;
+constexpr double QUARTER_PI = 0.78539816339744830962;
+constexpr double PI_ = 3.14159265358979323846;
+constexpr double TAN_PI_8 = 0.41421356237309504880;
+// Adding and subtracting 1.5 * 2^52 rounds to the nearest integer and leaves it in the low mantissa bits
+constexpr double ROUND_MAGIC = 6755399441055744.0;
+
+inline uint64_t bits(double x) {
+    uint64_t u;
+    memcpy(&u, &x, sizeof u);
+    return u;
+}
+
+inline double from_bits(uint64_t u) {
+    double x;
+    memcpy(&x, &u, sizeof x);
+    return x;
+}
+
+// asin(u) for |u| <= 0.5 (z = u^2), degree 7 in u^2 after the leading u
+inline double asin_core(double u, double z) {
+    double p = 3.44680006447591197e-02;
+    p = p * z + 3.60216777548999533e-04;
+    p = p * z + 2.13350546896026380e-02;
+    p = p * z + 2.17118965821121827e-02;
+    p = p * z + 3.04457531749027822e-02;
+    p = p * z + 4.46393868463562868e-02;
+    p = p * z + 7.50000947341264157e-02;
+    p = p * z + 1.66666665715532403e-01;
+    return u + u * z * p;
+}
+
+// atan(u) for |u| <= tan(pi/8), degree 6 in u^2 after the leading u
+inline double atan_core(double u) {
+    double z = u * u;
+    double p = -3.69781951802351169e-02;
+    p = p * z + 6.93225270221859424e-02;
+    p = p * z - 8.98230109363173379e-02;
+    p = p * z + 1.11022106559113085e-01;
+    p = p * z - 1.42853089677939415e-01;
+    p = p * z + 1.99999908168941726e-01;
+    p = p * z - 3.33333332572331109e-01;
+    return u + u * z * p;
+}
+
+// atan(t) for 0 <= t <= 1
+inline double atan_unit(double t) {
+    bool big = t > TAN_PI_8;
+    double u = big ? (t - 1) / (t + 1) : t;
+    double a = atan_core(u);
+    return big ? a + QUARTER_PI : a;
+}
+
+} // namespace geofik_math_detail
+
+inline void fast_sincos(const double x, double& s, double& c) {
+    using namespace geofik_math_detail;
+    double k = (x * TWO_OVER_PI + ROUND_MAGIC) - ROUND_MAGIC;
+    uint64_t quadrant = bits(x * TWO_OVER_PI + ROUND_MAGIC);
+    double r = ((x - k * PIO2_1) - k * PIO2_2) - k * PIO2_3;  // |r| <= pi/4
+    double z = r * r;
+    double ps = 2.71601402899762861e-06;
+    ps = ps * z - 1.98390437717177231e-04;
+    ps = ps * z + 8.33332823871891538e-03;
+    ps = ps * z - 1.66666666279990772e-01;
+    double sr = r + r * z * ps;
+    double pc = -2.72102378491499978e-07;
+    pc = pc * z + 2.47995200082962879e-05;
+    pc = pc * z - 1.38888837534004010e-03;
+    pc = pc * z + 4.16666666228278013e-02;
+    double cr = 1 - 0.5 * z + z * z * pc;
+    // quadrant 0: (sr, cr), 1: (cr, -sr), 2: (-sr, -cr), 3: (-cr, sr). The swap is a bit mask
+    // rather than a select, which would need 64-bit integer compares (SSE4.1) to vectorize
+    uint64_t swap = (bits(sr) ^ bits(cr)) & (0 - (quadrant & 1));
+    s = from_bits(bits(sr) ^ swap ^ ((quadrant & 2) << 62));
+    c = from_bits(bits(cr) ^ swap ^ (((quadrant + 1) & 2) << 62));
+}
+
+inline double fast_sin(const double x) {
+    double s, c;
+    fast_sincos(x, s, c);
+    return s;
+}
+
+inline double fast_cos(const double x) {
+    double s, c;
+    fast_sincos(x, s, c);
+    return c;
+}
+
+inline double fast_asin(const double x) {
+    using namespace geofik_math_detail;
+    // |x| > 0.5: asin(x) = pi/2 - 2 asin(sqrt((1 - |x|) / 2))
+    double ax = fabs(x);
+    bool big = ax > 0.5;
+    double z = big ? (1 - ax) * 0.5 : ax * ax;
+    double u = big ? sqrt(z) : ax;
+    double p = asin_core(u, z);
+    return copysign(big ? HALF_PI - 2 * p : p, x);
+}
+
+inline double fast_acos(const double x) {
+    using namespace geofik_math_detail;
+    // |x| <= 0.5: pi/2 - asin(x); otherwise 2 asin(sqrt((1 - |x|) / 2)), from pi for x < 0
+    double ax = fabs(x);
+    bool big = ax > 0.5;
+    double z = big ? (1 - ax) * 0.5 : x * x;
+    double u = big ? sqrt(z) : x;
+    double p = asin_core(u, z);
+    double a = big ? 2 * p : HALF_PI - p;
+    return big && x < 0 ? PI_ - a : a;
+}
+
+inline double fast_atan(const double x) {
+    using namespace geofik_math_detail;
+    // |x| > 1: atan(x) = pi/2 - atan(1/|x|)
+    double ax = fabs(x);
+    bool big = ax > 1;
+    double a = atan_unit(big ? 1 / ax : ax);
+    return copysign(big ? HALF_PI - a : a, x);
+}
+
+inline double fast_atan2(const double y, const double x) {
+    using namespace geofik_math_detail;
+    double ax = fabs(x), ay = fabs(y);
+    double mn = ax < ay ? ax : ay;
+    double mx = ax < ay ? ay : ax;
+    double a = atan_unit(mx > 0 ? mn / mx : 0);
+    a = ay > ax ? HALF_PI - a : a;
+    a = std::signbit(x) ? PI_ - a : a;
+    return copysign(a, y);
+}
+
+#ifdef GEOFIK_FAST_MATH
+inline double geofik_sin(const double x) { return fast_sin(x); }
+inline double geofik_cos(const double x) { return fast_cos(x); }
+inline void geofik_sincos(const double x, double& s, double& c) { fast_sincos(x, s, c); }
+inline double geofik_asin(const double x) { return fast_asin(x); }
+inline double geofik_acos(const double x) { return fast_acos(x); }
+inline double geofik_atan(const double x) { return fast_atan(x); }
+inline double geofik_atan2(const double y, const double x) { return fast_atan2(y, x); }
+#else
+inline double geofik_sin(const double x) { return sin(x); }
+inline double geofik_cos(const double x) { return cos(x); }
+inline void geofik_sincos(const double x, double& s, double& c) {
+    // GCC fuses the pair into one sincos call
+    s = sin(x);
+    c = cos(x);
+}
+inline double geofik_asin(const double x) { return asin(x); }
+inline double geofik_acos(const double x) { return acos(x); }
+inline double geofik_atan(const double x) { return atan(x); }
+inline double geofik_atan2(const double y, const double x) { return atan2(y, x); }
+#endif
+
+// Array forms: s[i], c[i] = sin(x[i]), cos(x[i]) and a[i] = atan2(y[i], x[i]) for i < n
+inline void geofik_sincos_n(const double* x, double* s, double* c, const size_t n) {
+    for (size_t i = 0; i < n; i++) geofik_sincos(x[i], s[i], c[i]);
+}
+
+inline void geofik_atan2_n(const double* y, const double* x, double* a, const size_t n) {
+    for (size_t i = 0; i < n; i++) a[i] = geofik_atan2(y[i], x[i]);
+}
+
+#endif // GEOFIK_MATH_H
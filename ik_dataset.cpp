@@ -0,0 +1,148 @@
+#include "ik_dataset.h"
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char IK_DATASET_MAGIC[8] = { 'G', 'E', 'O', 'F', 'I', 'K', 'D', 'S' };
+static const size_t IK_DATASET_ALIGNMENT = 64;
+
+size_t ik_section_record_size(IKDatasetSection section) {
+    switch (section) {
+        case IK_POSES: return sizeof(IKPose);
+        case IK_CURRENT_POSES: return sizeof(std::array<double, 7>);
+        case IK_NSOLS: return sizeof(uint32_t);
+        case IK_QSOLS: return sizeof(std::array<std::array<double, 7>, 8>);
+        case IK_JSOLS: return sizeof(std::array<std::array<std::array<double, 6>, 7>, 8>);
+        case IK_WEIGHTED: return sizeof(IKWeightedRecord);
+        default: return 0;
+    }
+}
+
+void store_weighted_result(const WeightedIKResult& result, IKWeightedRecord& record) {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    record.success = result.success ? 1 : 0;
+    record.solution_index = result.success ? result.solution_index : -1;
+    record.score = result.success ? result.score : nan;
+    record.manipulability = result.success ? result.manipulability : nan;
+    record.neutral_distance = result.success ? result.neutral_distance : nan;
+    record.current_distance = result.success ? result.current_distance : nan;
+    record.free_variable = result.success ? result.free_variable_optimal : nan;
+    record.q7_optimal = result.success ? result.q7_optimal : nan;
+    for (int j = 0; j < 7; j++) record.joint_angles[j] = result.success ? result.joint_angles[j] : nan;
+}
+
+IKDataset::IKDataset() : fd_(-1), base_(nullptr), file_size_(0), writable_(false) {}
+
+IKDataset::~IKDataset() {
+    close();
+}
+
+void* IKDataset::section(IKDatasetSection s) const {
+    if (!has(s)) return nullptr;
+    return static_cast<char*>(base_) + header()->offsets[s];
+}
+
+bool IKDataset::open(const std::string& path, bool writable) {
+    close();
+    fd_ = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd_ < 0) {
+        std::cerr << "ERROR: cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || (size_t)st.st_size < sizeof(IKDatasetHeader)) {
+        std::cerr << "ERROR: " << path << " is too small to be an IK dataset" << std::endl;
+        close();
+        return false;
+    }
+    file_size_ = (size_t)st.st_size;
+    base_ = mmap(nullptr, file_size_, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd_, 0);
+    if (base_ == MAP_FAILED) {
+        base_ = nullptr;
+        std::cerr << "ERROR: cannot map " << path << std::endl;
+        close();
+        return false;
+    }
+    writable_ = writable;
+
+    // Validate the header and that every section lies inside the file
+    const IKDatasetHeader* h = header();
+    const char* problem = nullptr;
+    if (memcmp(h->magic, IK_DATASET_MAGIC, sizeof(IK_DATASET_MAGIC)) != 0) problem = "bad magic";
+    else if (h->version > IK_DATASET_VERSION) problem = "unsupported version";
+    else if (h->header_size < sizeof(IKDatasetHeader)) problem = "bad header size";
+    for (uint32_t s = 0; s < IK_NUM_SECTIONS && !problem; s++) {
+        if (!(h->flags & (1u << s))) continue;
+        size_t record_size = ik_section_record_size((IKDatasetSection)s);
+        if (record_size == 0) problem = "unknown section";
+        else if (h->offsets[s] % IK_DATASET_ALIGNMENT != 0) problem = "misaligned section";
+        else if (h->offsets[s] > file_size_ || h->count > (file_size_ - h->offsets[s]) / record_size) problem = "truncated section";
+    }
+    if (problem) {
+        std::cerr << "ERROR: " << path << " is not a valid IK dataset (" << problem << ")" << std::endl;
+        close();
+        return false;
+    }
+    madvise(base_, file_size_, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool IKDataset::create(const std::string& path, uint64_t count, uint32_t sections) {
+    close();
+    IKDatasetHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, IK_DATASET_MAGIC, sizeof(IK_DATASET_MAGIC));
+    h.version = IK_DATASET_VERSION;
+    h.header_size = sizeof(IKDatasetHeader);
+    h.count = count;
+
+    // Lay the sections out back to back after the header
+    size_t offset = sizeof(IKDatasetHeader);
+    for (uint32_t s = 0; s < IK_NUM_SECTIONS; s++) {
+        if (!(sections & (1u << s))) continue;
+        size_t record_size = ik_section_record_size((IKDatasetSection)s);
+        if (record_size == 0) continue;
+        offset = (offset + IK_DATASET_ALIGNMENT - 1) / IK_DATASET_ALIGNMENT * IK_DATASET_ALIGNMENT;
+        h.flags |= 1u << s;
+        h.offsets[s] = offset;
+        offset += record_size * count;
+    }
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "ERROR: cannot create " << path << std::endl;
+        return false;
+    }
+    if (ftruncate(fd_, (off_t)offset) != 0) {
+        std::cerr << "ERROR: cannot allocate " << offset << " bytes for " << path << std::endl;
+        close();
+        return false;
+    }
+    file_size_ = offset;
+    base_ = mmap(nullptr, file_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base_ == MAP_FAILED) {
+        base_ = nullptr;
+        std::cerr << "ERROR: cannot map " << path << std::endl;
+        close();
+        return false;
+    }
+    writable_ = true;
+    memcpy(base_, &h, sizeof(h));
+    return true;
+}
+
+void IKDataset::sync() {
+    if (base_ && writable_) msync(base_, file_size_, MS_SYNC);
+}
+
+void IKDataset::close() {
+    if (base_) munmap(base_, file_size_);
+    if (fd_ >= 0) ::close(fd_);
+    base_ = nullptr;
+    fd_ = -1;
+    file_size_ = 0;
+    writable_ = false;
+}
@@ -0,0 +1,131 @@
+#ifndef IK_DATASET_H
+#define IK_DATASET_H
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "weighted_ik.h"
+
+/**
+ * @file    ik_dataset.h
+ * @brief   memory-mappable container for pose corpora and IK result sets.
+ *
+ * @details File layout (version 1, native little-endian, every section 64-byte aligned):
+ *
+ *          offset 0     IKDatasetHeader (128 bytes)
+ *          offsets[s]   section s, count records each, present if bit s of flags is set:
+ *
+ *          section            record type                                  bytes/record
+ *          IK_POSES           IKPose {position[3], ROE[9] row-first}       96
+ *          IK_CURRENT_POSES   array<double,7> current joint angles         56
+ *          IK_NSOLS           uint32_t number of solutions                 4
+ *          IK_QSOLS           array<array<double,7>,8> as in geofik.h      448
+ *          IK_JSOLS           array<array<array<double,6>,7>,8> (J^T)      2688
+ *          IK_WEIGHTED        IKWeightedRecord                             112
+ *
+ *          The record types are the ones the solvers already use, so views into the mapping
+ *          can be passed straight to franka_ik_* / franka_J_ik_* without copies.
+ *          Readers must reject files with a different magic, a newer version or a
+ *          header_size smaller than sizeof(IKDatasetHeader).
+ */
+
+constexpr uint32_t IK_DATASET_VERSION = 1;
+
+enum IKDatasetSection : uint32_t {
+    IK_POSES = 0,
+    IK_CURRENT_POSES = 1,
+    IK_NSOLS = 2,
+    IK_QSOLS = 3,
+    IK_JSOLS = 4,
+    IK_WEIGHTED = 5,
+    IK_NUM_SECTIONS = 8  // Slots in the header, the last two are reserved
+};
+
+// Bit of the header flags for a section
+constexpr uint32_t ik_section_bit(IKDatasetSection section) { return 1u << section; }
+
+struct IKDatasetHeader {
+    char magic[8];                       // "GEOFIKDS"
+    uint32_t version;                    // IK_DATASET_VERSION
+    uint32_t header_size;                // sizeof(IKDatasetHeader)
+    uint32_t flags;                      // ik_section_bit() of every present section
+    uint32_t reserved0;
+    uint64_t count;                      // Records per section
+    uint64_t offsets[IK_NUM_SECTIONS];   // Byte offset of each section, 0 if absent
+    uint8_t reserved[32];
+};
+
+struct IKPose {
+    std::array<double, 3> position;      // r_EO_O
+    std::array<double, 9> orientation;   // ROE (row-first format)
+};
+
+struct IKWeightedRecord {
+    uint32_t success;
+    int32_t solution_index;
+    double score;
+    double manipulability;
+    double neutral_distance;
+    double current_distance;
+    double free_variable;
+    double q7_optimal;
+    std::array<double, 7> joint_angles;
+};
+
+static_assert(sizeof(IKDatasetHeader) == 128, "IKDatasetHeader layout changed");
+static_assert(sizeof(IKPose) == 96, "IKPose layout changed");
+static_assert(sizeof(IKWeightedRecord) == 112, "IKWeightedRecord layout changed");
+
+// Bytes per record of a section
+size_t ik_section_record_size(IKDatasetSection section);
+
+// Copies a weighted solve into its flat record, metrics are NaN when it failed
+void store_weighted_result(const WeightedIKResult& result, IKWeightedRecord& record);
+
+// mmap-backed dataset. Views are valid until close() and point straight into the file.
+class IKDataset {
+private:
+    int fd_;
+    void* base_;
+    size_t file_size_;
+    bool writable_;
+
+    const IKDatasetHeader* header() const { return static_cast<const IKDatasetHeader*>(base_); }
+    void* section(IKDatasetSection s) const;
+
+public:
+    IKDataset();
+    ~IKDataset();
+    IKDataset(const IKDataset&) = delete;
+    IKDataset& operator=(const IKDataset&) = delete;
+
+    // Maps an existing file. Returns false (and prints the reason) if it is not a valid dataset.
+    bool open(const std::string& path, bool writable = false);
+
+    // Creates (or truncates) a file sized for count records of the given sections and maps it
+    // read-write. sections is a combination of ik_section_bit() values.
+    bool create(const std::string& path, uint64_t count, uint32_t sections);
+
+    // Flushes dirty pages to the file (only needed before reading it from another process)
+    void sync();
+    void close();
+
+    bool is_open() const { return base_ != nullptr; }
+    uint64_t count() const { return base_ ? header()->count : 0; }
+    bool has(IKDatasetSection s) const { return base_ && (header()->flags & ik_section_bit(s)); }
+
+    // Zero-copy views, nullptr if the section is absent
+    IKPose* poses() const { return static_cast<IKPose*>(section(IK_POSES)); }
+    std::array<double, 7>* current_poses() const { return static_cast<std::array<double, 7>*>(section(IK_CURRENT_POSES)); }
+    uint32_t* nsols() const { return static_cast<uint32_t*>(section(IK_NSOLS)); }
+    std::array<std::array<double, 7>, 8>* qsols() const {
+        return static_cast<std::array<std::array<double, 7>, 8>*>(section(IK_QSOLS));
+    }
+    std::array<std::array<std::array<double, 6>, 7>, 8>* jsols() const {
+        return static_cast<std::array<std::array<std::array<double, 6>, 7>, 8>*>(section(IK_JSOLS));
+    }
+    IKWeightedRecord* weighted() const { return static_cast<IKWeightedRecord*>(section(IK_WEIGHTED)); }
+};
+
+#endif // IK_DATASET_H
@@ -0,0 +1,294 @@
+#include "ik_jobs.h"
+
+// Worker the calling thread is, and the job it is running
+static thread_local const IKJobPool* current_pool = nullptr;
+static thread_local int current_worker = -1;
+static thread_local IKJobPriority current_priority = IKJobPriority::NORMAL;
+static thread_local std::shared_ptr<std::atomic<bool>> current_cancelled;
+
+IKJobPool::IKJobPool(const WeightedIKSolver& solver, int n_threads, int grid_grain)
+    : grain_(grid_grain < 1 ? 1 : grid_grain),
+      queued_(0),
+      stopping_(false) {
+    if (n_threads <= 0) {
+        n_threads = (int)std::thread::hardware_concurrency();
+        if (n_threads <= 0) n_threads = 1;
+    }
+    for (int t = 0; t <= n_threads; t++) {
+        queues_.emplace_back(new TaskQueue());
+    }
+    for (int t = 0; t < n_threads; t++) {
+        solvers_.emplace_back(new WeightedIKSolver(solver));
+        solvers_.back()->set_verbose(false);
+        // The copies would all record over the one tape of solver
+        solvers_.back()->set_q7_tape(nullptr);
+    }
+    for (int t = 0; t < n_threads; t++) {
+        threads_.emplace_back(&IKJobPool::worker_loop, this, t);
+    }
+}
+
+IKJobPool::~IKJobPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+int IKJobPool::worker_index() const {
+    return current_pool == this ? current_worker : -1;
+}
+
+void IKJobPool::push(Task task, IKJobPriority priority) {
+    // Workers push to their own deque, other threads to the submission queue
+    int self = worker_index();
+    TaskQueue& queue = self >= 0 ? *queues_[self] : *queues_.back();
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks[(int)priority].push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    {
+        // A worker that saw queued_ == 0 under the lock is either asleep now or will see the new count
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    wake_.notify_one();
+}
+
+bool IKJobPool::pop(int self, Task& task, IKJobPriority& priority) {
+    if (queued_.load() == 0) return false;
+    int n_workers = (int)threads_.size();
+    for (int p = 0; p < IK_JOB_PRIORITIES; p++) {
+        // Own tasks newest first (the smallest pieces of the current job), then the oldest task of
+        // the submission queue, then the oldest task (the largest piece) of another worker
+        for (int k = -1; k <= n_workers; k++) {
+            TaskQueue* queue;
+            bool own = k < 0;
+            if (own) {
+                if (self < 0) continue;
+                queue = queues_[self].get();
+            } else if (k == 0) {
+                queue = queues_.back().get();
+            } else {
+                int victim = ((self < 0 ? 0 : self) + k) % n_workers;
+                if (victim == self) continue;
+                queue = queues_[victim].get();
+            }
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            std::deque<Task>& tasks = queue->tasks[p];
+            if (tasks.empty()) continue;
+            if (own) {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+            } else {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            priority = (IKJobPriority)p;
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void IKJobPool::run(Task& task, IKJobPriority priority) {
+    // Tasks run nested while a worker waits in parallel_for, keep the outer context
+    IKJobPriority outer_priority = current_priority;
+    std::shared_ptr<std::atomic<bool>> outer_cancelled = std::move(current_cancelled);
+    current_priority = priority;
+    current_cancelled = task.cancelled;
+    task.run();
+    current_priority = outer_priority;
+    current_cancelled = std::move(outer_cancelled);
+}
+
+void IKJobPool::worker_loop(int index) {
+    current_pool = this;
+    current_worker = index;
+    Task task;
+    IKJobPriority priority;
+    while (true) {
+        if (pop(index, task, priority)) {
+            run(task, priority);
+            task = Task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+        if (stopping_ && queued_.load() == 0) break;
+    }
+}
+
+// Shared by the sub-ranges of one parallel_for
+struct IKJobPool::ParallelRange {
+    const std::function<void(int, int)>* body;
+    int grain;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+    IKJobPriority priority;
+    std::atomic<int> remaining;  // Items not done yet
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+void IKJobPool::run_range(const std::shared_ptr<ParallelRange>& range, int begin, int end) {
+    // Pushes the upper half until the range is down to the grain, so thieves take large pieces
+    while (end - begin > range->grain) {
+        int middle = begin + (end - begin) / 2;
+        push(Task{ [this, range, middle, end] { run_range(range, middle, end); }, range->cancelled }, range->priority);
+        end = middle;
+    }
+    if (!range->cancelled || !range->cancelled->load(std::memory_order_relaxed)) {
+        (*range->body)(begin, end);
+    }
+    if (range->remaining.fetch_sub(end - begin) == end - begin) {
+        std::lock_guard<std::mutex> lock(range->mutex);
+        range->done.notify_all();
+    }
+}
+
+void IKJobPool::parallel_for(int count, int grain, const std::function<void(int, int)>& body) {
+    if (count <= 0) return;
+    int self = worker_index();
+    auto range = std::make_shared<ParallelRange>();
+    range->body = &body;
+    range->grain = grain < 1 ? 1 : grain;
+    range->cancelled = self >= 0 ? current_cancelled : nullptr;
+    range->priority = self >= 0 ? current_priority : IKJobPriority::NORMAL;
+    range->remaining.store(count);
+
+    if (self >= 0) {
+        run_range(range, 0, count);
+        // Help with whatever is queued (most likely our own sub-ranges) until every piece is done
+        Task task;
+        IKJobPriority priority;
+        while (range->remaining.load() > 0) {
+            if (pop(self, task, priority)) {
+                run(task, priority);
+                task = Task();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        return;
+    }
+
+    push(Task{ [this, range, count] { run_range(range, 0, count); }, range->cancelled }, range->priority);
+    std::unique_lock<std::mutex> lock(range->mutex);
+    range->done.wait(lock, [&range] { return range->remaining.load() == 0; });
+}
+
+IKJobToken IKJobPool::submit(const IKRequest& request,
+                             std::function<void(const IKJobResult<IKResponse>&)> done,
+                             IKJobPriority priority) {
+    IKJobToken token;
+    std::shared_ptr<std::atomic<bool>> cancelled = token.flag();
+    push(Task{ [this, request, done, cancelled] {
+        IKJobResult<IKResponse> result{};
+        result.cancelled = cancelled->load(std::memory_order_relaxed);
+        if (!result.cancelled) {
+            IKServer::handle(*solvers_[worker_index()], request, result.value);
+        }
+        done(result);
+    }, cancelled }, priority);
+    return token;
+}
+
+WeightedIKResult IKJobPool::solve_grid(const IKGridJob& job) {
+    auto start = high_resolution_clock::now();
+    WeightedIKResult best{};
+    best.success = false;
+    best.score = -std::numeric_limits<double>::infinity();
+    // The samples of Q7Sweep::start(), so that the split sweep tests the same q7 as solve_q7
+    int n_samples = 0;
+    if (job.step_size > 0 && job.q7_end >= job.q7_start) {
+        n_samples = (int)((job.q7_end - job.q7_start) / job.step_size + 1e-9) + 1;
+    }
+
+    // Each sub-range is a solve_q7 over its samples on the worker that runs it
+    std::mutex best_mutex;
+    parallel_for(n_samples, grain_, [&](int begin, int end) {
+        WeightedIKResult part = solvers_[worker_index()]->solve_q7(
+            job.position, job.orientation, job.current_pose,
+            job.q7_start + begin * job.step_size, job.q7_start + (end - 0.5) * job.step_size, job.step_size);
+        std::lock_guard<std::mutex> lock(best_mutex);
+        int total_solutions_found = best.total_solutions_found + part.total_solutions_found;
+        int valid_solutions_count = best.valid_solutions_count + part.valid_solutions_count;
+        if (part.success && part.score > best.score) best = part;
+        best.total_solutions_found = total_solutions_found;
+        best.valid_solutions_count = valid_solutions_count;
+    });
+
+    best.q7_values_tested = n_samples;
+    best.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    return best;
+}
+
+IKJobToken IKJobPool::submit_grid(const IKGridJob& job,
+                                  std::function<void(const IKJobResult<WeightedIKResult>&)> done,
+                                  IKJobPriority priority) {
+    IKJobToken token;
+    std::shared_ptr<std::atomic<bool>> cancelled = token.flag();
+    push(Task{ [this, job, done, cancelled] {
+        IKJobResult<WeightedIKResult> result{};
+        if (!cancelled->load(std::memory_order_relaxed)) {
+            result.value = solve_grid(job);
+        }
+        // Sub-ranges skipped after a cancel leave the sweep incomplete
+        result.cancelled = cancelled->load(std::memory_order_relaxed);
+        done(result);
+    }, cancelled }, priority);
+    return token;
+}
+
+IKJobToken IKJobPool::submit_path(const IKPathJob& job,
+                                  std::function<void(const IKJobResult<PathIKResult>&)> done,
+                                  IKJobPriority priority) {
+    IKJobToken token;
+    std::shared_ptr<std::atomic<bool>> cancelled = token.flag();
+    push(Task{ [this, job, done, cancelled] {
+        IKJobResult<PathIKResult> result{};
+        if (!cancelled->load(std::memory_order_relaxed)) {
+            // The solver of this worker only scores candidates (const), so the workers that
+            // generate them may share it
+            PathIKSolver path(*solvers_[worker_index()], job.q7_samples, job.segment_length, 1, job.max_joint_step);
+            path.set_parallel_for([this](int count, const std::function<void(int, int)>& body) {
+                parallel_for(count, 1, body);
+            });
+            result.value = path.solve(job.positions, job.orientations, job.current_pose, job.q7_min, job.q7_max);
+        }
+        result.cancelled = cancelled->load(std::memory_order_relaxed);
+        done(result);
+    }, cancelled }, priority);
+    return token;
+}
+
+// Future versions: a promise set by the callback
+template <typename T>
+static std::function<void(const IKJobResult<T>&)> fulfil(IKJob<T>& job) {
+    auto promise = std::make_shared<std::promise<IKJobResult<T>>>();
+    job.result = promise->get_future();
+    return [promise](const IKJobResult<T>& result) { promise->set_value(result); };
+}
+
+IKJob<IKResponse> IKJobPool::submit(const IKRequest& request, IKJobPriority priority) {
+    IKJob<IKResponse> job;
+    job.token = submit(request, fulfil(job), priority);
+    return job;
+}
+
+IKJob<WeightedIKResult> IKJobPool::submit_grid(const IKGridJob& grid, IKJobPriority priority) {
+    IKJob<WeightedIKResult> job;
+    job.token = submit_grid(grid, fulfil(job), priority);
+    return job;
+}
+
+IKJob<PathIKResult> IKJobPool::submit_path(const IKPathJob& path, IKJobPriority priority) {
+    IKJob<PathIKResult> job;
+    job.token = submit_path(path, fulfil(job), priority);
+    return job;
+}
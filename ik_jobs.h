@@ -0,0 +1,167 @@
+#ifndef IK_JOBS_H
+#define IK_JOBS_H
+
+#include <array>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <thread>
+#include <limits>
+#include "weighted_ik.h"
+#include "path_ik.h"
+#include "ik_service.h"
+
+/**
+ * @file    ik_jobs.h
+ * @brief   asynchronous IK jobs on a work-stealing thread pool.
+ *
+ * @details Jobs of very different sizes (a raw IK in a microsecond, a q7 grid sweep or a path in
+ *          milliseconds) are submitted from any thread and complete through a future or a
+ *          callback. Every worker owns a deque per priority: it pops its own tasks newest first
+ *          and, when it runs dry, takes the oldest task of the submission queue or steals the
+ *          oldest task of another worker. Grid sweeps and path candidate generation split their
+ *          range in halves down to a grain, pushing one half each time, so idle workers pick up
+ *          the large pieces of a big job while its owner works through the small ones.
+ *
+ *          Priorities are strict: no worker starts a NORMAL task while it can find a HIGH one.
+ *          A running task is never preempted. Cancelling a job makes its queued tasks finish
+ *          without work; a grid sweep or path that already started stops at its next sub-range.
+ *
+ *          Every worker has its own copy of the WeightedIKSolver given to the pool, so one
+ *          WarmStartIndex or WorkspaceMap set on it is shared by all of them.
+ */
+
+enum class IKJobPriority : int {
+    HIGH = 0,
+    NORMAL = 1,
+    LOW = 2
+};
+
+constexpr int IK_JOB_PRIORITIES = 3;
+
+// Outcome of a job
+template <typename T>
+struct IKJobResult {
+    T value;          // Incomplete if cancelled
+    bool cancelled;   // The job was cancelled before it finished
+};
+
+// Submitter side of a job: cancels it, shared with the tasks of the job
+class IKJobToken {
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+
+public:
+    IKJobToken() : cancelled_(std::make_shared<std::atomic<bool>>(false)) {}
+    void cancel() { cancelled_->store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return cancelled_->load(std::memory_order_relaxed); }
+    const std::shared_ptr<std::atomic<bool>>& flag() const { return cancelled_; }
+};
+
+// Job whose result is delivered through a future
+template <typename T>
+struct IKJob {
+    IKJobToken token;
+    std::future<IKJobResult<T>> result;
+
+    void cancel() { token.cancel(); }
+    IKJobResult<T> get() { return result.get(); }
+};
+
+// q7 grid sweep as WeightedIKSolver::solve_q7, split into sub-ranges of samples
+struct IKGridJob {
+    std::array<double, 3> position;
+    std::array<double, 9> orientation;
+    std::array<double, 7> current_pose;
+    double q7_start;
+    double q7_end;
+    double step_size;
+};
+
+// Whole-path solve as PathIKSolver::solve, with the candidates generated on the pool
+struct IKPathJob {
+    std::vector<std::array<double, 3>> positions;
+    std::vector<std::array<double, 9>> orientations;
+    std::array<double, 7> current_pose;
+    double q7_min;
+    double q7_max;
+    int q7_samples = 32;
+    int segment_length = 256;
+    double max_joint_step = std::numeric_limits<double>::infinity();
+};
+
+class IKJobPool {
+private:
+    struct Task {
+        std::function<void()> run;
+        std::shared_ptr<std::atomic<bool>> cancelled;  // Of the job the task belongs to
+    };
+
+    // Tasks of one worker (or of the submission queue), one deque per priority
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks[IK_JOB_PRIORITIES];
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;  // One per worker, then the submission queue
+    std::vector<std::unique_ptr<WeightedIKSolver>> solvers_;
+    std::vector<std::thread> threads_;
+    int grain_;
+
+    std::atomic<long> queued_;     // Tasks in all queues
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+
+    struct ParallelRange;
+
+    void push(Task task, IKJobPriority priority);
+    bool pop(int self, Task& task, IKJobPriority& priority);
+    void run(Task& task, IKJobPriority priority);
+    void worker_loop(int index);
+    void run_range(const std::shared_ptr<ParallelRange>& range, int begin, int end);
+    WeightedIKResult solve_grid(const IKGridJob& job);
+    int worker_index() const;  // Index of the calling thread in this pool, -1 for other threads
+
+public:
+    // n_threads = 0 uses std::thread::hardware_concurrency(). grid_grain is the smallest
+    // sub-range of a grid sweep, in samples. Each worker solves on its own copy of solver,
+    // without its q7 tape (see WeightedIKSolver::set_q7_tape()).
+    explicit IKJobPool(const WeightedIKSolver& solver, int n_threads = 0, int grid_grain = 32);
+
+    // Finishes every queued job, then stops the workers
+    ~IKJobPool();
+    IKJobPool(const IKJobPool&) = delete;
+    IKJobPool& operator=(const IKJobPool&) = delete;
+
+    // One request as handled by the IK service (ik-* and opt-* modes)
+    IKJobToken submit(const IKRequest& request,
+                      std::function<void(const IKJobResult<IKResponse>&)> done,
+                      IKJobPriority priority = IKJobPriority::NORMAL);
+    IKJob<IKResponse> submit(const IKRequest& request, IKJobPriority priority = IKJobPriority::NORMAL);
+
+    IKJobToken submit_grid(const IKGridJob& job,
+                           std::function<void(const IKJobResult<WeightedIKResult>&)> done,
+                           IKJobPriority priority = IKJobPriority::NORMAL);
+    IKJob<WeightedIKResult> submit_grid(const IKGridJob& job, IKJobPriority priority = IKJobPriority::NORMAL);
+
+    IKJobToken submit_path(const IKPathJob& job,
+                           std::function<void(const IKJobResult<PathIKResult>&)> done,
+                           IKJobPriority priority = IKJobPriority::NORMAL);
+    IKJob<PathIKResult> submit_path(const IKPathJob& job, IKJobPriority priority = IKJobPriority::NORMAL);
+
+    // Runs body(begin, end) over sub-ranges of [0, count) of at most grain items and returns
+    // once all are done. On a worker the sub-ranges are stealable, inherit the priority and
+    // cancellation of the running job, and the worker runs other tasks while it waits.
+    // Other threads only wait.
+    void parallel_for(int count, int grain, const std::function<void(int, int)>& body);
+
+    int size() const { return (int)threads_.size(); }
+};
+
+#endif // IK_JOBS_H
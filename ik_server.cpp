@@ -0,0 +1,79 @@
+/**
+ * @file    ik_server.cpp
+ * @brief   standalone shared-memory IK server, see ik_service.h for the protocol.
+ *
+ * @details Creates the shared memory object, answers requests until a SHUTDOWN request,
+ *          SIGINT or SIGTERM, then removes the object.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include "ik_service.h"
+
+// compile with: g++ -I/usr/include/eigen3 ik_server.cpp ik_service.cpp ik_dataset.cpp weighted_ik.cpp geofik.cpp -O3 -pthread -lrt -o ik_server
+
+static IKServer* g_server = nullptr;
+
+static void handle_signal(int) {
+    if (g_server) g_server->stop();
+}
+
+static bool parse_doubles(const char* text, double* values, int n) {
+    for (int k = 0; k < n; k++) {
+        char* end;
+        values[k] = strtod(text, &end);
+        if (end == text) return false;
+        text = end;
+        while (*text == ',' || *text == ' ') text++;
+    }
+    return true;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -n NAME     shared memory object name (default /geofik)\n"
+        "  -f          sleep on a futex between requests instead of busy-polling\n"
+        "  -w M,N,C    weights for manipulability, neutral and current distance (default 1,0.5,2)\n"
+        "  -p Q1,..,Q7 neutral pose (default 0,0,0,-1.5,0,1.86,0)\n", program);
+}
+
+int main(int argc, char** argv) {
+    std::string name = "/geofik";
+    IKWaitMode wait_mode = IKWaitMode::BUSY_POLL;
+    double weights[3] = { 1.0, 0.5, 2.0 };
+    std::array<double, 7> neutral_pose = { 0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0 };
+
+    int opt;
+    bool valid = true;
+    while ((opt = getopt(argc, argv, "n:fw:p:h")) != -1 && valid) {
+        switch (opt) {
+            case 'n': name = optarg; break;
+            case 'f': wait_mode = IKWaitMode::FUTEX; break;
+            case 'w': valid = parse_doubles(optarg, weights, 3); break;
+            case 'p': valid = parse_doubles(optarg, neutral_pose.data(), 7); break;
+            default: valid = false; break;
+        }
+    }
+    if (!valid) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    WeightedIKSolver solver(neutral_pose, weights[0], weights[1], weights[2], false);
+    IKServer server(solver);
+    if (!server.create(name)) return 1;
+    g_server = &server;
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    cerr << "Serving IK requests on " << name << " ("
+         << (wait_mode == IKWaitMode::FUTEX ? "futex wait" : "busy poll") << ")" << endl;
+    long served = server.run(wait_mode);
+    g_server = nullptr;
+    server.close();
+    cerr << "Served " << served << " requests" << endl;
+    return 0;
+}
@@ -0,0 +1,202 @@
+#include "ik_service.h"
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char IK_SERVICE_MAGIC[8] = { 'G', 'E', 'O', 'F', 'I', 'K', 'S', 'V' };
+
+static RedundancyParam service_param(IKServiceMode mode) {
+    switch (mode) {
+        case IKServiceMode::IK_Q4: case IKServiceMode::OPT_Q4: return RedundancyParam::Q4;
+        case IKServiceMode::IK_Q6: case IKServiceMode::OPT_Q6: return RedundancyParam::Q6;
+        case IKServiceMode::IK_SWIVEL: case IKServiceMode::OPT_SWIVEL: return RedundancyParam::SWIVEL;
+        default: return RedundancyParam::Q7;
+    }
+}
+
+IKServer::IKServer(WeightedIKSolver& solver) : region_(nullptr), solver_(solver) {}
+
+IKServer::~IKServer() {
+    close();
+}
+
+bool IKServer::create(const std::string& name) {
+    close();
+    shm_unlink(name.c_str());  // A stale object of a crashed server would keep its old rings
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        std::cerr << "ERROR: cannot create shared memory object " << name << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, sizeof(IKServiceRegion)) != 0) {
+        std::cerr << "ERROR: cannot size shared memory object " << name << std::endl;
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* base = mmap(nullptr, sizeof(IKServiceRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "ERROR: cannot map shared memory object " << name << std::endl;
+        shm_unlink(name.c_str());
+        return false;
+    }
+    name_ = name;
+    region_ = static_cast<IKServiceRegion*>(base);
+    region_->version = IK_SERVICE_VERSION;
+    region_->region_size = sizeof(IKServiceRegion);
+    region_->stop.store(false, std::memory_order_relaxed);
+    region_->server_pid.store((uint32_t)getpid(), std::memory_order_relaxed);
+    region_->requests.init();
+    region_->responses.init();
+    // Clients check the magic first, so it goes in after everything else is initialized
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(region_->magic, IK_SERVICE_MAGIC, sizeof(IK_SERVICE_MAGIC));
+    return true;
+}
+
+void IKServer::handle(WeightedIKSolver& solver, const IKRequest& request, IKResponse& response) {
+    auto start = high_resolution_clock::now();
+    response.id = request.id;
+    response.nsols = 0;
+    response.reserved = 0;
+    WeightedIKResult result;
+    result.success = false;  // Stays false for the ik-* modes, whose weighted record is unused
+
+    switch (request.mode) {
+        case IKServiceMode::IK_Q7:
+            response.nsols = franka_ik_q7(request.position, request.orientation, request.free_variable, response.qsols);
+            break;
+        case IKServiceMode::IK_Q4:
+            response.nsols = franka_ik_q4(request.position, request.orientation, request.free_variable, response.qsols);
+            break;
+        case IKServiceMode::IK_Q6:
+            response.nsols = franka_ik_q6(request.position, request.orientation, request.free_variable, response.qsols);
+            break;
+        case IKServiceMode::IK_SWIVEL:
+            response.nsols = franka_ik_swivel(request.position, request.orientation, request.free_variable, response.qsols);
+            break;
+        case IKServiceMode::OPT_AUTO:
+            result = solver.solve_auto_optimized(request.position, request.orientation, request.current_pose,
+                                                 request.tolerance, request.max_iterations);
+            break;
+        case IKServiceMode::SHUTDOWN:
+            break;
+        default: {
+            RedundancyParam param = service_param(request.mode);
+            double lower = request.range_min, upper = request.range_max;
+            if (lower >= upper) redundancy_param_limits(param, lower, upper);
+            result = solver.solve_optimized(param, request.position, request.orientation, request.current_pose,
+                                            lower, upper, request.tolerance, request.max_iterations);
+            break;
+        }
+    }
+    if (request.mode > IKServiceMode::IK_SWIVEL) {
+        for (auto& q : response.qsols) q.fill(std::numeric_limits<double>::quiet_NaN());
+    }
+    store_weighted_result(result, response.weighted);
+    response.solve_nanoseconds = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+}
+
+long IKServer::run(IKWaitMode mode) {
+    if (!region_) return 0;
+    long served = 0;
+    IKRequest request;
+    IKResponse response;
+    while (region_->requests.wait(mode, region_->stop)) {
+        region_->requests.try_pop(request);
+        handle(solver_, request, response);
+        // The client may be slow to drain its responses, never drop one
+        while (!region_->responses.try_push(response)) {
+            if (region_->stop.load(std::memory_order_acquire)) return served;
+            sched_yield();
+        }
+        served++;
+        if (request.mode == IKServiceMode::SHUTDOWN) {
+            stop();
+            break;
+        }
+    }
+    return served;
+}
+
+void IKServer::stop() {
+    if (!region_) return;
+    region_->stop.store(true, std::memory_order_seq_cst);
+    region_->requests.wake();
+    region_->responses.wake();
+}
+
+void IKServer::close() {
+    if (!region_) return;
+    stop();
+    munmap(region_, sizeof(IKServiceRegion));
+    shm_unlink(name_.c_str());
+    region_ = nullptr;
+}
+
+IKClient::IKClient() : region_(nullptr), next_id_(1) {}
+
+IKClient::~IKClient() {
+    close();
+}
+
+bool IKClient::open(const std::string& name) {
+    close();
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        std::cerr << "ERROR: no IK server at " << name << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(IKServiceRegion)) {
+        std::cerr << "ERROR: " << name << " is not an IK service region of this build" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, sizeof(IKServiceRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "ERROR: cannot map " << name << std::endl;
+        return false;
+    }
+    IKServiceRegion* region = static_cast<IKServiceRegion*>(base);
+    bool valid = memcmp(region->magic, IK_SERVICE_MAGIC, sizeof(IK_SERVICE_MAGIC)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid || region->version != IK_SERVICE_VERSION || region->region_size != sizeof(IKServiceRegion)) {
+        std::cerr << "ERROR: " << name << " is not ready or has an incompatible version" << std::endl;
+        munmap(base, sizeof(IKServiceRegion));
+        return false;
+    }
+    region_ = region;
+    return true;
+}
+
+void IKClient::close() {
+    if (region_) munmap(region_, sizeof(IKServiceRegion));
+    region_ = nullptr;
+}
+
+uint64_t IKClient::submit(IKRequest& request) {
+    if (!region_) return 0;
+    request.id = next_id_;
+    if (!region_->requests.try_push(request)) return 0;
+    return next_id_++;
+}
+
+bool IKClient::receive(IKResponse& response, IKWaitMode mode) {
+    if (!region_) return false;
+    // Responses still queued when the server stopped are delivered before failing
+    if (!region_->responses.try_pop(response)) {
+        if (!region_->responses.wait(mode, region_->stop)) return false;
+        region_->responses.try_pop(response);
+    }
+    return true;
+}
+
+bool IKClient::call(IKRequest& request, IKResponse& response, IKWaitMode mode) {
+    if (submit(request) == 0) return false;
+    return receive(response, mode);
+}
@@ -0,0 +1,240 @@
+#ifndef IK_SERVICE_H
+#define IK_SERVICE_H
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "weighted_ik.h"
+#include "ik_dataset.h"
+
+/**
+ * @file    ik_service.h
+ * @brief   shared-memory IK service for low-latency requests from other processes.
+ *
+ * @details One server process owns a POSIX shared memory object (/dev/shm/<name>) holding an
+ *          IKServiceRegion: a request ring written by the client and read by the server, and a
+ *          response ring written by the server and read by the client. Both rings are
+ *          single-producer/single-consumer and lock-free, so a round trip costs two cache line
+ *          transfers per ring plus the solve. Each side either busy-polls (lowest latency, burns
+ *          a core) or sleeps on a futex that the producer only wakes when someone is waiting.
+ *
+ *          One region serves one client. Responses are returned in request order and carry
+ *          the request id so pipelined clients can match them.
+ */
+
+constexpr uint32_t IK_SERVICE_VERSION = 1;
+constexpr uint32_t IK_SERVICE_RING_SIZE = 64;   // Slots per ring, a power of two
+
+enum class IKWaitMode : uint32_t {
+    BUSY_POLL,   // Spin on the ring indices
+    FUTEX        // Sleep in the kernel until the producer publishes
+};
+
+enum class IKServiceMode : uint32_t {
+    IK_Q7, IK_Q4, IK_Q6, IK_SWIVEL,                 // Analytical IK at a fixed free variable
+    OPT_Q7, OPT_Q4, OPT_Q6, OPT_SWIVEL, OPT_AUTO,   // WeightedIKSolver optimization
+    SHUTDOWN                                        // Stops the server loop
+};
+
+struct IKRequest {
+    uint64_t id;
+    IKServiceMode mode;
+    int32_t max_iterations;              // opt-* modes
+    double free_variable;                // ik-* modes
+    double range_min;                    // opt-* modes, full range of the free variable if min >= max
+    double range_max;
+    double tolerance;
+    std::array<double, 3> position;      // r_EO_O
+    std::array<double, 9> orientation;   // ROE (row-first format)
+    std::array<double, 7> current_pose;
+};
+
+struct IKResponse {
+    uint64_t id;
+    uint32_t nsols;                      // ik-* modes
+    uint32_t reserved;
+    int64_t solve_nanoseconds;           // Time spent in the solver
+    IKWeightedRecord weighted;           // opt-* modes
+    std::array<std::array<double, 7>, 8> qsols;  // ik-* modes, NaN for invalid solutions
+};
+
+// Single-producer/single-consumer ring placed in shared memory. The indices only grow and
+// live on their own cache lines; the futex word counts publications so a consumer that read
+// it before going to sleep is woken by any later push.
+template <typename T, uint32_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "the rings need address-free atomics to work across processes");
+
+private:
+    alignas(64) std::atomic<uint64_t> head_;       // Next slot to write, owned by the producer
+    alignas(64) std::atomic<uint64_t> tail_;       // Next slot to read, owned by the consumer
+    alignas(64) std::atomic<uint32_t> published_;  // Futex word, bumped after every push
+    std::atomic<uint32_t> sleepers_;               // Consumers inside futex_wait
+    alignas(64) T slots_[N];
+
+public:
+    void init() {
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        published_.store(0, std::memory_order_relaxed);
+        sleepers_.store(0, std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_relaxed) == head_.load(std::memory_order_acquire);
+    }
+
+    // Producer side. Returns false if the ring is full.
+    bool try_push(const T& item);
+
+    // Consumer side. Returns false if the ring is empty.
+    bool try_pop(T& item);
+
+    // Consumer side. Waits until an item is available or stop becomes true (checked between
+    // polls, or after a wake() in futex mode). Returns false if stopped.
+    bool wait(IKWaitMode mode, const std::atomic<bool>& stop);
+
+    // Wakes a consumer sleeping in wait(), e.g. after setting its stop flag
+    void wake();
+};
+
+// Layout of the shared memory object
+struct IKServiceRegion {
+    char magic[8];                       // "GEOFIKSV", written last by the server
+    uint32_t version;
+    uint32_t region_size;
+    std::atomic<bool> stop;              // Asks the server loop to return
+    std::atomic<uint32_t> server_pid;
+    SpscRing<IKRequest, IK_SERVICE_RING_SIZE> requests;     // client -> server
+    SpscRing<IKResponse, IK_SERVICE_RING_SIZE> responses;   // server -> client
+};
+
+// Owns the shared memory object and answers requests with its WeightedIKSolver
+class IKServer {
+private:
+    std::string name_;
+    IKServiceRegion* region_;
+    WeightedIKSolver& solver_;
+
+public:
+    explicit IKServer(WeightedIKSolver& solver);
+    ~IKServer();
+    IKServer(const IKServer&) = delete;
+    IKServer& operator=(const IKServer&) = delete;
+
+    // Creates (or replaces) the shared memory object, name like "/geofik"
+    bool create(const std::string& name);
+
+    // Serves requests until a SHUTDOWN request or stop(). Returns the number of requests served.
+    long run(IKWaitMode mode);
+
+    // Makes run() return, callable from a signal handler or another thread
+    void stop();
+
+    // Unmaps and unlinks the shared memory object
+    void close();
+
+    // Solves one request in-process, as run() does for requests from the ring
+    static void handle(WeightedIKSolver& solver, const IKRequest& request, IKResponse& response);
+};
+
+// Maps the shared memory object of a running server
+class IKClient {
+private:
+    IKServiceRegion* region_;
+    uint64_t next_id_;
+
+public:
+    IKClient();
+    ~IKClient();
+    IKClient(const IKClient&) = delete;
+    IKClient& operator=(const IKClient&) = delete;
+
+    // Returns false (and prints the reason) if no compatible server owns the name
+    bool open(const std::string& name);
+    void close();
+    bool is_open() const { return region_ != nullptr; }
+
+    // Queues a request and returns its id, or 0 if the request ring is full
+    uint64_t submit(IKRequest& request);
+
+    // Waits for the next response, in request order. Returns false if the server stopped.
+    bool receive(IKResponse& response, IKWaitMode mode);
+
+    // submit() + receive()
+    bool call(IKRequest& request, IKResponse& response, IKWaitMode mode);
+};
+
+// Futex on a word that may be shared between processes (no FUTEX_PRIVATE_FLAG)
+inline void ik_futex_wait(std::atomic<uint32_t>* word, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+}
+
+inline void ik_futex_wake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+inline void ik_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+template <typename T, uint32_t N>
+bool SpscRing<T, N>::try_push(const T& item) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= N) return false;
+    slots_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    wake();
+    return true;
+}
+
+template <typename T, uint32_t N>
+bool SpscRing<T, N>::try_pop(T& item) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) return false;
+    item = slots_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T, uint32_t N>
+bool SpscRing<T, N>::wait(IKWaitMode mode, const std::atomic<bool>& stop) {
+    uint32_t spins = 0;
+    while (empty()) {
+        if (stop.load(std::memory_order_acquire)) return false;
+        if (mode == IKWaitMode::BUSY_POLL) {
+            // Give the core away now and then in case the other side shares it
+            if (++spins % 4096 == 0) sched_yield();
+            else ik_cpu_relax();
+            continue;
+        }
+        // Announce the sleeper before sampling the futex word: a producer that publishes
+        // after the sample makes FUTEX_WAIT return at once, one that published before it
+        // is visible to the empty() check below.
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t seen = published_.load(std::memory_order_seq_cst);
+        if (empty() && !stop.load(std::memory_order_seq_cst)) ik_futex_wait(&published_, seen);
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+template <typename T, uint32_t N>
+void SpscRing<T, N>::wake() {
+    published_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_seq_cst) != 0) ik_futex_wake(&published_);
+}
+
+#endif // IK_SERVICE_H
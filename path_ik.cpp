@@ -0,0 +1,248 @@
+#include "path_ik.h"
+#include <thread>
+#include <algorithm>
+
+PathIKSolver::PathIKSolver(
+    const WeightedIKSolver& solver,
+    int q7_samples,
+    int segment_length,
+    int n_threads,
+    double max_joint_step
+) : solver_(solver),
+    q7_samples_(q7_samples < 2 ? 2 : q7_samples),
+    segment_length_(segment_length < 1 ? 1 : segment_length),
+    n_threads_(n_threads),
+    max_joint_step_(max_joint_step) {
+
+    if (n_threads_ <= 0) {
+        n_threads_ = (int)std::thread::hardware_concurrency();
+        if (n_threads_ <= 0) n_threads_ = 1;
+    }
+}
+
+void PathIKSolver::generate_nodes(
+    const std::array<double, 3>& position,
+    const std::array<double, 9>& orientation,
+    double q7_min,
+    double q7_max,
+    std::vector<PathNode>& nodes
+) const {
+    bool joint_angles = true;
+    std::array<std::array<double, 7>, 8> qsols;
+    std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
+    IKValidity validity;
+
+    nodes.clear();
+    double step = (q7_max - q7_min) / (q7_samples_ - 1);
+    for (int k = 0; k < q7_samples_; k++) {
+        double q7 = q7_min + k * step;
+        franka_J_ik_q7(position, orientation, q7, Jsols, qsols, validity, joint_angles);
+        // Nodes are the solutions with all joints within limits and out of collision
+        for (unsigned int mask = validity.valid; mask; ) {
+            int i = next_valid_solution(mask);
+            double score = solver_.score_solution(qsols[i], Jsols[i]);
+            if (std::isinf(score)) continue;
+            nodes.push_back(PathNode{ qsols[i], score, i });
+        }
+    }
+}
+
+void PathIKSolver::generate_segment_nodes(
+    const std::vector<std::array<double, 3>>& positions,
+    const std::vector<std::array<double, 9>>& orientations,
+    int first,
+    int last,
+    double q7_min,
+    double q7_max,
+    std::vector<std::vector<PathNode>>& nodes
+) const {
+    int count = last - first;
+    if (parallel_for_) {
+        parallel_for_(count, [&](int begin, int end) {
+            for (int w = begin; w < end; w++) {
+                generate_nodes(positions[first + w], orientations[first + w], q7_min, q7_max, nodes[w]);
+            }
+        });
+        return;
+    }
+    int n_workers = std::min(n_threads_, count);
+
+    // Waypoints are interleaved across workers so uneven IK costs even out
+    auto work = [&](int worker) {
+        for (int w = worker; w < count; w += n_workers) {
+            generate_nodes(positions[first + w], orientations[first + w], q7_min, q7_max, nodes[w]);
+        }
+    };
+
+    if (n_workers <= 1) {
+        work(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (int t = 1; t < n_workers; t++) {
+        threads.emplace_back(work, t);
+    }
+    work(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+int PathIKSolver::run_segment(
+    const std::vector<std::vector<PathNode>>& nodes,
+    int count,
+    const std::vector<PathNode>& entry_nodes,
+    const std::vector<double>& entry_scores,
+    std::vector<std::vector<double>>& scores,
+    std::vector<std::vector<int>>& back
+) const {
+    const double NEG_INF = -std::numeric_limits<double>::infinity();
+
+    for (int w = 0; w < count; w++) {
+        const std::vector<PathNode>& prev_nodes = (w == 0 ? entry_nodes : nodes[w - 1]);
+        const std::vector<double>& prev_scores = (w == 0 ? entry_scores : scores[w - 1]);
+        const std::vector<PathNode>& cur_nodes = nodes[w];
+
+        scores[w].assign(cur_nodes.size(), NEG_INF);
+        back[w].assign(cur_nodes.size(), -1);
+        bool reachable = false;
+
+        for (size_t j = 0; j < cur_nodes.size(); j++) {
+            double best = NEG_INF;
+            int best_prev = -1;
+            for (size_t i = 0; i < prev_nodes.size(); i++) {
+                if (prev_scores[i] == NEG_INF) continue;
+
+                // Reject edges that jump too far in any joint (the move from current_pose is exempt)
+                bool continuous = true;
+                for (int k = 0; k < 7 && prev_nodes[i].solution_index >= 0; k++) {
+                    if (fabs(cur_nodes[j].q[k] - prev_nodes[i].q[k]) > max_joint_step_) {
+                        continuous = false;
+                        break;
+                    }
+                }
+                if (!continuous) continue;
+
+                double candidate = prev_scores[i] - solver_.transition_cost(prev_nodes[i].q, cur_nodes[j].q);
+                if (candidate > best) {
+                    best = candidate;
+                    best_prev = (int)i;
+                }
+            }
+            if (best_prev >= 0) {
+                scores[w][j] = best + cur_nodes[j].score;
+                back[w][j] = best_prev;
+                reachable = true;
+            }
+        }
+
+        if (!reachable) {
+            return w;
+        }
+    }
+    return -1;
+}
+
+PathIKResult PathIKSolver::solve(
+    const std::vector<std::array<double, 3>>& positions,
+    const std::vector<std::array<double, 9>>& orientations,
+    const std::array<double, 7>& current_pose,
+    double q7_min,
+    double q7_max
+) const {
+    PathIKResult result;
+    result.success = false;
+    result.total_score = -std::numeric_limits<double>::infinity();
+    result.max_joint_step = 0.0;
+    result.failed_waypoint = -1;
+    result.nodes_evaluated = 0;
+    result.duration_microseconds = 0;
+
+    auto start = high_resolution_clock::now();
+
+    int n_waypoints = (int)positions.size();
+    if (n_waypoints == 0 || orientations.size() != positions.size()) {
+        return result;
+    }
+
+    int n_segments = (n_waypoints + segment_length_ - 1) / segment_length_;
+
+    // Last waypoint of every segment, used as entry of the next one when backtracking
+    std::vector<std::vector<PathNode>> checkpoint_nodes(n_segments);
+    std::vector<std::vector<double>> checkpoint_scores(n_segments);
+    const std::vector<PathNode> start_nodes = { PathNode{ current_pose, 0.0, -1 } };
+    const std::vector<double> start_scores = { 0.0 };
+
+    // Per-segment working set
+    std::vector<std::vector<PathNode>> nodes(segment_length_);
+    std::vector<std::vector<double>> scores(segment_length_);
+    std::vector<std::vector<int>> back(segment_length_);
+
+    // Forward pass
+    for (int seg = 0; seg < n_segments; seg++) {
+        int first = seg * segment_length_;
+        int last = std::min(n_waypoints, first + segment_length_);
+        int count = last - first;
+
+        generate_segment_nodes(positions, orientations, first, last, q7_min, q7_max, nodes);
+        for (int w = 0; w < count; w++) {
+            result.nodes_evaluated += (long)nodes[w].size();
+        }
+
+        int failed = run_segment(nodes, count,
+                                 seg == 0 ? start_nodes : checkpoint_nodes[seg - 1],
+                                 seg == 0 ? start_scores : checkpoint_scores[seg - 1],
+                                 scores, back);
+        if (failed >= 0) {
+            result.failed_waypoint = first + failed;
+            result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+            return result;
+        }
+
+        checkpoint_nodes[seg] = nodes[count - 1];
+        checkpoint_scores[seg] = scores[count - 1];
+    }
+
+    // Best final node
+    const std::vector<double>& final_scores = checkpoint_scores[n_segments - 1];
+    int j = (int)(std::max_element(final_scores.begin(), final_scores.end()) - final_scores.begin());
+    result.total_score = final_scores[j];
+
+    // Backward pass, recomputing every segment but the last one which is still in memory
+    result.joint_angles.resize(n_waypoints);
+    result.solution_indices.resize(n_waypoints);
+    for (int seg = n_segments - 1; seg >= 0; seg--) {
+        int first = seg * segment_length_;
+        int last = std::min(n_waypoints, first + segment_length_);
+        int count = last - first;
+
+        if (seg != n_segments - 1) {
+            generate_segment_nodes(positions, orientations, first, last, q7_min, q7_max, nodes);
+            for (int w = 0; w < count; w++) {
+                result.nodes_evaluated += (long)nodes[w].size();
+            }
+            run_segment(nodes, count,
+                        seg == 0 ? start_nodes : checkpoint_nodes[seg - 1],
+                        seg == 0 ? start_scores : checkpoint_scores[seg - 1],
+                        scores, back);
+        }
+
+        for (int w = count - 1; w >= 0; w--) {
+            result.joint_angles[first + w] = nodes[w][j].q;
+            result.solution_indices[first + w] = nodes[w][j].solution_index;
+            j = back[w][j];
+        }
+    }
+
+    // Continuity of the chosen sequence
+    for (int w = 1; w < n_waypoints; w++) {
+        for (int k = 0; k < 7; k++) {
+            double step = fabs(result.joint_angles[w][k] - result.joint_angles[w - 1][k]);
+            if (step > result.max_joint_step) result.max_joint_step = step;
+        }
+    }
+
+    result.success = true;
+    result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    return result;
+}
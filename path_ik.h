@@ -0,0 +1,102 @@
+#ifndef PATH_IK_H
+#define PATH_IK_H
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <functional>
+#include "weighted_ik.h"
+
+// Structure to hold the result of a whole-path IK solve
+struct PathIKResult {
+    bool success;
+    std::vector<std::array<double, 7>> joint_angles;  // One configuration per waypoint
+    std::vector<int> solution_indices;                // IK branch (0-7) chosen at each waypoint
+    double total_score;        // Sum of node scores minus transition costs
+    double max_joint_step;     // Largest single-joint change between consecutive waypoints
+    int failed_waypoint;       // First waypoint with no feasible candidate, -1 if none
+
+    long nodes_evaluated;      // Candidates scored (both passes)
+    long duration_microseconds;
+};
+
+// Parallel loop of the candidate generation, see IKParallelFor in weighted_ik.h
+using PathParallelFor = IKParallelFor;
+
+// Candidate configuration of one waypoint
+struct PathNode {
+    std::array<double, 7> q;
+    double score;        // Weighted score without the current-pose term
+    int solution_index;  // Index in the qsols array returned by franka_J_ik_q7, -1 for current_pose
+};
+
+// Whole-trajectory IK: samples q7 at every waypoint, scores the candidates with the
+// weighted objective and picks the best continuous sequence by dynamic programming.
+// Edges are charged with WeightedIKSolver::transition_cost, so weight_current acts
+// as the smoothness weight along the path and as the cost of leaving current_pose.
+class PathIKSolver {
+private:
+    const WeightedIKSolver& solver_;
+    int q7_samples_;
+    int segment_length_;     // Waypoints between DP checkpoints
+    int n_threads_;
+    double max_joint_step_;  // Edges between waypoints with a larger single-joint change are not allowed
+    PathParallelFor parallel_for_;  // Generates the candidates instead of the per-segment threads if set
+
+    // Candidates of one waypoint, sorted by q7 sample then branch
+    void generate_nodes(
+        const std::array<double, 3>& position,
+        const std::array<double, 9>& orientation,
+        double q7_min,
+        double q7_max,
+        std::vector<PathNode>& nodes
+    ) const;
+
+    // Candidates of waypoints [first, last) computed on the worker threads
+    void generate_segment_nodes(
+        const std::vector<std::array<double, 3>>& positions,
+        const std::vector<std::array<double, 9>>& orientations,
+        int first,
+        int last,
+        double q7_min,
+        double q7_max,
+        std::vector<std::vector<PathNode>>& nodes
+    ) const;
+
+    // Viterbi recursion over one segment. entry_nodes/entry_scores describe the waypoint
+    // preceding the segment (a single node holding current_pose for the first segment).
+    // Returns the first waypoint of the segment without a reachable candidate, -1 if none.
+    int run_segment(
+        const std::vector<std::vector<PathNode>>& nodes,
+        int count,
+        const std::vector<PathNode>& entry_nodes,
+        const std::vector<double>& entry_scores,
+        std::vector<std::vector<double>>& scores,
+        std::vector<std::vector<int>>& back
+    ) const;
+
+public:
+    PathIKSolver(
+        const WeightedIKSolver& solver,
+        int q7_samples = 32,
+        int segment_length = 256,
+        int n_threads = 0,  // 0 = std::thread::hardware_concurrency()
+        double max_joint_step = std::numeric_limits<double>::infinity()
+    );
+
+    // Generate candidates with parallel_for (e.g. IKJobPool::parallel_for) instead of starting
+    // n_threads threads per segment. An empty function restores the threads.
+    void set_parallel_for(PathParallelFor parallel_for) { parallel_for_ = std::move(parallel_for); }
+
+    // Memory is bounded by the segment length: only the last waypoint of each segment is
+    // kept after the forward pass, and segments are recomputed while backtracking.
+    PathIKResult solve(
+        const std::vector<std::array<double, 3>>& positions,
+        const std::vector<std::array<double, 9>>& orientations,
+        const std::array<double, 7>& current_pose,
+        double q7_min,
+        double q7_max
+    ) const;
+};
+
+#endif // PATH_IK_H
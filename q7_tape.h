@@ -0,0 +1,71 @@
+#ifndef Q7_TAPE_H
+#define Q7_TAPE_H
+
+#include <array>
+#include <vector>
+
+// Valid IK solution recorded at one q7 sample
+struct Q7TapeRecord {
+    std::array<double, 7> q;
+    double manipulability;
+    double q7;   // Sample that produced it
+    int branch;  // Its solution index in franka_J_ik_q7 (0-7), or its branch on a restricted tape
+    double clearance;  // CollisionModel::clearance() of the solver's model, NaN without one
+};
+
+// Objectives of one record for a neutral and a current pose (see WeightedIKSolver::q7_pareto_front())
+struct Q7TapeObjectives {
+    double manipulability;    // Maximized
+    double neutral_distance;  // Minimized
+    double current_distance;  // Minimized
+    int record;               // Index in Q7SampleTape::records
+};
+
+// Valid solutions of a q7 grid sweep of one target, in sweep order (see
+// WeightedIKSolver::record_q7_tape()). Nothing in it depends on the weights, the neutral pose or
+// the current pose, so the solver can re-score it under new ones without solving the IK again.
+// clear() keeps the capacity of records, and a recording reserves room for 8 records per sample
+// (1 on a restricted sweep) before it starts: once reserve() has covered the largest sweep,
+// recording does not allocate.
+// Header-only, so WeightedIKSolver users need no extra translation unit.
+class Q7SampleTape {
+public:
+    // Sweep that was recorded
+    std::array<double, 3> position;
+    std::array<double, 9> orientation;
+    double q7_start = 0.0, q7_end = 0.0, step_size = 0.0;
+    int branch = -1;  // Branch the sweep was restricted to, -1 for all (see WeightedIKSolver::set_branch())
+    bool recorded = false;
+
+    std::vector<Q7TapeRecord> records;
+    int n_samples = 0;              // q7 values swept
+    int total_solutions_found = 0;  // Before the joint-limit screen
+
+    // True if this tape holds the sweep of exactly this target, range and branch
+    bool matches(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        double start,
+        double end,
+        double step,
+        int sweep_branch = -1
+    ) const {
+        return recorded && position == target_position && orientation == target_orientation
+               && q7_start == start && q7_end == end && step_size == step && branch == sweep_branch;
+    }
+
+    // Room for every valid solution of a sweep of n_samples q7 values (8 per sample, or 1 when
+    // restricted to a branch)
+    void reserve(int n_samples, bool one_branch = false) {
+        records.reserve((size_t)n_samples * (one_branch ? 1 : 8));
+    }
+
+    void clear() {
+        records.clear();
+        n_samples = 0;
+        total_solutions_found = 0;
+        recorded = false;
+    }
+};
+
+#endif // Q7_TAPE_H
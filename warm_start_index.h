@@ -0,0 +1,244 @@
+#ifndef WARM_START_INDEX_H
+#define WARM_START_INDEX_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <shared_mutex>
+#include <mutex>
+#include <cmath>
+#include <algorithm>
+
+// Free variable of a stored solve (same values as RedundancyParam in weighted_ik.h)
+enum class RedundancyParam;
+
+struct WarmStartIndexConfig {
+    size_t capacity = 4096;          // Stored solutions; the oldest is evicted once full
+    double match_radius = 0.05;      // Largest pose distance that still counts as a hit
+    double orientation_scale = 0.1;  // Metres per radian of orientation difference in the pose distance
+};
+
+// Stored solution returned by WarmStartIndex::nearest()
+struct WarmStartHit {
+    double free_variable;  // Optimal value of the free variable of the stored solve
+    double q7;             // Its q7
+    int branch;            // Its solution index in franka_J_ik_* (0-7)
+    double score;
+    double distance;       // Pose distance from the query
+};
+
+// Bounded nearest-neighbour store of solved poses, used to seed the Brent bracket of later
+// solves of nearby targets (see WeightedIKSolver::set_warm_start_index()).
+//
+// Poses are compared by sqrt(|dp|^2 + (s * theta)^2), with theta approximated from the
+// Frobenius distance of the rotations and s = orientation_scale. Entries are hashed on a grid of
+// match_radius cells by position, so a query only looks at the 27 cells around it. Storage is
+// allocated once in the constructor and recycled in insertion order (FIFO eviction).
+// nearest() may run concurrently from any number of threads; insert() takes the lock exclusively.
+// Header-only, so WeightedIKSolver users need no extra translation unit.
+class WarmStartIndex {
+private:
+    struct Entry {
+        std::array<double, 3> position;
+        std::array<double, 9> orientation;
+        std::array<int32_t, 3> cell;
+        RedundancyParam param;
+        WarmStartHit hit;
+        int32_t next;  // Next entry in the same bucket, -1 at the end
+        bool used;
+    };
+
+    WarmStartIndexConfig config_;
+    std::vector<Entry> entries_;
+    std::vector<int32_t> buckets_;  // First entry of each hash bucket, -1 if empty
+    size_t bucket_mask_;
+    size_t next_slot_;              // Slot the next insert() overwrites
+    size_t size_;
+    mutable std::shared_mutex mutex_;
+
+    std::array<int32_t, 3> cell_of(const std::array<double, 3>& position) const;
+    size_t bucket_of(const std::array<int32_t, 3>& cell) const;
+    void unlink(int32_t slot);
+
+public:
+    explicit WarmStartIndex(const WarmStartIndexConfig& config = WarmStartIndexConfig());
+    WarmStartIndex(const WarmStartIndex&) = delete;
+    WarmStartIndex& operator=(const WarmStartIndex&) = delete;
+
+    // Stores a solved pose, evicting the oldest entry if the index is full
+    void insert(
+        RedundancyParam param,
+        const std::array<double, 3>& position,
+        const std::array<double, 9>& orientation,
+        double free_variable,
+        double q7,
+        int branch,
+        double score
+    );
+
+    // Closest stored solve of the same free variable within match_radius.
+    // Returns false if there is none.
+    bool nearest(
+        RedundancyParam param,
+        const std::array<double, 3>& position,
+        const std::array<double, 9>& orientation,
+        WarmStartHit& hit
+    ) const;
+
+    // Pose distance used by nearest()
+    double distance(
+        const std::array<double, 3>& p1, const std::array<double, 9>& R1,
+        const std::array<double, 3>& p2, const std::array<double, 9>& R2
+    ) const;
+
+    void clear();
+    size_t size() const;
+    const WarmStartIndexConfig& config() const { return config_; }
+};
+
+inline WarmStartIndex::WarmStartIndex(const WarmStartIndexConfig& config)
+    : config_(config),
+      next_slot_(0),
+      size_(0) {
+    if (config_.capacity < 1) config_.capacity = 1;
+    if (!(config_.match_radius > 0.0)) config_.match_radius = WarmStartIndexConfig().match_radius;
+    entries_.resize(config_.capacity);
+    for (auto& entry : entries_) entry.used = false;
+
+    // Power of two with room for every entry in its own bucket
+    size_t n_buckets = 16;
+    while (n_buckets < 2 * config_.capacity) n_buckets *= 2;
+    buckets_.assign(n_buckets, -1);
+    bucket_mask_ = n_buckets - 1;
+}
+
+inline std::array<int32_t, 3> WarmStartIndex::cell_of(const std::array<double, 3>& position) const {
+    std::array<int32_t, 3> cell;
+    for (int axis = 0; axis < 3; axis++) {
+        cell[axis] = (int32_t)floor(position[axis] / config_.match_radius);
+    }
+    return cell;
+}
+
+inline size_t WarmStartIndex::bucket_of(const std::array<int32_t, 3>& cell) const {
+    uint64_t h = (uint64_t)(uint32_t)cell[0] * 73856093u ^ (uint64_t)(uint32_t)cell[1] * 19349663u
+               ^ (uint64_t)(uint32_t)cell[2] * 83492791u;
+    return (size_t)(h ^ (h >> 17)) & bucket_mask_;
+}
+
+inline void WarmStartIndex::unlink(int32_t slot) {
+    int32_t* link = &buckets_[bucket_of(entries_[slot].cell)];
+    while (*link != -1) {
+        if (*link == slot) {
+            *link = entries_[slot].next;
+            return;
+        }
+        link = &entries_[*link].next;
+    }
+}
+
+inline double WarmStartIndex::distance(
+    const std::array<double, 3>& p1, const std::array<double, 9>& R1,
+    const std::array<double, 3>& p2, const std::array<double, 9>& R2
+) const {
+    double dp2 = 0.0;
+    for (int i = 0; i < 3; i++) {
+        double d = p1[i] - p2[i];
+        dp2 += d * d;
+    }
+    // |R1 - R2|_F^2 = 4 (1 - cos(theta)), which is 2 theta^2 for small angles
+    double dR2 = 0.0;
+    for (int i = 0; i < 9; i++) {
+        double d = R1[i] - R2[i];
+        dR2 += d * d;
+    }
+    double s = config_.orientation_scale;
+    return sqrt(dp2 + 0.5 * s * s * dR2);
+}
+
+inline void WarmStartIndex::insert(
+    RedundancyParam param,
+    const std::array<double, 3>& position,
+    const std::array<double, 9>& orientation,
+    double free_variable,
+    double q7,
+    int branch,
+    double score
+) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    int32_t slot = (int32_t)next_slot_;
+    next_slot_ = (next_slot_ + 1) % config_.capacity;
+    Entry& entry = entries_[slot];
+    if (entry.used) {
+        unlink(slot);  // Evict the oldest entry
+    } else {
+        size_++;
+    }
+
+    entry.position = position;
+    entry.orientation = orientation;
+    entry.cell = cell_of(position);
+    entry.param = param;
+    entry.hit.free_variable = free_variable;
+    entry.hit.q7 = q7;
+    entry.hit.branch = branch;
+    entry.hit.score = score;
+    entry.hit.distance = 0.0;
+    entry.used = true;
+
+    int32_t& head = buckets_[bucket_of(entry.cell)];
+    entry.next = head;
+    head = slot;
+}
+
+inline bool WarmStartIndex::nearest(
+    RedundancyParam param,
+    const std::array<double, 3>& position,
+    const std::array<double, 9>& orientation,
+    WarmStartHit& hit
+) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    // Any entry within match_radius lies in one of the 27 cells around the query
+    std::array<int32_t, 3> center = cell_of(position);
+    double best_distance = config_.match_radius;
+    int32_t best = -1;
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                std::array<int32_t, 3> cell = { center[0] + dx, center[1] + dy, center[2] + dz };
+                for (int32_t slot = buckets_[bucket_of(cell)]; slot != -1; slot = entries_[slot].next) {
+                    const Entry& entry = entries_[slot];
+                    // Buckets are shared by hash collisions, skip entries of other cells
+                    if (entry.cell != cell || entry.param != param) continue;
+                    double d = distance(position, orientation, entry.position, entry.orientation);
+                    if (d <= best_distance) {
+                        best_distance = d;
+                        best = slot;
+                    }
+                }
+            }
+        }
+    }
+    if (best < 0) return false;
+
+    hit = entries_[best].hit;
+    hit.distance = best_distance;
+    return true;
+}
+
+inline void WarmStartIndex::clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (auto& entry : entries_) entry.used = false;
+    std::fill(buckets_.begin(), buckets_.end(), -1);
+    next_slot_ = 0;
+    size_ = 0;
+}
+
+inline size_t WarmStartIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return size_;
+}
+
+#endif // WARM_START_INDEX_H
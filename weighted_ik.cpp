@@ -1,4 +1,7 @@
 #include "weighted_ik.h"
+#include <algorithm>
+#include <vector>
+#include <thread>
 
 // Constructor - only robot-specific parameters
 WeightedIKSolver::WeightedIKSolver(
@@ -11,29 +14,46 @@ WeightedIKSolver::WeightedIKSolver(
     weight_manip_(weight_manip),
     weight_neutral_(weight_neutral),
     weight_current_(weight_current),
-    verbose_(verbose) {
+    verbose_(verbose),
+    workspace_map_(nullptr),
+    warm_start_index_(nullptr),
+    warm_start_window_(0.3),
+    warm_start_record_(true),
+    q7_tape_(nullptr),
+    branch_(-1),
+    collision_model_(nullptr),
+    collision_margin_(0.0),
+    collision_weight_(0.0),
+    collision_influence_(0.05) {
     
     // Pre-compute normalization factor
     normalization_factor_ = 7.0 * 6.28;
 }
 
-double WeightedIKSolver::calculate_manipulability(const std::array<std::array<double, 6>, 7>& J) const {
-    // Convert array to Eigen matrix
-    Eigen::MatrixXd jacobian(6, 7);
-    for (int i = 0; i < 6; i++) {
-        for (int j = 0; j < 7; j++) {
-            jacobian(i, j) = J[j][i];
-        }
-    }
+// Yoshikawa manipulability of a 6x7 Jacobian stored column-major (J^T row by row)
+static double manipulability_of(const double* J) {
+    // Map it without copying; fixed-size types keep this free of heap allocations.
+    Eigen::Map<const Eigen::Matrix<double, 6, 7>> jacobian(J);
     
     // Calculate manipulability as sqrt(det(J * J^T))
-    Eigen::MatrixXd JJT = jacobian * jacobian.transpose();
+    Eigen::Matrix<double, 6, 6> JJT = jacobian * jacobian.transpose();
     double det = JJT.determinant();
     
     return (det >= 0) ? sqrt(det) : 0.0;
 }
 
-double WeightedIKSolver::calculate_distance(const std::array<double, 7>& q1, const std::array<double, 7>& q2) const {
+double WeightedIKSolver::calculate_manipulability(const std::array<std::array<double, 6>, 7>& J) const {
+    // J holds J^T row by row, which is J in column-major order
+    static_assert(sizeof(J) == 42 * sizeof(double), "Jacobian rows must be contiguous");
+    return manipulability_of(J[0].data());
+}
+
+double WeightedIKSolver::calculate_manipulability(const IKSolutionSet& sols, unsigned int k) const {
+    if (sols.has_manipulability) return sols.manipulability[k];
+    return manipulability_of(sols.J[k].data());
+}
+
+double WeightedIKSolver::calculate_distance(const double* q1, const double* q2) const {
     double distance = 0.0;
     for (int j = 0; j < 7; j++) {
         double diff = q1[j] - q2[j];
@@ -42,6 +62,14 @@ double WeightedIKSolver::calculate_distance(const std::array<double, 7>& q1, con
     return sqrt(distance);
 }
 
+// Copies joint angles, Jacobian and branch of solution k into a result
+static void store_solution(const IKSolutionSet& sols, unsigned int k, WeightedIKResult& result) {
+    std::copy_n(sols.q[k].begin(), 7, result.joint_angles.begin());
+    std::copy_n(sols.J[k].begin(), 42, result.jacobian[0].begin());
+    result.q7_optimal = sols.q[k][6];
+    result.solution_index = sols.branch[k];
+}
+
 double WeightedIKSolver::compute_score(double manipulability, double neutral_dist, double current_dist) const {
     double normalized_neutral_dist = neutral_dist / normalization_factor_;
     double normalized_current_dist = current_dist / normalization_factor_;
@@ -51,6 +79,49 @@ double WeightedIKSolver::compute_score(double manipulability, double neutral_dis
          - weight_current_ * normalized_current_dist;
 }
 
+double WeightedIKSolver::collision_cost(double clearance) const {
+    if (!collision_model_) return 0.0;
+    if (!(clearance >= collision_margin_)) return std::numeric_limits<double>::infinity();
+    return collision_weight_ * std::max(0.0, 1.0 - (clearance - collision_margin_) / collision_influence_);
+}
+
+unsigned int WeightedIKSolver::screen_collisions(IKSolutionSet& sols, std::array<double, 8>& clearances) const {
+    if (!collision_model_) {
+        clearances.fill(std::numeric_limits<double>::quiet_NaN());
+        return sols.count;
+    }
+    // All solutions of the call in one batch, then compact the ones that are clear
+    std::array<double, 8> all;
+    collision_model_->clearances(sols.q[0].data(), sols.count, sols.q[0].size(), all.data());
+    unsigned int kept = 0;
+    for (unsigned int k = 0; k < sols.count; k++) {
+        if (!(all[k] >= collision_margin_)) continue;
+        if (kept != k) {
+            sols.q[kept] = sols.q[k];
+            if (sols.has_jacobians) sols.J[kept] = sols.J[k];
+            if (sols.has_manipulability) sols.manipulability[kept] = sols.manipulability[k];
+            sols.branch[kept] = sols.branch[k];
+        }
+        clearances[kept++] = all[k];
+    }
+    sols.count = kept;
+    return kept;
+}
+
+double WeightedIKSolver::score_solution(
+    const std::array<double, 7>& q,
+    const std::array<std::array<double, 6>, 7>& J
+) const {
+    double cost = collision_model_ ? collision_cost(collision_model_->clearance(q)) : 0.0;
+    return weight_manip_ * calculate_manipulability(J)
+         - weight_neutral_ * calculate_distance(q.data(), neutral_pose_.data()) / normalization_factor_
+         - cost;
+}
+
+double WeightedIKSolver::transition_cost(const std::array<double, 7>& q_from, const std::array<double, 7>& q_to) const {
+    return weight_current_ * calculate_distance(q_from.data(), q_to.data()) / normalization_factor_;
+}
+
 WeightedIKResult WeightedIKSolver::solve_q7(
     const std::array<double, 3>& target_position,
     const std::array<double, 9>& target_orientation,
@@ -59,18 +130,34 @@ WeightedIKResult WeightedIKSolver::solve_q7(
     double q7_end,
     double step_size
 ) {
+    if (q7_tape_) {
+        // Re-score the recorded sweep, recording it first if it is of another target or range
+        auto start = high_resolution_clock::now();
+        if (!q7_tape_->matches(target_position, target_orientation, q7_start, q7_end, step_size, branch_)) {
+            record_q7_tape(target_position, target_orientation, q7_start, q7_end, step_size, *q7_tape_);
+        }
+        WeightedIKResult result = solve_q7(*q7_tape_, current_pose);
+        result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        return result;
+    }
+    
     WeightedIKResult result;
     result.success = false;
     result.score = -std::numeric_limits<double>::infinity();
     result.total_solutions_found = 0;
     result.valid_solutions_count = 0;
-    result.q7_values_tested = (int)((q7_end - q7_start) / step_size) + 1;
+    // Pose-only terms are computed once for the whole sweep
+    PreparedTarget target;
+    prepare_target(target_position, target_orientation, target);
+    Q7Sweep sweep(target, q7_start, q7_end, step_size);
+    result.q7_values_tested = sweep.size();
     
     // Variables for IK solving
     unsigned int nsols = 0;
     bool joint_angles = true;
     std::array<std::array<double, 7>, 8> qsols;
     std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
+    IKValidity validity;
     
     if (verbose_) {
         cout << endl << "=======================================================" << endl;
@@ -85,42 +172,48 @@ WeightedIKResult WeightedIKSolver::solve_q7(
     auto start = high_resolution_clock::now();
     
     // Sweep through q7 values
-    for (double q7_sweep = q7_start; q7_sweep <= q7_end; q7_sweep += step_size) {
-        nsols = franka_J_ik_q7(target_position, target_orientation, q7_sweep, Jsols, qsols, joint_angles);
+    for (; !sweep.done(); sweep.next()) {
+        double q7_sweep = sweep.q7();
+        if (branch_ >= 0) {
+            // Only the solution of the branch, in slot 0
+            bool valid;
+            nsols = sweep.J_ik_branch(branch_, Jsols[0], qsols[0], valid);
+            validity.valid = valid ? 1u : 0u;
+        }
+        else {
+            nsols = sweep.J_ik(Jsols, qsols, validity, joint_angles);
+        }
         result.total_solutions_found += nsols;
         
-        // Check each solution for this q7 value
-        for (int i = 0; i < nsols; i++) {
-            // Check if solution is valid (all joints within limits)
-            bool valid_solution = true;
-            for (int j = 0; j < 7; j++) {
-                if (isnan(qsols[i][j])) {
-                    valid_solution = false;
-                    break;
-                }
-            }
+        // Visit the solutions with all joints within limits
+        for (unsigned int mask = validity.valid; mask; ) {
+            int i = next_valid_solution(mask);
             
-            if (valid_solution) {
-                result.valid_solutions_count++;
-                
-                // Calculate metrics using current_pose parameter
-                double manipulability = calculate_manipulability(Jsols[i]);
-                double neutral_distance = calculate_distance(qsols[i], neutral_pose_);
-                double current_distance = calculate_distance(qsols[i], current_pose);
-                double score = compute_score(manipulability, neutral_distance, current_distance);
-                
-                // Update best solution if this one is better
-                if (score > result.score) {
-                    result.success = true;
-                    result.score = score;
-                    result.manipulability = manipulability;
-                    result.neutral_distance = neutral_distance;
-                    result.current_distance = current_distance;
-                    result.q7_optimal = q7_sweep;
-                    result.joint_angles = qsols[i];
-                    result.jacobian = Jsols[i];
-                    result.solution_index = i;
-                }
+            // Collision screen first, the other metrics only for clear solutions
+            double clearance = collision_model_ ? collision_model_->clearance(qsols[i]) : std::numeric_limits<double>::quiet_NaN();
+            double cost = collision_cost(clearance);
+            if (std::isinf(cost)) continue;
+            result.valid_solutions_count++;
+            
+            // Calculate metrics using current_pose parameter
+            double manipulability = calculate_manipulability(Jsols[i]);
+            double neutral_distance = calculate_distance(qsols[i].data(), neutral_pose_.data());
+            double current_distance = calculate_distance(qsols[i].data(), current_pose.data());
+            double score = compute_score(manipulability, neutral_distance, current_distance) - cost;
+            
+            // Update best solution if this one is better
+            if (score > result.score) {
+                result.success = true;
+                result.score = score;
+                result.manipulability = manipulability;
+                result.neutral_distance = neutral_distance;
+                result.current_distance = current_distance;
+                result.q7_optimal = q7_sweep;
+                result.free_variable_optimal = q7_sweep;
+                result.joint_angles = qsols[i];
+                result.jacobian = Jsols[i];
+                result.solution_index = branch_ >= 0 ? branch_ : i;
+                result.clearance = clearance;
             }
         }
     }
@@ -136,6 +229,197 @@ WeightedIKResult WeightedIKSolver::solve_q7(
     return result;
 }
 
+void WeightedIKSolver::record_q7_tape(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    double q7_start,
+    double q7_end,
+    double step_size,
+    Q7SampleTape& tape
+) const {
+    tape.clear();
+    PreparedTarget target;
+    prepare_target(target_position, target_orientation, target);
+    Q7Sweep sweep(target, q7_start, q7_end, step_size);
+    tape.n_samples = sweep.size();
+    // At most one reallocation, none once the tape has been reserved for the sweep
+    tape.reserve(tape.n_samples, branch_ >= 0);
+    
+    // Same solutions and manipulabilities as the sweep of solve_q7, so re-scoring matches it exactly.
+    // Solutions in collision are kept with their clearance, the margin is applied when scoring.
+    auto clearance_of = [&](const std::array<double, 7>& q) {
+        return collision_model_ ? collision_model_->clearance(q) : std::numeric_limits<double>::quiet_NaN();
+    };
+    std::array<std::array<double, 7>, 8> qsols;
+    std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
+    IKValidity validity;
+    for (; !sweep.done(); sweep.next()) {
+        if (branch_ >= 0) {
+            bool valid;
+            tape.total_solutions_found += sweep.J_ik_branch(branch_, Jsols[0], qsols[0], valid);
+            if (valid) tape.records.push_back({ qsols[0], calculate_manipulability(Jsols[0]), sweep.q7(), branch_, clearance_of(qsols[0]) });
+            continue;
+        }
+        tape.total_solutions_found += sweep.J_ik(Jsols, qsols, validity, true);
+        for (unsigned int mask = validity.valid; mask; ) {
+            int i = next_valid_solution(mask);
+            tape.records.push_back({ qsols[i], calculate_manipulability(Jsols[i]), sweep.q7(), i, clearance_of(qsols[i]) });
+        }
+    }
+    
+    tape.position = target_position;
+    tape.orientation = target_orientation;
+    tape.q7_start = q7_start;
+    tape.q7_end = q7_end;
+    tape.step_size = step_size;
+    tape.branch = branch_;
+    tape.recorded = true;
+}
+
+// Fills result with record r of the tape, solving the IK at its q7 once for the Jacobian
+static void store_record(const Q7SampleTape& tape, int r, WeightedIKResult& result) {
+    const Q7TapeRecord& record = tape.records[r];
+    result.success = true;
+    result.joint_angles = record.q;
+    result.q7_optimal = record.q7;
+    result.free_variable_optimal = record.q7;
+    result.solution_index = record.branch;
+    result.clearance = record.clearance;
+    if (tape.branch >= 0) {
+        std::array<double, 7> q;
+        franka_J_ik_q7_branch(tape.position, tape.orientation, record.q7, tape.branch, result.jacobian, q);
+        return;
+    }
+    std::array<std::array<double, 7>, 8> qsols;
+    std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
+    franka_J_ik_q7(tape.position, tape.orientation, record.q7, Jsols, qsols);
+    result.jacobian = Jsols[record.branch];
+}
+
+WeightedIKResult WeightedIKSolver::solve_q7(const Q7SampleTape& tape, const std::array<double, 7>& current_pose) const {
+    auto start = high_resolution_clock::now();
+    WeightedIKResult result;
+    result.success = false;
+    result.score = -std::numeric_limits<double>::infinity();
+    result.total_solutions_found = tape.total_solutions_found;
+    result.valid_solutions_count = (int)tape.records.size();
+    result.q7_values_tested = tape.n_samples;
+    
+    int best = -1;
+    for (size_t r = 0; r < tape.records.size(); r++) {
+        const Q7TapeRecord& record = tape.records[r];
+        double cost = collision_cost(record.clearance);
+        if (std::isinf(cost)) {
+            result.valid_solutions_count--;
+            continue;
+        }
+        double neutral_distance = calculate_distance(record.q.data(), neutral_pose_.data());
+        double current_distance = calculate_distance(record.q.data(), current_pose.data());
+        double score = compute_score(record.manipulability, neutral_distance, current_distance) - cost;
+        if (score > result.score) {
+            result.score = score;
+            result.manipulability = record.manipulability;
+            result.neutral_distance = neutral_distance;
+            result.current_distance = current_distance;
+            best = (int)r;
+        }
+    }
+    if (best >= 0) store_record(tape, best, result);
+    
+    result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    if (verbose_) {
+        print_weighted_ik_results(result);
+    }
+    return result;
+}
+
+void WeightedIKSolver::solve_q7_weight_sweep(
+    const Q7SampleTape& tape,
+    const std::array<double, 7>& current_pose,
+    const std::vector<std::array<double, 3>>& weights,
+    std::vector<WeightedIKResult>& results
+) const {
+    auto start = high_resolution_clock::now();
+    results.resize(weights.size());
+    std::vector<int> best(weights.size(), -1);
+    for (WeightedIKResult& result : results) {
+        result = WeightedIKResult();
+        result.success = false;
+        result.score = -std::numeric_limits<double>::infinity();
+        result.total_solutions_found = tape.total_solutions_found;
+        result.valid_solutions_count = (int)tape.records.size();
+        result.q7_values_tested = tape.n_samples;
+    }
+    
+    for (size_t r = 0; r < tape.records.size(); r++) {
+        const Q7TapeRecord& record = tape.records[r];
+        double cost = collision_cost(record.clearance);
+        if (std::isinf(cost)) {
+            for (WeightedIKResult& result : results) result.valid_solutions_count--;
+            continue;
+        }
+        double neutral_distance = calculate_distance(record.q.data(), neutral_pose_.data());
+        double current_distance = calculate_distance(record.q.data(), current_pose.data());
+        // Normalized as in compute_score()
+        double normalized_neutral_dist = neutral_distance / normalization_factor_;
+        double normalized_current_dist = current_distance / normalization_factor_;
+        for (size_t w = 0; w < weights.size(); w++) {
+            double score = weights[w][0] * record.manipulability
+                         - weights[w][1] * normalized_neutral_dist
+                         - weights[w][2] * normalized_current_dist
+                         - cost;
+            if (score > results[w].score) {
+                results[w].score = score;
+                results[w].manipulability = record.manipulability;
+                results[w].neutral_distance = neutral_distance;
+                results[w].current_distance = current_distance;
+                best[w] = (int)r;
+            }
+        }
+    }
+    
+    for (size_t w = 0; w < weights.size(); w++) {
+        if (best[w] >= 0) store_record(tape, best[w], results[w]);
+    }
+    long duration = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    for (WeightedIKResult& result : results) result.duration_microseconds = duration;
+}
+
+void WeightedIKSolver::q7_pareto_front(
+    const Q7SampleTape& tape,
+    const std::array<double, 7>& current_pose,
+    std::vector<Q7TapeObjectives>& front
+) const {
+    std::vector<Q7TapeObjectives> candidates;
+    candidates.reserve(tape.records.size());
+    for (size_t r = 0; r < tape.records.size(); r++) {
+        const Q7TapeRecord& record = tape.records[r];
+        if (std::isinf(collision_cost(record.clearance))) continue;
+        candidates.push_back({ record.manipulability,
+                               calculate_distance(record.q.data(), neutral_pose_.data()),
+                               calculate_distance(record.q.data(), current_pose.data()),
+                               (int)r });
+    }
+    // By decreasing manipulability, so a record can only be beaten by one already on the front;
+    // of equal records the first is kept
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Q7TapeObjectives& a, const Q7TapeObjectives& b) {
+        if (a.manipulability != b.manipulability) return a.manipulability > b.manipulability;
+        if (a.neutral_distance != b.neutral_distance) return a.neutral_distance < b.neutral_distance;
+        return a.current_distance < b.current_distance;
+    });
+    front.clear();
+    for (const Q7TapeObjectives& candidate : candidates) {
+        bool dominated = false;
+        for (const Q7TapeObjectives& kept : front) {
+            if (kept.neutral_distance <= candidate.neutral_distance && kept.current_distance <= candidate.current_distance) {
+                dominated = true;
+                break;
+            }
+        }
+        if (!dominated) front.push_back(candidate);
+    }
+}
+
 void WeightedIKSolver::update_weights(double weight_manip, double weight_neutral, double weight_current) {
     weight_manip_ = weight_manip;
     weight_neutral_ = weight_neutral;
@@ -146,60 +430,147 @@ void WeightedIKSolver::update_neutral_pose(const std::array<double, 7>& neutral_
     neutral_pose_ = neutral_pose;
 }
 
-double WeightedIKSolver::evaluate_q7_cost(
-    double q7,
-    const std::array<double, 3>& target_position,
-    const std::array<double, 9>& target_orientation,
-    const std::array<double, 7>& current_pose
+const char* redundancy_param_name(RedundancyParam param) {
+    switch (param) {
+        case RedundancyParam::Q4: return "Q4";
+        case RedundancyParam::Q6: return "Q6";
+        case RedundancyParam::SWIVEL: return "Swivel";
+        default: return "Q7";
+    }
+}
+
+void redundancy_param_limits(RedundancyParam param, double& lower, double& upper) {
+    switch (param) {
+        case RedundancyParam::Q4: lower = q_low[3]; upper = q_up[3]; break;
+        case RedundancyParam::Q6: lower = q_low[5]; upper = q_up[5]; break;
+        case RedundancyParam::SWIVEL: lower = -PI; upper = PI; break;
+        default: lower = q_low[6]; upper = q_up[6]; break;
+    }
+}
+
+unsigned int WeightedIKSolver::solve_ik(
+    RedundancyParam param,
+    double value,
+    const PreparedTarget& target,
+    IKSolutionSet& sols,
+    std::array<double, 8>& clearances,
+    bool jacobians
 ) const {
-    // Variables for IK solving
-    unsigned int nsols = 0;
-    bool joint_angles = true;
-    std::array<std::array<double, 7>, 8> qsols;
-    std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
-    
-    // Solve IK for this q7 value
-    nsols = franka_J_ik_q7(target_position, target_orientation, q7, Jsols, qsols, joint_angles);
-    
-    if (nsols == 0) {
-        // No solutions found for this q7
-        return -std::numeric_limits<double>::infinity();
+    switch (param) {
+        case RedundancyParam::Q4:
+            franka_ik_q4_compact(target, value, sols, true);
+            break;
+        case RedundancyParam::Q6:
+            franka_ik_q6_compact(target, value, sols, true);
+            break;
+        case RedundancyParam::SWIVEL:
+            franka_ik_swivel_compact(target, value, sols, true);
+            break;
+        default:
+            if (branch_ >= 0) {
+                if (!jacobians) franka_ik_q7_branch_manipulability(target, value, branch_, sols);
+                else franka_ik_q7_branch_compact(target, value, branch_, sols, true);
+            }
+            else if (!jacobians) franka_ik_q7_manipulability(target, value, sols);
+            else franka_ik_q7_compact(target, value, sols, true);
+            break;
     }
+    return screen_collisions(sols, clearances);
+}
+
+double WeightedIKSolver::evaluate_cost(
+    RedundancyParam param,
+    double value,
+    const PreparedTarget& target,
+    const std::array<double, 7>& current_pose,
+    WeightedIKResult* best,
+    unsigned int* valid_branches
+) const {
+    // Valid solutions for this value of the free variable. The Jacobians are only needed to
+    // fill in best; the cost itself only needs their manipulability.
+    IKSolutionSet sols;
+    std::array<double, 8> clearances;
+    unsigned int valid_count = solve_ik(param, value, target, sols, clearances, best != nullptr);
     
     double best_score = -std::numeric_limits<double>::infinity();
+    bool best_updated = false;
     
     // Evaluate each solution
-    for (int i = 0; i < nsols; i++) {
-        // Check if solution is valid (all joints within limits)
-        bool valid_solution = true;
-        for (int j = 0; j < 7; j++) {
-            if (isnan(qsols[i][j])) {
-                valid_solution = false;
-                break;
-            }
-        }
+    for (unsigned int k = 0; k < valid_count; k++) {
+        // Calculate metrics
+        double manipulability = calculate_manipulability(sols, k);
+        double neutral_distance = calculate_distance(sols.q[k].data(), neutral_pose_.data());
+        double current_distance = calculate_distance(sols.q[k].data(), current_pose.data());
+        double score = compute_score(manipulability, neutral_distance, current_distance) - collision_cost(clearances[k]);
         
-        if (valid_solution) {
-            // Calculate metrics
-            double manipulability = calculate_manipulability(Jsols[i]);
-            double neutral_distance = calculate_distance(qsols[i], neutral_pose_);
-            double current_distance = calculate_distance(qsols[i], current_pose);
-            double score = compute_score(manipulability, neutral_distance, current_distance);
-            
-            // Update best score for this q7
-            if (score > best_score) {
-                best_score = score;
-            }
+        // Update best score for this value
+        if (score > best_score) {
+            best_score = score;
         }
+        if (best && score > best->score) {
+            best->success = true;
+            best->score = score;
+            best->manipulability = manipulability;
+            best->neutral_distance = neutral_distance;
+            best->current_distance = current_distance;
+            best->free_variable_optimal = value;
+            best->clearance = clearances[k];
+            store_solution(sols, k, *best);
+            best->total_solutions_found = sols.n_found;
+            best_updated = true;
+        }
+    }
+    if (best_updated) best->valid_solutions_count = valid_count;
+    if (valid_branches) {
+        *valid_branches = 0;
+        for (unsigned int k = 0; k < valid_count; k++) *valid_branches |= 1u << sols.branch[k];
     }
     
     return best_score;
 }
 
+double WeightedIKSolver::find_feasible_interval(
+    RedundancyParam param,
+    const PreparedTarget& target,
+    const std::array<double, 7>& current_pose,
+    int n_samples,
+    double& lower,
+    double& upper
+) const {
+    double range_min, range_max;
+    redundancy_param_limits(param, range_min, range_max);
+    double step = (range_max - range_min) / (n_samples - 1);
+    
+    // Longest run of consecutive feasible samples
+    double best_width = -1.0;
+    int run_start = -1;
+    for (int i = 0; i <= n_samples; i++) {
+        bool feasible = false;
+        if (i < n_samples) {
+            double value = range_min + i * step;
+            feasible = evaluate_cost(param, value, target, current_pose)
+                       > -std::numeric_limits<double>::infinity();
+        }
+        if (feasible && run_start < 0) {
+            run_start = i;
+        } else if (!feasible && run_start >= 0) {
+            double width = (i - 1 - run_start) * step;
+            if (width > best_width) {
+                best_width = width;
+                lower = range_min + run_start * step;
+                upper = range_min + (i - 1) * step;
+            }
+            run_start = -1;
+        }
+    }
+    
+    return best_width;
+}
+
 double WeightedIKSolver::brent_optimize(
+    RedundancyParam param,
     double ax, double bx, double cx,
-    const std::array<double, 3>& target_position,
-    const std::array<double, 9>& target_orientation,
+    const PreparedTarget& target,
     const std::array<double, 7>& current_pose,
     double tolerance,
     int max_iterations,
@@ -217,7 +588,7 @@ double WeightedIKSolver::brent_optimize(
     
     // Initialize points
     x = w = v = bx;
-    fw = fv = fx = -evaluate_q7_cost(x, target_position, target_orientation, current_pose);  // Minimize negative of cost
+    fw = fv = fx = -evaluate_cost(param, x, target, current_pose);  // Minimize negative of cost
     
     iterations_used = 0;
     
@@ -262,7 +633,7 @@ double WeightedIKSolver::brent_optimize(
         
         // Function evaluation
         u = (fabs(d) >= tol1 ? x + d : x + (d >= 0 ? fabs(tol1) : -fabs(tol1)));
-        fu = -evaluate_q7_cost(u, target_position, target_orientation, current_pose);  // Minimize negative of cost
+        fu = -evaluate_cost(param, u, target, current_pose);  // Minimize negative of cost
         
         // Update points
         if (fu <= fx) {
@@ -285,12 +656,13 @@ double WeightedIKSolver::brent_optimize(
     return x;
 }
 
-WeightedIKResult WeightedIKSolver::solve_q7_optimized(
+WeightedIKResult WeightedIKSolver::solve_optimized(
+    RedundancyParam param,
     const std::array<double, 3>& target_position,
     const std::array<double, 9>& target_orientation,
     const std::array<double, 7>& current_pose,
-    double q7_min,
-    double q7_max,
+    double value_min,
+    double value_max,
     double tolerance,
     int max_iterations
 ) {
@@ -301,13 +673,16 @@ WeightedIKResult WeightedIKSolver::solve_q7_optimized(
     result.valid_solutions_count = 0;
     result.q7_values_tested = 0;  // Will be set to optimization iterations
     result.optimization_iterations = 0;
+    result.parameterization = param;
+    
+    const char* name = redundancy_param_name(param);
     
     if (verbose_) {
         cout << endl << "=======================================================" << endl;
-        cout << "Weighted IK Q7 Optimization (1D Optimization)" << endl;
+        cout << "Weighted IK " << name << " Optimization (1D Optimization)" << endl;
         cout << "=======================================================" << endl;
         cout << "Target position: [" << target_position[0] << ", " << target_position[1] << ", " << target_position[2] << "]" << endl;
-        cout << "Q7 range: " << q7_min << " to " << q7_max << " rad" << endl;
+        cout << name << " range: " << value_min << " to " << value_max << " rad" << endl;
         cout << "Tolerance: " << tolerance << endl;
         cout << "Max iterations: " << max_iterations << endl;
         cout << "Weights - Manipulability: " << weight_manip_ << ", Neutral: " << weight_neutral_ << ", Current: " << weight_current_ << endl;
@@ -316,65 +691,107 @@ WeightedIKResult WeightedIKSolver::solve_q7_optimized(
     
     auto start = high_resolution_clock::now();
     
-    // Use Brent's method to find optimal q7
+    // Pose-only terms are computed once for all evaluations of the free variable
+    PreparedTarget target;
+    prepare_target(target_position, target_orientation, target);
+    
+    // Use Brent's method to find the optimal value of the free variable
     // We need three initial points: ax, bx, cx where bx is between ax and cx
-    double ax = q7_min;
-    double cx = q7_max;
+    double ax = value_min;
+    double cx = value_max;
     double bx = 0.5 * (ax + cx);  // Start in the middle
     
+    if (workspace_map_ && param == RedundancyParam::Q7) {
+        const WorkspaceCell* cell = workspace_map_->lookup(target_position, target_orientation);
+        if (cell && !(cell->flags & WORKSPACE_NEAR_REACHABLE)) {
+            // Nothing reachable around this target, skip the solve
+            result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+            if (verbose_) {
+                cout << "Target rejected by the workspace map" << endl;
+            }
+            return result;
+        }
+        if (cell && (cell->flags & WORKSPACE_REACHABLE)) {
+            // Feasible interval of the cell center, widened by one sample for the offset of the target
+            double margin = workspace_map_->q7_sample_step();
+            double lower = std::max(ax, workspace_map_->q7_value(cell->q7_lower) - margin);
+            double upper = std::min(cx, workspace_map_->q7_value(cell->q7_upper) + margin);
+            double seed = workspace_map_->q7_value(cell->q7_best);
+            if (lower < upper && seed > lower && seed < upper) {
+                ax = lower;
+                cx = upper;
+                bx = seed;
+            } else if (seed > ax && seed < cx) {
+                bx = seed;  // Best q7 lies in another feasible interval, only start from it
+            }
+        }
+    }
+    
+    // Range to fall back to if the warm-start window turns out infeasible
+    double full_ax = ax, full_bx = bx, full_cx = cx;
+    bool warm_started = false;
+    WarmStartHit hit;
+    if (warm_start_index_ && warm_start_index_->nearest(param, target_position, target_orientation, hit)
+        && hit.free_variable > ax && hit.free_variable < cx) {
+        // The optimum moves little between nearby poses, search around the stored one
+        ax = std::max(ax, hit.free_variable - warm_start_window_);
+        cx = std::min(cx, hit.free_variable + warm_start_window_);
+        bx = hit.free_variable;
+        warm_started = true;
+        if (verbose_) {
+            cout << "Warm start from a solve " << hit.distance << " away: " << name << " = " << hit.free_variable << endl;
+        }
+    }
+    
     int iterations_used = 0;
-    double optimal_q7 = brent_optimize(ax, bx, cx, target_position, target_orientation, current_pose,
-                                      tolerance, max_iterations, iterations_used);
+    double optimal_value = brent_optimize(param, ax, bx, cx, target, current_pose,
+                                          tolerance, max_iterations, iterations_used);
+    
+    if (warm_started) {
+        iterations_used++;  // The feasibility check below
+        if (std::isinf(evaluate_cost(param, optimal_value, target, current_pose))) {
+            int fallback_iterations = 0;
+            optimal_value = brent_optimize(param, full_ax, full_bx, full_cx, target, current_pose, tolerance, max_iterations, fallback_iterations);
+            iterations_used += fallback_iterations;
+        }
+    }
     
     result.optimization_iterations = iterations_used;
     result.q7_values_tested = iterations_used;  // For compatibility
     
-    // Now evaluate the optimal q7 to get full solution details
-    unsigned int nsols = 0;
-    bool joint_angles = true;
-    std::array<std::array<double, 7>, 8> qsols;
-    std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
-    
-    nsols = franka_J_ik_q7(target_position, target_orientation, optimal_q7, Jsols, qsols, joint_angles);
-    result.total_solutions_found = nsols;
+    // Now evaluate the optimal value to get full solution details
+    IKSolutionSet sols;
+    std::array<double, 8> clearances;
+    unsigned int valid_count = solve_ik(param, optimal_value, target, sols, clearances);
+    result.total_solutions_found = sols.n_found;
+    result.valid_solutions_count = valid_count;
     
-    if (nsols > 0) {
-        // Find the best solution for the optimal q7
-        for (int i = 0; i < nsols; i++) {
-            // Check if solution is valid
-            bool valid_solution = true;
-            for (int j = 0; j < 7; j++) {
-                if (isnan(qsols[i][j])) {
-                    valid_solution = false;
-                    break;
-                }
-            }
-            
-            if (valid_solution) {
-                result.valid_solutions_count++;
-                
-                // Calculate metrics
-                double manipulability = calculate_manipulability(Jsols[i]);
-                double neutral_distance = calculate_distance(qsols[i], neutral_pose_);
-                double current_distance = calculate_distance(qsols[i], current_pose);
-                double score = compute_score(manipulability, neutral_distance, current_distance);
-                
-                // Update best solution
-                if (score > result.score) {
-                    result.success = true;
-                    result.score = score;
-                    result.manipulability = manipulability;
-                    result.neutral_distance = neutral_distance;
-                    result.current_distance = current_distance;
-                    result.q7_optimal = optimal_q7;
-                    result.joint_angles = qsols[i];
-                    result.jacobian = Jsols[i];
-                    result.solution_index = i;
-                }
-            }
+    // Find the best solution for the optimal value
+    for (unsigned int k = 0; k < valid_count; k++) {
+        // Calculate metrics
+        double manipulability = calculate_manipulability(sols, k);
+        double neutral_distance = calculate_distance(sols.q[k].data(), neutral_pose_.data());
+        double current_distance = calculate_distance(sols.q[k].data(), current_pose.data());
+        double score = compute_score(manipulability, neutral_distance, current_distance) - collision_cost(clearances[k]);
+        
+        // Update best solution
+        if (score > result.score) {
+            result.success = true;
+            result.score = score;
+            result.manipulability = manipulability;
+            result.neutral_distance = neutral_distance;
+            result.current_distance = current_distance;
+            result.free_variable_optimal = optimal_value;
+            result.clearance = clearances[k];
+            store_solution(sols, k, result);
         }
     }
     
+    if (warm_start_index_ && warm_start_record_ && result.success) {
+        warm_start_index_->insert(param, target_position, target_orientation, result.free_variable_optimal,
+                                  result.q7_optimal, result.solution_index, result.score);
+    }
+    
     auto end = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(end - start);
     result.duration_microseconds = duration.count();
@@ -390,6 +807,9 @@ WeightedIKResult WeightedIKSolver::solve_q7_optimized(
         
         if (result.success) {
             cout << "OPTIMAL SOLUTION FOUND:" << endl;
+            if (param != RedundancyParam::Q7) {
+                cout << "Optimal " << name << ": " << result.free_variable_optimal << " rad" << endl;
+            }
             cout << "Optimal q7: " << result.q7_optimal << " rad" << endl;
             cout << "Overall score: " << std::setprecision(8) << result.score << endl;
             cout << "Solution index: " << result.solution_index + 1 << endl;
@@ -419,8 +839,402 @@ WeightedIKResult WeightedIKSolver::solve_q7_optimized(
             cout << T_best << endl;
             
         } else {
-            cout << "No valid solutions found in the specified q7 range!" << endl;
+            cout << "No valid solutions found in the specified " << name << " range!" << endl;
+        }
+    }
+    
+    return result;
+}
+
+WeightedIKResult WeightedIKSolver::solve_q7_optimized(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose,
+    double q7_min,
+    double q7_max,
+    double tolerance,
+    int max_iterations
+) {
+    return solve_optimized(RedundancyParam::Q7, target_position, target_orientation, current_pose,
+                           q7_min, q7_max, tolerance, max_iterations);
+}
+
+WeightedIKResult WeightedIKSolver::solve_q4_optimized(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose,
+    double q4_min,
+    double q4_max,
+    double tolerance,
+    int max_iterations
+) {
+    return solve_optimized(RedundancyParam::Q4, target_position, target_orientation, current_pose,
+                           q4_min, q4_max, tolerance, max_iterations);
+}
+
+WeightedIKResult WeightedIKSolver::solve_q6_optimized(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose,
+    double q6_min,
+    double q6_max,
+    double tolerance,
+    int max_iterations
+) {
+    return solve_optimized(RedundancyParam::Q6, target_position, target_orientation, current_pose,
+                           q6_min, q6_max, tolerance, max_iterations);
+}
+
+WeightedIKResult WeightedIKSolver::solve_swivel_optimized(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose,
+    double theta_min,
+    double theta_max,
+    double tolerance,
+    int max_iterations
+) {
+    return solve_optimized(RedundancyParam::SWIVEL, target_position, target_orientation, current_pose,
+                           theta_min, theta_max, tolerance, max_iterations);
+}
+
+WeightedIKResult WeightedIKSolver::solve_auto_optimized(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose,
+    double tolerance,
+    int max_iterations,
+    int n_samples
+) {
+    auto start = high_resolution_clock::now();
+    PreparedTarget target;
+    prepare_target(target_position, target_orientation, target);
+    n_samples = std::max(2, n_samples);  // Both ends of each range at least
+    
+    // Pick the parameterization with the widest feasible interval
+    const RedundancyParam params[4] = { RedundancyParam::Q7, RedundancyParam::Q4,
+                                        RedundancyParam::Q6, RedundancyParam::SWIVEL };
+    RedundancyParam best_param = RedundancyParam::Q7;
+    double best_width = -1.0, best_lower = 0.0, best_upper = 0.0;
+    for (RedundancyParam param : params) {
+        double lower, upper;
+        double width = find_feasible_interval(param, target, current_pose,
+                                              n_samples, lower, upper);
+        if (width > best_width) {
+            best_width = width;
+            best_param = param;
+            best_lower = lower;
+            best_upper = upper;
+        }
+    }
+    
+    if (best_width < 0) {
+        // Nothing feasible anywhere, report a failed result
+        WeightedIKResult result;
+        result.success = false;
+        result.score = -std::numeric_limits<double>::infinity();
+        result.total_solutions_found = 0;
+        result.valid_solutions_count = 0;
+        result.q7_values_tested = 4 * n_samples;
+        result.optimization_iterations = 0;
+        result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        if (verbose_) {
+            cout << "No feasible interval found for any parameterization!" << endl;
+        }
+        return result;
+    }
+    
+    WeightedIKResult result = solve_optimized(best_param, target_position, target_orientation, current_pose,
+                                              best_lower, best_upper, tolerance, max_iterations);
+    result.q7_values_tested += 4 * n_samples;  // Include the sampling evaluations
+    result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    return result;
+}
+
+void WeightedIKSolver::run_parallel(int count, int n_threads, const std::function<void(int, int)>& body) const {
+    if (count <= 0) return;
+    if (parallel_for_) {
+        parallel_for_(count, body);
+        return;
+    }
+    if (n_threads <= 0) n_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    int n_workers = std::min(n_threads, count);
+    
+    // Items are interleaved across workers so uneven costs even out
+    auto work = [&](int worker) {
+        for (int i = worker; i < count; i += n_workers) body(i, i + 1);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < n_workers; t++) {
+        threads.emplace_back(work, t);
+    }
+    work(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+WeightedIKResult WeightedIKSolver::solve_q7_multi_bracket(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose,
+    double q7_min,
+    double q7_max,
+    const MultiBracketConfig& config
+) {
+    WeightedIKResult result;
+    result.success = false;
+    result.score = -std::numeric_limits<double>::infinity();
+    result.total_solutions_found = 0;
+    result.valid_solutions_count = 0;
+    result.q7_values_tested = 0;
+    result.optimization_iterations = 0;
+    
+    int n_brackets = std::max(1, config.n_brackets);
+    
+    if (verbose_) {
+        cout << endl << "=======================================================" << endl;
+        cout << "Weighted IK Q7 Optimization (" << n_brackets << " Brent brackets)" << endl;
+        cout << "=======================================================" << endl;
+        cout << "Target position: [" << target_position[0] << ", " << target_position[1] << ", " << target_position[2] << "]" << endl;
+        cout << "Q7 range: " << q7_min << " to " << q7_max << " rad" << endl;
+        cout << "Brackets aligned to feasible intervals: " << (config.align_to_feasible ? "yes" : "no") << endl;
+        cout << "Weights - Manipulability: " << weight_manip_ << ", Neutral: " << weight_neutral_ << ", Current: " << weight_current_ << endl;
+        cout << endl;
+    }
+    
+    auto start = high_resolution_clock::now();
+    PreparedTarget target;
+    prepare_target(target_position, target_orientation, target);
+    
+    // Brackets (ax, bx, cx) for brent_optimize, bx inside the feasible part
+    std::vector<std::array<double, 3>> brackets;
+    if (config.align_to_feasible) {
+        int n_samples = std::max(2, n_brackets * config.samples_per_bracket);
+        double step = (q7_max - q7_min) / (n_samples - 1);
+        std::vector<char> feasible(n_samples);
+        run_parallel(n_samples, config.n_threads, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                feasible[i] = evaluate_cost(RedundancyParam::Q7, q7_min + i * step, target, current_pose)
+                              > -std::numeric_limits<double>::infinity();
+            }
+        });
+        result.q7_values_tested += n_samples;
+        
+        // Runs of feasible samples [first, last], the widest n_brackets of them in range order
+        std::vector<std::array<int, 2>> runs;
+        for (int i = 0; i < n_samples; i++) {
+            if (!feasible[i]) continue;
+            if (runs.empty() || runs.back()[1] != i - 1) runs.push_back({ i, i });
+            else runs.back()[1] = i;
+        }
+        if ((int)runs.size() > n_brackets) {
+            std::stable_sort(runs.begin(), runs.end(), [](const std::array<int, 2>& a, const std::array<int, 2>& b) {
+                return a[1] - a[0] > b[1] - b[0];
+            });
+            runs.resize(n_brackets);
+            std::sort(runs.begin(), runs.end());
+        }
+        
+        // One bracket per run, the others one at a time to the run with the widest brackets
+        std::vector<int> shares(runs.size(), 1);
+        for (int k = (int)runs.size(); k < n_brackets; k++) {
+            size_t widest = 0;
+            for (size_t r = 1; r < runs.size(); r++) {
+                if ((runs[r][1] - runs[r][0]) * shares[widest] > (runs[widest][1] - runs[widest][0]) * shares[r]) widest = r;
+            }
+            shares[widest]++;
+        }
+        
+        for (size_t r = 0; r < runs.size(); r++) {
+            // Runs reach up to a step past their outer samples; brent_optimize never moves to an
+            // infeasible point from a feasible one, so the outer brackets may include that step
+            double lower = q7_min + runs[r][0] * step;
+            double upper = q7_min + runs[r][1] * step;
+            int n = runs[r][1] > runs[r][0] ? shares[r] : 1;
+            for (int k = 0; k < n; k++) {
+                double ax = lower + k * (upper - lower) / n;
+                double cx = lower + (k + 1) * (upper - lower) / n;
+                double bx = 0.5 * (ax + cx);
+                if (k == 0) ax = std::max(q7_min, lower - step);
+                if (k == n - 1) cx = std::min(q7_max, upper + step);
+                brackets.push_back({ ax, bx, cx });
+            }
+        }
+    } else {
+        double width = (q7_max - q7_min) / n_brackets;
+        for (int k = 0; k < n_brackets; k++) {
+            double ax = q7_min + k * width;
+            brackets.push_back({ ax, ax + 0.5 * width, ax + width });
+        }
+    }
+    
+    std::vector<WeightedIKResult> bracket_results(brackets.size());
+    std::vector<int> iterations(brackets.size(), 0);
+    run_parallel((int)brackets.size(), config.n_threads, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            double q7 = brent_optimize(RedundancyParam::Q7, brackets[k][0], brackets[k][1], brackets[k][2],
+                                       target, current_pose, config.tolerance, config.max_iterations, iterations[k]);
+            WeightedIKResult& candidate = bracket_results[k];
+            candidate.success = false;
+            candidate.score = -std::numeric_limits<double>::infinity();
+            evaluate_cost(RedundancyParam::Q7, q7, target, current_pose, &candidate);
+        }
+    });
+    
+    // Best bracket, first one on ties
+    int best = -1;
+    int total_iterations = 0;
+    for (size_t k = 0; k < brackets.size(); k++) {
+        total_iterations += iterations[k];
+        if (bracket_results[k].success && (best < 0 || bracket_results[k].score > bracket_results[best].score)) {
+            best = (int)k;
+        }
+    }
+    int n_scanned = result.q7_values_tested;
+    if (best >= 0) result = bracket_results[best];
+    result.optimization_iterations = total_iterations;
+    result.q7_values_tested = n_scanned + total_iterations + (int)brackets.size();
+    result.parameterization = RedundancyParam::Q7;
+    result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    
+    if (verbose_) {
+        cout << "Brackets: " << brackets.size() << endl;
+        print_weighted_ik_results(result);
+    }
+    
+    return result;
+}
+
+// Sample of the score along q7 in solve_q7_certified()
+struct CertifiedSample {
+    double q7;
+    double score;           // Best valid solution, -inf if none
+    unsigned int branches;  // Mask of the branches with a valid solution
+};
+
+// Interval between two samples, ordered by its bound in a max-heap
+struct CertifiedInterval {
+    double bound;
+    int left, right;  // Samples at its ends
+    bool operator<(const CertifiedInterval& other) const { return bound < other.bound; }
+};
+
+// Largest score a valid solution can reach between samples a and b, if the score of each branch
+// is L-Lipschitz and valid stretches are wider than b - a, so that every branch valid in between
+// is valid at a or at b. With the same branches valid at both ends, the score of each of them is
+// below the two cones from a and b; otherwise a branch valid at one end only is bounded by its cone.
+static double certified_bound(const CertifiedSample& a, const CertifiedSample& b, double lipschitz) {
+    if (a.branches == 0 && b.branches == 0) return -std::numeric_limits<double>::infinity();
+    double width = b.q7 - a.q7;
+    if (a.branches == b.branches) return 0.5 * (a.score + b.score + lipschitz * width);
+    return std::max(a.score, b.score) + lipschitz * width;
+}
+
+WeightedIKResult WeightedIKSolver::solve_q7_certified(
+    const std::array<double, 3>& target_position,
+    const std::array<double, 9>& target_orientation,
+    const std::array<double, 7>& current_pose,
+    double q7_min,
+    double q7_max,
+    const CertifiedQ7Config& config
+) {
+    WeightedIKResult result;
+    result.success = false;
+    result.score = -std::numeric_limits<double>::infinity();
+    result.total_solutions_found = 0;
+    result.valid_solutions_count = 0;
+    result.optimization_iterations = 0;
+    result.optimality_gap = std::numeric_limits<double>::infinity();
+    
+    if (verbose_) {
+        cout << endl << "=======================================================" << endl;
+        cout << "Weighted IK Q7 Optimization (Branch and Bound)" << endl;
+        cout << "=======================================================" << endl;
+        cout << "Target position: [" << target_position[0] << ", " << target_position[1] << ", " << target_position[2] << "]" << endl;
+        cout << "Q7 range: " << q7_min << " to " << q7_max << " rad (resolution: " << config.resolution << ")" << endl;
+        cout << "Epsilon: " << config.epsilon << endl;
+        cout << "Weights - Manipulability: " << weight_manip_ << ", Neutral: " << weight_neutral_ << ", Current: " << weight_current_ << endl;
+        cout << endl;
+    }
+    
+    auto start = high_resolution_clock::now();
+    PreparedTarget target;
+    prepare_target(target_position, target_orientation, target);
+    
+    std::vector<CertifiedSample> samples;
+    std::vector<CertifiedInterval> intervals;
+    samples.reserve(std::max(config.max_evaluations, 2));
+    intervals.reserve(std::max(config.max_evaluations, 2));
+    int best = 0;
+    // Steepest slope between neighbouring samples with the same valid branches. It only grows as
+    // intervals are split: the slope over [a, b] is at most the larger one over [a, m] and [m, b].
+    double max_slope = 0.0;
+    auto add_sample = [&](double q7) {
+        CertifiedSample sample;
+        sample.q7 = q7;
+        sample.score = evaluate_cost(RedundancyParam::Q7, q7, target, current_pose, nullptr, &sample.branches);
+        samples.push_back(sample);
+        if (sample.score > samples[best].score) best = (int)samples.size() - 1;
+        return (int)samples.size() - 1;
+    };
+    auto add_interval = [&](int left, int right, double lipschitz) {
+        const CertifiedSample& a = samples[left];
+        const CertifiedSample& b = samples[right];
+        if (a.branches != 0 && a.branches == b.branches) {
+            max_slope = std::max(max_slope, fabs(b.score - a.score) / (b.q7 - a.q7));
+        }
+        intervals.push_back({ certified_bound(a, b, lipschitz), left, right });
+        std::push_heap(intervals.begin(), intervals.end());
+    };
+    auto lipschitz_estimate = [&]() {
+        return config.lipschitz > 0 ? config.lipschitz : std::max(config.lipschitz_min, config.lipschitz_safety * max_slope);
+    };
+    
+    // Initial grid, no wider than the resolution between samples
+    int n_grid = std::max(2, (int)ceil((q7_max - q7_min) / config.resolution) + 1);
+    double step = (q7_max - q7_min) / (n_grid - 1);
+    for (int i = 0; i < n_grid; i++) {
+        add_sample(i + 1 < n_grid ? q7_min + i * step : q7_max);
+        if (i > 0) add_interval(i - 1, i, 0.0);
+    }
+    
+    // Split the interval with the highest bound until none can beat the best sample by epsilon.
+    // Intervals below that stay in the heap, pruned, in case a larger L lifts them again.
+    double lipschitz = -1.0;
+    while (true) {
+        if (lipschitz_estimate() != lipschitz) {
+            lipschitz = lipschitz_estimate();
+            for (CertifiedInterval& interval : intervals) {
+                interval.bound = certified_bound(samples[interval.left], samples[interval.right], lipschitz);
+            }
+            std::make_heap(intervals.begin(), intervals.end());
+        }
+        if (intervals.front().bound <= samples[best].score + config.epsilon
+            || (int)samples.size() >= config.max_evaluations) {
+            break;
         }
+        std::pop_heap(intervals.begin(), intervals.end());
+        CertifiedInterval split = intervals.back();
+        intervals.pop_back();
+        int middle = add_sample(0.5 * (samples[split.left].q7 + samples[split.right].q7));
+        add_interval(split.left, middle, lipschitz);
+        add_interval(middle, split.right, lipschitz);
+        result.optimization_iterations++;
+    }
+    result.q7_values_tested = (int)samples.size();
+    
+    // Full solution at the best sample
+    if (samples[best].branches != 0) {
+        evaluate_cost(RedundancyParam::Q7, samples[best].q7, target, current_pose, &result);
+        result.optimality_gap = std::max(0.0, intervals.front().bound - result.score);
+    }
+    
+    result.duration_microseconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    
+    if (verbose_) {
+        print_weighted_ik_results(result);
+        cout << "Lipschitz constant: " << lipschitz << ", certified gap: " << result.optimality_gap << endl;
     }
     
     return result;
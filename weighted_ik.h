@@ -7,12 +7,26 @@
 #include <chrono>
 #include <limits>
 #include <cmath>
+#include <vector>
+#include <functional>
 #include "Eigen/Dense"
 #include "geofik.h"
+#include "workspace_map.h"
+#include "warm_start_index.h"
+#include "q7_tape.h"
+#include "collision.h"
 
 using namespace std;
 using namespace std::chrono;
 
+// Free variable used to parameterize the redundancy of the arm
+enum class RedundancyParam {
+    Q7,      // franka_J_ik_q7
+    Q4,      // franka_J_ik_q4
+    Q6,      // franka_J_ik_q6
+    SWIVEL   // franka_J_ik_swivel
+};
+
 // Structure to hold the result of weighted IK optimization
 struct WeightedIKResult {
     bool success;
@@ -30,6 +44,41 @@ struct WeightedIKResult {
     int q7_values_tested;
     int optimization_iterations;  // Number of iterations used by optimization algorithm
     long duration_microseconds;
+    
+    RedundancyParam parameterization = RedundancyParam::Q7;  // Free variable that was optimized
+    // Optimal value of the free variable (equals q7_optimal for Q7; NaN without a solution)
+    double free_variable_optimal = std::numeric_limits<double>::quiet_NaN();
+    
+    // How much the global optimum can score above this result (solve_q7_certified only, NaN for
+    // the other solvers). A bound only with CertifiedQ7Config::lipschitz supplied; with the
+    // default estimate of L it is an estimate that can fall short
+    double optimality_gap = std::numeric_limits<double>::quiet_NaN();
+    
+    // Clearance of the solution (m, see CollisionModel; NaN without set_collision_model())
+    double clearance = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Settings of WeightedIKSolver::solve_q7_multi_bracket()
+struct MultiBracketConfig {
+    int n_brackets = 8;              // Brent searches, each over its own sub-interval
+    bool align_to_feasible = true;   // Place the brackets on the feasible intervals of a coarse scan
+    int samples_per_bracket = 8;     // Scan resolution: n_brackets * samples_per_bracket samples
+    int n_threads = 0;               // Threads when no parallel_for is set, 0 = hardware concurrency
+    double tolerance = 1e-6;
+    int max_iterations = 100;        // Per bracket
+};
+
+// Runs body(begin, end) over sub-ranges covering [0, count) and returns once all of them are done
+using IKParallelFor = std::function<void(int count, const std::function<void(int, int)>& body)>;
+
+// Settings of WeightedIKSolver::solve_q7_certified()
+struct CertifiedQ7Config {
+    double epsilon = 1e-4;          // Stop once the gap is below this (score units; certified only with lipschitz > 0)
+    double resolution = 0.05;       // Narrowest q7 stretch (rad) on which a solution branch is valid
+    double lipschitz = 0.0;         // Lipschitz constant of the score in q7; 0 estimates it from the samples
+    double lipschitz_safety = 2.0;  // Estimate: this factor times the steepest slope seen within one branch
+    double lipschitz_min = 0.2;     // Floor of the estimate, for ranges with too few samples to measure it
+    int max_evaluations = 2000;     // Stop here even if the gap is still above epsilon
 };
 
 class WeightedIKSolver {
@@ -44,30 +93,93 @@ private:
     double normalization_factor_;
     bool verbose_;
     
+    // Optional precomputed map, see set_workspace_map()
+    const WorkspaceMap* workspace_map_;
+    
+    // Optional store of earlier solves, see set_warm_start_index()
+    WarmStartIndex* warm_start_index_;
+    double warm_start_window_;
+    bool warm_start_record_;
+    
+    // Runs the brackets of solve_q7_multi_bracket() instead of threads if set
+    IKParallelFor parallel_for_;
+    
+    // Optional record of the last sweep, see set_q7_tape()
+    Q7SampleTape* q7_tape_;
+    
+    // Branch the q7 solves are restricted to, -1 for all, see set_branch()
+    int branch_;
+    
+    // Optional collision screen and clearance cost, see set_collision_model()
+    const CollisionModel* collision_model_;
+    double collision_margin_;
+    double collision_weight_;
+    double collision_influence_;
+    
     // Helper methods
-    double calculate_manipulability(const std::array<std::array<double, 6>, 7>& J) const;
-    double calculate_distance(const std::array<double, 7>& q1, const std::array<double, 7>& q2) const;
+    double calculate_distance(const double* q1, const double* q2) const;
     double compute_score(double manipulability, double neutral_dist, double current_dist) const;
     
-    // Cost function for optimization
-    double evaluate_q7_cost(
-        double q7,
-        const std::array<double, 3>& target_position,
-        const std::array<double, 9>& target_orientation,
-        const std::array<double, 7>& current_pose
+    // Score penalty of a solution with this clearance: infinite below the margin, 0 without a
+    // collision model (clearance NaN)
+    double collision_cost(double clearance) const;
+    
+    // Drops the solutions of sols closer than the margin to a collision, before any score term is
+    // computed for them, and writes the clearance of the others (NaN without a collision model)
+    unsigned int screen_collisions(IKSolutionSet& sols, std::array<double, 8>& clearances) const;
+    
+    // Analytical IK for the given free variable, valid solutions with their Jacobians. Without
+    // jacobians, q7 solves only compute the manipulability (other free variables always get J).
+    // q7 solves compute only the branch of set_branch(), if any. Solutions in collision are
+    // dropped (see screen_collisions()).
+    unsigned int solve_ik(
+        RedundancyParam param,
+        double value,
+        const PreparedTarget& target,
+        IKSolutionSet& sols,
+        std::array<double, 8>& clearances,
+        bool jacobians = true
+    ) const;
+    
+    // Cost function for optimization. If best is given, it is overwritten with the full
+    // solution whenever a valid solution at this value scores higher than best->score.
+    // If valid_branches is given, it receives the mask of the branches with a valid solution.
+    double evaluate_cost(
+        RedundancyParam param,
+        double value,
+        const PreparedTarget& target,
+        const std::array<double, 7>& current_pose,
+        WeightedIKResult* best = nullptr,
+        unsigned int* valid_branches = nullptr
+    ) const;
+    
+    // Largest contiguous interval of the free variable with at least one valid solution.
+    // Returns its width, or a negative value if no sample was feasible.
+    double find_feasible_interval(
+        RedundancyParam param,
+        const PreparedTarget& target,
+        const std::array<double, 7>& current_pose,
+        int n_samples,
+        double& lower,
+        double& upper
     ) const;
     
     // 1D optimization algorithms
     double brent_optimize(
+        RedundancyParam param,
         double ax, double bx, double cx,
-        const std::array<double, 3>& target_position,
-        const std::array<double, 9>& target_orientation,
+        const PreparedTarget& target,
         const std::array<double, 7>& current_pose,
         double tolerance,
         int max_iterations,
         int& iterations_used
     ) const;
 
+    // body(begin, end) over [0, count) on parallel_for_, or interleaved over n_threads threads
+    void run_parallel(int count, int n_threads, const std::function<void(int, int)>& body) const;
+
+    friend class AnytimeIKSolver;  // Drives the optimizer one evaluation at a time
+
 public:
     // Constructor - only takes robot-specific parameters that don't change
     WeightedIKSolver(
@@ -88,6 +200,40 @@ public:
         double step_size
     );
     
+    // Sweeps q7 as solve_q7 does and stores every valid solution with its manipulability in tape
+    void record_q7_tape(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        double q7_start,
+        double q7_end,
+        double step_size,
+        Q7SampleTape& tape
+    ) const;
+    
+    // solve_q7 on a recorded sweep: scores the records with the current weights and neutral pose
+    // and current_pose, without solving the IK, and returns what solve_q7 returns for that sweep.
+    // Only the Jacobian of the returned solution is solved for.
+    WeightedIKResult solve_q7(const Q7SampleTape& tape, const std::array<double, 7>& current_pose) const;
+    
+    // Best record of the tape for each weight setting {manip, neutral, current} in one pass over
+    // it: the distances of a record are computed once for all settings
+    void solve_q7_weight_sweep(
+        const Q7SampleTape& tape,
+        const std::array<double, 7>& current_pose,
+        const std::vector<std::array<double, 3>>& weights,
+        std::vector<WeightedIKResult>& results
+    ) const;
+    
+    // Records that no other record beats in all of manipulability, distance from the neutral pose
+    // and distance from current_pose, by decreasing manipulability. For any non-negative weights
+    // the best record is among them. Records in collision (see set_collision_model()) are left out.
+    // Sorts its candidates in a vector, so it allocates.
+    void q7_pareto_front(
+        const Q7SampleTape& tape,
+        const std::array<double, 7>& current_pose,
+        std::vector<Q7TapeObjectives>& front
+    ) const;
+    
     // Optimized solving method using 1D optimization instead of grid search
     WeightedIKResult solve_q7_optimized(
         const std::array<double, 3>& target_position,
@@ -99,17 +245,170 @@ public:
         int max_iterations = 100
     );
     
+    // Brent over several sub-intervals of [q7_min, q7_max] at once, best result wins (ties go to
+    // the lowest bracket, so the result does not depend on the scheduling). With
+    // align_to_feasible, a coarse scan finds the feasible intervals first and the brackets are
+    // shared out over them by width, one at least per interval (the widest n_brackets if there
+    // are more); otherwise the range is cut into n_brackets equal parts. The scan and the
+    // brackets run on set_parallel_for() or on config.n_threads threads. Allocates.
+    WeightedIKResult solve_q7_multi_bracket(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose,
+        double q7_min,
+        double q7_max,
+        const MultiBracketConfig& config = MultiBracketConfig()
+    );
+    
+    // Global q7 optimization by branch and bound. A grid at config.resolution is refined where the
+    // Lipschitz bound of an interval between two samples could beat the best sample by more than
+    // config.epsilon; the search stops when no interval can. result.optimality_gap is the final
+    // bound minus the returned score. It is certified if the score of each branch is L-Lipschitz in
+    // q7 and no branch is valid only on a stretch narrower than config.resolution (so every valid
+    // stretch contains a sample); with config.lipschitz = 0, L is estimated from the samples and
+    // the gap is an estimate, not a bound. Allocates its sample list.
+    WeightedIKResult solve_q7_certified(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose,
+        double q7_min,
+        double q7_max,
+        const CertifiedQ7Config& config = CertifiedQ7Config()
+    );
+    
+    // Optimizer core shared by all solve_*_optimized methods, with the free variable chosen at run time
+    WeightedIKResult solve_optimized(
+        RedundancyParam param,
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose,
+        double value_min,
+        double value_max,
+        double tolerance = 1e-6,
+        int max_iterations = 100
+    );
+    
+    // Same optimization with q4, q6 or the swivel angle as the free variable
+    WeightedIKResult solve_q4_optimized(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose,
+        double q4_min,
+        double q4_max,
+        double tolerance = 1e-6,
+        int max_iterations = 100
+    );
+    
+    WeightedIKResult solve_q6_optimized(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose,
+        double q6_min,
+        double q6_max,
+        double tolerance = 1e-6,
+        int max_iterations = 100
+    );
+    
+    WeightedIKResult solve_swivel_optimized(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose,
+        double theta_min,
+        double theta_max,
+        double tolerance = 1e-6,
+        int max_iterations = 100
+    );
+    
+    // Samples every parameterization over its full range (n_samples values each, at least 2),
+    // picks the one whose feasible interval is largest and optimizes over that interval
+    WeightedIKResult solve_auto_optimized(
+        const std::array<double, 3>& target_position,
+        const std::array<double, 9>& target_orientation,
+        const std::array<double, 7>& current_pose,
+        double tolerance = 1e-6,
+        int max_iterations = 100,
+        int n_samples = 32
+    );
+    
+    // Yoshikawa manipulability sqrt(det(J J^T)) of a Jacobian stored as J^T (as returned by franka_J_ik_*)
+    double calculate_manipulability(const std::array<std::array<double, 6>, 7>& J) const;
+    double calculate_manipulability(const IKSolutionSet& sols, unsigned int k) const;
+    
+    // Score of one IK solution without the current-pose term:
+    // weight_manip * manipulability - weight_neutral * normalized neutral distance,
+    // minus the clearance cost with a collision model (-infinity if it collides)
+    double score_solution(
+        const std::array<double, 7>& q,
+        const std::array<std::array<double, 6>, 7>& J
+    ) const;
+    
+    // Current-pose term of the score for moving from q_from to q_to
+    double transition_cost(const std::array<double, 7>& q_from, const std::array<double, 7>& q_to) const;
+    
     // Update weights without recreating object
     void update_weights(double weight_manip, double weight_neutral, double weight_current);
     
     // Update neutral pose (rarely needed)
     void update_neutral_pose(const std::array<double, 7>& neutral_pose);
     
+    // Use a workspace map (kept by the caller, nullptr to stop) in q7 optimizations: targets in
+    // unreachable cells fail without solving, and the Brent bracket is seeded from the cell's
+    // feasible q7 interval and most manipulable q7
+    void set_workspace_map(const WorkspaceMap* map) { workspace_map_ = map; }
+    
+    // Seed the optimizations from the nearest earlier solve in index (kept by the caller, may be
+    // shared between solvers, nullptr to stop): the bracket shrinks to the stored value of the free
+    // variable +/- window, and falls back to the full range if nothing in it is feasible.
+    // If record is set, successful solves are stored in the index.
+    void set_warm_start_index(WarmStartIndex* index, double window = 0.3, bool record = true) {
+        warm_start_index_ = index;
+        warm_start_window_ = window;
+        warm_start_record_ = record;
+    }
+    
+    // Keep the sweep of solve_q7 in tape (kept by the caller, nullptr to stop): a solve_q7 of the
+    // target and range on the tape only re-scores it, after new weights or a new current pose;
+    // a solve_q7 of another target or range records it over the tape first. A tape belongs to one
+    // solver: copies of the solver keep the pointer, so give each copy its own tape or nullptr
+    // (IKJobPool clears it on its copies). Recording allocates unless Q7SampleTape::reserve() has
+    // covered the sweep beforehand.
+    void set_q7_tape(Q7SampleTape* tape) { q7_tape_ = tape; }
+    
+    // Restrict the q7 solves (solve_q7, its tape and the q7 optimizers) to one branch (see IKBranch,
+    // e.g. franka_q7_branch() of the current pose): each IK evaluation then computes only that
+    // solution. solution_index is the branch instead of the slot in franka_J_ik_q7. -1 restores all
+    // branches. The q4, q6 and swivel solvers are not restricted.
+    void set_branch(int branch) { branch_ = branch; }
+    int get_branch() const { return branch_; }
+    
+    // Screen solutions against a collision model (kept by the caller, nullptr to stop): every
+    // solver drops the solutions whose clearance is below margin, as if outside the joint limits,
+    // before computing their score. Clearer solutions lose
+    // weight * (1 - (clearance - margin) / influence) of score while within influence of the margin.
+    // Clears the q7 tape of set_q7_tape(); records of other tapes keep the clearance of the model
+    // they were recorded with.
+    void set_collision_model(const CollisionModel* model, double margin = 0.0, double weight = 0.0, double influence = 0.05) {
+        collision_model_ = model;
+        collision_margin_ = margin;
+        collision_weight_ = weight;
+        collision_influence_ = influence;
+        if (q7_tape_) q7_tape_->clear();
+    }
+    const CollisionModel* get_collision_model() const { return collision_model_; }
+    
+    // Run the parallel parts of solve_q7_multi_bracket() with parallel_for (e.g.
+    // IKJobPool::parallel_for) instead of starting threads. An empty function restores the threads.
+    void set_parallel_for(IKParallelFor parallel_for) { parallel_for_ = std::move(parallel_for); }
+    
     // Getters
     const std::array<double, 7>& get_neutral_pose() const { return neutral_pose_; }
     void set_verbose(bool verbose) { verbose_ = verbose; }
 };
 
+// Name and full range of a free variable
+const char* redundancy_param_name(RedundancyParam param);
+void redundancy_param_limits(RedundancyParam param, double& lower, double& upper);
+
 // Standalone functions for backward compatibility
 double calculate_manipulability_weighted(const std::array<std::array<double, 6>, 7>& J);
 WeightedIKResult weighted_ik_q7(
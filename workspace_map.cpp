@@ -0,0 +1,258 @@
+#include "workspace_map.h"
+#include "weighted_ik.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char WORKSPACE_MAP_MAGIC[8] = { 'G', 'E', 'O', 'F', 'I', 'K', 'W', 'M' };
+
+WorkspaceMap::WorkspaceMap() : fd_(-1), base_(nullptr), file_size_(0), header_(nullptr), cells_(nullptr) {}
+
+WorkspaceMap::~WorkspaceMap() {
+    close();
+}
+
+bool WorkspaceMap::open(const std::string& path) {
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        std::cerr << "ERROR: cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || (size_t)st.st_size < sizeof(WorkspaceMapHeader)) {
+        std::cerr << "ERROR: " << path << " is too small to be a workspace map" << std::endl;
+        close();
+        return false;
+    }
+    file_size_ = (size_t)st.st_size;
+    base_ = mmap(nullptr, file_size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (base_ == MAP_FAILED) {
+        base_ = nullptr;
+        std::cerr << "ERROR: cannot map " << path << std::endl;
+        close();
+        return false;
+    }
+
+    const WorkspaceMapHeader* h = static_cast<const WorkspaceMapHeader*>(base_);
+    const char* problem = nullptr;
+    uint64_t expected = (uint64_t)h->dims[0] * h->dims[1] * h->dims[2] * h->n_polar * h->n_azimuth * h->n_roll;
+    if (memcmp(h->magic, WORKSPACE_MAP_MAGIC, sizeof(WORKSPACE_MAP_MAGIC)) != 0) problem = "bad magic";
+    else if (h->version > WORKSPACE_MAP_VERSION) problem = "unsupported version";
+    else if (h->header_size < sizeof(WorkspaceMapHeader) || h->cell_size != sizeof(WorkspaceCell)) problem = "bad record sizes";
+    else if (expected == 0 || h->count != expected || h->n_q7_samples < 2 || !(h->voxel_size > 0.0)) problem = "bad dimensions";
+    else if (h->cells_offset > file_size_ || h->count > (file_size_ - h->cells_offset) / sizeof(WorkspaceCell)) problem = "truncated cells";
+    if (problem) {
+        std::cerr << "ERROR: " << path << " is not a valid workspace map (" << problem << ")" << std::endl;
+        close();
+        return false;
+    }
+    header_ = h;
+    cells_ = reinterpret_cast<const WorkspaceCell*>(static_cast<const char*>(base_) + h->cells_offset);
+    madvise(base_, file_size_, MADV_RANDOM);
+    return true;
+}
+
+void WorkspaceMap::close() {
+    if (base_) munmap(base_, file_size_);
+    if (fd_ >= 0) ::close(fd_);
+    base_ = nullptr;
+    fd_ = -1;
+    file_size_ = 0;
+    header_ = nullptr;
+    cells_ = nullptr;
+}
+
+// Rotation (row-first) at the center of an orientation bin, inverse of workspace_orientation_bin
+static std::array<double, 9> bin_center_orientation(const WorkspaceMapSpec& spec, uint32_t ip, uint32_t ia, uint32_t ir) {
+    double polar = (ip + 0.5) * PI / spec.n_polar;
+    double azimuth = -PI + (ia + 0.5) * 2.0 * PI / spec.n_azimuth;
+    double roll = -PI + (ir + 0.5) * 2.0 * PI / spec.n_roll;
+    double ct = cos(polar), st = sin(polar), cp = cos(azimuth), sp = sin(azimuth);
+    std::array<double, 3> k = { st * cp, st * sp, ct };
+    std::array<double, 3> e_theta = { ct * cp, ct * sp, -st };
+    std::array<double, 3> e_phi = { -sp, cp, 0.0 };
+    std::array<double, 3> i, j;
+    for (int a = 0; a < 3; a++) i[a] = cos(roll) * e_theta[a] + sin(roll) * e_phi[a];
+    j = { k[1] * i[2] - k[2] * i[1], k[2] * i[0] - k[0] * i[2], k[0] * i[1] - k[1] * i[0] };
+    return { i[0], j[0], k[0], i[1], j[1], k[1], i[2], j[2], k[2] };
+}
+
+// Cell before quantization of the manipulability
+struct CellSample {
+    WorkspaceCell cell;
+    float manipulability;
+};
+
+static CellSample sample_cell(const WeightedIKSolver& solver, const WorkspaceMapSpec& spec,
+                              const std::array<double, 3>& position, const std::array<double, 9>& orientation) {
+    CellSample sample;
+    memset(&sample.cell, 0, sizeof(sample.cell));
+    sample.manipulability = 0.0f;
+
+    std::array<std::array<double, 7>, 8> qsols;
+    std::array<std::array<std::array<double, 6>, 7>, 8> Jsols;
+    IKValidity validity;
+    double step = (q_up[6] - q_low[6]) / (spec.n_q7_samples - 1);
+    double best_manipulability = -1.0;
+    int run_start = -1, best_run_length = 0, n_runs = 0;
+    for (uint32_t s = 0; s <= spec.n_q7_samples; s++) {
+        bool feasible = false;
+        if (s < spec.n_q7_samples) {
+            franka_J_ik_q7(position, orientation, q_low[6] + s * step, Jsols, qsols, validity, true);
+            for (unsigned int mask = validity.valid; mask; ) {
+                int b = next_valid_solution(mask);
+                feasible = true;
+                double manipulability = solver.calculate_manipulability(Jsols[b]);
+                if (manipulability > best_manipulability) {
+                    best_manipulability = manipulability;
+                    sample.cell.q7_best = (uint8_t)lround(s * 255.0 / (spec.n_q7_samples - 1));
+                    sample.cell.best_branch = (uint8_t)b;
+                }
+            }
+            if (feasible) sample.cell.feasible_samples++;
+        }
+        if (feasible && run_start < 0) {
+            run_start = (int)s;
+        } else if (!feasible && run_start >= 0) {
+            n_runs++;
+            if ((int)s - run_start > best_run_length) {
+                best_run_length = (int)s - run_start;
+                sample.cell.q7_lower = (uint8_t)lround(run_start * 255.0 / (spec.n_q7_samples - 1));
+                sample.cell.q7_upper = (uint8_t)lround((s - 1) * 255.0 / (spec.n_q7_samples - 1));
+            }
+            run_start = -1;
+        }
+    }
+    if (sample.cell.feasible_samples > 0) {
+        sample.cell.flags = WORKSPACE_REACHABLE | WORKSPACE_NEAR_REACHABLE;
+        if (n_runs > 1) sample.cell.flags |= WORKSPACE_SPLIT_INTERVAL;
+        sample.manipulability = (float)best_manipulability;
+    }
+    return sample;
+}
+
+// One pass of the NEAR_REACHABLE dilation along a single axis of the cell index
+static void dilate_axis(std::vector<WorkspaceCell>& cells, const std::array<uint32_t, 6>& shape, int axis, bool wrap) {
+    uint64_t stride = 1;
+    for (int a = 5; a > axis; a--) stride *= shape[a];
+    uint64_t n = shape[axis];
+    std::vector<uint8_t> near(cells.size());
+    for (uint64_t c = 0; c < cells.size(); c++) near[c] = cells[c].flags & WORKSPACE_NEAR_REACHABLE;
+    for (uint64_t c = 0; c < cells.size(); c++) {
+        uint64_t k = (c / stride) % n;
+        bool lower = k > 0 || (wrap && n > 1);
+        bool upper = k + 1 < n || (wrap && n > 1);
+        uint64_t c_lower = k > 0 ? c - stride : c + (n - 1) * stride;
+        uint64_t c_upper = k + 1 < n ? c + stride : c - (n - 1) * stride;
+        if ((lower && near[c_lower]) || (upper && near[c_upper])) cells[c].flags |= WORKSPACE_NEAR_REACHABLE;
+    }
+}
+
+bool build_workspace_map(const std::string& path, const WorkspaceMapSpec& spec, int n_threads, bool verbose) {
+    if (spec.n_q7_samples < 2 || spec.n_q7_samples > 255 || !(spec.voxel_size > 0.0) ||
+        spec.dims[0] * spec.dims[1] * spec.dims[2] == 0 || spec.n_polar * spec.n_azimuth * spec.n_roll == 0) {
+        std::cerr << "ERROR: invalid workspace map specification" << std::endl;
+        return false;
+    }
+    if (n_threads <= 0) n_threads = (int)std::thread::hardware_concurrency();
+    if (n_threads <= 0) n_threads = 1;
+
+    const uint64_t n_voxels = (uint64_t)spec.dims[0] * spec.dims[1] * spec.dims[2];
+    const uint64_t n_orientations = (uint64_t)spec.n_polar * spec.n_azimuth * spec.n_roll;
+    std::vector<WorkspaceCell> cells(n_voxels * n_orientations);
+    std::vector<float> manipulability(cells.size());
+
+    // Orientation bin centers are shared by every voxel
+    std::vector<std::array<double, 9>> orientations;
+    orientations.reserve(n_orientations);
+    for (uint32_t ip = 0; ip < spec.n_polar; ip++)
+        for (uint32_t ia = 0; ia < spec.n_azimuth; ia++)
+            for (uint32_t ir = 0; ir < spec.n_roll; ir++)
+                orientations.push_back(bin_center_orientation(spec, ip, ia, ir));
+
+    // Workers take voxels from a shared counter, each voxel covers all its orientations
+    std::atomic<uint64_t> next_voxel(0);
+    std::atomic<uint64_t> done_voxels(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < n_threads; t++) {
+        workers.emplace_back([&]() {
+            WeightedIKSolver solver({ 0.0, 0.0, 0.0, -1.5, 0.0, 1.86, 0.0 }, 1.0, 0.0, 0.0, false);
+            for (uint64_t v = next_voxel++; v < n_voxels; v = next_voxel++) {
+                uint64_t ix = v / ((uint64_t)spec.dims[1] * spec.dims[2]);
+                uint64_t iy = (v / spec.dims[2]) % spec.dims[1];
+                uint64_t iz = v % spec.dims[2];
+                std::array<double, 3> position = { spec.origin[0] + (ix + 0.5) * spec.voxel_size,
+                                                   spec.origin[1] + (iy + 0.5) * spec.voxel_size,
+                                                   spec.origin[2] + (iz + 0.5) * spec.voxel_size };
+                for (uint64_t o = 0; o < n_orientations; o++) {
+                    CellSample sample = sample_cell(solver, spec, position, orientations[o]);
+                    cells[v * n_orientations + o] = sample.cell;
+                    manipulability[v * n_orientations + o] = sample.manipulability;
+                }
+                uint64_t done = ++done_voxels;
+                if (verbose && done % 64 == 0) {
+                    fprintf(stderr, "\rvoxels: %llu / %llu", (unsigned long long)done, (unsigned long long)n_voxels);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (verbose) fprintf(stderr, "\rvoxels: %llu / %llu\n", (unsigned long long)n_voxels, (unsigned long long)n_voxels);
+
+    // Quantize the manipulability against the largest value found
+    float scale = *std::max_element(manipulability.begin(), manipulability.end());
+    if (!(scale > 0.0f)) scale = 1.0f;
+    for (uint64_t c = 0; c < cells.size(); c++) {
+        cells[c].manipulability = (uint8_t)lround(255.0 * manipulability[c] / scale);
+    }
+
+    // A target between cell centers can be reachable although its own center is not, so
+    // rejection looks at the 3x3x3x3x3x3 neighbourhood (separable, one axis at a time)
+    const std::array<uint32_t, 6> shape = { spec.dims[0], spec.dims[1], spec.dims[2],
+                                            spec.n_polar, spec.n_azimuth, spec.n_roll };
+    for (int axis = 0; axis < 6; axis++) {
+        dilate_axis(cells, shape, axis, axis >= 4);  // Azimuth and roll wrap around
+    }
+
+    WorkspaceMapHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, WORKSPACE_MAP_MAGIC, sizeof(WORKSPACE_MAP_MAGIC));
+    h.version = WORKSPACE_MAP_VERSION;
+    h.header_size = sizeof(WorkspaceMapHeader);
+    for (int a = 0; a < 3; a++) {
+        h.dims[a] = spec.dims[a];
+        h.origin[a] = spec.origin[a];
+    }
+    h.n_polar = spec.n_polar;
+    h.n_azimuth = spec.n_azimuth;
+    h.n_roll = spec.n_roll;
+    h.n_q7_samples = spec.n_q7_samples;
+    h.cell_size = sizeof(WorkspaceCell);
+    h.voxel_size = spec.voxel_size;
+    h.manipulability_scale = scale;
+    h.q7_min = q_low[6];
+    h.q7_max = q_up[6];
+    h.count = cells.size();
+    h.cells_offset = sizeof(WorkspaceMapHeader);
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "ERROR: cannot create " << path << std::endl;
+        return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, file) == 1 &&
+              fwrite(cells.data(), sizeof(WorkspaceCell), cells.size(), file) == cells.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) std::cerr << "ERROR: cannot write " << path << std::endl;
+    return ok;
+}
@@ -0,0 +1,169 @@
+#ifndef WORKSPACE_MAP_H
+#define WORKSPACE_MAP_H
+
+#include <array>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @file    workspace_map.h
+ * @brief   precomputed reachability and dexterity map of the workspace, loaded by mmap.
+ *
+ * @details The workspace is cut into a box of position voxels times a discretized orientation:
+ *          the approach axis k_E (third column of ROE) is binned by polar and azimuth angle,
+ *          and the roll of i_E about k_E by angle. Each cell holds a WorkspaceCell computed
+ *          offline at the cell center by sampling franka_J_ik_q7 over the q7 range.
+ *
+ *          File layout (version 1, native little-endian):
+ *
+ *          offset 0            WorkspaceMapHeader (128 bytes)
+ *          header.cells_offset WorkspaceCell[count], orientation bins innermost:
+ *                              index = ((((ix * ny + iy) * nz + iz) * n_polar + ip) * n_azimuth + ia) * n_roll + ir
+ *
+ *          Lookups are O(1) and inline, so code that only reads a map does not need to link
+ *          workspace_map.cpp.
+ */
+
+constexpr uint32_t WORKSPACE_MAP_VERSION = 1;
+
+enum WorkspaceCellFlags : uint8_t {
+    WORKSPACE_REACHABLE = 1,        // At least one q7 sample has a valid solution at the cell center
+    WORKSPACE_NEAR_REACHABLE = 2,   // The cell or one of its neighbours (position and orientation) is reachable
+    WORKSPACE_SPLIT_INTERVAL = 4    // The feasible q7 samples form more than one interval
+};
+
+struct WorkspaceMapSpec {
+    std::array<double, 3> origin = { -0.9, -0.9, -0.4 };   // Lower corner of the position box (m)
+    double voxel_size = 0.1;                                // Edge of a position voxel (m)
+    std::array<uint32_t, 3> dims = { 18, 18, 17 };          // Voxels along x, y, z
+    uint32_t n_polar = 6;                                   // Bins of the approach axis polar angle [0, pi]
+    uint32_t n_azimuth = 12;                                // Bins of the approach axis azimuth [-pi, pi)
+    uint32_t n_roll = 8;                                    // Bins of the roll about the approach axis [-pi, pi)
+    uint32_t n_q7_samples = 32;                             // q7 samples per cell, at most 255
+};
+
+struct WorkspaceMapHeader {
+    char magic[8];                       // "GEOFIKWM"
+    uint32_t version;                    // WORKSPACE_MAP_VERSION
+    uint32_t header_size;                // sizeof(WorkspaceMapHeader)
+    uint32_t dims[3];
+    uint32_t n_polar;
+    uint32_t n_azimuth;
+    uint32_t n_roll;
+    uint32_t n_q7_samples;
+    uint32_t cell_size;                  // sizeof(WorkspaceCell)
+    double origin[3];
+    double voxel_size;
+    double manipulability_scale;         // Manipulability of WorkspaceCell::manipulability == 255
+    double q7_min;                       // Range the q7 bytes are quantized over
+    double q7_max;
+    uint64_t count;                      // Number of cells
+    uint64_t cells_offset;
+    uint8_t reserved[8];
+};
+
+// One cell, q7 values quantized to a byte over [q7_min, q7_max]
+struct WorkspaceCell {
+    uint8_t flags;             // WorkspaceCellFlags
+    uint8_t feasible_samples;  // q7 samples with at least one valid solution
+    uint8_t q7_lower;          // Largest contiguous feasible q7 interval
+    uint8_t q7_upper;
+    uint8_t q7_best;           // q7 of the most manipulable valid solution
+    uint8_t best_branch;       // Its solution index in franka_J_ik_q7 (0-7)
+    uint8_t manipulability;    // Its manipulability, quantized over [0, manipulability_scale]
+    uint8_t reserved;
+};
+
+static_assert(sizeof(WorkspaceMapHeader) == 128, "WorkspaceMapHeader layout changed");
+static_assert(sizeof(WorkspaceCell) == 8, "WorkspaceCell layout changed");
+
+// mmap-backed read-only map, see build_workspace_map() for how to make one
+class WorkspaceMap {
+private:
+    int fd_;
+    void* base_;
+    size_t file_size_;
+    const WorkspaceMapHeader* header_;
+    const WorkspaceCell* cells_;
+
+public:
+    WorkspaceMap();
+    ~WorkspaceMap();
+    WorkspaceMap(const WorkspaceMap&) = delete;
+    WorkspaceMap& operator=(const WorkspaceMap&) = delete;
+
+    // Maps a map file. Returns false (and prints the reason) if it is not a valid map.
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return base_ != nullptr; }
+    const WorkspaceMapHeader& header() const { return *header_; }
+
+    // Cell holding the pose, nullptr if the position is outside the mapped box
+    inline const WorkspaceCell* lookup(const std::array<double, 3>& position,
+                                       const std::array<double, 9>& orientation) const;
+
+    // Whether the target can be rejected without solving: inside the box and no reachable
+    // cell around it. Targets outside the box are never rejected.
+    bool unreachable(const std::array<double, 3>& position, const std::array<double, 9>& orientation) const {
+        const WorkspaceCell* cell = lookup(position, orientation);
+        return cell && !(cell->flags & WORKSPACE_NEAR_REACHABLE);
+    }
+
+    // Converts the quantized q7 and manipulability bytes of a cell back to values
+    double q7_value(uint8_t q) const {
+        return header_->q7_min + q * (header_->q7_max - header_->q7_min) / 255.0;
+    }
+    double manipulability_value(uint8_t m) const { return m * header_->manipulability_scale / 255.0; }
+
+    // Spacing of the q7 samples the cells were built from
+    double q7_sample_step() const {
+        return (header_->q7_max - header_->q7_min) / (header_->n_q7_samples - 1);
+    }
+};
+
+// Orientation bin of a rotation matrix (row-first), shared by the builder and the lookup
+inline void workspace_orientation_bin(const std::array<double, 9>& ROE, uint32_t n_polar, uint32_t n_azimuth,
+                                      uint32_t n_roll, uint32_t& ip, uint32_t& ia, uint32_t& ir) {
+    const double pi = 3.14159265358979323846;
+    double kx = ROE[2], ky = ROE[5], kz = ROE[8];
+    double polar = acos(kz < -1.0 ? -1.0 : (kz > 1.0 ? 1.0 : kz));
+    double azimuth = atan2(ky, kx);
+    // Roll of i_E in the polar/azimuth frame of the approach axis (sines and cosines read off k)
+    double ct = kz, st = sqrt(kx * kx + ky * ky);
+    double cp = st > 0.0 ? kx / st : 1.0, sp = st > 0.0 ? ky / st : 0.0;
+    double i_theta = ROE[0] * ct * cp + ROE[3] * ct * sp - ROE[6] * st;
+    double i_phi = -ROE[0] * sp + ROE[3] * cp;
+    double roll = atan2(i_phi, i_theta);
+
+    ip = (uint32_t)(polar / pi * n_polar);
+    ia = (uint32_t)((azimuth + pi) / (2.0 * pi) * n_azimuth);
+    ir = (uint32_t)((roll + pi) / (2.0 * pi) * n_roll);
+    if (ip >= n_polar) ip = n_polar - 1;
+    if (ia >= n_azimuth) ia = n_azimuth - 1;
+    if (ir >= n_roll) ir = n_roll - 1;
+}
+
+inline const WorkspaceCell* WorkspaceMap::lookup(const std::array<double, 3>& position,
+                                                 const std::array<double, 9>& orientation) const {
+    if (!cells_) return nullptr;
+    const WorkspaceMapHeader& h = *header_;
+    uint64_t index = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        double v = (position[axis] - h.origin[axis]) / h.voxel_size;
+        if (!(v >= 0.0) || v >= h.dims[axis]) return nullptr;
+        index = index * h.dims[axis] + (uint32_t)v;
+    }
+    uint32_t ip, ia, ir;
+    workspace_orientation_bin(orientation, h.n_polar, h.n_azimuth, h.n_roll, ip, ia, ir);
+    index = ((index * h.n_polar + ip) * h.n_azimuth + ia) * h.n_roll + ir;
+    return &cells_[index];
+}
+
+// Samples every cell of spec on n_threads threads (0 = hardware concurrency) and writes the
+// map file. Prints progress on stderr if verbose. Returns false (and prints why) on failure.
+bool build_workspace_map(const std::string& path, const WorkspaceMapSpec& spec, int n_threads = 0,
+                         bool verbose = false);
+
+#endif // WORKSPACE_MAP_H